@@ -1,131 +1,373 @@
 #ifndef AST_HPP
 #define AST_HPP
 
-#include <memory>
-#include <string>
-#include <vector>
+#include "Arena.hpp"
+#include "Symbol.hpp"
+#include <cstdint>
+#include <string_view>
 
-// Base AST node.
+// Concrete node types. Every node records its kind so that passes can
+// dispatch with a switch instead of chains of dynamic_casts.
+enum class NodeKind : uint8_t {
+    // Expressions.
+    NUMERIC_LITERAL,
+    STRING_LITERAL,
+    IDENTIFIER,
+    ASSIGNMENT,
+    BINARY_EXPRESSION,
+    UNARY_EXPRESSION,
+    CALL_EXPRESSION,
+    MEMBER_ACCESS_EXPRESSION,
+    NEW_EXPRESSION,
+    ARRAY_LITERAL,
+    INDEX_EXPRESSION,
+    INDEX_ASSIGNMENT,
+    SPAWN_EXPRESSION,
+    PARALLEL_FOR,
+    // Statements.
+    VARIABLE_DECLARATION,
+    PRINT_STATEMENT,
+    EXPRESSION_STATEMENT,
+    RETURN_STATEMENT,
+    BREAK_STATEMENT,
+    CONTINUE_STATEMENT,
+    BLOCK_STATEMENT,
+    IF_STATEMENT,
+    WHILE_STATEMENT,
+    FUNCTION_DECLARATION,
+    CLASS_DECLARATION,
+    // Root.
+    PROGRAM
+};
+
+// Base AST node. Nodes are allocated in the Program's Arena and are never
+// destroyed individually, so they hold plain pointers to their children and
+// views of text copied into the arena.
 struct ASTNode {
-    virtual ~ASTNode() = default;
+    const NodeKind kind;
+    explicit ASTNode(NodeKind kind) : kind(kind) {}
+};
+
+// Checked downcast by node kind: returns nullptr if the node is not a T.
+template <typename T>
+T* nodeCast(ASTNode* node) {
+    return node && node->kind == T::KIND ? static_cast<T*>(node) : nullptr;
+}
+
+// Resolved location of a variable, filled in by the Resolver.
+// depth counts frames outward from the frame of the enclosing function
+// (0 = own frame, 1 = the global frame); slot indexes into that frame.
+// In methods and field initializers, depth FIELD names a field of the
+// object, and slot indexes its fields.
+struct VariableAddress {
+    static constexpr int FIELD = 2;
+    int depth = -1;
+    int slot = -1;
+};
+
+// Kinds of static types inferred for the C++ backend by TypeInference.
+// INTEGER marks numbers that are provably whole, so they can be held in an
+// int64_t; every other number is a double.
+enum class TypeKind : uint8_t {
+    UNKNOWN,
+    INTEGER,
+    NUMBER,
+    STRING,
+    OBJECT,
+    ARRAY,
+    TASK
+};
+
+// Static type of a variable, parameter, field or function result.
+struct StaticType {
+    TypeKind kind = TypeKind::UNKNOWN;
+    Symbol className = Symbols::NONE; // Class of an OBJECT.
+    TypeKind result = TypeKind::UNKNOWN; // What joining a TASK returns.
+};
+
+// Binary operators.
+enum class BinaryOp : uint8_t {
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    LESS,
+    LESS_EQUAL,
+    GREATER,
+    GREATER_EQUAL
+};
+
+// Unary operators.
+enum class UnaryOp : uint8_t {
+    NEGATE
 };
 
+// Source spelling of an operator, e.g. "<=".
+inline const char* operatorText(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::ADD: return "+";
+        case BinaryOp::SUBTRACT: return "-";
+        case BinaryOp::MULTIPLY: return "*";
+        case BinaryOp::DIVIDE: return "/";
+        case BinaryOp::LESS: return "<";
+        case BinaryOp::LESS_EQUAL: return "<=";
+        case BinaryOp::GREATER: return ">";
+        case BinaryOp::GREATER_EQUAL: return ">=";
+    }
+    return "?";
+}
+
+inline const char* operatorText(UnaryOp op) {
+    switch (op) {
+        case UnaryOp::NEGATE: return "-";
+    }
+    return "?";
+}
+
 // Expressions.
-struct Expression : public ASTNode {};
+struct Expression : public ASTNode {
+    TypeKind type = TypeKind::UNKNOWN; // Set by TypeInference.
+
+protected:
+    explicit Expression(NodeKind kind) : ASTNode(kind) {}
+};
 
 // Numeric literal.
 struct NumericLiteral : public Expression {
+    static constexpr NodeKind KIND = NodeKind::NUMERIC_LITERAL;
+    NumericLiteral() : Expression(KIND) {}
     double value;
 };
 
 // String literal.
 struct StringLiteral : public Expression {
-    std::string value;
+    static constexpr NodeKind KIND = NodeKind::STRING_LITERAL;
+    StringLiteral() : Expression(KIND) {}
+    std::string_view value;
 };
 
 // Identifier.
 struct Identifier : public Expression {
-    std::string name;
+    static constexpr NodeKind KIND = NodeKind::IDENTIFIER;
+    Identifier() : Expression(KIND) {}
+    Symbol name = Symbols::NONE;
+    VariableAddress address;
 };
 
 // Assignment.
 struct Assignment : public Expression {
-    std::string name;
-    std::unique_ptr<Expression> value;
+    static constexpr NodeKind KIND = NodeKind::ASSIGNMENT;
+    Assignment() : Expression(KIND) {}
+    Symbol name = Symbols::NONE;
+    Expression* value = nullptr;
+    VariableAddress address;
 };
 
 // Binary expression (e.g., +, -, *, /, etc.).
 struct BinaryExpression : public Expression {
-    std::string op;
-    std::unique_ptr<Expression> left;
-    std::unique_ptr<Expression> right;
+    static constexpr NodeKind KIND = NodeKind::BINARY_EXPRESSION;
+    BinaryExpression() : Expression(KIND) {}
+    BinaryOp op = BinaryOp::ADD;
+    Expression* left = nullptr;
+    Expression* right = nullptr;
 };
 
 // Unary expression (e.g., -expr).
 struct UnaryExpression : public Expression {
-    std::string op;
-    std::unique_ptr<Expression> argument;
+    static constexpr NodeKind KIND = NodeKind::UNARY_EXPRESSION;
+    UnaryExpression() : Expression(KIND) {}
+    UnaryOp op = UnaryOp::NEGATE;
+    Expression* argument = nullptr;
 };
 
 // Call expression (for function/method calls).
 struct CallExpression : public Expression {
-    std::unique_ptr<Expression> callee;
-    std::vector<std::unique_ptr<Expression>> arguments;
+    static constexpr NodeKind KIND = NodeKind::CALL_EXPRESSION;
+    CallExpression() : Expression(KIND) {}
+    Expression* callee = nullptr;
+    ArenaArray<Expression*> arguments;
+    bool builtIn = false; // Calls an overridable built-in; set by TypeInference.
 };
 
 // Member access: object.member.
 struct MemberAccessExpression : public Expression {
-    std::unique_ptr<Expression> object;
-    std::string member;
+    static constexpr NodeKind KIND = NodeKind::MEMBER_ACCESS_EXPRESSION;
+    MemberAccessExpression() : Expression(KIND) {}
+    Expression* object = nullptr;
+    Symbol member = Symbols::NONE;
+    uint32_t cache = 0; // Index of the inline cache of this site, set by the Resolver.
 };
 
 // New expression: new ClassName(arg, ...).
 struct NewExpression : public Expression {
-    std::string className;
-    std::vector<std::unique_ptr<Expression>> arguments;
+    static constexpr NodeKind KIND = NodeKind::NEW_EXPRESSION;
+    NewExpression() : Expression(KIND) {}
+    Symbol className = Symbols::NONE;
+    ArenaArray<Expression*> arguments;
+};
+
+// Array literal: [element, ...].
+struct ArrayLiteral : public Expression {
+    static constexpr NodeKind KIND = NodeKind::ARRAY_LITERAL;
+    ArrayLiteral() : Expression(KIND) {}
+    ArenaArray<Expression*> elements;
+};
+
+// Element read: array[index].
+struct IndexExpression : public Expression {
+    static constexpr NodeKind KIND = NodeKind::INDEX_EXPRESSION;
+    IndexExpression() : Expression(KIND) {}
+    Expression* array = nullptr;
+    Expression* index = nullptr;
+};
+
+// Element write: array[index] = value.
+struct IndexAssignment : public Expression {
+    static constexpr NodeKind KIND = NodeKind::INDEX_ASSIGNMENT;
+    IndexAssignment() : Expression(KIND) {}
+    Expression* array = nullptr;
+    Expression* index = nullptr;
+    Expression* value = nullptr;
+};
+
+// spawn f(arg, ...): runs the call as a task and yields its handle.
+struct SpawnExpression : public Expression {
+    static constexpr NodeKind KIND = NodeKind::SPAWN_EXPRESSION;
+    SpawnExpression() : Expression(KIND) {}
+    CallExpression* call = nullptr; // The callee is an Identifier.
+    TypeKind result = TypeKind::UNKNOWN; // What joining the task returns; set by TypeInference.
+};
+
+// parallelFor(from, to, f): the array of f(i) for every whole i with
+// from <= i < to, computed by tasks.
+struct ParallelFor : public Expression {
+    static constexpr NodeKind KIND = NodeKind::PARALLEL_FOR;
+    ParallelFor() : Expression(KIND) {}
+    Expression* from = nullptr;
+    Expression* to = nullptr;
+    Symbol function = Symbols::NONE;
 };
 
 // Statements.
-struct Statement : public ASTNode {};
+struct Statement : public ASTNode {
+protected:
+    explicit Statement(NodeKind kind) : ASTNode(kind) {}
+};
 
 // Variable declaration.
 struct VariableDeclaration : public Statement {
-    std::string identifier;
-    std::unique_ptr<Expression> expression;
+    static constexpr NodeKind KIND = NodeKind::VARIABLE_DECLARATION;
+    VariableDeclaration() : Statement(KIND) {}
+    Symbol identifier = Symbols::NONE;
+    Expression* expression = nullptr;
+    VariableAddress address;
+    StaticType type; // Set by TypeInference.
 };
 
 // Print statement.
 struct PrintStatement : public Statement {
-    std::unique_ptr<Expression> expression;
+    static constexpr NodeKind KIND = NodeKind::PRINT_STATEMENT;
+    PrintStatement() : Statement(KIND) {}
+    Expression* expression = nullptr;
 };
 
 // Expression statement.
 struct ExpressionStatement : public Statement {
-    std::unique_ptr<Expression> expression;
+    static constexpr NodeKind KIND = NodeKind::EXPRESSION_STATEMENT;
+    ExpressionStatement() : Statement(KIND) {}
+    Expression* expression = nullptr;
 };
 
 // Return statement.
 struct ReturnStatement : public Statement {
-    std::unique_ptr<Expression> expression; // May be nullptr.
+    static constexpr NodeKind KIND = NodeKind::RETURN_STATEMENT;
+    ReturnStatement() : Statement(KIND) {}
+    Expression* expression = nullptr; // May be nullptr.
+    // The expression is a call whose result the function returns as is, so
+    // the callee can take over the caller's frame. Set by the Resolver.
+    bool tailCall = false;
+};
+
+// Break statement: leaves the innermost loop.
+struct BreakStatement : public Statement {
+    static constexpr NodeKind KIND = NodeKind::BREAK_STATEMENT;
+    BreakStatement() : Statement(KIND) {}
+};
+
+// Continue statement: jumps to the next iteration of the innermost loop.
+struct ContinueStatement : public Statement {
+    static constexpr NodeKind KIND = NodeKind::CONTINUE_STATEMENT;
+    ContinueStatement() : Statement(KIND) {}
 };
 
 // Block statement.
 struct BlockStatement : public Statement {
-    std::vector<std::unique_ptr<Statement>> statements;
+    static constexpr NodeKind KIND = NodeKind::BLOCK_STATEMENT;
+    BlockStatement() : Statement(KIND) {}
+    ArenaArray<Statement*> statements;
 };
 
 // If statement.
 struct IfStatement : public Statement {
-    std::unique_ptr<Expression> condition;
-    std::unique_ptr<BlockStatement> thenBranch;
-    std::unique_ptr<BlockStatement> elseBranch; // Optional.
+    static constexpr NodeKind KIND = NodeKind::IF_STATEMENT;
+    IfStatement() : Statement(KIND) {}
+    Expression* condition = nullptr;
+    BlockStatement* thenBranch = nullptr;
+    BlockStatement* elseBranch = nullptr; // Optional.
 };
 
 // While statement.
 struct WhileStatement : public Statement {
-    std::unique_ptr<Expression> condition;
-    std::unique_ptr<BlockStatement> body;
+    static constexpr NodeKind KIND = NodeKind::WHILE_STATEMENT;
+    WhileStatement() : Statement(KIND) {}
+    Expression* condition = nullptr;
+    BlockStatement* body = nullptr;
 };
 
 // Function declaration.
 struct FunctionDeclaration : public Statement {
-    std::string name;
-    std::vector<std::string> params;
-    std::unique_ptr<BlockStatement> body;
+    static constexpr NodeKind KIND = NodeKind::FUNCTION_DECLARATION;
+    FunctionDeclaration() : Statement(KIND) {}
+    Symbol name = Symbols::NONE;
+    ArenaArray<Symbol> params;
+    BlockStatement* body = nullptr;
+    int frameSize = 0; // Local slots (parameters included), set by the Resolver.
+    ArenaArray<StaticType> paramTypes; // Set by TypeInference.
+    StaticType returnType;             // Set by TypeInference.
+    bool noMemo = false;               // Annotated @nomemo.
+    bool memoize = false;              // Pure; set by PurityAnalysis.
 };
 
 // Class declaration.
 // The class can optionally extend a base class.
 struct ClassDeclaration : public Statement {
-    std::string name;
-    std::string baseClass; // Empty if no inheritance.
+    static constexpr NodeKind KIND = NodeKind::CLASS_DECLARATION;
+    ClassDeclaration() : Statement(KIND) {}
+    Symbol name = Symbols::NONE;
+    Symbol baseClass = Symbols::NONE; // NONE if no inheritance.
     // The class body is a block statement containing field and method declarations.
-    std::unique_ptr<BlockStatement> body;
+    BlockStatement* body = nullptr;
+    int fieldCount = 0; // Field slots, inherited ones first; set by the Resolver.
 };
 
-// Program (a list of statements).
+// Program (a list of statements). The root is the only node allocated on the
+// heap: it owns the arena holding the rest of the tree.
 struct Program : public ASTNode {
-    std::vector<std::unique_ptr<Statement>> statements;
+    static constexpr NodeKind KIND = NodeKind::PROGRAM;
+    Program() : ASTNode(KIND) {}
+    Arena arena;
+    ArenaArray<Statement*> statements;
+    int frameSize = 0; // Slots in the global frame, set by the Resolver.
+    bool usesTasks = false; // Has a spawn or parallelFor; set by the Parser.
+    // Paths of the modules imported, as written; set by the Parser.
+    ArenaArray<std::string_view> imports;
+    // When the C++ backend compiles the program apart from the modules it
+    // imports: their functions, without a body, with the types their own
+    // compilation gave them.
+    ArenaArray<FunctionDeclaration*> externs;
+    // An imported module compiled on its own: it has no main(), and any
+    // number passed to it is a double.
+    bool isModule = false;
 };
 
 #endif // AST_HPP
\ No newline at end of file
@@ -0,0 +1,121 @@
+#ifndef ASTVISITOR_HPP
+#define ASTVISITOR_HPP
+
+#include "AST.hpp"
+#include <stdexcept>
+#include <string>
+
+// Statically dispatched AST visitor. A pass derives from
+//     ASTVisitor<MyPass, ExprResult, StmtResult>
+// and defines visitX(X*) for the node types it handles. visit() switches on
+// the node kind and calls the derived method directly (CRTP), so there is no
+// virtual call and no RTTI on the hot path. Node types a pass does not
+// handle fall back to the defaults below, which throw.
+template <typename Derived, typename ExprResult, typename StmtResult = ExprResult>
+class ASTVisitor {
+public:
+    ExprResult visit(Expression* expr) {
+        switch (expr->kind) {
+            case NodeKind::NUMERIC_LITERAL:
+                return self().visitNumericLiteral(static_cast<NumericLiteral*>(expr));
+            case NodeKind::STRING_LITERAL:
+                return self().visitStringLiteral(static_cast<StringLiteral*>(expr));
+            case NodeKind::IDENTIFIER:
+                return self().visitIdentifier(static_cast<Identifier*>(expr));
+            case NodeKind::ASSIGNMENT:
+                return self().visitAssignment(static_cast<Assignment*>(expr));
+            case NodeKind::BINARY_EXPRESSION:
+                return self().visitBinaryExpression(static_cast<BinaryExpression*>(expr));
+            case NodeKind::UNARY_EXPRESSION:
+                return self().visitUnaryExpression(static_cast<UnaryExpression*>(expr));
+            case NodeKind::CALL_EXPRESSION:
+                return self().visitCallExpression(static_cast<CallExpression*>(expr));
+            case NodeKind::MEMBER_ACCESS_EXPRESSION:
+                return self().visitMemberAccessExpression(static_cast<MemberAccessExpression*>(expr));
+            case NodeKind::NEW_EXPRESSION:
+                return self().visitNewExpression(static_cast<NewExpression*>(expr));
+            case NodeKind::ARRAY_LITERAL:
+                return self().visitArrayLiteral(static_cast<ArrayLiteral*>(expr));
+            case NodeKind::INDEX_EXPRESSION:
+                return self().visitIndexExpression(static_cast<IndexExpression*>(expr));
+            case NodeKind::INDEX_ASSIGNMENT:
+                return self().visitIndexAssignment(static_cast<IndexAssignment*>(expr));
+            case NodeKind::SPAWN_EXPRESSION:
+                return self().visitSpawnExpression(static_cast<SpawnExpression*>(expr));
+            case NodeKind::PARALLEL_FOR:
+                return self().visitParallelFor(static_cast<ParallelFor*>(expr));
+            default:
+                throw std::runtime_error("Unknown expression type.");
+        }
+    }
+
+    StmtResult visit(Statement* stmt) {
+        switch (stmt->kind) {
+            case NodeKind::VARIABLE_DECLARATION:
+                return self().visitVariableDeclaration(static_cast<VariableDeclaration*>(stmt));
+            case NodeKind::PRINT_STATEMENT:
+                return self().visitPrintStatement(static_cast<PrintStatement*>(stmt));
+            case NodeKind::EXPRESSION_STATEMENT:
+                return self().visitExpressionStatement(static_cast<ExpressionStatement*>(stmt));
+            case NodeKind::RETURN_STATEMENT:
+                return self().visitReturnStatement(static_cast<ReturnStatement*>(stmt));
+            case NodeKind::BREAK_STATEMENT:
+                return self().visitBreakStatement(static_cast<BreakStatement*>(stmt));
+            case NodeKind::CONTINUE_STATEMENT:
+                return self().visitContinueStatement(static_cast<ContinueStatement*>(stmt));
+            case NodeKind::BLOCK_STATEMENT:
+                return self().visitBlockStatement(static_cast<BlockStatement*>(stmt));
+            case NodeKind::IF_STATEMENT:
+                return self().visitIfStatement(static_cast<IfStatement*>(stmt));
+            case NodeKind::WHILE_STATEMENT:
+                return self().visitWhileStatement(static_cast<WhileStatement*>(stmt));
+            case NodeKind::FUNCTION_DECLARATION:
+                return self().visitFunctionDeclaration(static_cast<FunctionDeclaration*>(stmt));
+            case NodeKind::CLASS_DECLARATION:
+                return self().visitClassDeclaration(static_cast<ClassDeclaration*>(stmt));
+            default:
+                throw std::runtime_error("Unknown statement type.");
+        }
+    }
+
+protected:
+    // Defaults for node types a pass does not support.
+    ExprResult visitNumericLiteral(NumericLiteral* node) { return unsupportedExpr(node); }
+    ExprResult visitStringLiteral(StringLiteral* node) { return unsupportedExpr(node); }
+    ExprResult visitIdentifier(Identifier* node) { return unsupportedExpr(node); }
+    ExprResult visitAssignment(Assignment* node) { return unsupportedExpr(node); }
+    ExprResult visitBinaryExpression(BinaryExpression* node) { return unsupportedExpr(node); }
+    ExprResult visitUnaryExpression(UnaryExpression* node) { return unsupportedExpr(node); }
+    ExprResult visitCallExpression(CallExpression* node) { return unsupportedExpr(node); }
+    ExprResult visitMemberAccessExpression(MemberAccessExpression* node) { return unsupportedExpr(node); }
+    ExprResult visitNewExpression(NewExpression* node) { return unsupportedExpr(node); }
+    ExprResult visitArrayLiteral(ArrayLiteral* node) { return unsupportedExpr(node); }
+    ExprResult visitIndexExpression(IndexExpression* node) { return unsupportedExpr(node); }
+    ExprResult visitIndexAssignment(IndexAssignment* node) { return unsupportedExpr(node); }
+    ExprResult visitSpawnExpression(SpawnExpression* node) { return unsupportedExpr(node); }
+    ExprResult visitParallelFor(ParallelFor* node) { return unsupportedExpr(node); }
+
+    StmtResult visitVariableDeclaration(VariableDeclaration* node) { return unsupportedStmt(node); }
+    StmtResult visitPrintStatement(PrintStatement* node) { return unsupportedStmt(node); }
+    StmtResult visitExpressionStatement(ExpressionStatement* node) { return unsupportedStmt(node); }
+    StmtResult visitReturnStatement(ReturnStatement* node) { return unsupportedStmt(node); }
+    StmtResult visitBreakStatement(BreakStatement* node) { return unsupportedStmt(node); }
+    StmtResult visitContinueStatement(ContinueStatement* node) { return unsupportedStmt(node); }
+    StmtResult visitBlockStatement(BlockStatement* node) { return unsupportedStmt(node); }
+    StmtResult visitIfStatement(IfStatement* node) { return unsupportedStmt(node); }
+    StmtResult visitWhileStatement(WhileStatement* node) { return unsupportedStmt(node); }
+    StmtResult visitFunctionDeclaration(FunctionDeclaration* node) { return unsupportedStmt(node); }
+    StmtResult visitClassDeclaration(ClassDeclaration* node) { return unsupportedStmt(node); }
+
+    ExprResult unsupportedExpr(Expression*) {
+        throw std::runtime_error(std::string("Unsupported expression type in ") + Derived::PASS_NAME + ".");
+    }
+    StmtResult unsupportedStmt(Statement*) {
+        throw std::runtime_error(std::string("Unsupported statement type in ") + Derived::PASS_NAME + ".");
+    }
+
+private:
+    Derived& self() { return static_cast<Derived&>(*this); }
+};
+
+#endif // ASTVISITOR_HPP
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include "Arena.hpp"
+#include <cstdlib>
+#include <cstring>
+
+Arena::~Arena() {
+    while (blocks) {
+        Block* next = blocks->next;
+        std::free(blocks);
+        blocks = next;
+    }
+}
+
+std::string_view Arena::copyString(std::string_view text) {
+    if (text.empty())
+        return std::string_view();
+    char* chars = static_cast<char*>(allocate(text.size(), 1));
+    std::memcpy(chars, text.data(), text.size());
+    return std::string_view(chars, text.size());
+}
+
+void Arena::reset() {
+    // Keep one standard block; oversized ones are not worth holding on to.
+    Block* kept = nullptr;
+    while (blocks) {
+        Block* next = blocks->next;
+        if (!kept && blocks->size == BLOCK_SIZE) {
+            kept = blocks;
+            kept->next = nullptr;
+        } else {
+            std::free(blocks);
+        }
+        blocks = next;
+    }
+    blocks = kept;
+    cursor = kept ? reinterpret_cast<char*>(kept + 1) : nullptr;
+    limit = kept ? cursor + kept->size : nullptr;
+    bytesUsed = 0;
+}
+
+void* Arena::allocateSlow(size_t size, size_t align) {
+    // Oversized requests get a block of their own; otherwise start a new
+    // standard block and continue bumping from it.
+    size_t payload = size + align > BLOCK_SIZE ? size + align : BLOCK_SIZE;
+    Block* block = static_cast<Block*>(std::malloc(sizeof(Block) + payload));
+    if (!block)
+        throw std::bad_alloc();
+    block->next = blocks;
+    block->size = payload;
+    blocks = block;
+    cursor = reinterpret_cast<char*>(block + 1);
+    limit = cursor + payload;
+    return allocate(size, align);
+}
\ No newline at end of file
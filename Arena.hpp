@@ -0,0 +1,93 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Fixed-size array whose elements live in an Arena.
+template <typename T>
+struct ArenaArray {
+    T* items = nullptr;
+    uint32_t count = 0;
+
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t index) const { return items[index]; }
+};
+
+// Bump allocator backing the AST. Objects are carved out of large blocks in
+// allocation order and are never destroyed individually: destroying the arena
+// releases the whole tree at once, without running per-node destructors.
+class Arena {
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena();
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "Arena objects must be trivially destructible");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Copies text into the arena.
+    std::string_view copyString(std::string_view text);
+
+    // Copies the elements of a temporary vector into the arena.
+    template <typename T>
+    ArenaArray<T> copyArray(const std::vector<T>& elements) {
+        static_assert(std::is_trivially_copyable<T>::value, "Arena arrays hold plain data");
+        ArenaArray<T> array;
+        if (elements.empty())
+            return array;
+        array.items = static_cast<T*>(allocate(sizeof(T) * elements.size(), alignof(T)));
+        array.count = static_cast<uint32_t>(elements.size());
+        for (size_t i = 0; i < elements.size(); i++)
+            new (&array.items[i]) T(elements[i]);
+        return array;
+    }
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+        if (cursor && aligned + size <= reinterpret_cast<uintptr_t>(limit)) {
+            cursor = reinterpret_cast<char*>(aligned + size);
+            bytesUsed += size;
+            return reinterpret_cast<void*>(aligned);
+        }
+        return allocateSlow(size, align);
+    }
+
+    // Releases everything allocated so far. One block is kept for reuse, so
+    // an arena that is reset between units of work stops allocating memory
+    // once it has warmed up.
+    void reset();
+
+    // Bytes handed out so far, excluding alignment padding.
+    size_t used() const { return bytesUsed; }
+
+private:
+    struct Block {
+        Block* next;
+        size_t size; // Payload bytes following the header.
+    };
+
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    Block* blocks = nullptr;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t bytesUsed = 0;
+
+    void* allocateSlow(size_t size, size_t align);
+};
+
+#endif // ARENA_HPP
\ No newline at end of file
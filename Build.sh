@@ -2,7 +2,7 @@
 # Build.sh: Build the MiniLang compiler.
 
 # Compile the compiler source files into the mini_compiler executable.
-g++ -std=c++17 main.cpp Lexer.cpp Parser.cpp CodeGenerator.cpp Builtins.cpp -o mini_compiler
+g++ -std=c++17 -O2 -pthread main.cpp Arena.cpp Symbol.cpp MappedFile.cpp Lexer.cpp Parser.cpp CodeGenerator.cpp Interpreter.cpp Resolver.cpp Optimizer.cpp Purity.cpp TypeInference.cpp BytecodeCompiler.cpp VM.cpp Value.cpp Builtins.cpp BuildCache.cpp NativeTier.cpp ProgramImage.cpp Modules.cpp -ldl -o mini_compiler
 
 if [ $? -eq 0 ]; then
     echo "mini_compiler built successfully."
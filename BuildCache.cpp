@@ -0,0 +1,317 @@
+#include "BuildCache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/file.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// SHA-256 (FIPS 180-4).
+class Sha256 {
+public:
+    void update(const void* data, size_t length) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        totalBytes += length;
+        while (length > 0) {
+            size_t take = std::min(length, sizeof(block) - blockSize);
+            std::memcpy(block + blockSize, bytes, take);
+            blockSize += take;
+            bytes += take;
+            length -= take;
+            if (blockSize == sizeof(block)) {
+                compress(block);
+                blockSize = 0;
+            }
+        }
+    }
+
+    std::string hexDigest() {
+        uint64_t bits = totalBytes * 8;
+        uint8_t padding[72] = {0x80};
+        size_t padLength = (blockSize < 56 ? 56 : 120) - blockSize;
+        for (int i = 0; i < 8; i++)
+            padding[padLength + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+        update(padding, padLength + 8);
+
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(64);
+        for (uint32_t word : state) {
+            for (int shift = 28; shift >= 0; shift -= 4)
+                hex += digits[(word >> shift) & 0xf];
+        }
+        return hex;
+    }
+
+private:
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    uint8_t block[64];
+    size_t blockSize = 0;
+    uint64_t totalBytes = 0;
+
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void compress(const uint8_t* chunk) {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (static_cast<uint32_t>(chunk[4 * i]) << 24) | (static_cast<uint32_t>(chunk[4 * i + 1]) << 16) |
+                   (static_cast<uint32_t>(chunk[4 * i + 2]) << 8) | static_cast<uint32_t>(chunk[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+};
+
+// Entries are named by their key; anything else in the directory (the stats
+// file, half-written copies) is not an entry.
+bool isEntryName(const std::string& name) {
+    return name.size() == 64 &&
+           std::all_of(name.begin(), name.end(), [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+}
+
+// Copies source to destination through a temporary file and a rename, so
+// readers never see a partial file and a running program can be replaced.
+// The temporary is unique to the copy, since threads compiling identical
+// sources store the same entry at once.
+bool copyAtomically(const std::string& source, const std::string& destination) {
+    static std::atomic<uint64_t> copies{0};
+    std::error_code error;
+    std::string temporary = destination + ".tmp" + std::to_string(::getpid()) + "." + std::to_string(copies++);
+    if (!fs::copy_file(source, temporary, fs::copy_options::overwrite_existing, error)) {
+        fs::remove(temporary, error);
+        return false;
+    }
+    fs::rename(temporary, destination, error);
+    if (error) {
+        fs::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+const char* const STATS_FILE = "stats";
+
+} // namespace
+
+BuildCache::BuildCache() : maxBytes(DEFAULT_MAX_BYTES) {
+    if (const char* dir = std::getenv("MINILANG_CACHE_DIR"); dir && *dir)
+        directory = dir;
+    else if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+        directory = std::string(xdg) + "/minilang";
+    else if (const char* home = std::getenv("HOME"); home && *home)
+        directory = std::string(home) + "/.cache/minilang";
+    else
+        directory = ".minilang-cache";
+    if (const char* megabytes = std::getenv("MINILANG_CACHE_SIZE"); megabytes && *megabytes)
+        maxBytes = std::strtoull(megabytes, nullptr, 10) << 20;
+}
+
+BuildCache::BuildCache(std::string directory, uint64_t maxBytes)
+    : directory(std::move(directory)), maxBytes(maxBytes) {}
+
+std::string BuildCache::key(std::initializer_list<std::string_view> parts) {
+    Sha256 hash;
+    for (std::string_view part : parts) {
+        uint64_t length = part.size();
+        hash.update(&length, sizeof(length));
+        hash.update(part.data(), part.size());
+    }
+    return hash.hexDigest();
+}
+
+std::string BuildCache::cxxCompiler() {
+    const char* cxx = std::getenv("CXX");
+    return cxx && *cxx ? cxx : "g++";
+}
+
+std::string BuildCache::compilerVersion(const std::string& compiler) {
+    std::string version;
+    if (FILE* pipe = ::popen((compiler + " --version 2>/dev/null").c_str(), "r")) {
+        char buffer[256];
+        size_t count;
+        while ((count = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+            version.append(buffer, count);
+        ::pclose(pipe);
+    }
+    return version;
+}
+
+std::string BuildCache::entryPath(const std::string& key) const {
+    return directory + "/" + key;
+}
+
+bool BuildCache::fetch(const std::string& key, const std::string& destination) {
+    std::string entry = entryPath(key);
+    if (::access(entry.c_str(), R_OK) != 0 || !copyAtomically(entry, destination)) {
+        count(&CacheStats::misses);
+        return false;
+    }
+    // The modification time orders entries for eviction.
+    std::error_code error;
+    fs::last_write_time(entry, fs::file_time_type::clock::now(), error);
+    count(&CacheStats::hits);
+    return true;
+}
+
+void BuildCache::store(const std::string& key, const std::string& file) {
+    std::error_code error;
+    fs::create_directories(directory, error);
+    if (error || !copyAtomically(file, entryPath(key)))
+        return;
+    count(&CacheStats::stores);
+    evict();
+}
+
+void BuildCache::evict() {
+    struct Entry {
+        fs::file_time_type used;
+        uint64_t size;
+        fs::path path;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code error;
+    for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+        if (!isEntryName(it->path().filename().string()))
+            continue;
+        std::error_code entryError;
+        uint64_t size = it->file_size(entryError);
+        fs::file_time_type used = it->last_write_time(entryError);
+        if (entryError)
+            continue;
+        entries.push_back({used, size, it->path()});
+        total += size;
+    }
+    if (total <= maxBytes)
+        return;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    uint64_t evicted = 0;
+    for (const Entry& entry : entries) {
+        if (total <= maxBytes)
+            break;
+        if (fs::remove(entry.path, error)) {
+            total -= entry.size;
+            evicted++;
+        }
+    }
+    count(&CacheStats::evictions, evicted);
+}
+
+uint64_t BuildCache::size() const {
+    uint64_t total = 0;
+    std::error_code error;
+    for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+        std::error_code entryError;
+        if (isEntryName(it->path().filename().string()))
+            total += it->file_size(entryError);
+    }
+    return total;
+}
+
+// The counters are one line each in a small text file, updated under an
+// exclusive lock so that concurrent builds do not lose counts.
+static bool readStats(int fd, CacheStats& stats) {
+    char buffer[256];
+    ssize_t length = ::pread(fd, buffer, sizeof(buffer) - 1, 0);
+    if (length < 0)
+        return false;
+    buffer[length] = '\0';
+    unsigned long long hits = 0, misses = 0, stores = 0, evictions = 0;
+    std::sscanf(buffer, "hits %llu misses %llu stores %llu evictions %llu", &hits, &misses, &stores, &evictions);
+    stats = {hits, misses, stores, evictions};
+    return true;
+}
+
+void BuildCache::count(uint64_t CacheStats::*counter, uint64_t amount) {
+    if (amount == 0)
+        return;
+    std::error_code error;
+    fs::create_directories(directory, error);
+    std::string path = directory + "/" + STATS_FILE;
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return;
+    CacheStats stats;
+    if (::flock(fd, LOCK_EX) == 0 && readStats(fd, stats)) {
+        stats.*counter += amount;
+        char buffer[256];
+        int length = std::snprintf(buffer, sizeof(buffer), "hits %llu\nmisses %llu\nstores %llu\nevictions %llu\n",
+                                   static_cast<unsigned long long>(stats.hits),
+                                   static_cast<unsigned long long>(stats.misses),
+                                   static_cast<unsigned long long>(stats.stores),
+                                   static_cast<unsigned long long>(stats.evictions));
+        // Losing a count is harmless, so write errors are ignored.
+        if (::ftruncate(fd, 0) == 0)
+            ::pwrite(fd, buffer, static_cast<size_t>(length), 0);
+    }
+    ::close(fd);
+}
+
+CacheStats BuildCache::stats() const {
+    CacheStats stats;
+    std::string path = directory + "/" + STATS_FILE;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return stats;
+    if (::flock(fd, LOCK_SH) != 0 || !readStats(fd, stats))
+        stats = CacheStats();
+    ::close(fd);
+    return stats;
+}
+
+void BuildCache::clear() {
+    std::error_code error;
+    std::vector<fs::path> entries;
+    for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+        if (isEntryName(it->path().filename().string()))
+            entries.push_back(it->path());
+    }
+    for (const fs::path& entry : entries)
+        fs::remove(entry, error);
+    fs::remove(directory + "/" + STATS_FILE, error);
+}
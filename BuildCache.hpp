@@ -0,0 +1,67 @@
+#ifndef BUILDCACHE_HPP
+#define BUILDCACHE_HPP
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+// Counters kept in the cache directory across runs.
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t stores = 0;
+    uint64_t evictions = 0; // Entries removed to stay under the size limit.
+};
+
+// Content-addressed on-disk cache for build products: generated C++ and
+// linked programs. An entry is named by the SHA-256 of everything that went
+// into it (source, flags, compiler and runtime), so entries never go stale
+// and need no invalidation. Fetching an entry marks it as recently used;
+// when the cache outgrows its size limit, the least recently used entries are
+// removed. The cache only ever speeds a build up: if it cannot be read or
+// written, the product is simply rebuilt.
+class BuildCache {
+public:
+    static constexpr uint64_t DEFAULT_MAX_BYTES = 256ull << 20;
+
+    // Uses $MINILANG_CACHE_DIR, else $XDG_CACHE_HOME/minilang, else
+    // ~/.cache/minilang. $MINILANG_CACHE_SIZE sets the limit in megabytes.
+    BuildCache();
+    BuildCache(std::string directory, uint64_t maxBytes);
+
+    // Hex SHA-256 of the parts. Each part is hashed with its length, so
+    // moving bytes from one part to the next changes the key.
+    static std::string key(std::initializer_list<std::string_view> parts);
+
+    // The C++ compiler that builds cached products: $CXX, else g++.
+    static std::string cxxCompiler();
+
+    // Output of `compiler --version`, for keys of compiled products, so that
+    // upgrading the compiler rebuilds them. Empty if it cannot be run.
+    static std::string compilerVersion(const std::string& compiler);
+
+    // Copies the entry to destination. Returns false on a miss.
+    bool fetch(const std::string& key, const std::string& destination);
+
+    // Copies file into the cache, then evicts entries over the size limit.
+    void store(const std::string& key, const std::string& file);
+
+    CacheStats stats() const;
+    uint64_t size() const; // Bytes taken by entries.
+    uint64_t maxSize() const { return maxBytes; }
+    const std::string& path() const { return directory; }
+
+    // Removes every entry and resets the counters.
+    void clear();
+
+private:
+    std::string directory;
+    uint64_t maxBytes;
+
+    std::string entryPath(const std::string& key) const;
+    void count(uint64_t CacheStats::*counter, uint64_t amount = 1);
+    void evict();
+};
+
+#endif // BUILDCACHE_HPP
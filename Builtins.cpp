@@ -1,22 +1,1102 @@
 #include "Builtins.hpp"
-#include <fstream>
-#include <sstream>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
 
+namespace {
+
+class FileDescriptor {
+public:
+    explicit FileDescriptor(int fd) : fd(fd) {}
+    ~FileDescriptor() {
+        if (fd >= 0)
+            ::close(fd);
+    }
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int fd;
+};
+
+// Returns false on a write error.
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+// Files mapped by mapFile: the start of each mapping with the device and
+// inode of its file.
+struct Mapping {
+    const char* data;
+    dev_t device;
+    ino_t inode;
+};
+std::mutex mappingsMutex;
+std::vector<Mapping> mappings;
+
+bool isMapped(const struct stat& info) {
+    std::lock_guard<std::mutex> guard(mappingsMutex);
+    return std::any_of(mappings.begin(), mappings.end(), [&info](const Mapping& mapping) {
+        return mapping.device == info.st_dev && mapping.inode == info.st_ino;
+    });
+}
+
+// Writes content to a new file beside filename and renames it over
+// filename, leaving the old file to the mappings of it.
+void replaceFile(const std::string &filename, std::string_view content, mode_t mode) {
+    std::string temporary = filename + ".XXXXXX";
+    int fd = ::mkstemp(&temporary[0]);
+    if (fd >= 0) {
+        bool written = ::fchmod(fd, mode & 07777) == 0 && writeAll(fd, content.data(), content.size());
+        if (::close(fd) == 0 && written && ::rename(temporary.c_str(), filename.c_str()) == 0)
+            return;
+        ::unlink(temporary.c_str());
+    }
+    throw std::runtime_error("Could not write to file: " + filename);
+}
+
+} // namespace
+
+// Regular files are read straight into a string of their size, the rest,
+// such as pipes, in growing chunks.
 std::string readFile(const std::string &filename) {
-    std::ifstream file(filename);
-    if (!file) {
+    FileDescriptor file(::open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+    if (file.fd < 0)
         throw std::runtime_error("Could not open file: " + filename);
+    struct stat info;
+    bool regular = ::fstat(file.fd, &info) == 0 && S_ISREG(info.st_mode);
+    // One byte more than the size, so that the read seeing the end needs no
+    // larger string.
+    std::string text(regular ? static_cast<size_t>(info.st_size) + 1 : 4096, '\0');
+    size_t used = 0;
+    for (;;) {
+        if (used == text.size())
+            text.resize(text.size() * 2);
+        ssize_t count = ::read(file.fd, &text[used], text.size() - used);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("Could not read file: " + filename);
+        }
+        if (count == 0)
+            break;
+        used += static_cast<size_t>(count);
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    text.resize(used);
+    return text;
 }
 
-void writeFile(const std::string &filename, const std::string &content) {
-    std::ofstream file(filename);
-    if (!file) {
+void writeFile(const std::string &filename, std::string_view content) {
+    struct stat info;
+    if (::stat(filename.c_str(), &info) == 0 && isMapped(info)) {
+        replaceFile(filename, content, info.st_mode);
+        return;
+    }
+    FileDescriptor file(::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666));
+    if (file.fd < 0 || !writeAll(file.fd, content.data(), content.size()))
         throw std::runtime_error("Could not write to file: " + filename);
+}
+
+const char* mapFile(const std::string &filename, size_t &length) {
+    FileDescriptor file(::open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+    if (file.fd < 0)
+        throw std::runtime_error("Could not open file: " + filename);
+    struct stat info;
+    if (::fstat(file.fd, &info) != 0 || !S_ISREG(info.st_mode) || static_cast<size_t>(info.st_size) < MAP_THRESHOLD)
+        return nullptr;
+    length = static_cast<size_t>(info.st_size);
+    void* data = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file.fd, 0);
+    if (data == MAP_FAILED)
+        return nullptr;
+    std::lock_guard<std::mutex> guard(mappingsMutex);
+    mappings.push_back({static_cast<const char*>(data), info.st_dev, info.st_ino});
+    return static_cast<const char*>(data);
+}
+
+void unmapFile(const char* data, size_t length) {
+    {
+        std::lock_guard<std::mutex> guard(mappingsMutex);
+        auto found = std::find_if(mappings.begin(), mappings.end(),
+                                  [data](const Mapping& mapping) { return mapping.data == data; });
+        if (found != mappings.end()) {
+            *found = mappings.back();
+            mappings.pop_back();
+        }
+    }
+    ::munmap(const_cast<char*>(data), length);
+}
+
+namespace {
+
+// Static storage, so the buffer is still alive when flush() runs at exit.
+constexpr size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+char outputBuffer[OUTPUT_BUFFER_SIZE];
+size_t outputUsed = 0;
+int lineBufferedMode = -1; // -1 until the first print decides from isatty.
+// Set when the task pool starts its workers. Output and line streams are
+// locked from then on only, so that programs without tasks pay nothing for
+// it.
+std::atomic<bool> tasksStarted{false};
+std::mutex outputMutex;
+
+// Locks a mutex once tasks have started.
+class TaskLock {
+public:
+    explicit TaskLock(std::mutex& mutex) : mutex(mutex), locked(tasksStarted.load(std::memory_order_relaxed)) {
+        if (locked)
+            mutex.lock();
+    }
+    ~TaskLock() {
+        if (locked)
+            mutex.unlock();
+    }
+    TaskLock(const TaskLock&) = delete;
+    TaskLock& operator=(const TaskLock&) = delete;
+
+private:
+    std::mutex& mutex;
+    bool locked;
+};
+
+// Output that cannot be written (e.g. to a closed pipe) is dropped.
+void flushOutput() {
+    writeAll(STDOUT_FILENO, outputBuffer, outputUsed);
+    outputUsed = 0;
+}
+
+void appendOutput(const char* data, size_t size) {
+    if (outputUsed + size > OUTPUT_BUFFER_SIZE) {
+        flushOutput();
+        if (size > OUTPUT_BUFFER_SIZE) {
+            writeAll(STDOUT_FILENO, data, size);
+            return;
+        }
+    }
+    std::memcpy(outputBuffer + outputUsed, data, size);
+    outputUsed += size;
+}
+
+void endLine() {
+    appendOutput("\n", 1);
+    if (lineBufferedMode < 0) {
+        lineBufferedMode = ::isatty(STDOUT_FILENO) ? 1 : 0;
+        std::atexit(flush);
+    }
+    if (lineBufferedMode)
+        flushOutput();
+}
+
+} // namespace
+
+void print(double value) {
+    // "%g" with the default precision of 6 is what std::cout uses.
+    char text[32];
+    int length = std::snprintf(text, sizeof(text), "%g", value);
+    TaskLock lock(outputMutex);
+    appendOutput(text, static_cast<size_t>(length));
+    endLine();
+}
+
+void print(std::string_view text) {
+    TaskLock lock(outputMutex);
+    appendOutput(text.data(), text.size());
+    endLine();
+}
+
+void flush() {
+    TaskLock lock(outputMutex);
+    flushOutput();
+}
+
+void setLineBuffered(bool lineBuffered) {
+    if (lineBufferedMode < 0)
+        std::atexit(flush);
+    lineBufferedMode = lineBuffered ? 1 : 0;
+}
+
+namespace {
+
+constexpr size_t STREAM_BUFFER_SIZE = 64 * 1024;
+
+// A reader holds the unread part of its buffer in [begin, end); a writer
+// the lines not yet written in [0, end). Every use of a stream holds its
+// mutex, and a stream closed while another task held it is no longer open.
+struct LineStream {
+    LineStream(int fd, const std::string &path, bool writer) : file(fd), path(path), writer(writer) {}
+
+    std::mutex mutex;
+    FileDescriptor file;
+    std::string path;
+    bool writer;
+    bool open = true;
+    std::unique_ptr<char[]> buffer{new char[STREAM_BUFFER_SIZE]};
+    size_t begin = 0;
+    size_t end = 0;
+    std::string line; // A line read across buffer refills.
+};
+
+// The open streams by handle. A stream lives on, closed, until the last
+// task using it lets go.
+std::mutex streamsMutex;
+std::unordered_map<uint64_t, std::shared_ptr<LineStream>> streams;
+uint64_t streamsOpened = 0;
+
+enum class StreamKind { READER, WRITER, ANY };
+
+double addStream(int fd, const std::string &path, bool writer) {
+    TaskLock lock(streamsMutex);
+    streams.emplace(++streamsOpened, std::make_shared<LineStream>(fd, path, writer));
+    return static_cast<double>(streamsOpened);
+}
+
+// name is the built-in given the handle.
+std::runtime_error notOpen(StreamKind kind, const char* name) {
+    const char* from = kind == StreamKind::READER   ? "openLines"
+                       : kind == StreamKind::WRITER ? "openWriter"
+                                                    : "openLines or openWriter";
+    return std::runtime_error(std::string(name) + " expects an open handle from " + from + ".");
+}
+
+std::shared_ptr<LineStream> findStream(double handle, StreamKind kind, const char* name) {
+    TaskLock lock(streamsMutex);
+    if (handle >= 1 && handle <= static_cast<double>(streamsOpened) &&
+        handle == static_cast<double>(static_cast<uint64_t>(handle))) {
+        auto found = streams.find(static_cast<uint64_t>(handle));
+        if (found != streams.end() &&
+            (kind == StreamKind::ANY || found->second->writer == (kind == StreamKind::WRITER)))
+            return found->second;
+    }
+    throw notOpen(kind, name);
+}
+
+// An open stream of a kind, locked until destroyed.
+class StreamLock {
+public:
+    StreamLock(double handle, StreamKind kind, const char* name)
+        : stream(findStream(handle, kind, name)), lock(stream->mutex) {
+        if (!stream->open)
+            throw notOpen(kind, name);
+    }
+    LineStream& operator*() const { return *stream; }
+    LineStream* operator->() const { return stream.get(); }
+
+private:
+    std::shared_ptr<LineStream> stream;
+    TaskLock lock;
+};
+
+// Refills an empty reader. Returns false at the end of the file.
+bool fillReader(LineStream& reader) {
+    if (reader.begin < reader.end)
+        return true;
+    for (;;) {
+        ssize_t count = ::read(reader.file.fd, reader.buffer.get(), STREAM_BUFFER_SIZE);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("Could not read file: " + reader.path);
+        }
+        reader.begin = 0;
+        reader.end = static_cast<size_t>(count);
+        return count > 0;
+    }
+}
+
+std::string_view withoutCarriageReturn(std::string_view line) {
+    if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+    return line;
+}
+
+void flushWriter(LineStream& writer) {
+    bool written = writeAll(writer.file.fd, writer.buffer.get(), writer.end);
+    writer.end = 0;
+    if (!written)
+        throw std::runtime_error("Could not write to file: " + writer.path);
+}
+
+void appendWriter(LineStream& writer, const char* data, size_t size) {
+    if (writer.end + size > STREAM_BUFFER_SIZE) {
+        flushWriter(writer);
+        if (size > STREAM_BUFFER_SIZE) {
+            if (!writeAll(writer.file.fd, data, size))
+                throw std::runtime_error("Could not write to file: " + writer.path);
+            return;
+        }
+    }
+    std::memcpy(writer.buffer.get() + writer.end, data, size);
+    writer.end += size;
+}
+
+// At exit, writes out what writers still buffer. Errors cannot be reported
+// any more and are dropped.
+void flushWriters() {
+    std::vector<std::shared_ptr<LineStream>> open;
+    {
+        TaskLock lock(streamsMutex);
+        for (auto& [handle, stream] : streams)
+            open.push_back(stream);
+    }
+    for (std::shared_ptr<LineStream>& stream : open) {
+        TaskLock lock(stream->mutex);
+        if (stream->open && stream->writer)
+            writeAll(stream->file.fd, stream->buffer.get(), stream->end);
+    }
+}
+
+} // namespace
+
+double fileOpenLines(const std::string &filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("Could not open file: " + filename);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return addStream(fd, filename, false);
+}
+
+int64_t fileHasLine(double handle) {
+    return fillReader(*StreamLock(handle, StreamKind::READER, "hasLine")) ? 1 : 0;
+}
+
+// A line within the buffer is copied from there; one that runs past it is
+// gathered in line first.
+std::string fileNextLine(double handle) {
+    StreamLock stream(handle, StreamKind::READER, "nextLine");
+    LineStream& reader = *stream;
+    reader.line.clear();
+    while (fillReader(reader)) {
+        const char* start = reader.buffer.get() + reader.begin;
+        size_t available = reader.end - reader.begin;
+        auto newline = static_cast<const char*>(std::memchr(start, '\n', available));
+        if (!newline) {
+            reader.line.append(start, available);
+            reader.begin = reader.end;
+            continue;
+        }
+        size_t length = static_cast<size_t>(newline - start);
+        reader.begin += length + 1;
+        if (reader.line.empty())
+            return std::string(withoutCarriageReturn(std::string_view(start, length)));
+        reader.line.append(start, length);
+        break;
+    }
+    return std::string(withoutCarriageReturn(reader.line));
+}
+
+double fileOpenWriter(const std::string &filename) {
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (fd < 0)
+        throw std::runtime_error("Could not write to file: " + filename);
+    static bool flushAtExit = (std::atexit(flushWriters), true);
+    (void)flushAtExit;
+    return addStream(fd, filename, true);
+}
+
+double fileWrite(double handle, std::string_view text) {
+    StreamLock writer(handle, StreamKind::WRITER, "write");
+    appendWriter(*writer, text.data(), text.size());
+    appendWriter(*writer, "\n", 1);
+    return 0;
+}
+
+double fileWrite(double handle, double value) {
+    char text[32];
+    int length = std::snprintf(text, sizeof(text), "%g", value);
+    return fileWrite(handle, std::string_view(text, static_cast<size_t>(length)));
+}
+
+// The file itself is closed with the last reference to the stream.
+double fileClose(double handle) {
+    StreamLock stream(handle, StreamKind::ANY, "close");
+    {
+        TaskLock lock(streamsMutex);
+        streams.erase(static_cast<uint64_t>(handle));
+    }
+    stream->open = false;
+    if (stream->writer)
+        flushWriter(*stream);
+    return 0;
+}
+
+void printMemoStats(std::string_view name, const MemoStats& stats) {
+    uint64_t calls = stats.hits + stats.misses;
+    std::fprintf(stderr, "memo %.*s: %llu hits, %llu misses (%.1f%% hit rate)\n", static_cast<int>(name.size()),
+                 name.data(), static_cast<unsigned long long>(stats.hits),
+                 static_cast<unsigned long long>(stats.misses), calls ? 100.0 * stats.hits / calls : 0.0);
+}
+
+double* allocateArray(size_t length) {
+    void* memory = ::operator new(length * sizeof(double), std::align_val_t(64));
+    std::memset(memory, 0, length * sizeof(double));
+    return static_cast<double*>(memory);
+}
+
+void freeArray(double* data) {
+    ::operator delete(data, std::align_val_t(64));
+}
+
+// Products and sums stay separate, rounded twice, in every kernel: an FMA
+// (AVX-512 implies the instructions) would round once and change the bits.
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+
+namespace {
+
+// Partial results of a reduction: element i of the array goes to lane
+// i % LANES. Vector kernels keep the lanes in LANES / WIDTH registers of
+// WIDTH doubles each (GCC generic vectors: 2 for SSE2, 4 for AVX2, 8 for
+// AVX-512); the scalar kernels keep them in an array.
+constexpr size_t LANES = 16;
+
+template <size_t WIDTH>
+struct Vector {
+    typedef double Lanes __attribute__((vector_size(WIDTH * sizeof(double))));
+};
+
+// Vector code is inlined into each kernel, so that it is compiled for that
+// kernel's instruction set.
+#define KERNEL_INLINE inline __attribute__((always_inline))
+
+// Vectors go by reference: passing them by value outside their instruction
+// set has no stable ABI.
+template <typename V>
+KERNEL_INLINE void load(V& lanes, const double* data) {
+    std::memcpy(&lanes, data, sizeof lanes);
+}
+
+template <typename V>
+KERNEL_INLINE void store(double* out, const V& lanes) {
+    std::memcpy(out, &lanes, sizeof lanes);
+}
+
+// min and max pick like MINPD and MAXPD: the first operand if the comparison
+// holds, else the second. Element first, partial result second.
+double pickMin(double x, double partial) {
+    return x < partial ? x : partial;
+}
+
+double pickMax(double x, double partial) {
+    return x > partial ? x : partial;
+}
+
+// The tails of the reductions, from element from on, and the combination of
+// the lanes, in the same order for every kernel.
+double finishSum(double* lanes, const double* data, size_t from, size_t length) {
+    for (size_t i = from; i < length; i++)
+        lanes[i % LANES] += data[i];
+    for (size_t width = LANES / 2; width > 0; width /= 2) {
+        for (size_t k = 0; k < width; k++)
+            lanes[k] += lanes[k + width];
+    }
+    return lanes[0];
+}
+
+double finishDot(double* lanes, const double* left, const double* right, size_t from, size_t length) {
+    for (size_t i = from; i < length; i++) {
+        double product = left[i] * right[i];
+        lanes[i % LANES] += product;
+    }
+    return finishSum(lanes, nullptr, 0, 0);
+}
+
+template <double (*pick)(double, double)>
+double finishPick(double* lanes, bool nan, const double* data, size_t from, size_t length) {
+    for (size_t i = from; i < length; i++) {
+        nan |= data[i] != data[i];
+        lanes[i % LANES] = pick(data[i], lanes[i % LANES]);
+    }
+    for (size_t width = LANES / 2; width > 0; width /= 2) {
+        for (size_t k = 0; k < width; k++)
+            lanes[k] = pick(lanes[k + width], lanes[k]);
+    }
+    return nan ? std::numeric_limits<double>::quiet_NaN() : lanes[0];
+}
+
+// Kernel bodies.
+template <size_t WIDTH>
+KERNEL_INLINE double sumLanes(const double* data, size_t length) {
+    typedef typename Vector<WIDTH>::Lanes V;
+    constexpr size_t REGISTERS = LANES / WIDTH;
+    V partial[REGISTERS] = {};
+    size_t i = 0;
+    for (; i + LANES <= length; i += LANES) {
+#pragma GCC unroll 8
+        for (size_t r = 0; r < REGISTERS; r++) {
+            V x;
+            load(x, data + i + r * WIDTH);
+            partial[r] += x;
+        }
+    }
+    double lanes[LANES];
+    for (size_t r = 0; r < REGISTERS; r++)
+        store(lanes + r * WIDTH, partial[r]);
+    return finishSum(lanes, data, i, length);
+}
+
+template <size_t WIDTH>
+KERNEL_INLINE double dotLanes(const double* left, const double* right, size_t length) {
+    typedef typename Vector<WIDTH>::Lanes V;
+    constexpr size_t REGISTERS = LANES / WIDTH;
+    V partial[REGISTERS] = {};
+    size_t i = 0;
+    for (; i + LANES <= length; i += LANES) {
+#pragma GCC unroll 8
+        for (size_t r = 0; r < REGISTERS; r++) {
+            V x, y;
+            load(x, left + i + r * WIDTH);
+            load(y, right + i + r * WIDTH);
+            V product = x * y;
+            partial[r] += product;
+        }
+    }
+    double lanes[LANES];
+    for (size_t r = 0; r < REGISTERS; r++)
+        store(lanes + r * WIDTH, partial[r]);
+    return finishDot(lanes, left, right, i, length);
+}
+
+template <size_t WIDTH>
+KERNEL_INLINE void scaleLanes(double* out, const double* data, double factor, size_t length) {
+    typedef typename Vector<WIDTH>::Lanes V;
+    V factors = V{} + factor;
+    size_t i = 0;
+    for (; i + WIDTH <= length; i += WIDTH) {
+        V x;
+        load(x, data + i);
+        x *= factors;
+        store(out + i, x);
+    }
+    for (; i < length; i++)
+        out[i] = data[i] * factor;
+}
+
+template <size_t WIDTH>
+KERNEL_INLINE void addLanes(double* out, const double* left, const double* right, size_t length) {
+    typedef typename Vector<WIDTH>::Lanes V;
+    size_t i = 0;
+    for (; i + WIDTH <= length; i += WIDTH) {
+        V x, y;
+        load(x, left + i);
+        load(y, right + i);
+        x += y;
+        store(out + i, x);
     }
-    file << content;
-}
\ No newline at end of file
+    for (; i < length; i++)
+        out[i] = left[i] + right[i];
+}
+
+// Each lane keeps x where the comparison with the partial result holds, as
+// pickMin and pickMax choose, and the NaNs seen are kept aside.
+template <size_t WIDTH, bool MIN>
+KERNEL_INLINE double pickLanes(const double* data, size_t length) {
+    typedef typename Vector<WIDTH>::Lanes V;
+    constexpr size_t REGISTERS = LANES / WIDTH;
+    constexpr double start = MIN ? std::numeric_limits<double>::infinity() : -std::numeric_limits<double>::infinity();
+    V partial[REGISTERS];
+    for (size_t r = 0; r < REGISTERS; r++)
+        partial[r] = V{} + start;
+    V nans = {};
+    size_t i = 0;
+    for (; i + LANES <= length; i += LANES) {
+#pragma GCC unroll 8
+        for (size_t r = 0; r < REGISTERS; r++) {
+            V x;
+            load(x, data + i + r * WIDTH);
+            nans = x != x ? x : nans;
+            partial[r] = (MIN ? x < partial[r] : x > partial[r]) ? x : partial[r];
+        }
+    }
+    double lanes[LANES];
+    for (size_t r = 0; r < REGISTERS; r++)
+        store(lanes + r * WIDTH, partial[r]);
+    double nanLanes[WIDTH];
+    store(nanLanes, nans);
+    bool nan = std::any_of(nanLanes, nanLanes + WIDTH, [](double lane) { return lane != lane; });
+    return finishPick<MIN ? pickMin : pickMax>(lanes, nan, data, i, length);
+}
+
+// One instruction set's kernels.
+struct Kernels {
+    const char* level;
+    double (*sum)(const double*, size_t);
+    double (*dot)(const double*, const double*, size_t);
+    void (*scale)(double*, const double*, double, size_t);
+    void (*add)(double*, const double*, const double*, size_t);
+    double (*min)(const double*, size_t);
+    double (*max)(const double*, size_t);
+};
+
+#define VECTOR_KERNELS(ISA, TARGET, WIDTH)                                                              \
+    TARGET double sum_##ISA(const double* data, size_t length) { return sumLanes<WIDTH>(data, length); } \
+    TARGET double dot_##ISA(const double* left, const double* right, size_t length) {                   \
+        return dotLanes<WIDTH>(left, right, length);                                                    \
+    }                                                                                                   \
+    TARGET void scale_##ISA(double* out, const double* data, double factor, size_t length) {            \
+        scaleLanes<WIDTH>(out, data, factor, length);                                                   \
+    }                                                                                                   \
+    TARGET void add_##ISA(double* out, const double* left, const double* right, size_t length) {        \
+        addLanes<WIDTH>(out, left, right, length);                                                      \
+    }                                                                                                   \
+    TARGET double min_##ISA(const double* data, size_t length) { return pickLanes<WIDTH, true>(data, length); } \
+    TARGET double max_##ISA(const double* data, size_t length) {                                        \
+        return pickLanes<WIDTH, false>(data, length);                                                   \
+    }                                                                                                   \
+    const Kernels ISA##Kernels = {#ISA, sum_##ISA, dot_##ISA, scale_##ISA, add_##ISA, min_##ISA, max_##ISA};
+
+#if defined(__x86_64__) || defined(__i386__)
+VECTOR_KERNELS(sse2, __attribute__((target("sse2"))), 2)
+VECTOR_KERNELS(avx2, __attribute__((target("avx2"))), 4)
+VECTOR_KERNELS(avx512, __attribute__((target("avx512f"))), 8)
+#endif
+
+// Portable kernels, with the lanes of the vector kernels.
+double sumScalar(const double* data, size_t length) {
+    double lanes[LANES] = {};
+    return finishSum(lanes, data, 0, length);
+}
+
+double dotScalar(const double* left, const double* right, size_t length) {
+    double lanes[LANES] = {};
+    return finishDot(lanes, left, right, 0, length);
+}
+
+void scaleScalar(double* out, const double* data, double factor, size_t length) {
+    for (size_t i = 0; i < length; i++)
+        out[i] = data[i] * factor;
+}
+
+void addScalar(double* out, const double* left, const double* right, size_t length) {
+    for (size_t i = 0; i < length; i++)
+        out[i] = left[i] + right[i];
+}
+
+double minScalar(const double* data, size_t length) {
+    double lanes[LANES];
+    std::fill(lanes, lanes + LANES, std::numeric_limits<double>::infinity());
+    return finishPick<pickMin>(lanes, false, data, 0, length);
+}
+
+double maxScalar(const double* data, size_t length) {
+    double lanes[LANES];
+    std::fill(lanes, lanes + LANES, -std::numeric_limits<double>::infinity());
+    return finishPick<pickMax>(lanes, false, data, 0, length);
+}
+
+const Kernels scalarKernels = {"scalar", sumScalar, dotScalar, scaleScalar, addScalar, minScalar, maxScalar};
+
+// Levels in increasing width; $MINILANG_SIMD names the widest allowed.
+const Kernels& chooseKernels() {
+    static const char* const levels[] = {"scalar", "sse2", "avx2", "avx512"};
+    int allowed = 3;
+    if (const char* limit = std::getenv("MINILANG_SIMD")) {
+        for (int i = 0; i < 4; i++) {
+            if (std::strcmp(limit, levels[i]) == 0)
+                allowed = i;
+        }
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (allowed >= 3 && __builtin_cpu_supports("avx512f"))
+        return avx512Kernels;
+    if (allowed >= 2 && __builtin_cpu_supports("avx2"))
+        return avx2Kernels;
+    if (allowed >= 1 && __builtin_cpu_supports("sse2"))
+        return sse2Kernels;
+#endif
+    return scalarKernels;
+}
+
+const Kernels& kernels() {
+    static const Kernels& chosen = chooseKernels();
+    return chosen;
+}
+
+} // namespace
+
+#pragma GCC pop_options
+
+namespace simd {
+
+double sum(const double* data, size_t length) {
+    return kernels().sum(data, length);
+}
+
+double dot(const double* left, const double* right, size_t length) {
+    return kernels().dot(left, right, length);
+}
+
+void scale(double* out, const double* data, double factor, size_t length) {
+    kernels().scale(out, data, factor, length);
+}
+
+void add(double* out, const double* left, const double* right, size_t length) {
+    kernels().add(out, left, right, length);
+}
+
+double min(const double* data, size_t length) {
+    return kernels().min(data, length);
+}
+
+double max(const double* data, size_t length) {
+    return kernels().max(data, length);
+}
+
+// Sorting networks would not beat introsort at the sizes scripts use.
+void sort(double* data, size_t length) {
+    std::sort(data, data + length, [](double a, double b) { return a < b || (a == a && b != b); });
+}
+
+const char* level() {
+    return kernels().level;
+}
+
+} // namespace simd
+
+void badArrayIndex(double index, size_t length) {
+    char text[96];
+    if (index == index && index != std::trunc(index))
+        std::snprintf(text, sizeof(text), "Array index %g is not a whole number.", index);
+    else
+        std::snprintf(text, sizeof(text), "Array index %g is out of range for length %zu.", index, length);
+    throw std::runtime_error(text);
+}
+
+size_t arrayLengthArgument(double length) {
+    if (!(length >= 0 && length <= 9007199254740992.0) || length != std::trunc(length))
+        throw std::runtime_error("array expects a length that is a whole number >= 0.");
+    return static_cast<size_t>(length);
+}
+
+void checkSameLength(const char* name, size_t left, size_t right) {
+    if (left != right)
+        throw std::runtime_error(std::string(name) + " expects arrays of the same length, not " +
+                                 std::to_string(left) + " and " + std::to_string(right) + ".");
+}
+
+void checkNotEmpty(const char* name, size_t length) {
+    if (length == 0)
+        throw std::runtime_error(std::string(name) + " of an empty array.");
+}
+
+std::string arrayText(const double* data, size_t length) {
+    std::string text = "[";
+    char number[32];
+    for (size_t i = 0; i < length; i++) {
+        if (i > 0)
+            text += ", ";
+        text.append(number, static_cast<size_t>(std::snprintf(number, sizeof(number), "%g", data[i])));
+    }
+    return text + "]";
+}
+
+Array newArray(double length) {
+    return Array(arrayLengthArgument(length));
+}
+
+int64_t arrayLength(const Array& array) {
+    return static_cast<int64_t>(array.size());
+}
+
+double arraySum(const Array& array) {
+    return simd::sum(array.data(), array.size());
+}
+
+double arrayDot(const Array& left, const Array& right) {
+    checkSameLength("dot", left.size(), right.size());
+    return simd::dot(left.data(), right.data(), left.size());
+}
+
+Array arrayScale(const Array& array, double factor) {
+    Array result(array.size());
+    simd::scale(result.data(), array.data(), factor, array.size());
+    return result;
+}
+
+Array arrayAdd(const Array& left, const Array& right) {
+    checkSameLength("add", left.size(), right.size());
+    Array result(left.size());
+    simd::add(result.data(), left.data(), right.data(), left.size());
+    return result;
+}
+
+double arrayMin(const Array& array) {
+    checkNotEmpty("min", array.size());
+    return simd::min(array.data(), array.size());
+}
+
+double arrayMax(const Array& array) {
+    checkNotEmpty("max", array.size());
+    return simd::max(array.data(), array.size());
+}
+
+Array arraySort(const Array& array) {
+    Array result(array.size());
+    std::copy(array.data(), array.data() + array.size(), result.data());
+    simd::sort(result.data(), result.size());
+    return result;
+}
+
+std::string arrayText(const Array& array) {
+    return arrayText(array.data(), array.size());
+}
+
+void print(const Array& array) {
+    print(arrayText(array));
+}
+
+namespace {
+
+// More chunks than threads, so that threads finishing early steal the rest.
+constexpr uint64_t CHUNKS_PER_THREAD = 4;
+constexpr unsigned MAX_THREADS = 1024;
+
+unsigned chooseThreadCount() {
+    if (const char* text = std::getenv("MINILANG_THREADS")) {
+        long threads = std::strtol(text, nullptr, 10);
+        if (threads >= 1)
+            return static_cast<unsigned>(std::min<long>(threads, MAX_THREADS));
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+class TaskPool {
+public:
+    explicit TaskPool(unsigned threads);
+    ~TaskPool();
+
+    void submit(std::shared_ptr<TaskState> task);
+    // Runs queued tasks until done() holds.
+    template <typename Done>
+    void helpUntil(Done done);
+    size_t pendingTasks() const { return pending.load(); }
+
+private:
+    // Tasks of one thread: it pushes and pops at the back, thieves take
+    // from the front.
+    struct Queue {
+        std::mutex lock;
+        std::deque<std::shared_ptr<TaskState>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // [0] for threads outside the pool.
+    std::vector<std::thread> workers;           // Worker i owns queues[i + 1].
+    std::atomic<size_t> queued{0};              // Tasks in all queues.
+    std::atomic<size_t> pending{0};             // Tasks submitted and not done.
+    std::atomic<bool> stopping{false};
+    std::mutex sleepLock;
+    std::condition_variable wake;     // Workers: a task was queued.
+    std::condition_variable finished; // Waiters: a task finished or was queued.
+    int waiting = 0;                  // Threads waiting on finished; under sleepLock.
+
+    static thread_local size_t self; // Queue of the calling thread.
+
+    void work(size_t index);
+    std::shared_ptr<TaskState> take();
+    bool runOne();
+};
+
+thread_local size_t TaskPool::self = 0;
+
+TaskPool::TaskPool(unsigned threads) {
+    for (unsigned i = 0; i < threads; i++)
+        queues.push_back(std::make_unique<Queue>());
+    if (threads > 1)
+        tasksStarted = true;
+    for (unsigned i = 1; i < threads; i++)
+        workers.emplace_back(&TaskPool::work, this, i);
+}
+
+// Tasks still queued at exit are never joined and are dropped; the running
+// ones finish first.
+TaskPool::~TaskPool() {
+    stopping = true;
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    flush();
+}
+
+void TaskPool::submit(std::shared_ptr<TaskState> task) {
+    pending++;
+    {
+        Queue& queue = *queues[self];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(std::move(task));
+        queued++;
+    }
+    bool waiters;
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        waiters = waiting > 0;
+    }
+    wake.notify_one();
+    if (waiters)
+        finished.notify_all();
+}
+
+template <typename Done>
+void TaskPool::helpUntil(Done done) {
+    while (!done()) {
+        if (runOne())
+            continue;
+        std::unique_lock<std::mutex> lock(sleepLock);
+        waiting++;
+        finished.wait(lock, [&] { return done() || queued > 0; });
+        waiting--;
+    }
+}
+
+void TaskPool::work(size_t index) {
+    self = index;
+    while (!stopping) {
+        if (runOne())
+            continue;
+        std::unique_lock<std::mutex> lock(sleepLock);
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+    }
+}
+
+// The newest task of the own queue, else the oldest of another, starting
+// with the next queue so that thieves spread out.
+std::shared_ptr<TaskState> TaskPool::take() {
+    size_t count = queues.size();
+    for (size_t i = 0; i < count; i++) {
+        Queue& queue = *queues[(self + i) % count];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tasks.empty())
+            continue;
+        std::shared_ptr<TaskState> task;
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        queued--;
+        return task;
+    }
+    return nullptr;
+}
+
+bool TaskPool::runOne() {
+    std::shared_ptr<TaskState> task = take();
+    if (!task)
+        return false;
+    try {
+        task->run();
+    } catch (...) {
+        task->error = std::current_exception();
+    }
+    task->done.store(true, std::memory_order_release);
+    pending--;
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+    }
+    finished.notify_all();
+    return true;
+}
+
+TaskPool& taskPool() {
+    static TaskPool pool(taskThreads());
+    return pool;
+}
+
+struct RangeTask : TaskState {
+    RangeTask(const std::function<void(int64_t, int64_t)>& body, int64_t begin, int64_t end)
+        : body(body), begin(begin), end(end) {}
+    void run() override { body(begin, end); }
+
+    const std::function<void(int64_t, int64_t)>& body;
+    int64_t begin;
+    int64_t end;
+};
+
+} // namespace
+
+void submitTask(std::shared_ptr<TaskState> task) {
+    taskPool().submit(std::move(task));
+}
+
+void waitTask(TaskState& task) {
+    if (!task.done.load(std::memory_order_acquire))
+        taskPool().helpUntil([&task] { return task.done.load(std::memory_order_acquire); });
+    if (task.error)
+        std::rethrow_exception(task.error);
+}
+
+void waitAllTasks() {
+    TaskPool& pool = taskPool();
+    pool.helpUntil([&pool] { return pool.pendingTasks() == 0; });
+}
+
+void parallelRange(int64_t from, int64_t to, const std::function<void(int64_t, int64_t)>& body) {
+    if (to <= from)
+        return;
+    uint64_t count = static_cast<uint64_t>(to) - static_cast<uint64_t>(from);
+    uint64_t chunks = std::min<uint64_t>(count, taskThreads() * CHUNKS_PER_THREAD);
+    if (taskThreads() == 1 || chunks == 1) {
+        body(from, to);
+        return;
+    }
+    // The first count % chunks chunks take one index more.
+    uint64_t size = count / chunks;
+    uint64_t extra = count % chunks;
+    std::vector<std::shared_ptr<RangeTask>> tasks;
+    int64_t begin = from;
+    for (uint64_t i = 0; i < chunks; i++) {
+        int64_t end = begin + static_cast<int64_t>(size + (i < extra ? 1 : 0));
+        tasks.push_back(std::make_shared<RangeTask>(body, begin, end));
+        submitTask(tasks.back());
+        begin = end;
+    }
+    // Every chunk must be done before body goes out of scope.
+    std::exception_ptr error;
+    for (auto& task : tasks) {
+        taskPool().helpUntil([&task] { return task->done.load(std::memory_order_acquire); });
+        if (task->error && !error)
+            error = task->error;
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+unsigned taskThreads() {
+    static const unsigned threads = chooseThreadCount();
+    return threads;
+}
+
+int64_t parallelBound(double bound) {
+    if (!(std::fabs(bound) <= 9007199254740992.0) || bound != std::trunc(bound))
+        throw std::runtime_error("parallelFor expects bounds that are whole numbers.");
+    return static_cast<int64_t>(bound);
+}
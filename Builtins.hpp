@@ -1,12 +1,336 @@
 #ifndef BUILTINS_HPP
 #define BUILTINS_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 
 // Reads an entire file into a string.
 std::string readFile(const std::string &filename);
 
-// Writes the provided content into a file.
-void writeFile(const std::string &filename, const std::string &content);
+// Writes the provided content into a file. A file that readFile strings
+// still map is replaced rather than overwritten, so they keep its old text.
+void writeFile(const std::string &filename, std::string_view content);
+
+// readFile of the interpreters: maps a regular file of MAP_THRESHOLD bytes
+// or more read-only, so that its string uses the page cache instead of a
+// copy. Returns nullptr for smaller files and files that cannot be mapped,
+// which readFile reads. The mapping lasts until unmapFile. Truncating the
+// file by other means while it is mapped is an error (SIGBUS).
+constexpr size_t MAP_THRESHOLD = 64 * 1024;
+const char* mapFile(const std::string &filename, size_t &length);
+void unmapFile(const char* data, size_t length);
+
+// Line streams, which read or append files of any size with one buffer of
+// their own. A stream is named by a handle, a number that no later stream
+// reuses. Tasks may share a handle: each call has the stream to itself.
+// fileOpenLines opens a file to read: fileHasLine tells whether a line is
+// left, and fileNextLine returns the next one without its \n or \r\n, or
+// "" at the end.
+double fileOpenLines(const std::string &filename);
+int64_t fileHasLine(double handle);
+std::string fileNextLine(double handle);
+// fileOpenWriter opens a file to append to, creating it if missing:
+// fileWrite adds a line, which is written out when the buffer fills, on
+// fileClose and at exit. Numbers are formatted like print.
+double fileOpenWriter(const std::string &filename);
+double fileWrite(double handle, std::string_view text);
+double fileWrite(double handle, double value);
+// Closes a stream of either kind.
+double fileClose(double handle);
+
+// Buffered standard output, shared by the interpreters and generated
+// programs. print writes one line into a large buffer, which is written out
+// when full, by flush() and at exit. Numbers are formatted like
+// std::cout << value. When stdout is a terminal, or after
+// setLineBuffered(true), every line is written out immediately. Lines
+// printed by concurrent tasks never interleave.
+void print(double value);
+void print(std::string_view text);
+void flush();
+void setLineBuffered(bool lineBuffered);
+
+// Element storage of arrays, zeroed and aligned to 64 bytes so that SIMD
+// kernels never split a vector across cache lines.
+double* allocateArray(size_t length);
+void freeArray(double* data);
+
+// Numeric kernels behind the array built-ins, shared by the interpreter and
+// generated programs. The first call picks the widest instruction set the
+// CPU supports: AVX-512, AVX2, SSE2 or plain C++; $MINILANG_SIMD (avx512,
+// avx2, sse2 or scalar) caps the choice. Reductions keep sixteen partial
+// results, element i going to partial i % 16, and combine them in a fixed
+// order, so every instruction set returns the same bits.
+namespace simd {
+double sum(const double* data, size_t length);
+double dot(const double* left, const double* right, size_t length);
+void scale(double* out, const double* data, double factor, size_t length);
+void add(double* out, const double* left, const double* right, size_t length);
+// NaN if any element is NaN. length must not be 0.
+double min(const double* data, size_t length);
+double max(const double* data, size_t length);
+// Ascending, NaNs last.
+void sort(double* data, size_t length);
+// Instruction set in use: "avx512", "avx2", "sse2" or "scalar".
+const char* level();
+} // namespace simd
+
+// Position of array[index]. Throws unless index is a whole number in
+// [0, length).
+[[noreturn]] void badArrayIndex(double index, size_t length);
+inline size_t arrayIndex(double index, size_t length) {
+    bool inRange = index >= 0 && index < static_cast<double>(length);
+    if (!inRange || index != static_cast<double>(static_cast<size_t>(index)))
+        badArrayIndex(index, length);
+    return static_cast<size_t>(index);
+}
+inline size_t arrayIndex(int64_t index, size_t length) {
+    if (static_cast<uint64_t>(index) >= length)
+        badArrayIndex(static_cast<double>(index), length);
+    return static_cast<size_t>(index);
+}
+
+// Argument checks of the array built-ins, which throw std::runtime_error.
+// The length passed to array(n) must be a whole number >= 0.
+size_t arrayLengthArgument(double length);
+void checkSameLength(const char* name, size_t left, size_t right);
+void checkNotEmpty(const char* name, size_t length);
+
+// Text of an array as print shows it, elements formatted like numbers:
+// [1, 2.5, -3].
+std::string arrayText(const double* data, size_t length);
+
+// Array of doubles in generated programs. Copies share the elements, like
+// MiniLang variables holding the same array.
+class Array {
+public:
+    Array() = default;
+    explicit Array(size_t length) : storage(std::make_shared<Storage>(length)) {}
+    Array(std::initializer_list<double> elements) : Array(elements.size()) {
+        std::copy(elements.begin(), elements.end(), data());
+    }
+
+    size_t size() const { return storage ? storage->length : 0; }
+    double* data() const { return storage ? storage->data : nullptr; }
+    template <typename Index>
+    double& operator[](Index index) const {
+        if constexpr (std::is_integral_v<Index>)
+            return storage->data[arrayIndex(static_cast<int64_t>(index), size())];
+        else
+            return storage->data[arrayIndex(static_cast<double>(index), size())];
+    }
+
+private:
+    struct Storage {
+        explicit Storage(size_t length) : length(length), data(allocateArray(length)) {}
+        ~Storage() { freeArray(data); }
+        Storage(const Storage&) = delete;
+        Storage& operator=(const Storage&) = delete;
+        size_t length;
+        double* data;
+    };
+    std::shared_ptr<Storage> storage;
+};
+
+// The array built-ins of generated programs. They throw like the
+// interpreter's on bad arguments.
+Array newArray(double length);
+int64_t arrayLength(const Array& array);
+double arraySum(const Array& array);
+double arrayDot(const Array& left, const Array& right);
+Array arrayScale(const Array& array, double factor);
+Array arrayAdd(const Array& left, const Array& right);
+double arrayMin(const Array& array);
+double arrayMax(const Array& array);
+Array arraySort(const Array& array);
+std::string arrayText(const Array& array);
+void print(const Array& array);
+
+// Work-stealing task pool shared by the interpreter and generated programs.
+// It runs $MINILANG_THREADS threads in all, counting the one that spawns
+// tasks, else one per hardware thread. Each worker keeps a deque of tasks:
+// it runs its newest task first and, when out of work, steals the oldest
+// task of another. A thread waiting for a task runs queued tasks meanwhile,
+// so tasks may wait for tasks they spawned. The workers start on the first
+// submitted task.
+struct TaskState {
+    virtual ~TaskState() = default;
+    virtual void run() = 0;
+
+    std::atomic<bool> done{false};
+    std::exception_ptr error; // What run() threw, once done.
+};
+
+void submitTask(std::shared_ptr<TaskState> task);
+// Returns once task is done; rethrows what it threw.
+void waitTask(TaskState& task);
+// Waits for every submitted task. Their errors are dropped.
+void waitAllTasks();
+// Calls body(begin, end) on consecutive chunks of [from, to), in parallel,
+// and returns once all are done. Rethrows the error of the first chunk that
+// threw.
+void parallelRange(int64_t from, int64_t to, const std::function<void(int64_t, int64_t)>& body);
+// Threads running tasks, the caller's included.
+unsigned taskThreads();
+
+// Handle of a task of a generated program: spawn f(...) runs a copy of the
+// arguments through f, and join returns its result.
+template <typename T>
+class Task {
+public:
+    Task() = default;
+    explicit Task(std::function<T()> body) : state(std::make_shared<State>(std::move(body))) { submitTask(state); }
+
+    T join() const {
+        if (!state)
+            throw std::runtime_error("join of a task that was never spawned.");
+        waitTask(*state);
+        return state->result;
+    }
+
+private:
+    struct State : TaskState {
+        explicit State(std::function<T()> body) : body(std::move(body)) {}
+        void run() override {
+            result = body();
+            body = nullptr;
+        }
+        std::function<T()> body;
+        T result{};
+    };
+    std::shared_ptr<State> state;
+};
+
+template <typename T>
+T joinTask(const Task<T>& task) {
+    return task.join();
+}
+
+template <typename T>
+std::string taskText(const Task<T>&) {
+    return "<task>";
+}
+template <typename T>
+void print(const Task<T>& task) {
+    print(taskText(task));
+}
+
+// What a task gets of a spawn argument: arrays are copied so that the task
+// and the spawner share no elements; numbers and strings are values already.
+inline Array taskCopy(const Array& array) {
+    Array copy(array.size());
+    std::copy(array.data(), array.data() + array.size(), copy.data());
+    return copy;
+}
+template <typename T>
+T taskCopy(T value) {
+    return value;
+}
+
+// Bound of parallelFor; throws unless it is a whole number.
+int64_t parallelBound(double bound);
+
+// parallelFor(from, to, f) of generated programs.
+template <typename F>
+Array parallelMap(double from, double to, F f) {
+    int64_t first = parallelBound(from);
+    int64_t last = parallelBound(to);
+    Array result(last > first ? static_cast<size_t>(last - first) : 0);
+    double* data = result.data();
+    parallelRange(first, last, [&](int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; i++)
+            data[i - first] = f(i);
+    });
+    return result;
+}
+
+// Hits and misses of one memoized function.
+struct MemoStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+// Writes "memo name: N hits, M misses" to stderr.
+void printMemoStats(std::string_view name, const MemoStats& stats);
+
+// Key of a memoized call: the bits of each argument, so that 0 and -0 stay
+// apart and a NaN argument finds its earlier result.
+inline uint64_t memoKey(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof bits);
+    return bits;
+}
+inline uint64_t memoKey(int64_t value) { return static_cast<uint64_t>(value); }
+
+// Results of a pure function by argument, shared by the interpreter and
+// generated programs. The table is direct-mapped: each key has one slot out
+// of SLOTS, and a new result replaces whatever that slot held, so memory
+// stays bounded however many arguments a program tries. Slots are allocated
+// on the first store.
+template <typename Result>
+class MemoTable {
+public:
+    static constexpr size_t MAX_ARGS = 4;
+    static constexpr int SLOT_BITS = 10;
+    static constexpr size_t SLOTS = size_t(1) << SLOT_BITS;
+
+    explicit MemoTable(size_t arity) : arity(arity) {}
+
+    // key holds arity words.
+    const Result* find(const uint64_t* key) {
+        if (slots) {
+            const Slot& slot = slots[index(key)];
+            if (slot.used && std::memcmp(slot.key, key, arity * sizeof(uint64_t)) == 0) {
+                counts.hits++;
+                return &slot.result;
+            }
+        }
+        counts.misses++;
+        return nullptr;
+    }
+
+    const Result& store(const uint64_t* key, Result result) {
+        if (!slots)
+            slots.reset(new Slot[SLOTS]);
+        Slot& slot = slots[index(key)];
+        std::memcpy(slot.key, key, arity * sizeof(uint64_t));
+        slot.used = true;
+        slot.result = std::move(result);
+        return slot.result;
+    }
+
+    const MemoStats& stats() const { return counts; }
+
+private:
+    struct Slot {
+        uint64_t key[MAX_ARGS];
+        bool used = false;
+        Result result{};
+    };
+
+    size_t arity;
+    std::unique_ptr<Slot[]> slots;
+    MemoStats counts;
+
+    // Fibonacci hashing: the top bits of the product depend on every bit of
+    // the key, including the exponent bits where small doubles differ.
+    size_t index(const uint64_t* key) const {
+        uint64_t hash = 0;
+        for (size_t i = 0; i < arity; i++)
+            hash = (hash ^ key[i]) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(hash >> (64 - SLOT_BITS));
+    }
+};
 
 #endif // BUILTINS_HPP
\ No newline at end of file
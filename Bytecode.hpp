@@ -0,0 +1,82 @@
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+#include "Value.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Instruction set of the MiniLang virtual machine.
+// Operands are stored inline after the opcode, little-endian.
+enum class OpCode : uint8_t {
+    CONSTANT,       // u32 constant index: push a constant.
+    POP,            // Discard the top of the stack.
+    GET_LOCAL,      // u16 slot: push a local of the current frame.
+    SET_LOCAL,      // u16 slot: store the top of the stack into a local (value is kept).
+    GET_GLOBAL,     // u32 global slot: push a global from a function.
+    SET_GLOBAL,     // u32 global slot: assign a global from a function (value is kept).
+    DEFINE_GLOBAL,  // u32 global slot: initialize a script-frame slot from the top of the stack and pop it.
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    LESS,
+    LESS_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    NEGATE,
+    PRINT,          // Pop and print the top of the stack.
+    JUMP,           // i32 offset, relative to the next instruction.
+    JUMP_IF_FALSE,  // i32 offset; pops the condition.
+    CALL,           // u32 function index, u8 argument count.
+    CALL_BUILTIN,   // u8 builtin id, u8 argument count.
+    RETURN          // Return the top of the stack to the caller.
+};
+
+// Built-in functions callable through CALL_BUILTIN.
+enum class BuiltinId : uint8_t {
+    READ_FILE,
+    WRITE_FILE,
+    FLUSH,
+    OPEN_LINES,
+    HAS_LINE,
+    NEXT_LINE,
+    OPEN_WRITER,
+    WRITE,
+    CLOSE
+};
+
+// A sequence of instructions with its constant pool.
+struct Chunk {
+    std::vector<uint8_t> code;
+    std::vector<Value> constants;
+};
+
+// A compiled function.
+struct FunctionProto {
+    std::string name;
+    uint16_t arity = 0;
+    uint32_t localCount = 0; // Frame slots, parameters included.
+    bool defined = false;    // False for functions that are called but never declared.
+    Chunk chunk;
+};
+
+// What the VM reads of a function, wherever its code and constants are
+// stored: in a FunctionProto or in a mapped ProgramImage.
+struct FunctionCode {
+    const uint8_t* code;
+    size_t codeSize;
+    const Value* constants;
+    uint16_t arity;
+    uint32_t localCount;
+    bool defined;
+};
+
+// The result of lowering a Program: top-level code plus the function table.
+struct CompiledProgram {
+    FunctionProto script;
+    std::vector<FunctionProto> functions;
+    std::vector<std::string> globals; // Global variable names, indexed by script-frame slot.
+};
+
+#endif // BYTECODE_HPP
\ No newline at end of file
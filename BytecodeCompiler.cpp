@@ -0,0 +1,353 @@
+#include "BytecodeCompiler.hpp"
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+CompiledProgram BytecodeCompiler::compile(Program* program) {
+    resolver.resolve(program);
+    result = CompiledProgram();
+    functionIndex.clear();
+
+    // Globals live in the script frame; keep their names for diagnostics.
+    result.globals.resize(program->frameSize);
+    for (auto& stmt : program->statements) {
+        if (auto varDecl = nodeCast<VariableDeclaration>(stmt))
+            result.globals[varDecl->address.slot] = std::string(symbolName(varDecl->identifier));
+    }
+
+    // First pass: register top-level functions so calls may precede declarations.
+    for (auto& stmt : program->statements) {
+        if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt))
+            functionSlot(funcDecl->name);
+    }
+    // Compile function bodies. Each body is built in a local proto because
+    // calls to undeclared functions may grow the function table meanwhile.
+    for (auto& stmt : program->statements) {
+        if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt))
+            compileFunction(funcDecl);
+    }
+    // Compile the top-level code.
+    result.script.name = "<script>";
+    result.script.defined = true;
+    result.script.localCount = static_cast<uint32_t>(program->frameSize);
+    beginChunk(result.script);
+    for (auto& stmt : program->statements) {
+        if (stmt->kind == NodeKind::FUNCTION_DECLARATION)
+            continue;
+        visit(stmt);
+    }
+    emit(OpCode::CONSTANT);
+    emitU32(numberConstant(0));
+    emit(OpCode::RETURN);
+    return std::move(result);
+}
+
+void BytecodeCompiler::beginStream() {
+    resolver.beginStream();
+    result = CompiledProgram();
+    functionIndex.clear();
+}
+
+void BytecodeCompiler::compileStatement(Statement* stmt) {
+    if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt)) {
+        resolver.resolveFunction(funcDecl);
+        functionSlot(funcDecl->name);
+        compileFunction(funcDecl);
+        return;
+    }
+    resolver.resolveStatement(stmt);
+    result.globals.resize(resolver.globalFrameSize());
+    if (auto varDecl = nodeCast<VariableDeclaration>(stmt))
+        result.globals[varDecl->address.slot] = std::string(symbolName(varDecl->identifier));
+    result.script = FunctionProto();
+    result.script.name = "<script>";
+    result.script.defined = true;
+    result.script.localCount = static_cast<uint32_t>(resolver.globalFrameSize());
+    beginChunk(result.script);
+    visit(stmt);
+    emit(OpCode::CONSTANT);
+    emitU32(numberConstant(0));
+    emit(OpCode::RETURN);
+    // The script's frame covers the block locals of the statement; the next
+    // one may reuse their slots.
+    resolver.endStatement();
+}
+
+void BytecodeCompiler::compileFunction(FunctionDeclaration* funcDecl) {
+    FunctionProto proto;
+    proto.name = std::string(symbolName(funcDecl->name));
+    proto.defined = true;
+    inFunction = true;
+    compileFunctionBody(funcDecl, proto);
+    inFunction = false;
+    result.functions[functionIndex[funcDecl->name]] = std::move(proto);
+}
+
+void BytecodeCompiler::compileFunctionBody(FunctionDeclaration* funcDecl, FunctionProto& proto) {
+    if (funcDecl->params.size() > std::numeric_limits<uint8_t>::max())
+        throw std::runtime_error("Too many parameters in function: " + std::string(symbolName(funcDecl->name)));
+    if (funcDecl->frameSize > std::numeric_limits<uint16_t>::max())
+        throw std::runtime_error("Too many local variables in function: " + std::string(symbolName(funcDecl->name)));
+    proto.arity = static_cast<uint16_t>(funcDecl->params.size());
+    proto.localCount = static_cast<uint16_t>(funcDecl->frameSize);
+    beginChunk(proto);
+    visitBlockStatement(funcDecl->body);
+    // Falling off the end returns 0.
+    emit(OpCode::CONSTANT);
+    emitU32(numberConstant(0));
+    emit(OpCode::RETURN);
+}
+
+void BytecodeCompiler::visitVariableDeclaration(VariableDeclaration* varDecl) {
+    visit(varDecl->expression);
+    if (inFunction) {
+        emit(OpCode::SET_LOCAL);
+        emitU16(static_cast<uint16_t>(varDecl->address.slot));
+        emit(OpCode::POP);
+    } else {
+        // Declarations in the script frame mark the slot as initialized.
+        emit(OpCode::DEFINE_GLOBAL);
+        emitU32(static_cast<uint32_t>(varDecl->address.slot));
+    }
+}
+
+void BytecodeCompiler::visitPrintStatement(PrintStatement* printStmt) {
+    visit(printStmt->expression);
+    emit(OpCode::PRINT);
+}
+
+void BytecodeCompiler::visitExpressionStatement(ExpressionStatement* exprStmt) {
+    visit(exprStmt->expression);
+    emit(OpCode::POP);
+}
+
+void BytecodeCompiler::visitBlockStatement(BlockStatement* block) {
+    // Block scoping was resolved statically, so blocks emit no scope code.
+    for (auto& stmt : block->statements)
+        visit(stmt);
+}
+
+void BytecodeCompiler::visitIfStatement(IfStatement* ifStmt) {
+    visit(ifStmt->condition);
+    size_t elseJump = emitJump(OpCode::JUMP_IF_FALSE);
+    visitBlockStatement(ifStmt->thenBranch);
+    if (ifStmt->elseBranch) {
+        size_t endJump = emitJump(OpCode::JUMP);
+        patchJump(elseJump);
+        visitBlockStatement(ifStmt->elseBranch);
+        patchJump(endJump);
+    } else {
+        patchJump(elseJump);
+    }
+}
+
+void BytecodeCompiler::visitWhileStatement(WhileStatement* whileStmt) {
+    size_t loopStart = current->chunk.code.size();
+    visit(whileStmt->condition);
+    size_t exitJump = emitJump(OpCode::JUMP_IF_FALSE);
+    loops.push_back({loopStart, {}});
+    visitBlockStatement(whileStmt->body);
+    emitLoop(loopStart);
+    patchJump(exitJump);
+    for (size_t breakJump : loops.back().breakJumps)
+        patchJump(breakJump);
+    loops.pop_back();
+}
+
+void BytecodeCompiler::visitBreakStatement(BreakStatement*) {
+    loops.back().breakJumps.push_back(emitJump(OpCode::JUMP));
+}
+
+void BytecodeCompiler::visitContinueStatement(ContinueStatement*) {
+    emitLoop(loops.back().start);
+}
+
+void BytecodeCompiler::visitReturnStatement(ReturnStatement* returnStmt) {
+    if (returnStmt->expression) {
+        visit(returnStmt->expression);
+    } else {
+        emit(OpCode::CONSTANT);
+        emitU32(numberConstant(0));
+    }
+    emit(OpCode::RETURN);
+}
+
+void BytecodeCompiler::visitFunctionDeclaration(FunctionDeclaration*) {
+    // Only top-level functions are callable; nested declarations are ignored
+    // just like in the interpreter.
+}
+
+void BytecodeCompiler::visitNumericLiteral(NumericLiteral* num) {
+    emit(OpCode::CONSTANT);
+    emitU32(numberConstant(num->value));
+}
+
+void BytecodeCompiler::visitStringLiteral(StringLiteral* str) {
+    emit(OpCode::CONSTANT);
+    emitU32(stringConstant(str->value));
+}
+
+void BytecodeCompiler::visitIdentifier(Identifier* id) {
+    emitVariable(OpCode::GET_LOCAL, OpCode::GET_GLOBAL, id->address);
+}
+
+void BytecodeCompiler::visitAssignment(Assignment* assign) {
+    visit(assign->value);
+    emitVariable(OpCode::SET_LOCAL, OpCode::SET_GLOBAL, assign->address);
+}
+
+void BytecodeCompiler::visitBinaryExpression(BinaryExpression* bin) {
+    visit(bin->left);
+    visit(bin->right);
+    switch (bin->op) {
+        case BinaryOp::ADD: emit(OpCode::ADD); return;
+        case BinaryOp::SUBTRACT: emit(OpCode::SUBTRACT); return;
+        case BinaryOp::MULTIPLY: emit(OpCode::MULTIPLY); return;
+        case BinaryOp::DIVIDE: emit(OpCode::DIVIDE); return;
+        case BinaryOp::LESS: emit(OpCode::LESS); return;
+        case BinaryOp::LESS_EQUAL: emit(OpCode::LESS_EQUAL); return;
+        case BinaryOp::GREATER: emit(OpCode::GREATER); return;
+        case BinaryOp::GREATER_EQUAL: emit(OpCode::GREATER_EQUAL); return;
+    }
+    throw std::runtime_error(std::string("Unknown binary operator: ") + operatorText(bin->op));
+}
+
+void BytecodeCompiler::visitUnaryExpression(UnaryExpression* unary) {
+    visit(unary->argument);
+    switch (unary->op) {
+        case UnaryOp::NEGATE: emit(OpCode::NEGATE); return;
+    }
+    throw std::runtime_error(std::string("Unknown unary operator: ") + operatorText(unary->op));
+}
+
+void BytecodeCompiler::visitCallExpression(CallExpression* callExpr) {
+    auto calleeId = nodeCast<Identifier>(callExpr->callee);
+    if (!calleeId)
+        throw std::runtime_error("Can only call functions identified by name.");
+    if (callExpr->arguments.size() > std::numeric_limits<uint8_t>::max())
+        throw std::runtime_error("Too many arguments in call to " + std::string(symbolName(calleeId->name)));
+    for (auto& arg : callExpr->arguments)
+        visit(arg);
+    uint8_t argc = static_cast<uint8_t>(callExpr->arguments.size());
+    // Built-ins take precedence over user functions, except the line stream
+    // ones, which functions declared so far replace.
+    BuiltinId builtin;
+    bool isBuiltin = true;
+    switch (calleeId->name) {
+        case Symbols::READ_FILE: builtin = BuiltinId::READ_FILE; break;
+        case Symbols::WRITE_FILE: builtin = BuiltinId::WRITE_FILE; break;
+        case Symbols::FLUSH: builtin = BuiltinId::FLUSH; break;
+        case Symbols::OPEN_LINES: builtin = BuiltinId::OPEN_LINES; break;
+        case Symbols::HAS_LINE: builtin = BuiltinId::HAS_LINE; break;
+        case Symbols::NEXT_LINE: builtin = BuiltinId::NEXT_LINE; break;
+        case Symbols::OPEN_WRITER: builtin = BuiltinId::OPEN_WRITER; break;
+        case Symbols::WRITE: builtin = BuiltinId::WRITE; break;
+        case Symbols::CLOSE: builtin = BuiltinId::CLOSE; break;
+        default: isBuiltin = false; break;
+    }
+    if (Symbols::isLineStreamBuiltIn(calleeId->name) && functionIndex.count(calleeId->name))
+        isBuiltin = false;
+    if (isBuiltin) {
+        emit(OpCode::CALL_BUILTIN);
+        emitByte(static_cast<uint8_t>(builtin));
+        emitByte(argc);
+        return;
+    }
+    emit(OpCode::CALL);
+    emitU32(functionSlot(calleeId->name));
+    emitByte(argc);
+}
+
+// Emits a variable access. Function locals use compact 16-bit slots; the
+// script frame is the global frame and may grow past that, so top-level code
+// addresses it with the 32-bit global instructions.
+void BytecodeCompiler::emitVariable(OpCode localOp, OpCode globalOp, const VariableAddress& address) {
+    if (inFunction && address.depth == 0) {
+        emit(localOp);
+        emitU16(static_cast<uint16_t>(address.slot));
+    } else {
+        emit(globalOp);
+        emitU32(static_cast<uint32_t>(address.slot));
+    }
+}
+
+uint32_t BytecodeCompiler::functionSlot(Symbol name) {
+    auto it = functionIndex.find(name);
+    if (it != functionIndex.end())
+        return it->second;
+    uint32_t index = static_cast<uint32_t>(result.functions.size());
+    result.functions.emplace_back();
+    result.functions.back().name = std::string(symbolName(name));
+    functionIndex.emplace(name, index);
+    return index;
+}
+
+void BytecodeCompiler::beginChunk(FunctionProto& proto) {
+    current = &proto;
+    loops.clear();
+    numberConstants.clear();
+    stringConstants.clear();
+}
+
+uint32_t BytecodeCompiler::numberConstant(double value) {
+    // Key on the bit pattern so that 0.0 and -0.0 stay distinct.
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    auto it = numberConstants.find(bits);
+    if (it != numberConstants.end())
+        return it->second;
+    uint32_t index = static_cast<uint32_t>(current->chunk.constants.size());
+    current->chunk.constants.emplace_back(value);
+    numberConstants.emplace(bits, index);
+    return index;
+}
+
+uint32_t BytecodeCompiler::stringConstant(std::string_view value) {
+    auto it = stringConstants.find(value);
+    if (it != stringConstants.end())
+        return it->second;
+    uint32_t index = static_cast<uint32_t>(current->chunk.constants.size());
+    current->chunk.constants.emplace_back(value);
+    stringConstants.emplace(value, index);
+    return index;
+}
+
+void BytecodeCompiler::emit(OpCode op) {
+    current->chunk.code.push_back(static_cast<uint8_t>(op));
+}
+
+void BytecodeCompiler::emitByte(uint8_t byte) {
+    current->chunk.code.push_back(byte);
+}
+
+void BytecodeCompiler::emitU16(uint16_t value) {
+    emitByte(static_cast<uint8_t>(value & 0xff));
+    emitByte(static_cast<uint8_t>(value >> 8));
+}
+
+void BytecodeCompiler::emitU32(uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        emitByte(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+// Emits a jump with a placeholder offset and returns the operand position.
+size_t BytecodeCompiler::emitJump(OpCode op) {
+    emit(op);
+    size_t operandOffset = current->chunk.code.size();
+    emitU32(0);
+    return operandOffset;
+}
+
+void BytecodeCompiler::patchJump(size_t operandOffset) {
+    auto& code = current->chunk.code;
+    int32_t offset = static_cast<int32_t>(code.size() - (operandOffset + 4));
+    uint32_t bits = static_cast<uint32_t>(offset);
+    for (int i = 0; i < 4; i++)
+        code[operandOffset + i] = static_cast<uint8_t>(bits >> (8 * i));
+}
+
+void BytecodeCompiler::emitLoop(size_t loopStart) {
+    emit(OpCode::JUMP);
+    int32_t offset = static_cast<int32_t>(loopStart) - static_cast<int32_t>(current->chunk.code.size() + 4);
+    emitU32(static_cast<uint32_t>(offset));
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#ifndef BYTECODECOMPILER_HPP
+#define BYTECODECOMPILER_HPP
+
+#include "AST.hpp"
+#include "ASTVisitor.hpp"
+#include "Bytecode.hpp"
+#include "Resolver.hpp"
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class BytecodeCompiler : private ASTVisitor<BytecodeCompiler, void> {
+public:
+    static constexpr const char* PASS_NAME = "bytecode compiler";
+
+    // Lowers a MiniLang program into bytecode for the VM.
+    CompiledProgram compile(Program* program);
+
+    // Streaming mode: compiles top-level statements one at a time, in source
+    // order. A function declaration is added to the function table. Any other
+    // statement replaces the script of compiled(), ready for VM::execute.
+    void beginStream();
+    void compileStatement(Statement* stmt);
+    const CompiledProgram& compiled() const { return result; }
+
+private:
+    CompiledProgram result;
+    Resolver resolver;
+    FunctionProto* current = nullptr;
+    bool inFunction = false;
+    // Innermost loop being compiled: its start and the pending break jumps.
+    struct Loop {
+        size_t start;
+        std::vector<size_t> breakJumps;
+    };
+    std::vector<Loop> loops;
+    std::unordered_map<Symbol, uint32_t> functionIndex;
+    std::unordered_map<uint64_t, uint32_t> numberConstants;
+    std::unordered_map<std::string_view, uint32_t> stringConstants;
+
+    friend class ASTVisitor<BytecodeCompiler, void>;
+
+    void compileFunction(FunctionDeclaration* funcDecl);
+    void compileFunctionBody(FunctionDeclaration* funcDecl, FunctionProto& proto);
+
+    // Statements.
+    void visitVariableDeclaration(VariableDeclaration* varDecl);
+    void visitPrintStatement(PrintStatement* printStmt);
+    void visitExpressionStatement(ExpressionStatement* exprStmt);
+    void visitBlockStatement(BlockStatement* block);
+    void visitIfStatement(IfStatement* ifStmt);
+    void visitWhileStatement(WhileStatement* whileStmt);
+    void visitBreakStatement(BreakStatement* breakStmt);
+    void visitContinueStatement(ContinueStatement* continueStmt);
+    void visitReturnStatement(ReturnStatement* returnStmt);
+    void visitFunctionDeclaration(FunctionDeclaration* funcDecl);
+
+    // Expressions.
+    void visitNumericLiteral(NumericLiteral* num);
+    void visitStringLiteral(StringLiteral* str);
+    void visitIdentifier(Identifier* id);
+    void visitAssignment(Assignment* assign);
+    void visitBinaryExpression(BinaryExpression* bin);
+    void visitUnaryExpression(UnaryExpression* unary);
+    void visitCallExpression(CallExpression* callExpr);
+
+    void emitVariable(OpCode localOp, OpCode globalOp, const VariableAddress& address);
+    uint32_t functionSlot(Symbol name);
+
+    // Emission helpers.
+    void beginChunk(FunctionProto& proto);
+    uint32_t numberConstant(double value);
+    uint32_t stringConstant(std::string_view value);
+    void emit(OpCode op);
+    void emitByte(uint8_t byte);
+    void emitU16(uint16_t value);
+    void emitU32(uint32_t value);
+    size_t emitJump(OpCode op);
+    void patchJump(size_t operandOffset);
+    void emitLoop(size_t loopStart);
+};
+
+#endif // BYTECODECOMPILER_HPP
\ No newline at end of file
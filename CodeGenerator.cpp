@@ -1,110 +1,542 @@
 #include "CodeGenerator.hpp"
 #include "AST.hpp"
+#include "TypeInference.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <sstream>
 #include <stdexcept>
-#include <typeinfo>
+#include <unordered_set>
 
 // Helper: Check if an expression is a string literal.
 static bool isStringLiteral(Expression* expr) {
-    return dynamic_cast<StringLiteral*>(expr) != nullptr;
+    return expr->kind == NodeKind::STRING_LITERAL;
 }
 
-// Determines the return type for a function based on its name.
-// For our demo, "greet", "setName", and "bark" return std::string.
-static std::string determineFunctionReturnType(FunctionDeclaration* funcDecl) {
-    if (funcDecl->name == "greet" || funcDecl->name == "setName" || funcDecl->name == "bark")
-        return "std::string";
-    return "int";
+static bool isIntegerLiteral(Expression* expr) {
+    return expr->kind == NodeKind::NUMERIC_LITERAL && expr->type == TypeKind::INTEGER;
 }
 
-// Determines parameter type; for setName the parameter is std::string.
-static std::string determineParameterType(FunctionDeclaration* funcDecl) {
-    if (funcDecl->name == "setName")
-        return "std::string";
-    return "int";
+// C++ spelling of an inferred type. Values nothing constrains are doubles.
+static std::string cppType(StaticType type) {
+    switch (type.kind) {
+        case TypeKind::INTEGER: return "int64_t";
+        case TypeKind::STRING: return "std::string";
+        case TypeKind::OBJECT: return std::string(symbolName(type.className)) + "*";
+        case TypeKind::ARRAY: return "Array";
+        case TypeKind::TASK: return "Task<" + cppType({type.result}) + ">";
+        default: return "double";
+    }
+}
+
+// What a while loop reads and writes, for the loop optimizations of the
+// CodeGenerator. A variable is invariant in the loop if nothing in the loop
+// assigns or declares it; generated code has no globals, so calls cannot
+// change it either (methods, whose fields calls may change, are not
+// optimized). The loop is counted if its condition compares an integer
+// variable with an invariant bound and its body ends by stepping that
+// variable by a positive constant toward the bound, with no other write to
+// it and no continue that would skip the step.
+class CodeGenerator::LoopAnalysis : private ASTVisitor<CodeGenerator::LoopAnalysis, void, void> {
+public:
+    static constexpr const char* PASS_NAME = "loop analysis";
+
+    explicit LoopAnalysis(WhileStatement* loop) {
+        roots.push_back(loop->condition);
+        visitBlockStatement(loop->body);
+        findCounter(loop);
+    }
+
+    // Numeric, and computed from literals and invariant variables only.
+    bool invariant(Expression* expr) const {
+        if (expr->type != TypeKind::INTEGER && expr->type != TypeKind::NUMBER)
+            return false;
+        switch (expr->kind) {
+            case NodeKind::NUMERIC_LITERAL:
+                return true;
+            case NodeKind::IDENTIFIER:
+                return !changed.count(static_cast<Identifier*>(expr)->name);
+            case NodeKind::BINARY_EXPRESSION: {
+                auto bin = static_cast<BinaryExpression*>(expr);
+                return invariant(bin->left) && invariant(bin->right);
+            }
+            case NodeKind::UNARY_EXPRESSION:
+                return invariant(static_cast<UnaryExpression*>(expr)->argument);
+            default:
+                return false;
+        }
+    }
+
+    // The largest invariant expressions in the loop worth computing once:
+    // not a lone literal or variable. In evaluation order.
+    std::vector<Expression*> invariants() const {
+        std::vector<Expression*> found;
+        for (Expression* root : roots)
+            collectInvariants(root, found);
+        return found;
+    }
+
+    // Products of the counter and an invariant integer, for a counted loop.
+    std::vector<BinaryExpression*> counterProducts() const {
+        std::vector<BinaryExpression*> found;
+        for (Expression* root : roots)
+            collectProducts(root, found);
+        return found;
+    }
+
+    Identifier* counter = nullptr; // Null unless the loop is counted.
+    int64_t step = 0;              // Added to the counter each iteration.
+
+private:
+    std::unordered_map<Symbol, int> writes;
+    std::unordered_set<Symbol> changed;  // Assigned or declared in the loop.
+    std::unordered_set<Symbol> declared; // Declared in the loop.
+    std::vector<Expression*> roots;     // Expressions directly under statements.
+    int nestedLoops = 0;
+    bool continues = false; // A continue of this loop, not of a nested one.
+
+    friend class ASTVisitor<CodeGenerator::LoopAnalysis, void, void>;
+
+    void findCounter(WhileStatement* loop) {
+        auto compare = nodeCast<BinaryExpression>(loop->condition);
+        if (!compare || continues || loop->body->statements.empty())
+            return;
+        bool up = compare->op == BinaryOp::LESS || compare->op == BinaryOp::LESS_EQUAL;
+        bool down = compare->op == BinaryOp::GREATER || compare->op == BinaryOp::GREATER_EQUAL;
+        auto id = nodeCast<Identifier>(compare->left);
+        if ((!up && !down) || !id || id->type != TypeKind::INTEGER || !invariant(compare->right))
+            return;
+        auto last = nodeCast<ExpressionStatement>(loop->body->statements[loop->body->statements.size() - 1]);
+        auto assign = last ? nodeCast<Assignment>(last->expression) : nullptr;
+        auto next = assign ? nodeCast<BinaryExpression>(assign->value) : nullptr;
+        if (!next || assign->name != id->name || writes[id->name] != 1 || declared.count(id->name))
+            return;
+        auto self = nodeCast<Identifier>(next->left);
+        auto amount = nodeCast<NumericLiteral>(next->right);
+        if (!self || self->name != id->name || !amount || amount->type != TypeKind::INTEGER || amount->value <= 0)
+            return;
+        if ((up && next->op != BinaryOp::ADD) || (down && next->op != BinaryOp::SUBTRACT))
+            return;
+        counter = id;
+        step = up ? static_cast<int64_t>(amount->value) : -static_cast<int64_t>(amount->value);
+    }
+
+    void collectInvariants(Expression* expr, std::vector<Expression*>& found) const {
+        if (invariant(expr)) {
+            if (expr->kind != NodeKind::NUMERIC_LITERAL && expr->kind != NodeKind::IDENTIFIER)
+                found.push_back(expr);
+            return;
+        }
+        forEachChild(expr, [&](Expression* child) { collectInvariants(child, found); });
+    }
+
+    void collectProducts(Expression* expr, std::vector<BinaryExpression*>& found) const {
+        auto bin = nodeCast<BinaryExpression>(expr);
+        if (bin && bin->op == BinaryOp::MULTIPLY && (isCounterTimesInvariant(bin->left, bin->right) ||
+                                                     isCounterTimesInvariant(bin->right, bin->left))) {
+            found.push_back(bin);
+            return;
+        }
+        forEachChild(expr, [&](Expression* child) { collectProducts(child, found); });
+    }
+
+    bool isCounterTimesInvariant(Expression* left, Expression* right) const {
+        auto id = nodeCast<Identifier>(left);
+        return id && id->name == counter->name && right->type == TypeKind::INTEGER && invariant(right);
+    }
+
+    template <typename F>
+    static void forEachChild(Expression* expr, F f) {
+        switch (expr->kind) {
+            case NodeKind::ASSIGNMENT:
+                f(static_cast<Assignment*>(expr)->value);
+                break;
+            case NodeKind::BINARY_EXPRESSION:
+                f(static_cast<BinaryExpression*>(expr)->left);
+                f(static_cast<BinaryExpression*>(expr)->right);
+                break;
+            case NodeKind::UNARY_EXPRESSION:
+                f(static_cast<UnaryExpression*>(expr)->argument);
+                break;
+            case NodeKind::CALL_EXPRESSION:
+                for (Expression* arg : static_cast<CallExpression*>(expr)->arguments)
+                    f(arg);
+                break;
+            case NodeKind::MEMBER_ACCESS_EXPRESSION:
+                f(static_cast<MemberAccessExpression*>(expr)->object);
+                break;
+            case NodeKind::NEW_EXPRESSION:
+                for (Expression* arg : static_cast<NewExpression*>(expr)->arguments)
+                    f(arg);
+                break;
+            case NodeKind::ARRAY_LITERAL:
+                for (Expression* element : static_cast<ArrayLiteral*>(expr)->elements)
+                    f(element);
+                break;
+            case NodeKind::INDEX_EXPRESSION:
+                f(static_cast<IndexExpression*>(expr)->array);
+                f(static_cast<IndexExpression*>(expr)->index);
+                break;
+            case NodeKind::INDEX_ASSIGNMENT:
+                f(static_cast<IndexAssignment*>(expr)->array);
+                f(static_cast<IndexAssignment*>(expr)->index);
+                f(static_cast<IndexAssignment*>(expr)->value);
+                break;
+            case NodeKind::SPAWN_EXPRESSION:
+                for (Expression* arg : static_cast<SpawnExpression*>(expr)->call->arguments)
+                    f(arg);
+                break;
+            case NodeKind::PARALLEL_FOR:
+                f(static_cast<ParallelFor*>(expr)->from);
+                f(static_cast<ParallelFor*>(expr)->to);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void root(Expression* expr) {
+        roots.push_back(expr);
+        visit(expr);
+    }
+
+    // Statements.
+    void visitVariableDeclaration(VariableDeclaration* varDecl) {
+        changed.insert(varDecl->identifier);
+        declared.insert(varDecl->identifier);
+        root(varDecl->expression);
+    }
+    void visitPrintStatement(PrintStatement* printStmt) { root(printStmt->expression); }
+    void visitExpressionStatement(ExpressionStatement* exprStmt) { root(exprStmt->expression); }
+    void visitBlockStatement(BlockStatement* block) {
+        for (auto& stmt : block->statements)
+            visit(stmt);
+    }
+    void visitIfStatement(IfStatement* ifStmt) {
+        root(ifStmt->condition);
+        visitBlockStatement(ifStmt->thenBranch);
+        if (ifStmt->elseBranch)
+            visitBlockStatement(ifStmt->elseBranch);
+    }
+    void visitWhileStatement(WhileStatement* whileStmt) {
+        root(whileStmt->condition);
+        nestedLoops++;
+        visitBlockStatement(whileStmt->body);
+        nestedLoops--;
+    }
+    void visitReturnStatement(ReturnStatement* returnStmt) {
+        if (returnStmt->expression)
+            root(returnStmt->expression);
+    }
+    void visitBreakStatement(BreakStatement*) {}
+    void visitContinueStatement(ContinueStatement*) {
+        if (nestedLoops == 0)
+            continues = true;
+    }
+    // Generated functions see no variable of the code around them.
+    void visitFunctionDeclaration(FunctionDeclaration*) {}
+    void visitClassDeclaration(ClassDeclaration*) {}
+
+    // Expressions.
+    void visitNumericLiteral(NumericLiteral*) {}
+    void visitStringLiteral(StringLiteral*) {}
+    void visitIdentifier(Identifier*) {}
+    void visitAssignment(Assignment* assign) {
+        writes[assign->name]++;
+        changed.insert(assign->name);
+        visit(assign->value);
+    }
+    void visitBinaryExpression(BinaryExpression* bin) {
+        visit(bin->left);
+        visit(bin->right);
+    }
+    void visitUnaryExpression(UnaryExpression* unary) { visit(unary->argument); }
+    void visitCallExpression(CallExpression* callExpr) {
+        for (auto& arg : callExpr->arguments)
+            visit(arg);
+    }
+    void visitMemberAccessExpression(MemberAccessExpression* memberAccess) { visit(memberAccess->object); }
+    void visitNewExpression(NewExpression* newExpr) {
+        for (auto& arg : newExpr->arguments)
+            visit(arg);
+    }
+    void visitArrayLiteral(ArrayLiteral* arrayLit) {
+        for (auto& element : arrayLit->elements)
+            visit(element);
+    }
+    void visitIndexExpression(IndexExpression* indexExpr) {
+        visit(indexExpr->array);
+        visit(indexExpr->index);
+    }
+    // Elements are never invariant, so writing one changes no variable.
+    void visitIndexAssignment(IndexAssignment* indexAssign) {
+        visit(indexAssign->array);
+        visit(indexAssign->index);
+        visit(indexAssign->value);
+    }
+    void visitSpawnExpression(SpawnExpression* spawnExpr) { visitCallExpression(spawnExpr->call); }
+    void visitParallelFor(ParallelFor* loop) {
+        visit(loop->from);
+        visit(loop->to);
+    }
+};
+
+// Types of the result and parameters, which an override must repeat.
+static std::string signature(FunctionDeclaration* funcDecl) {
+    std::string text = cppType(funcDecl->returnType) + "(";
+    for (const StaticType& type : funcDecl->paramTypes)
+        text += cppType(type) + ",";
+    return text + ")";
+}
+
+// A variable may hold objects of subclasses of its class, so a method that
+// subclasses override is virtual. Methods of one name are grouped under the
+// highest class declaring it; a group whose signatures differ stays
+// non-virtual, the overrides hiding the method, since C++ would reject them.
+void CodeGenerator::findVirtualMethods(Program* program) {
+    std::unordered_map<Symbol, ClassDeclaration*> classes;
+    for (auto& stmt : program->statements) {
+        if (auto classDecl = nodeCast<ClassDeclaration>(stmt))
+            classes[classDecl->name] = classDecl;
+    }
+    auto declared = [](ClassDeclaration* classDecl, Symbol name) -> FunctionDeclaration* {
+        for (auto& member : classDecl->body->statements) {
+            auto methodDecl = nodeCast<FunctionDeclaration>(member);
+            if (methodDecl && methodDecl->name == name)
+                return methodDecl;
+        }
+        return nullptr;
+    };
+    std::unordered_map<FunctionDeclaration*, std::vector<FunctionDeclaration*>> overrides; // By highest method.
+    for (auto& [name, classDecl] : classes) {
+        for (auto& member : classDecl->body->statements) {
+            auto methodDecl = nodeCast<FunctionDeclaration>(member);
+            if (!methodDecl)
+                continue;
+            FunctionDeclaration* highest = methodDecl;
+            for (auto base = classes.find(classDecl->baseClass); base != classes.end();
+                 base = classes.find(base->second->baseClass)) {
+                if (FunctionDeclaration* found = declared(base->second, methodDecl->name))
+                    highest = found;
+            }
+            if (highest != methodDecl)
+                overrides[highest].push_back(methodDecl);
+        }
+    }
+    virtualMethods.clear();
+    for (auto& [highest, methods] : overrides) {
+        bool same = std::all_of(methods.begin(), methods.end(), [&](FunctionDeclaration* methodDecl) {
+            return signature(methodDecl) == signature(highest);
+        });
+        if (same)
+            virtualMethods.insert(highest);
+    }
 }
 
 // Generates complete C++ code from the MiniLang AST.
 std::string CodeGenerator::generate(Program* program) {
+    TypeInference().infer(program);
+    usesTasks = program->usesTasks;
+    module = program->isModule;
+    findVirtualMethods(program);
+
     std::ostringstream out;
     // Standard includes and built-in functions.
+    out << "#include <cstdint>\n";
     out << "#include <iostream>\n";
+    out << "#include <limits>\n";
+    out << "#include <stdexcept>\n";
     out << "#include <string>\n";
     out << "#include <fstream>\n";
     out << "#include \"Builtins.hpp\"\n\n";
 
+    // Forward declarations for classes, which prototypes may refer to.
+    for (auto& stmt : program->statements) {
+        if (auto classDecl = nodeCast<ClassDeclaration>(stmt))
+            out << "class " << symbolName(classDecl->name) << ";\n";
+    }
+
+    // Functions of imported modules, which are compiled apart and linked in.
+    for (auto funcDecl : program->externs)
+        out << generateFunctionPrototype(funcDecl) << "\n";
     // Forward declarations for functions.
     for (auto& stmt : program->statements) {
-        if (auto funcDecl = dynamic_cast<FunctionDeclaration*>(stmt.get())) {
+        if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt)) {
             out << generateFunctionPrototype(funcDecl) << "\n";
         }
     }
     out << "\n";
     // Generate class definitions.
     for (auto& stmt : program->statements) {
-        if (auto classDecl = dynamic_cast<ClassDeclaration*>(stmt.get())) {
+        if (auto classDecl = nodeCast<ClassDeclaration>(stmt)) {
             out << generateClassDeclaration(classDecl) << "\n\n";
         }
     }
     // Generate function definitions.
     for (auto& stmt : program->statements) {
-        if (auto funcDecl = dynamic_cast<FunctionDeclaration*>(stmt.get())) {
-            out << generateFunctionDefinition(funcDecl) << "\n\n";
+        if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt)) {
+            out << generateFunctionDefinition(funcDecl, false) << "\n\n";
+        }
+    }
+    if (module)
+        return out.str();
+    // Memo tables of imported functions, for --memo-stats.
+    if (options.memoStats) {
+        for (auto funcDecl : program->externs) {
+            if (memoized(funcDecl))
+                out << "extern thread_local MemoTable<" << cppType(funcDecl->returnType) << "> minilang_memo_"
+                    << symbolName(funcDecl->name) << ";\n";
         }
     }
     // Generate main() from remaining (non-function, non-class) statements.
+    // Output buffered before an error is flushed ahead of the message.
     out << "int main() {\n";
+    if (options.lineBuffered)
+        out << "    setLineBuffered(true);\n";
+    out << "    try {\n";
     for (auto& stmt : program->statements) {
-        if (dynamic_cast<FunctionDeclaration*>(stmt.get()) || 
-            dynamic_cast<ClassDeclaration*>(stmt.get()))
+        if (nodeCast<FunctionDeclaration>(stmt) || 
+            nodeCast<ClassDeclaration>(stmt))
             continue;
-        out << generateStatement(stmt.get()) << "\n";
+        out << visit(stmt) << "\n";
+    }
+    // Tasks nobody joined still run to completion.
+    if (usesTasks)
+        out << "    waitAllTasks();\n";
+    out << "    } catch (const std::exception& e) {\n";
+    out << "        flush();\n";
+    out << "        std::cerr << \"Error: \" << e.what() << std::endl;\n";
+    out << "        return 1;\n";
+    out << "    }\n";
+    if (options.memoStats) {
+        std::vector<FunctionDeclaration*> functions(program->externs.begin(), program->externs.end());
+        for (auto& stmt : program->statements) {
+            if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt))
+                functions.push_back(funcDecl);
+        }
+        for (auto funcDecl : functions) {
+            if (memoized(funcDecl))
+                out << "    printMemoStats(\"" << symbolName(funcDecl->name) << "\", minilang_memo_"
+                    << symbolName(funcDecl->name) << ".stats());\n";
+        }
     }
     out << "    return 0;\n";
     out << "}\n";
     return out.str();
 }
 
+std::string CodeGenerator::generateNative(const std::vector<FunctionDeclaration*>& functions) {
+    std::ostringstream out;
+    out << "#include <cstdint>\n";
+    out << "#include <limits>\n\n";
+    out << "namespace minilang_native {\n\n";
+    out << "static void (*print)(double);\n\n";
+    for (FunctionDeclaration* funcDecl : functions)
+        out << generateFunctionPrototype(funcDecl) << "\n";
+    out << "\n";
+    for (FunctionDeclaration* funcDecl : functions)
+        out << generateFunctionDefinition(funcDecl, false) << "\n\n";
+    out << "} // namespace minilang_native\n\n";
+
+    out << "extern \"C\" void minilang_bind(void (*printNumber)(double)) {\n";
+    out << "    minilang_native::print = printNumber;\n";
+    out << "}\n\n";
+    FunctionDeclaration* entry = functions.front();
+    out << "extern \"C\" double minilang_entry(const double* args) {\n";
+    out << "    return minilang_native::" << symbolName(entry->name) << "(";
+    for (size_t i = 0; i < entry->params.size(); i++)
+        out << (i > 0 ? ", " : "") << "args[" << i << "]";
+    out << ");\n";
+    out << "}\n";
+    return out.str();
+}
+
 std::string CodeGenerator::generateFunctionPrototype(FunctionDeclaration* funcDecl) {
     std::ostringstream out;
-    std::string retType = determineFunctionReturnType(funcDecl);
-    out << retType << " " << funcDecl->name << "(";
-    bool first = true;
-    for (auto& param : funcDecl->params) {
-        if (!first)
-            out << ", ";
-        out << determineParameterType(funcDecl) << " " << param;
-        first = false;
-    }
-    out << ");";
+    out << cppType(funcDecl->returnType) << " " << symbolName(funcDecl->name) << "("
+        << generateParameters(funcDecl, true) << ");";
     return out.str();
 }
 
-std::string CodeGenerator::generateFunctionDefinition(FunctionDeclaration* funcDecl) {
+// Missing arguments default to 0 in MiniLang, which {} stands for. Defaults
+// go on the first declaration: the prototype, or the definition of a method.
+// Parameters have no inferred type in native tier code; they are doubles.
+std::string CodeGenerator::generateParameters(FunctionDeclaration* funcDecl, bool withDefaults) {
+    std::string out;
+    for (size_t i = 0; i < funcDecl->params.size(); i++) {
+        if (i > 0)
+            out += ", ";
+        StaticType type = i < funcDecl->paramTypes.size() ? funcDecl->paramTypes[i] : StaticType();
+        out += cppType(type) + " " + std::string(symbolName(funcDecl->params[i]));
+        if (withDefaults)
+            out += " = {}";
+    }
+    return out;
+}
+
+// A memoized function looks its arguments up in a MemoTable of its own and
+// runs its body, as a lambda, only on a miss.
+std::string CodeGenerator::generateFunctionDefinition(FunctionDeclaration* funcDecl, bool method) {
+    function = method ? nullptr : funcDecl;
+    selfTailCall = false;
+    inMethod = method;
+    std::string body = generateBlockBody(funcDecl->body);
+    function = nullptr;
+    inMethod = false;
+    std::string returnType = cppType(funcDecl->returnType);
+    std::string name(symbolName(funcDecl->name));
     std::ostringstream out;
-    std::string retType = determineFunctionReturnType(funcDecl);
-    out << retType << " " << funcDecl->name << "(";
-    bool first = true;
-    for (auto& param : funcDecl->params) {
-        if (!first)
-            out << ", ";
-        out << determineParameterType(funcDecl) << " " << param;
-        first = false;
+    bool memo = !method && memoized(funcDecl);
+    if (memo) {
+        // The tables of a module are linked to the program's main() for
+        // --memo-stats, and the program may call the module from tasks.
+        const char* table = module ? "thread_local MemoTable<" : usesTasks ? "static thread_local MemoTable<" : "static MemoTable<";
+        out << table << returnType << "> minilang_memo_" << name << "(" << funcDecl->params.size() << ");\n";
     }
-    out << ") {\n";
-    out << generateStatement(funcDecl->body.get()) << "\n";
-    out << "}";
+    if (virtualMethods.count(funcDecl))
+        out << "virtual ";
+    out << returnType << " " << name << "(" << generateParameters(funcDecl, method) << ") {\n";
+    if (memo) {
+        out << "    const uint64_t minilang_key[] = {";
+        for (size_t i = 0; i < funcDecl->params.size(); i++)
+            out << (i > 0 ? ", " : "") << "memoKey(" << symbolName(funcDecl->params[i]) << ")";
+        out << "};\n";
+        out << "    if (const " << returnType << "* hit = minilang_memo_" << name << ".find(minilang_key))\n";
+        out << "        return *hit;\n";
+        out << "    return minilang_memo_" << name << ".store(minilang_key, [&]() -> " << returnType << " {\n";
+    }
+    if (selfTailCall)
+        out << "tail_call:\n";
+    out << body;
+    // Falling off the end of a MiniLang function returns 0.
+    if (!TypeInference::alwaysReturns(funcDecl->body))
+        out << "    return 0;\n";
+    if (memo)
+        out << "    }());\n";
+    out << "\n}";
     return out.str();
 }
 
+// Keys are numbers; native tier code has no inferred types, and the
+// interpreter caches its results instead. Arrays change in place, so their
+// elements cannot be part of a key; neither can tasks.
+bool CodeGenerator::memoized(FunctionDeclaration* funcDecl) {
+    if (!funcDecl->memoize || funcDecl->paramTypes.size() != funcDecl->params.size())
+        return false;
+    return std::all_of(funcDecl->paramTypes.begin(), funcDecl->paramTypes.end(), [](StaticType type) {
+        return type.kind != TypeKind::STRING && type.kind != TypeKind::OBJECT && type.kind != TypeKind::ARRAY &&
+               type.kind != TypeKind::TASK;
+    });
+}
+
 std::string CodeGenerator::generateClassDeclaration(ClassDeclaration* classDecl) {
     std::ostringstream out;
-    if (classDecl->baseClass.empty())
-        out << "class " << classDecl->name << " {\n";
+    if (classDecl->baseClass == Symbols::NONE)
+        out << "class " << symbolName(classDecl->name) << " {\n";
     else
-        out << "class " << classDecl->name << " : public " << classDecl->baseClass << " {\n";
+        out << "class " << symbolName(classDecl->name) << " : public " << symbolName(classDecl->baseClass) << " {\n";
     out << "public:\n";
-    out << generateClassBody(classDecl->body.get());
+    out << generateClassBody(classDecl->body);
     out << "\n};";
     return out.str();
 }
@@ -113,15 +545,13 @@ std::string CodeGenerator::generateClassBody(BlockStatement* body) {
     std::ostringstream out;
     for (auto& stmt : body->statements) {
         // Field declarations.
-        if (auto varDecl = dynamic_cast<VariableDeclaration*>(stmt.get())) {
-            if (isStringLiteral(varDecl->expression.get()))
-                out << "    std::string " << varDecl->identifier << " = " << generateExpression(varDecl->expression.get()) << ";\n";
-            else
-                out << "    int " << varDecl->identifier << " = " << generateExpression(varDecl->expression.get()) << ";\n";
+        if (auto varDecl = nodeCast<VariableDeclaration>(stmt)) {
+            out << "    " << cppType(varDecl->type) << " " << symbolName(varDecl->identifier) << " = "
+                << visit(varDecl->expression) << ";\n";
         }
         // Method declarations.
-        else if (auto funcDecl = dynamic_cast<FunctionDeclaration*>(stmt.get())) {
-            out << "    " << generateFunctionDefinition(funcDecl) << "\n";
+        else if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt)) {
+            out << "    " << generateFunctionDefinition(funcDecl, true) << "\n";
         }
         else {
             throw std::runtime_error("Unknown statement type in class body.");
@@ -130,82 +560,397 @@ std::string CodeGenerator::generateClassBody(BlockStatement* body) {
     return out.str();
 }
 
-std::string CodeGenerator::generateStatement(Statement* stmt) {
+// let x = x + 1 in a nested scope reads the outer x, which C++ would not:
+// the initializer goes to a temporary first.
+std::string CodeGenerator::visitVariableDeclaration(VariableDeclaration* varDecl) {
+    declaring = varDecl->identifier;
+    readsShadowed = false;
+    std::string value = visit(varDecl->expression);
+    std::string type = cppType(varDecl->type);
+    std::string name(symbolName(varDecl->identifier));
+    std::string code;
+    if (readsShadowed) {
+        std::string temp = "minilang_shadowed" + std::to_string(loopTemps++);
+        code = "    " + type + " " + temp + " = " + value + ";\n";
+        value = temp;
+    }
+    declaring = Symbols::NONE;
+    return code + "    " + type + " " + name + " = " + value + ";";
+}
+
+std::string CodeGenerator::visitPrintStatement(PrintStatement* printStmt) {
+    return "    print(" + numberAsDouble(printStmt->expression) + ");";
+}
+
+std::string CodeGenerator::visitExpressionStatement(ExpressionStatement* exprStmt) {
+    return "    " + visit(exprStmt->expression) + ";";
+}
+
+std::string CodeGenerator::visitReturnStatement(ReturnStatement* returnStmt) {
+    auto callExpr = nodeCast<CallExpression>(returnStmt->expression);
+    auto calleeId = callExpr ? nodeCast<Identifier>(callExpr->callee) : nullptr;
+    if (function && calleeId && calleeId->name == function->name &&
+        callExpr->arguments.size() <= function->params.size())
+        return generateSelfTailCall(callExpr);
+    return "    return " + (returnStmt->expression ? visit(returnStmt->expression) : "0") + ";";
+}
+
+// return f(...) inside f becomes a jump back to the start of f with the
+// arguments as the new parameters, so that tail recursion runs in constant
+// stack even where the C++ compiler would not eliminate the call. All
+// arguments are evaluated before any parameter changes.
+std::string CodeGenerator::generateSelfTailCall(CallExpression* callExpr) {
+    selfTailCall = true;
+    std::ostringstream out;
+    out << "    {\n";
+    for (size_t i = 0; i < callExpr->arguments.size(); i++) {
+        StaticType type = i < function->paramTypes.size() ? function->paramTypes[i] : StaticType();
+        out << "    " << cppType(type) << " minilang_arg" << i << " = " << visit(callExpr->arguments[i]) << ";\n";
+    }
+    for (size_t i = 0; i < function->params.size(); i++) {
+        out << "    " << symbolName(function->params[i]) << " = ";
+        if (i < callExpr->arguments.size())
+            out << "minilang_arg" << i << ";\n";
+        else
+            out << "{};\n";
+    }
+    out << "    goto tail_call;\n";
+    out << "    }";
+    return out.str();
+}
+
+std::string CodeGenerator::visitIfStatement(IfStatement* ifStmt) {
+    std::ostringstream out;
+    out << "    if (" << condition(ifStmt->condition) << ") {\n";
+    out << generateBlockBody(ifStmt->thenBranch) << "\n    }";
+    if (ifStmt->elseBranch) {
+        out << " else {\n";
+        out << generateBlockBody(ifStmt->elseBranch) << "\n    }";
+    }
+    return out.str();
+}
+
+// Statements of a body whose braces the caller emits.
+std::string CodeGenerator::generateBlockBody(BlockStatement* block) {
+    std::ostringstream out;
+    for (auto& s : block->statements) {
+        out << visit(s) << "\n";
+    }
+    return out.str();
+}
+
+// A block standing alone as a statement keeps its own C++ scope.
+std::string CodeGenerator::visitBlockStatement(BlockStatement* blockStmt) {
+    return "    {\n" + generateBlockBody(blockStmt) + "    }";
+}
+
+std::string CodeGenerator::visitWhileStatement(WhileStatement* whileStmt) {
+    if (options.optimizeLoops && !inMethod)
+        return generateLoop(whileStmt);
+    std::ostringstream out;
+    out << "    while (" << condition(whileStmt->condition) << ") {\n";
+    out << generateBlockBody(whileStmt->body) << "\n    }";
+    return out.str();
+}
+
+// An optimized loop sits in a block of its own that first computes its
+// invariant expressions, and the starting values of the strength-reduced
+// products of a counted loop. A counted loop becomes a for loop that steps
+// its counter, so that the C++ compiler sees a canonical loop with a known
+// trip count. A product counter * k becomes an integer that grows by
+// step * k each iteration. Converted to a double, the exact product rounds
+// like the product of the doubles, so the results are the same; once the
+// integer would overflow, or if k is too large to be exact as a double, the
+// product is computed as doubles instead, for the rest of the loop.
+std::string CodeGenerator::generateLoop(WhileStatement* whileStmt) {
+    LoopAnalysis loop(whileStmt);
+    std::vector<Expression*> own; // Replaced by this loop.
+    std::ostringstream setup;
+    for (Expression* expr : loop.invariants()) {
+        if (replaced.count(expr))
+            continue;
+        own.push_back(expr);
+        std::string name = "minilang_loop" + std::to_string(loopTemps++);
+        setup << "    const " << cppType({expr->type}) << " " << name << " = " << visit(expr) << ";\n";
+        replaced.emplace(expr, name);
+    }
+    std::ostringstream step;
+    std::vector<Statement*> body(whileStmt->body->statements.begin(), whileStmt->body->statements.end());
+    if (loop.counter) {
+        std::string counter(symbolName(loop.counter->name));
+        step << counter << (loop.step > 0 ? " += " : " -= ") << (loop.step > 0 ? loop.step : -loop.step);
+        for (BinaryExpression* product : loop.counterProducts()) {
+            Expression* factor = nodeCast<Identifier>(product->left) &&
+                                         static_cast<Identifier*>(product->left)->name == loop.counter->name
+                                     ? product->right
+                                     : product->left;
+            std::string name = "minilang_loop" + std::to_string(loopTemps++);
+            std::string k = "static_cast<int64_t>(" + visit(factor) + ")";
+            setup << "    int64_t " << name << " = 0;\n";
+            setup << "    int64_t " << name << "_step = 0;\n";
+            setup << "    bool " << name << "_wide = " << k << " > (int64_t(1) << 53) || " << k
+                  << " < -(int64_t(1) << 53) ||\n";
+            setup << "        __builtin_mul_overflow(static_cast<int64_t>(" << counter << "), " << k << ", &" << name
+                  << ") ||\n";
+            setup << "        __builtin_mul_overflow(static_cast<int64_t>(" << loop.step << "), " << k << ", &" << name
+                  << "_step);\n";
+            step << ", " << name << "_wide = " << name << "_wide || __builtin_add_overflow(" << name << ", " << name
+                 << "_step, &" << name << ")";
+            own.push_back(product);
+            replaced.emplace(product, "(" + name + "_wide ? static_cast<double>(" + counter +
+                                          ") * static_cast<double>(" + visit(factor) +
+                                          ") : static_cast<double>(" + name + "))");
+        }
+        body.pop_back();
+    }
+
+    std::ostringstream out;
+    std::string text = setup.str();
+    if (!text.empty())
+        out << "    {\n" << text;
+    if (loop.counter)
+        out << "    for (; " << condition(whileStmt->condition) << "; " << step.str() << ") {\n";
+    else
+        out << "    while (" << condition(whileStmt->condition) << ") {\n";
+    for (Statement* stmt : body)
+        out << visit(stmt) << "\n";
+    out << "\n    }";
+    if (!text.empty())
+        out << "\n    }";
+    for (Expression* expr : own)
+        replaced.erase(expr);
+    return out.str();
+}
+
+std::string CodeGenerator::visitBreakStatement(BreakStatement*) {
+    return "    break;";
+}
+
+std::string CodeGenerator::visitContinueStatement(ContinueStatement*) {
+    return "    continue;";
+}
+
+// Whole numbers print as integers; other values with the fewest digits that
+// read back as the same double.
+std::string CodeGenerator::visitNumericLiteral(NumericLiteral* num) {
+    double value = num->value;
+    if (num->type == TypeKind::INTEGER)
+        return std::to_string(static_cast<int64_t>(value));
+    if (std::isnan(value))
+        return std::signbit(value) ? "(-std::numeric_limits<double>::quiet_NaN())"
+                                   : "std::numeric_limits<double>::quiet_NaN()";
+    if (std::isinf(value))
+        return value < 0 ? "(-std::numeric_limits<double>::infinity())" : "std::numeric_limits<double>::infinity()";
+    std::string text;
+    for (int precision = 15; precision <= 17; precision++) {
+        std::ostringstream out;
+        out.precision(precision);
+        out << value;
+        text = out.str();
+        if (std::strtod(text.c_str(), nullptr) == value)
+            break;
+    }
+    if (text.find_first_of(".e") == std::string::npos)
+        text += ".0";
+    return value < 0 ? "(" + text + ")" : text;
+}
+
+std::string CodeGenerator::visitStringLiteral(StringLiteral* str) {
+    return "\"" + std::string(str->value) + "\"";
+}
+
+std::string CodeGenerator::visitIdentifier(Identifier* id) {
+    if (id->name == declaring)
+        readsShadowed = true;
+    return std::string(symbolName(id->name));
+}
+
+// With loop optimizations, x = x + e becomes x += e: reductions in the shape
+// the C++ compiler vectorizes, and strings appended in place.
+std::string CodeGenerator::visitAssignment(Assignment* assign) {
+    if (assign->name == declaring)
+        readsShadowed = true;
+    std::string name(symbolName(assign->name));
+    auto bin = nodeCast<BinaryExpression>(assign->value);
+    auto left = bin ? nodeCast<Identifier>(bin->left) : nullptr;
+    if (options.optimizeLoops && left && left->name == assign->name && !replaced.count(bin)) {
+        if (bin->type == TypeKind::STRING)
+            return name + " += " + stringOperand(bin->right, false);
+        if (bin->op == BinaryOp::ADD || bin->op == BinaryOp::SUBTRACT || bin->op == BinaryOp::MULTIPLY)
+            return name + " " + operatorText(bin->op) + "= " + numberOperand(bin->right);
+    }
+    return name + " = " + visit(assign->value);
+}
+
+std::string CodeGenerator::visit(Expression* expr) {
+    if (!replaced.empty()) {
+        auto it = replaced.find(expr);
+        if (it != replaced.end())
+            return it->second;
+    }
+    return ASTVisitor::visit(expr);
+}
+
+std::string CodeGenerator::visitBinaryExpression(BinaryExpression* bin) {
+    if (bin->type == TypeKind::STRING)
+        return "(" + stringOperand(bin->left, true) + " + " + stringOperand(bin->right, false) + ")";
+    std::string leftText = numberOperand(bin->left);
+    std::string rightText = numberOperand(bin->right);
+    // Products, quotients and unbounded sums are doubles even for whole
+    // operands, as at runtime.
+    if (bin->type == TypeKind::NUMBER && bin->left->type == TypeKind::INTEGER)
+        leftText = "static_cast<double>(" + leftText + ")";
+    // Keep sums of whole literals from overflowing int.
+    else if (bin->type == TypeKind::INTEGER && isIntegerLiteral(bin->left))
+        leftText = "static_cast<int64_t>(" + leftText + ")";
+    return "(" + leftText + " " + operatorText(bin->op) + " " + rightText + ")";
+}
+
+std::string CodeGenerator::visitUnaryExpression(UnaryExpression* unary) {
+    return std::string("(") + operatorText(unary->op) + numberOperand(unary->argument) + ")";
+}
+
+// The array, join and line stream built-ins are functions of Builtins.hpp
+// with other names, so that they cannot clash with functions of the program.
+static const char* builtInFunction(Symbol name) {
+    switch (name) {
+        case Symbols::ARRAY: return "newArray";
+        case Symbols::LEN: return "arrayLength";
+        case Symbols::SUM: return "arraySum";
+        case Symbols::DOT: return "arrayDot";
+        case Symbols::SCALE: return "arrayScale";
+        case Symbols::ADD: return "arrayAdd";
+        case Symbols::MIN: return "arrayMin";
+        case Symbols::MAX: return "arrayMax";
+        case Symbols::SORT: return "arraySort";
+        case Symbols::JOIN: return "joinTask";
+        case Symbols::OPEN_LINES: return "fileOpenLines";
+        case Symbols::HAS_LINE: return "fileHasLine";
+        case Symbols::NEXT_LINE: return "fileNextLine";
+        case Symbols::OPEN_WRITER: return "fileOpenWriter";
+        case Symbols::WRITE: return "fileWrite";
+        case Symbols::CLOSE: return "fileClose";
+        default: throw std::runtime_error("Undefined built-in function: " + std::string(symbolName(name)));
+    }
+}
+
+std::string CodeGenerator::visitCallExpression(CallExpression* callExpr) {
     std::ostringstream out;
-    if (auto varDecl = dynamic_cast<VariableDeclaration*>(stmt)) {
-        out << "    auto " << varDecl->identifier << " = " << generateExpression(varDecl->expression.get()) << ";";
-    } else if (auto printStmt = dynamic_cast<PrintStatement*>(stmt)) {
-        out << "    std::cout << " << generateExpression(printStmt->expression.get()) << " << std::endl;";
-    } else if (auto exprStmt = dynamic_cast<ExpressionStatement*>(stmt)) {
-        out << "    " << generateExpression(exprStmt->expression.get()) << ";";
-    } else if (auto returnStmt = dynamic_cast<ReturnStatement*>(stmt)) {
-        out << "    return " << (returnStmt->expression ? generateExpression(returnStmt->expression.get()) : "0") << ";";
-    } else if (auto ifStmt = dynamic_cast<IfStatement*>(stmt)) {
-        out << "    if (" << generateExpression(ifStmt->condition.get()) << ") {\n";
-        out << generateStatement(ifStmt->thenBranch.get()) << "\n    }";
-        if (ifStmt->elseBranch) {
-            out << " else {\n";
-            out << generateStatement(ifStmt->elseBranch.get()) << "\n    }";
-        }
-    } else if (auto blockStmt = dynamic_cast<BlockStatement*>(stmt)) {
-        for (auto& s : blockStmt->statements) {
-            out << generateStatement(s.get()) << "\n";
-        }
-    } else if (auto whileStmt = dynamic_cast<WhileStatement*>(stmt)) {
-        out << "    while (" << generateExpression(whileStmt->condition.get()) << ") {\n";
-        out << generateStatement(whileStmt->body.get()) << "\n    }";
-    } else {
-        throw std::runtime_error("Unknown statement type in code generator.");
+    if (callExpr->builtIn)
+        out << builtInFunction(static_cast<Identifier*>(callExpr->callee)->name) << "(";
+    else
+        out << visit(callExpr->callee) << "(";
+    bool first = true;
+    for (auto& arg : callExpr->arguments) {
+        if (!first)
+            out << ", ";
+        out << visit(arg);
+        first = false;
     }
+    out << ")";
     return out.str();
 }
 
-std::string CodeGenerator::generateExpression(Expression* expr) {
+std::string CodeGenerator::visitMemberAccessExpression(MemberAccessExpression* memberAccess) {
+    // Use arrow operator for member access.
+    return visit(memberAccess->object) + "->" + std::string(symbolName(memberAccess->member));
+}
+
+std::string CodeGenerator::visitNewExpression(NewExpression* newExpr) {
     std::ostringstream out;
-    if (auto num = dynamic_cast<NumericLiteral*>(expr)) {
-        out << static_cast<int>(num->value);
-    } else if (auto str = dynamic_cast<StringLiteral*>(expr)) {
-        out << "\"" << str->value << "\"";
-    } else if (auto id = dynamic_cast<Identifier*>(expr)) {
-        out << id->name;
-    } else if (auto assign = dynamic_cast<Assignment*>(expr)) {
-        out << assign->name << " = " << generateExpression(assign->value.get());
-    } else if (auto bin = dynamic_cast<BinaryExpression*>(expr)) {
-        std::string leftText = generateExpression(bin->left.get());
-        std::string rightText = generateExpression(bin->right.get());
-        // For binary plus, if the left operand is a string literal, use std::string concatenation.
-        if (bin->op == "+" && leftText.size() >= 2 && leftText.front() == '\"' && leftText.back() == '\"') {
-            out << "std::string(" << leftText << ") + " << rightText;
-        } else {
-            out << "(" << leftText << " " << bin->op << " " << rightText << ")";
-        }
-    } else if (auto unary = dynamic_cast<UnaryExpression*>(expr)) {
-        out << "(" << unary->op << generateExpression(unary->argument.get()) << ")";
-    } else if (auto callExpr = dynamic_cast<CallExpression*>(expr)) {
-        out << generateExpression(callExpr->callee.get()) << "(";
-        bool first = true;
-        for (auto& arg : callExpr->arguments) {
-            if (!first)
-                out << ", ";
-            out << generateExpression(arg.get());
-            first = false;
-        }
-        out << ")";
-    } else if (auto memberAccess = dynamic_cast<MemberAccessExpression*>(expr)) {
-        // Use arrow operator for member access.
-        out << generateExpression(memberAccess->object.get()) << "->" << memberAccess->member;
-    } else if (auto newExpr = dynamic_cast<NewExpression*>(expr)) {
-        out << "new " << newExpr->className << "(";
-        bool first = true;
-        for (auto& arg : newExpr->arguments) {
-            if (!first)
-                out << ", ";
-            out << generateExpression(arg.get());
-            first = false;
-        }
-        out << ")";
-    } else {
-        throw std::runtime_error("Unknown expression type in code generator.");
+    out << "new " << symbolName(newExpr->className) << "(";
+    bool first = true;
+    for (auto& arg : newExpr->arguments) {
+        if (!first)
+            out << ", ";
+        out << visit(arg);
+        first = false;
     }
+    out << ")";
     return out.str();
-}
\ No newline at end of file
+}
+
+std::string CodeGenerator::visitArrayLiteral(ArrayLiteral* arrayLit) {
+    std::ostringstream out;
+    out << "Array{";
+    bool first = true;
+    for (auto& element : arrayLit->elements) {
+        if (!first)
+            out << ", ";
+        out << numberAsDouble(element);
+        first = false;
+    }
+    out << "}";
+    return out.str();
+}
+
+std::string CodeGenerator::visitIndexExpression(IndexExpression* indexExpr) {
+    return visit(indexExpr->array) + "[" + visit(indexExpr->index) + "]";
+}
+
+std::string CodeGenerator::visitIndexAssignment(IndexAssignment* indexAssign) {
+    return "(" + visit(indexAssign->array) + "[" + visit(indexAssign->index) + "] = " + visit(indexAssign->value) + ")";
+}
+
+// The arguments are evaluated, and arrays copied, by the spawner; the task
+// gets the copies as captures of its lambda. The function is named with ::
+// so that a method of the same name cannot hide it.
+std::string CodeGenerator::visitSpawnExpression(SpawnExpression* spawnExpr) {
+    CallExpression* callExpr = spawnExpr->call;
+    std::string result = cppType({spawnExpr->result});
+    std::ostringstream captures;
+    std::ostringstream args;
+    for (size_t i = 0; i < callExpr->arguments.size(); i++) {
+        captures << (i > 0 ? ", " : "") << "minilang_arg" << i << " = taskCopy(" << visit(callExpr->arguments[i])
+                 << ")";
+        args << (i > 0 ? ", " : "") << "minilang_arg" << i;
+    }
+    return "Task<" + result + ">([" + captures.str() + "]() -> " + result + " { return ::" +
+           std::string(symbolName(static_cast<Identifier*>(callExpr->callee)->name)) + "(" + args.str() + "); })";
+}
+
+std::string CodeGenerator::visitParallelFor(ParallelFor* loop) {
+    return "parallelMap(" + visit(loop->from) + ", " + visit(loop->to) +
+           ", [](int64_t minilang_index) -> double { return ::" + std::string(symbolName(loop->function)) +
+           "(minilang_index); })";
+}
+// Numbers print and concatenate the way the interpreters format doubles.
+std::string CodeGenerator::numberAsDouble(Expression* expr) {
+    if (expr->type == TypeKind::INTEGER)
+        return "static_cast<double>(" + visit(expr) + ")";
+    return visit(expr);
+}
+
+// An operand of a string concatenation. Numbers are formatted with
+// std::to_string, arrays as print shows them, and the left operand is made a
+// std::string so that + appends.
+std::string CodeGenerator::stringOperand(Expression* expr, bool left) {
+    if (expr->type == TypeKind::INTEGER || expr->type == TypeKind::NUMBER)
+        return "std::to_string(" + numberAsDouble(expr) + ")";
+    if (expr->type == TypeKind::ARRAY)
+        return "arrayText(" + visit(expr) + ")";
+    if (expr->type == TypeKind::TASK)
+        return "taskText(" + visit(expr) + ")";
+    if (left && isStringLiteral(expr))
+        return "std::string(" + visit(expr) + ")";
+    return visit(expr);
+}
+
+// Arithmetic treats strings, arrays and tasks as 0; the operand is still
+// evaluated.
+std::string CodeGenerator::numberOperand(Expression* expr) {
+    if (expr->type != TypeKind::STRING && expr->type != TypeKind::ARRAY && expr->type != TypeKind::TASK)
+        return visit(expr);
+    if (isStringLiteral(expr))
+        return "0.0";
+    return "(static_cast<void>(" + visit(expr) + "), 0.0)";
+}
+
+// Strings are true when not empty, arrays and tasks always.
+std::string CodeGenerator::condition(Expression* expr) {
+    if (expr->type == TypeKind::STRING)
+        return "!" + visit(expr) + ".empty()";
+    if (expr->type == TypeKind::ARRAY || expr->type == TypeKind::TASK)
+        return "(static_cast<void>(" + visit(expr) + "), true)";
+    return visit(expr);
+}
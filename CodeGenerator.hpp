@@ -2,19 +2,110 @@
 #define CODEGENERATOR_HPP
 
 #include "AST.hpp"
+#include "ASTVisitor.hpp"
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
-class CodeGenerator {
+struct CodeGenOptions {
+    // Write out every printed line at once, even when output is not a
+    // terminal.
+    bool lineBuffered = false;
+    // Report the hit rate of each memoized function at exit.
+    bool memoStats = false;
+    // Emit counted loops as for loops, hoist loop-invariant expressions out
+    // of loops and strength-reduce products of the loop counter.
+    bool optimizeLoops = true;
+};
+
+class CodeGenerator : private ASTVisitor<CodeGenerator, std::string> {
 public:
-    // Generates complete C++ source code from a MiniLang program.
+    static constexpr const char* PASS_NAME = "code generator";
+
+    explicit CodeGenerator(const CodeGenOptions& options = CodeGenOptions()) : options(options) {}
+
+    // Generates complete C++ source code from a MiniLang program. A module
+    // (Program::isModule) gets its functions only, with no main().
     std::string generate(Program* program);
+
+    // Generates a shared object for the NativeTier from functions that use
+    // numbers only. extern "C" minilang_entry runs the first function on an
+    // array of arguments; minilang_bind routes print to the caller's output.
+    std::string generateNative(const std::vector<FunctionDeclaration*>& functions);
+
+    // Whether the generated function caches its results, in a table named
+    // minilang_memo_ and the function's name.
+    static bool memoized(FunctionDeclaration* funcDecl);
 private:
+    class LoopAnalysis;
+
+    CodeGenOptions options;
+    // Function being generated, whose calls to itself in tail position jump
+    // back to its start; null in methods, which overrides may replace.
+    FunctionDeclaration* function = nullptr;
+    bool selfTailCall = false; // function has such a call.
+    bool inMethod = false;     // Loops in methods may change fields through calls.
+    // Text that replaces an expression inside the loops being generated: a
+    // hoisted invariant or a strength-reduced product, by node.
+    std::unordered_map<Expression*, std::string> replaced;
+    int loopTemps = 0; // Numbers the temporaries of generated code.
+    // Variable being declared, and whether its initializer reads the variable
+    // it shadows, which the new C++ variable would hide.
+    Symbol declaring = Symbols::NONE;
+    bool readsShadowed = false;
+    // Tasks may call memoized functions at once, so each thread keeps its
+    // own tables.
+    bool usesTasks = false;
+    bool module = false; // Generating a module compiled on its own.
+    std::unordered_set<FunctionDeclaration*> virtualMethods;
+
+    void findVirtualMethods(Program* program);
+
     std::string generateFunctionPrototype(FunctionDeclaration* funcDecl);
-    std::string generateFunctionDefinition(FunctionDeclaration* funcDecl);
+    std::string generateFunctionDefinition(FunctionDeclaration* funcDecl, bool method);
+    std::string generateSelfTailCall(CallExpression* callExpr);
+    std::string generateParameters(FunctionDeclaration* funcDecl, bool withDefaults);
     std::string generateClassDeclaration(ClassDeclaration* classDecl);
     std::string generateClassBody(BlockStatement* body);
-    std::string generateStatement(Statement* stmt);
-    std::string generateExpression(Expression* expr);
+    std::string generateBlockBody(BlockStatement* block);
+    std::string numberAsDouble(Expression* expr);
+    std::string numberOperand(Expression* expr);
+    std::string stringOperand(Expression* expr, bool left);
+    std::string condition(Expression* expr);
+
+    friend class ASTVisitor<CodeGenerator, std::string>;
+
+    using ASTVisitor::visit;
+    std::string visit(Expression* expr);
+    std::string generateLoop(WhileStatement* whileStmt);
+
+    // Statements.
+    std::string visitVariableDeclaration(VariableDeclaration* varDecl);
+    std::string visitPrintStatement(PrintStatement* printStmt);
+    std::string visitExpressionStatement(ExpressionStatement* exprStmt);
+    std::string visitReturnStatement(ReturnStatement* returnStmt);
+    std::string visitIfStatement(IfStatement* ifStmt);
+    std::string visitBlockStatement(BlockStatement* blockStmt);
+    std::string visitWhileStatement(WhileStatement* whileStmt);
+    std::string visitBreakStatement(BreakStatement* breakStmt);
+    std::string visitContinueStatement(ContinueStatement* continueStmt);
+
+    // Expressions.
+    std::string visitNumericLiteral(NumericLiteral* num);
+    std::string visitStringLiteral(StringLiteral* str);
+    std::string visitIdentifier(Identifier* id);
+    std::string visitAssignment(Assignment* assign);
+    std::string visitBinaryExpression(BinaryExpression* bin);
+    std::string visitUnaryExpression(UnaryExpression* unary);
+    std::string visitCallExpression(CallExpression* callExpr);
+    std::string visitMemberAccessExpression(MemberAccessExpression* memberAccess);
+    std::string visitNewExpression(NewExpression* newExpr);
+    std::string visitArrayLiteral(ArrayLiteral* arrayLit);
+    std::string visitIndexExpression(IndexExpression* indexExpr);
+    std::string visitIndexAssignment(IndexAssignment* indexAssign);
+    std::string visitSpawnExpression(SpawnExpression* spawnExpr);
+    std::string visitParallelFor(ParallelFor* loop);
 };
 
 #endif // CODEGENERATOR_HPP
\ No newline at end of file
@@ -1,205 +1,868 @@
 #include "Interpreter.hpp"
-#include <iostream>
+#include "Builtins.hpp"
+#include <algorithm>
 #include <stdexcept>
-#include <fstream>
-#include <sstream>
 
-Interpreter::Interpreter() {
-    environments.emplace_back(); // Global environment.
+// Checking on a compilation costs a system call; a function still being
+// compiled does so once every this many calls and back-edges.
+static constexpr unsigned POLL_INTERVAL = 256;
+
+Interpreter::Interpreter(bool tiered) {
+    if (tiered)
+        nativeTier = std::make_unique<NativeTier>();
+}
+
+// Tasks run without native code. Each has memo tables of its own, which
+// allocate their slots on the first store.
+Interpreter::Interpreter(std::shared_ptr<const TaskContext> context) : context(std::move(context)), worker(true) {
+    functions.resize(this->context->functions.size());
+    for (size_t i = 0; i < functions.size(); i++) {
+        FunctionDeclaration* funcDecl = this->context->functions[i];
+        functions[i].decl = funcDecl;
+        if (funcDecl && funcDecl->memoize)
+            functions[i].memo = std::make_unique<MemoTable<Value>>(funcDecl->params.size());
+    }
+    shapes = this->context->shapes;
+    caches.assign(this->context->caches, InlineCache());
+}
+
+// The tasks may still use the program. A task does not wait: it would wait
+// for itself.
+Interpreter::~Interpreter() {
+    if (spawned && !worker)
+        waitAllTasks();
 }
 
 void Interpreter::interpret(Program* program) {
-    // First pass: register function declarations.
+    resolver.resolve(program);
+    context = nullptr;
+    stack.assign(program->frameSize, Value());
+    globalDefined.assign(program->frameSize, false);
+    frameBase = 0;
+    callDepth = 0;
+    receiver = nullptr;
+    // First pass: register function and class declarations.
+    functions.clear();
+    functions.resize(SymbolTable::global().size());
+    shapes.clear();
+    shapes.resize(SymbolTable::global().size());
+    std::vector<ClassDeclaration*> classes;
     for (auto& stmt : program->statements) {
-        if (auto funcDecl = dynamic_cast<FunctionDeclaration*>(stmt.get()))
-            functions[funcDecl->name] = funcDecl;
+        if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt)) {
+            functions[funcDecl->name].decl = funcDecl;
+            if (funcDecl->memoize)
+                functions[funcDecl->name].memo = std::make_unique<MemoTable<Value>>(funcDecl->params.size());
+        } else if (auto classDecl = nodeCast<ClassDeclaration>(stmt))
+            classes.push_back(classDecl);
+    }
+    // A base class may be declared after its subclasses; the Resolver has
+    // made sure that every base exists and that there is no cycle.
+    while (!classes.empty()) {
+        auto ready = [this](ClassDeclaration* classDecl) {
+            return classDecl->baseClass == Symbols::NONE || shapes[classDecl->baseClass];
+        };
+        auto next = std::find_if(classes.begin(), classes.end(), ready);
+        defineClass(*next);
+        classes.erase(next);
     }
-    // Execute non-function statements.
+    caches.assign(resolver.inlineCacheCount(), InlineCache());
+    cacheHits = 0;
+    cacheMisses = 0;
+    // Execute the other statements; a top-level return ends the program.
     for (auto& stmt : program->statements) {
-        if (dynamic_cast<FunctionDeclaration*>(stmt.get()))
+        if (stmt->kind == NodeKind::FUNCTION_DECLARATION || stmt->kind == NodeKind::CLASS_DECLARATION)
             continue;
-        execute(stmt.get());
-    }
-}
-
-void Interpreter::execute(Statement* stmt) {
-    if (auto varDecl = dynamic_cast<VariableDeclaration*>(stmt)) {
-        Value value = visit(varDecl->expression.get());
-        declareVariable(varDecl->identifier, value);
-    } else if (auto printStmt = dynamic_cast<PrintStatement*>(stmt)) {
-        Value value = visit(printStmt->expression.get());
-        if (value.type == Value::NUMBER)
-            std::cout << value.numberValue << std::endl;
-        else
-            std::cout << value.stringValue << std::endl;
-    } else if (auto exprStmt = dynamic_cast<ExpressionStatement*>(stmt)) {
-        visit(exprStmt->expression.get());
-    } else if (auto blockStmt = dynamic_cast<BlockStatement*>(stmt)) {
-        executeBlock(blockStmt);
-    } else if (auto ifStmt = dynamic_cast<IfStatement*>(stmt)) {
-        Value cond = visit(ifStmt->condition.get());
-        bool condition = false;
-        if (cond.type == Value::NUMBER)
-            condition = (cond.numberValue != 0);
-        else
-            condition = !cond.stringValue.empty();
-        if (condition)
-            executeBlock(ifStmt->thenBranch.get());
-        else if (ifStmt->elseBranch)
-            executeBlock(ifStmt->elseBranch.get());
-    } else if (auto whileStmt = dynamic_cast<WhileStatement*>(stmt)) {
-        while (true) {
-            Value cond = visit(whileStmt->condition.get());
-            bool condition = false;
-            if (cond.type == Value::NUMBER)
-                condition = (cond.numberValue != 0);
-            else
-                condition = !cond.stringValue.empty();
-            if (!condition)
-                break;
-            executeBlock(whileStmt->body.get());
-        }
-    } else if (auto returnStmt = dynamic_cast<ReturnStatement*>(stmt)) {
-        Value retVal;
-        if (returnStmt->expression)
-            retVal = visit(returnStmt->expression.get());
-        throw ReturnException(retVal);
-    } else if (dynamic_cast<FunctionDeclaration*>(stmt)) {
-        // Already handled.
-        return;
+        if (visit(stmt) == Completion::RETURN)
+            break;
+    }
+    // Tasks nobody joined still run to completion, as in generated programs.
+    if (spawned)
+        waitAllTasks();
+}
+
+void Interpreter::beginStream() {
+    resolver.beginStream();
+    stack.clear();
+    globalDefined.clear();
+    frameBase = 0;
+    callDepth = 0;
+    functions.clear();
+    shapes.clear();
+    caches.clear();
+    context = nullptr;
+    receiver = nullptr;
+}
+
+bool Interpreter::execute(Statement* stmt) {
+    if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt)) {
+        resolver.resolveFunction(funcDecl);
+        if (funcDecl->name >= functions.size())
+            functions.resize(SymbolTable::global().size());
+        functions[funcDecl->name] = FunctionEntry();
+        functions[funcDecl->name].decl = funcDecl;
+        context = nullptr;
+        return true;
+    }
+    if (auto classDecl = nodeCast<ClassDeclaration>(stmt)) {
+        resolver.resolveClass(classDecl);
+        caches.resize(resolver.inlineCacheCount());
+        if (classDecl->name >= shapes.size())
+            shapes.resize(SymbolTable::global().size());
+        defineClass(classDecl);
+        context = nullptr;
+        return true;
+    }
+    resolver.resolveStatement(stmt);
+    caches.resize(resolver.inlineCacheCount());
+    // The global frame grows as declarations arrive; no call is active
+    // between top-level statements, so it is always the whole stack.
+    stack.resize(resolver.globalFrameSize());
+    globalDefined.resize(resolver.globalFrameSize(), false);
+    bool more = visit(stmt) != Completion::RETURN;
+    // The statement's caches and block locals go, so that the next one
+    // starts with empty ones.
+    resolver.endStatement();
+    caches.resize(resolver.inlineCacheCount());
+    stack.resize(resolver.globalFrameSize());
+    globalDefined.resize(resolver.globalFrameSize());
+    return more;
+}
+
+Completion Interpreter::visitVariableDeclaration(VariableDeclaration* varDecl) {
+    Value value = visit(varDecl->expression);
+    stack[frameBase + varDecl->address.slot] = std::move(value);
+    if (callDepth == 0)
+        globalDefined[varDecl->address.slot] = true;
+    return Completion::NORMAL;
+}
+
+Completion Interpreter::visitPrintStatement(PrintStatement* printStmt) {
+    Value value = visit(printStmt->expression);
+    if (value.isNumber()) {
+        print(value.asNumber());
     } else {
-        throw std::runtime_error("Unknown statement type in execute.");
+        std::string buffer;
+        print(objectText(value, buffer));
     }
+    return Completion::NORMAL;
 }
 
-void Interpreter::executeBlock(BlockStatement* block) {
-    environments.push_back({});
-    try {
-        for (auto& stmt : block->statements) {
-            execute(stmt.get());
-        }
-    } catch (...) {
-        environments.pop_back();
-        throw;
-    }
-    environments.pop_back();
-}
-
-Value Interpreter::visit(Expression* expr) {
-    if (auto num = dynamic_cast<NumericLiteral*>(expr))
-        return Value(num->value);
-    else if (auto str = dynamic_cast<StringLiteral*>(expr))
-        return Value(str->value);
-    else if (auto id = dynamic_cast<Identifier*>(expr))
-        return lookupVariable(id->name);
-    else if (auto assign = dynamic_cast<Assignment*>(expr)) {
-        Value value = visit(assign->value.get());
-        assignVariable(assign->name, value);
-        return value;
-    } else if (auto bin = dynamic_cast<BinaryExpression*>(expr)) {
-        Value left = visit(bin->left.get());
-        Value right = visit(bin->right.get());
-        if (bin->op == "+") {
-            if (left.type == Value::NUMBER && right.type == Value::NUMBER)
-                return Value(left.numberValue + right.numberValue);
-            else
-                return Value((left.type == Value::STRING ? left.stringValue : std::to_string(left.numberValue)) +
-                             (right.type == Value::STRING ? right.stringValue : std::to_string(right.numberValue)));
-        } else if (bin->op == "-") {
-            return Value(left.numberValue - right.numberValue);
-        } else if (bin->op == "*") {
-            return Value(left.numberValue * right.numberValue);
-        } else if (bin->op == "/") {
-            return Value(left.numberValue / right.numberValue);
-        } else if (bin->op == "<") {
-            return Value((left.numberValue < right.numberValue) ? 1.0 : 0.0);
-        } else if (bin->op == "<=") {
-            return Value((left.numberValue <= right.numberValue) ? 1.0 : 0.0);
-        } else if (bin->op == ">") {
-            return Value((left.numberValue > right.numberValue) ? 1.0 : 0.0);
-        } else if (bin->op == ">=") {
-            return Value((left.numberValue >= right.numberValue) ? 1.0 : 0.0);
+Completion Interpreter::visitExpressionStatement(ExpressionStatement* exprStmt) {
+    visit(exprStmt->expression);
+    return Completion::NORMAL;
+}
+
+Completion Interpreter::visitBlockStatement(BlockStatement* block) {
+    // Block scoping was resolved statically; no runtime environment is needed.
+    for (auto& stmt : block->statements) {
+        Completion completion = visit(stmt);
+        if (completion != Completion::NORMAL)
+            return completion;
+    }
+    return Completion::NORMAL;
+}
+
+Completion Interpreter::visitIfStatement(IfStatement* ifStmt) {
+    if (visit(ifStmt->condition).isTruthy())
+        return visitBlockStatement(ifStmt->thenBranch);
+    if (ifStmt->elseBranch)
+        return visitBlockStatement(ifStmt->elseBranch);
+    return Completion::NORMAL;
+}
+
+Completion Interpreter::visitWhileStatement(WhileStatement* whileStmt) {
+    while (visit(whileStmt->condition).isTruthy()) {
+        if (running)
+            warm(*running);
+        Completion completion = visitBlockStatement(whileStmt->body);
+        if (completion == Completion::BREAK)
+            break;
+        if (completion == Completion::RETURN || completion == Completion::TAIL_CALL)
+            return completion;
+    }
+    return Completion::NORMAL;
+}
+
+Completion Interpreter::visitReturnStatement(ReturnStatement* returnStmt) {
+    if (returnStmt->tailCall)
+        return tailCall(static_cast<CallExpression*>(returnStmt->expression));
+    returnValue = returnStmt->expression ? visit(returnStmt->expression) : Value();
+    return Completion::RETURN;
+}
+
+Completion Interpreter::visitBreakStatement(BreakStatement*) {
+    return Completion::BREAK;
+}
+
+Completion Interpreter::visitContinueStatement(ContinueStatement*) {
+    return Completion::CONTINUE;
+}
+
+Completion Interpreter::visitFunctionDeclaration(FunctionDeclaration*) {
+    // Already handled.
+    return Completion::NORMAL;
+}
+
+// Top-level classes are defined before the program runs.
+Completion Interpreter::visitClassDeclaration(ClassDeclaration*) {
+    throw std::runtime_error("Classes can only be declared at the top level.");
+}
+
+void Interpreter::defineClass(ClassDeclaration* classDecl) {
+    auto shape = std::make_shared<Shape>();
+    shape->className = classDecl->name;
+    if (classDecl->baseClass != Symbols::NONE) {
+        const Shape& base = *shapes[classDecl->baseClass];
+        shape->fieldSlots = base.fieldSlots;
+        shape->initializers = base.initializers;
+        shape->methods = base.methods;
+    }
+    shape->initializers.resize(classDecl->fieldCount);
+    for (auto& stmt : classDecl->body->statements) {
+        if (auto varDecl = nodeCast<VariableDeclaration>(stmt)) {
+            shape->fieldSlots[varDecl->identifier] = varDecl->address.slot;
+            shape->initializers[varDecl->address.slot] = varDecl;
+        } else if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt)) {
+            shape->methods[funcDecl->name] = funcDecl;
+        } else {
+            throw std::runtime_error("Unknown statement type in class body.");
         }
-        throw std::runtime_error("Unknown binary operator: " + bin->op);
-    } else if (auto unary = dynamic_cast<UnaryExpression*>(expr)) {
-        Value arg = visit(unary->argument.get());
-        if (unary->op == "-")
-            return Value(-arg.numberValue);
-        throw std::runtime_error("Unknown unary operator: " + unary->op);
-    } else if (auto callExpr = dynamic_cast<CallExpression*>(expr)) {
-        auto calleeId = dynamic_cast<Identifier*>(callExpr->callee.get());
+    }
+    shapes[classDecl->name] = std::move(shape);
+}
+
+Value Interpreter::visitNumericLiteral(NumericLiteral* num) {
+    return Value(num->value);
+}
+
+Value Interpreter::visitStringLiteral(StringLiteral* str) {
+    return Value(str->value);
+}
+
+Value Interpreter::visitIdentifier(Identifier* id) {
+    return variable(id->address, id->name);
+}
+
+Value Interpreter::visitAssignment(Assignment* assign) {
+    Value value = visit(assign->value);
+    variable(assign->address, assign->name) = value;
+    return value;
+}
+
+Value Interpreter::visitBinaryExpression(BinaryExpression* bin) {
+    Value left = visit(bin->left);
+    Value right = visit(bin->right);
+    switch (bin->op) {
+        case BinaryOp::ADD:
+            return addValues(left, right);
+        case BinaryOp::SUBTRACT:
+            return Value(left.toNumber() - right.toNumber());
+        case BinaryOp::MULTIPLY:
+            return Value(left.toNumber() * right.toNumber());
+        case BinaryOp::DIVIDE:
+            return Value(left.toNumber() / right.toNumber());
+        case BinaryOp::LESS:
+            return Value((left.toNumber() < right.toNumber()) ? 1.0 : 0.0);
+        case BinaryOp::LESS_EQUAL:
+            return Value((left.toNumber() <= right.toNumber()) ? 1.0 : 0.0);
+        case BinaryOp::GREATER:
+            return Value((left.toNumber() > right.toNumber()) ? 1.0 : 0.0);
+        case BinaryOp::GREATER_EQUAL:
+            return Value((left.toNumber() >= right.toNumber()) ? 1.0 : 0.0);
+    }
+    throw std::runtime_error(std::string("Unknown binary operator: ") + operatorText(bin->op));
+}
+
+Value Interpreter::visitUnaryExpression(UnaryExpression* unary) {
+    Value arg = visit(unary->argument);
+    switch (unary->op) {
+        case UnaryOp::NEGATE:
+            return Value(-arg.toNumber());
+    }
+    throw std::runtime_error(std::string("Unknown unary operator: ") + operatorText(unary->op));
+}
+
+Value Interpreter::visitCallExpression(CallExpression* callExpr) {
+    if (auto memberAccess = nodeCast<MemberAccessExpression>(callExpr->callee))
+        return callMember(callExpr, memberAccess);
+    auto calleeId = nodeCast<Identifier>(callExpr->callee);
+    if (!calleeId)
+        throw std::runtime_error("Can only call functions identified by name.");
+    Symbol funcName = calleeId->name;
+    std::vector<Value> args = arguments(callExpr);
+    // Inside a method, a bare name calls a method of the object first.
+    if (receiver) {
+        auto method = receiver->shape->methods.find(funcName);
+        if (method != receiver->shape->methods.end())
+            return callMethod(method->second, receiver, args);
+    }
+    // Then built-in functions.
+    if (funcName == Symbols::READ_FILE || funcName == Symbols::WRITE_FILE || funcName == Symbols::FLUSH)
+        return builtInFunction(funcName, args);
+    if (funcName < functions.size() && functions[funcName].decl)
+        return callFunction(functions[funcName], args);
+    // Array built-ins come after program functions, which may reuse their names.
+    if (Symbols::isOverridableBuiltIn(funcName))
+        return overridableBuiltIn(funcName, args);
+    throw std::runtime_error("Undefined function: " + std::string(symbolName(funcName)));
+}
+
+// Inlined into both callers: the frame setup is the hot part of a call.
+inline Value Interpreter::invoke(FunctionDeclaration* funcDecl, ObjInstance* object, const std::vector<Value>& args) {
+    ObjInstance* savedReceiver = receiver;
+    receiver = object;
+    size_t savedBase = frameBase;
+    frameBase = stack.size();
+    stack.resize(frameBase + funcDecl->frameSize);
+    // Parameters occupy the first slots; missing arguments default to 0.
+    for (size_t i = 0; i < funcDecl->params.size() && i < args.size(); i++)
+        stack[frameBase + i] = args[i];
+    callDepth++;
+    Value retVal;
+    Completion completion = visitBlockStatement(funcDecl->body);
+    if (completion == Completion::RETURN)
+        retVal = std::move(returnValue);
+    else if (completion == Completion::TAIL_CALL)
+        retVal = runTailCalls();
+    callDepth--;
+    stack.resize(frameBase);
+    frameBase = savedBase;
+    receiver = savedReceiver;
+    return retVal;
+}
+
+Value Interpreter::callMember(CallExpression* callExpr, MemberAccessExpression* memberAccess) {
+    Value object = visit(memberAccess->object);
+    std::vector<Value> args = arguments(callExpr);
+    return callMethod(method(memberAccess, object), object.asInstance(), args);
+}
+
+// return f(...) in a function: evaluates the callee and the arguments, and
+// leaves the call to invoke, which runs it in the frame of the function
+// returning. Recursion in tail position thus runs in constant native and
+// interpreter stack. Built-in functions are called at once.
+Completion Interpreter::tailCall(CallExpression* callExpr) {
+    TailCall call;
+    if (auto memberAccess = nodeCast<MemberAccessExpression>(callExpr->callee)) {
+        call.object = visit(memberAccess->object);
+        call.args = arguments(callExpr);
+        call.decl = method(memberAccess, call.object);
+        call.receiver = call.object.asInstance();
+    } else {
+        auto calleeId = nodeCast<Identifier>(callExpr->callee);
         if (!calleeId)
             throw std::runtime_error("Can only call functions identified by name.");
-        std::string funcName = calleeId->name;
-        std::vector<Value> args;
-        for (auto& arg : callExpr->arguments)
-            args.push_back(visit(arg.get()));
-        // Check for built-in functions first.
-        if (funcName == "readFile" || funcName == "writeFile")
-            return builtInFunction(funcName, args);
-        if (functions.find(funcName) == functions.end())
-            throw std::runtime_error("Undefined function: " + funcName);
-        return callFunction(functions[funcName], args);
+        Symbol funcName = calleeId->name;
+        call.args = arguments(callExpr);
+        if (receiver) {
+            auto found = receiver->shape->methods.find(funcName);
+            if (found != receiver->shape->methods.end()) {
+                call.decl = found->second;
+                call.receiver = receiver;
+            }
+        }
+        if (!call.decl) {
+            if (funcName == Symbols::READ_FILE || funcName == Symbols::WRITE_FILE || funcName == Symbols::FLUSH) {
+                returnValue = builtInFunction(funcName, call.args);
+                return Completion::RETURN;
+            }
+            bool defined = funcName < functions.size() && functions[funcName].decl;
+            if (!defined && Symbols::isOverridableBuiltIn(funcName)) {
+                returnValue = overridableBuiltIn(funcName, call.args);
+                return Completion::RETURN;
+            }
+            if (!defined)
+                throw std::runtime_error("Undefined function: " + std::string(symbolName(funcName)));
+            call.function = &functions[funcName];
+            call.decl = call.function->decl;
+        }
     }
-    throw std::runtime_error("Unknown expression type in visit.");
+    pendingCall = std::move(call);
+    return Completion::TAIL_CALL;
 }
 
-Value Interpreter::callFunction(FunctionDeclaration* funcDecl, const std::vector<Value>& args) {
-    environments.push_back({});
-    for (size_t i = 0; i < funcDecl->params.size(); i++) {
-        Value argVal = (i < args.size() ? args[i] : Value(0));
-        environments.back()[funcDecl->params[i]] = argVal;
+// Runs the calls left by tail calls one after the other in the current
+// frame, until a function returns without one.
+Value Interpreter::runTailCalls() {
+    Value self; // Holds the receiver of a tail-called obj.m(...).
+    for (;;) {
+        TailCall call = std::move(pendingCall);
+        if (nativeTier) {
+            if (call.function) {
+                Value result;
+                if (call.function->native) {
+                    if (callNative(*call.function, call.args, result))
+                        return result;
+                } else {
+                    warm(*call.function);
+                }
+            }
+            running = call.function;
+        }
+        if (call.object.isInstance())
+            self = std::move(call.object);
+        receiver = call.receiver;
+        FunctionDeclaration* funcDecl = call.decl;
+        stack.resize(frameBase);
+        stack.resize(frameBase + funcDecl->frameSize);
+        for (size_t i = 0; i < funcDecl->params.size() && i < call.args.size(); i++)
+            stack[frameBase + i] = std::move(call.args[i]);
+        Completion completion = visitBlockStatement(funcDecl->body);
+        if (completion == Completion::RETURN)
+            return std::move(returnValue);
+        if (completion != Completion::TAIL_CALL)
+            return Value();
     }
-    Value retVal;
-    try {
-        executeBlock(funcDecl->body.get());
-    } catch (const ReturnException& e) {
-        retVal = e.value;
+}
+
+std::vector<Value> Interpreter::arguments(CallExpression* callExpr) {
+    std::vector<Value> args;
+    args.reserve(callExpr->arguments.size());
+    for (auto& arg : callExpr->arguments)
+        args.push_back(visit(arg));
+    return args;
+}
+
+FunctionDeclaration* Interpreter::method(MemberAccessExpression* memberAccess, const Value& object) {
+    InlineCache::Entry entry = member(memberAccess, object, true);
+    if (!entry.method)
+        throw std::runtime_error("Field " + std::string(symbolName(memberAccess->member)) + " of " +
+                                 std::string(symbolName(entry.shape->className)) + " is not a method.");
+    return entry.method;
+}
+
+// Native code takes numbers only; a call passing a string is interpreted
+// instead.
+inline bool Interpreter::callNative(FunctionEntry& function, const std::vector<Value>& args, Value& result) {
+    double numbers[NativeTier::MAX_PARAMS] = {};
+    size_t count = std::min(args.size(), function.decl->params.size());
+    size_t i = 0;
+    for (; i < count && args[i].isNumber(); i++)
+        numbers[i] = args[i].asNumber();
+    if (i < count)
+        return false;
+    result = Value(function.native(numbers));
+    return true;
+}
+
+Value Interpreter::callFunction(FunctionEntry& function, const std::vector<Value>& args) {
+    if (function.memo)
+        return callMemoized(function, args);
+    return runFunction(function, args);
+}
+
+// The key is the arguments the function sees, missing ones as 0. A call
+// passing a string is not cached.
+Value Interpreter::callMemoized(FunctionEntry& function, const std::vector<Value>& args) {
+    uint64_t key[MemoTable<Value>::MAX_ARGS];
+    for (size_t i = 0; i < function.decl->params.size(); i++) {
+        if (i >= args.size()) {
+            key[i] = memoKey(0.0);
+        } else if (args[i].isNumber()) {
+            key[i] = memoKey(args[i].asNumber());
+        } else {
+            return runFunction(function, args);
+        }
     }
-    environments.pop_back();
-    return retVal;
+    if (const Value* hit = function.memo->find(key))
+        return *hit;
+    return function.memo->store(key, runFunction(function, args));
 }
 
-Value Interpreter::lookupVariable(const std::string& name) {
-    for (auto it = environments.rbegin(); it != environments.rend(); ++it) {
-        if (it->find(name) != it->end())
-            return it->at(name);
+inline Value Interpreter::runFunction(FunctionEntry& function, const std::vector<Value>& args) {
+    FunctionDeclaration* funcDecl = function.decl;
+    FunctionEntry* caller = running;
+    if (nativeTier) {
+        if (function.native) {
+            Value result;
+            if (callNative(function, args, result))
+                return result;
+        } else {
+            warm(function);
+        }
+        running = &function;
     }
-    throw std::runtime_error("Undefined variable: " + name);
+    Value result = invoke(funcDecl, nullptr, args);
+    running = caller;
+    return result;
+}
+
+// Methods are not compiled natively, and their loops count toward no
+// function.
+Value Interpreter::callMethod(FunctionDeclaration* method, ObjInstance* object, const std::vector<Value>& args) {
+    FunctionEntry* caller = running;
+    running = nullptr;
+    Value result = invoke(method, object, args);
+    running = caller;
+    return result;
+}
+
+Value Interpreter::visitMemberAccessExpression(MemberAccessExpression* memberAccess) {
+    Value object = visit(memberAccess->object);
+    InlineCache::Entry entry = member(memberAccess, object, false);
+    if (entry.method)
+        throw std::runtime_error("Method " + std::string(symbolName(memberAccess->member)) + " of " +
+                                 std::string(symbolName(entry.shape->className)) + " must be called.");
+    return object.asInstance()->fields()[entry.slot];
 }
 
-void Interpreter::assignVariable(const std::string& name, const Value& value) {
-    for (auto it = environments.rbegin(); it != environments.rend(); ++it) {
-        if (it->find(name) != it->end()) {
-            (*it)[name] = value;
+// Classes have no constructors: arguments are evaluated and dropped, like
+// extra arguments to a function. Field initializers run in slot order and
+// may read the fields before them.
+Value Interpreter::visitNewExpression(NewExpression* newExpr) {
+    for (auto& arg : newExpr->arguments)
+        visit(arg);
+    Symbol name = newExpr->className;
+    if (name >= shapes.size() || !shapes[name])
+        throw std::runtime_error("Undefined class: " + std::string(symbolName(name)));
+    const Shape* shape = shapes[name].get();
+    Value object = Value::adopt(ObjInstance::create(shape, static_cast<uint32_t>(shape->initializers.size())));
+    ObjInstance* savedReceiver = receiver;
+    receiver = object.asInstance();
+    for (size_t slot = 0; slot < shape->initializers.size(); slot++) {
+        if (VariableDeclaration* init = shape->initializers[slot])
+            receiver->fields()[slot] = visit(init->expression);
+    }
+    receiver = savedReceiver;
+    return object;
+}
+
+// A call site looks for a method first, any other site for a field.
+InlineCache::Entry Interpreter::member(MemberAccessExpression* memberAccess, const Value& object, bool call) {
+    if (!object.isInstance())
+        throw std::runtime_error("Only objects have members: cannot access " +
+                                 std::string(symbolName(memberAccess->member)) + ".");
+    const Shape* shape = object.asInstance()->shape;
+    InlineCache& cache = caches[memberAccess->cache];
+    for (int i = 0; i < cache.size; i++) {
+        if (cache.entries[i].shape == shape) {
+            cacheHits++;
+            return cache.entries[i];
+        }
+    }
+    cacheMisses++;
+    InlineCache::Entry entry;
+    entry.shape = shape;
+    auto method = shape->methods.find(memberAccess->member);
+    auto field = shape->fieldSlots.find(memberAccess->member);
+    if (method != shape->methods.end() && (call || field == shape->fieldSlots.end()))
+        entry.method = method->second;
+    else if (field != shape->fieldSlots.end())
+        entry.slot = field->second;
+    else
+        throw std::runtime_error("Undefined member " + std::string(symbolName(memberAccess->member)) + " of " +
+                                 std::string(symbolName(shape->className)) + ".");
+    if (cache.size < InlineCache::WAYS)
+        cache.entries[cache.size++] = entry;
+    else
+        cache.megamorphic = true;
+    return entry;
+}
+
+InlineCacheStats Interpreter::inlineCacheStats() const {
+    InlineCacheStats stats;
+    stats.hits = cacheHits;
+    stats.misses = cacheMisses;
+    for (const InlineCache& cache : caches) {
+        if (cache.megamorphic)
+            stats.megamorphicSites++;
+        else if (cache.size > 1)
+            stats.polymorphicSites++;
+        else if (cache.size == 1)
+            stats.monomorphicSites++;
+    }
+    return stats;
+}
+
+std::vector<std::pair<Symbol, MemoStats>> Interpreter::memoStats() const {
+    std::vector<std::pair<Symbol, MemoStats>> stats;
+    for (const FunctionEntry& function : functions) {
+        if (function.memo)
+            stats.emplace_back(function.decl->name, function.memo->stats());
+    }
+    return stats;
+}
+
+void Interpreter::warm(FunctionEntry& function) {
+    if (function.tier == Tier::INTERPRETED) {
+        if (++function.heat < NativeTier::HOT_THRESHOLD)
+            return;
+        function.job = nativeTier->compile(function.decl, [this](Symbol name) -> FunctionDeclaration* {
+            return name < functions.size() ? functions[name].decl : nullptr;
+        });
+        if (function.job < 0) {
+            function.tier = Tier::REJECTED;
             return;
         }
+        function.tier = Tier::COMPILING;
+    } else if (function.tier != Tier::COMPILING || ++function.heat % POLL_INTERVAL != 0) {
+        return;
+    }
+    NativeFunction native = nullptr;
+    switch (nativeTier->poll(function.job, native)) {
+        case NativeTier::State::COMPILING:
+            break;
+        case NativeTier::State::READY:
+            function.native = native;
+            function.tier = Tier::NATIVE;
+            break;
+        case NativeTier::State::FAILED:
+            function.tier = Tier::REJECTED;
+            break;
+    }
+}
+
+Value Interpreter::visitArrayLiteral(ArrayLiteral* arrayLit) {
+    Value array = Value::adopt(ObjArray::create(arrayLit->elements.size()));
+    double* data = array.asArray()->data;
+    for (size_t i = 0; i < arrayLit->elements.size(); i++) {
+        Value element = visit(arrayLit->elements[i]);
+        if (!element.isNumber())
+            throw std::runtime_error("Array elements must be numbers.");
+        data[i] = element.asNumber();
     }
-    throw std::runtime_error("Undefined variable: " + name);
+    return array;
+}
+
+Value Interpreter::visitIndexExpression(IndexExpression* indexExpr) {
+    Value array = visit(indexExpr->array);
+    Value index = visit(indexExpr->index);
+    return Value(element(array, index));
+}
+
+// The array and index are evaluated before the value, as in C++17.
+Value Interpreter::visitIndexAssignment(IndexAssignment* indexAssign) {
+    Value array = visit(indexAssign->array);
+    Value index = visit(indexAssign->index);
+    Value value = visit(indexAssign->value);
+    if (!value.isNumber())
+        throw std::runtime_error("Array elements must be numbers.");
+    element(array, index) = value.asNumber();
+    return value;
 }
 
-void Interpreter::declareVariable(const std::string& name, const Value& value) {
-    environments.back()[name] = value;
+double& Interpreter::element(const Value& array, const Value& index) {
+    if (!array.isArray())
+        throw std::runtime_error("Only arrays can be indexed.");
+    if (!index.isNumber())
+        throw std::runtime_error("Array index must be a number.");
+    ObjArray* obj = array.asArray();
+    return obj->data[arrayIndex(index.asNumber(), obj->length)];
 }
 
-Value Interpreter::builtInFunction(const std::string& name, const std::vector<Value>& args) {
-    if (name == "readFile") {
-        if (args.size() < 1 || args[0].type != Value::STRING)
+Value& Interpreter::variable(const VariableAddress& address, Symbol name) {
+    if (address.depth == 0)
+        return stack[frameBase + address.slot];
+    if (address.depth == VariableAddress::FIELD)
+        return receiver->fields()[address.slot];
+    if (worker)
+        throw std::runtime_error("Tasks cannot use global variables: " + std::string(symbolName(name)));
+    if (!globalDefined[address.slot])
+        throw std::runtime_error("Undefined variable: " + std::string(symbolName(name)));
+    return stack[address.slot];
+}
+
+Value Interpreter::builtInFunction(Symbol name, const std::vector<Value>& args) {
+    if (name == Symbols::READ_FILE) {
+        if (args.size() < 1 || !args[0].isString())
             throw std::runtime_error("readFile expects a string filename.");
-        std::ifstream file(args[0].stringValue);
-        if (!file)
-            throw std::runtime_error("Could not open file: " + args[0].stringValue);
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        return Value(buffer.str());
-    } else if (name == "writeFile") {
-        if (args.size() < 2 || args[0].type != Value::STRING || args[1].type != Value::STRING)
+        return Value::adopt(ObjString::fromFile(std::string(args[0].stringView())));
+    } else if (name == Symbols::WRITE_FILE) {
+        if (args.size() < 2 || !args[0].isString() || !args[1].isString())
             throw std::runtime_error("writeFile expects two string arguments: filename and content.");
-        std::ofstream file(args[0].stringValue);
-        if (!file)
-            throw std::runtime_error("Could not write to file: " + args[0].stringValue);
-        file << args[1].stringValue;
+        writeFile(std::string(args[0].stringView()), args[1].stringView());
+        return Value(0);
+    } else if (name == Symbols::FLUSH) {
+        flush();
         return Value(0);
     }
-    throw std::runtime_error("Undefined built-in function: " + name);
-}
\ No newline at end of file
+    throw std::runtime_error("Undefined built-in function: " + std::string(symbolName(name)));
+}
+
+// Handles are numbers; anything else is refused like a closed handle.
+static Value lineStreamBuiltIn(Symbol name, const std::vector<Value>& args) {
+    std::string text(symbolName(name));
+    if (name == Symbols::OPEN_LINES || name == Symbols::OPEN_WRITER) {
+        if (args.empty() || !args[0].isString())
+            throw std::runtime_error(text + " expects a string filename.");
+        std::string filename(args[0].stringView());
+        return Value(name == Symbols::OPEN_LINES ? fileOpenLines(filename) : fileOpenWriter(filename));
+    }
+    double handle = !args.empty() && args[0].isNumber() ? args[0].asNumber() : 0;
+    if (name == Symbols::HAS_LINE)
+        return Value(static_cast<double>(fileHasLine(handle)));
+    if (name == Symbols::NEXT_LINE)
+        return Value(fileNextLine(handle));
+    if (name == Symbols::WRITE) {
+        if (args.size() < 2 || !(args[1].isString() || args[1].isNumber()))
+            throw std::runtime_error("write expects a handle and a string or number.");
+        return Value(args[1].isString() ? fileWrite(handle, args[1].stringView())
+                                        : fileWrite(handle, args[1].asNumber()));
+    }
+    return Value(fileClose(handle));
+}
+
+Value Interpreter::overridableBuiltIn(Symbol name, const std::vector<Value>& args) {
+    if (name == Symbols::JOIN)
+        return joinTask(args);
+    if (Symbols::isLineStreamBuiltIn(name))
+        return lineStreamBuiltIn(name, args);
+    std::string text(symbolName(name));
+    auto array = [&](size_t i) {
+        if (i >= args.size() || !args[i].isArray()) {
+            bool binary = name == Symbols::DOT || name == Symbols::ADD;
+            throw std::runtime_error(text + (binary ? " expects two arrays." : " expects an array."));
+        }
+        return args[i].asArray();
+    };
+    auto result = [](size_t length) { return Value::adopt(ObjArray::create(length)); };
+    if (name == Symbols::ARRAY) {
+        // Anything but a number is refused like a bad length.
+        return result(arrayLengthArgument(args.empty() || !args[0].isNumber() ? -1 : args[0].asNumber()));
+    } else if (name == Symbols::LEN) {
+        return Value(static_cast<double>(array(0)->length));
+    } else if (name == Symbols::SUM) {
+        return Value(simd::sum(array(0)->data, array(0)->length));
+    } else if (name == Symbols::DOT) {
+        ObjArray* left = array(0);
+        ObjArray* right = array(1);
+        checkSameLength(text.c_str(), left->length, right->length);
+        return Value(simd::dot(left->data, right->data, left->length));
+    } else if (name == Symbols::SCALE) {
+        ObjArray* source = array(0);
+        if (args.size() < 2 || !args[1].isNumber())
+            throw std::runtime_error("scale expects an array and a number.");
+        Value scaled = result(source->length);
+        simd::scale(scaled.asArray()->data, source->data, args[1].asNumber(), source->length);
+        return scaled;
+    } else if (name == Symbols::ADD) {
+        ObjArray* left = array(0);
+        ObjArray* right = array(1);
+        checkSameLength(text.c_str(), left->length, right->length);
+        Value sum = result(left->length);
+        simd::add(sum.asArray()->data, left->data, right->data, left->length);
+        return sum;
+    } else if (name == Symbols::MIN || name == Symbols::MAX) {
+        ObjArray* source = array(0);
+        checkNotEmpty(text.c_str(), source->length);
+        return Value(name == Symbols::MIN ? simd::min(source->data, source->length)
+                                          : simd::max(source->data, source->length));
+    } else if (name == Symbols::SORT) {
+        ObjArray* source = array(0);
+        Value sorted = result(source->length);
+        std::copy(source->data, source->data + source->length, sorted.asArray()->data);
+        simd::sort(sorted.asArray()->data, source->length);
+        return sorted;
+    }
+    throw std::runtime_error("Undefined built-in function: " + std::string(symbolName(name)));
+}
+
+// The arguments and the result are the task's own: nothing else refers to
+// them while it runs.
+struct Interpreter::Task : TaskState {
+    std::shared_ptr<const TaskContext> context;
+    FunctionDeclaration* function = nullptr;
+    std::vector<Value> args;
+    Value result;
+
+    void run() override {
+        std::vector<Value> arguments = std::move(args);
+        Interpreter interpreter(context);
+        Value value = interpreter.callFunction(interpreter.functions[function->name], arguments);
+        if (value.isInstance() || value.isTask())
+            throw std::runtime_error("Tasks must return numbers, strings or arrays.");
+        result = std::move(value);
+    }
+};
+
+// Strings and arrays are copied: reference counts are not atomic, so a task
+// may share no object with its spawner.
+static Value taskArgument(const Value& value) {
+    if (value.isNumber())
+        return value;
+    if (value.isString())
+        return Value(value.stringView());
+    if (value.isArray()) {
+        ObjArray* source = value.asArray();
+        Value copy = Value::adopt(ObjArray::create(source->length));
+        std::copy(source->data, source->data + source->length, copy.asArray()->data);
+        return copy;
+    }
+    throw std::runtime_error("spawn arguments must be numbers, strings or arrays.");
+}
+
+std::shared_ptr<const Interpreter::TaskContext> Interpreter::taskContext() {
+    if (!context) {
+        auto fresh = std::make_shared<TaskContext>();
+        fresh->functions.reserve(functions.size());
+        for (const FunctionEntry& function : functions)
+            fresh->functions.push_back(function.decl);
+        fresh->shapes = shapes;
+        fresh->caches = resolver.inlineCacheCount();
+        context = std::move(fresh);
+    }
+    return context;
+}
+
+// Tasks call functions only: a method would need its object.
+FunctionDeclaration* Interpreter::taskFunction(Symbol name) {
+    if (name >= functions.size() || !functions[name].decl)
+        throw std::runtime_error("Undefined function: " + std::string(symbolName(name)));
+    return functions[name].decl;
+}
+
+Value Interpreter::visitSpawnExpression(SpawnExpression* spawnExpr) {
+    auto task = std::make_shared<Task>();
+    task->args.reserve(spawnExpr->call->arguments.size());
+    for (auto& arg : spawnExpr->call->arguments)
+        task->args.push_back(taskArgument(visit(arg)));
+    task->function = taskFunction(static_cast<Identifier*>(spawnExpr->call->callee)->name);
+    task->context = taskContext();
+    submitTask(task);
+    spawned = true;
+    return Value::adopt(ObjTask::create(std::move(task)));
+}
+
+// A failed task fails every join.
+Value Interpreter::joinTask(const std::vector<Value>& args) {
+    if (args.empty() || !args[0].isTask())
+        throw std::runtime_error("join expects a task.");
+    ObjTask* handle = args[0].asTask();
+    if (handle->state) {
+        waitTask(*handle->state);
+        handle->result = std::move(static_cast<Task&>(*handle->state).result);
+        handle->state.reset();
+    }
+    return handle->result;
+}
+
+// Each chunk of the range runs on an interpreter of its own and writes its
+// own elements of the result.
+Value Interpreter::visitParallelFor(ParallelFor* loop) {
+    Value from = visit(loop->from);
+    Value to = visit(loop->to);
+    if (!from.isNumber() || !to.isNumber())
+        throw std::runtime_error("parallelFor expects bounds that are whole numbers.");
+    int64_t first = parallelBound(from.asNumber());
+    int64_t last = parallelBound(to.asNumber());
+    FunctionDeclaration* funcDecl = taskFunction(loop->function);
+    if (funcDecl->params.empty())
+        throw std::runtime_error("parallelFor expects a function taking the index: " +
+                                 std::string(symbolName(loop->function)) + ".");
+    std::shared_ptr<const TaskContext> shared = taskContext();
+    Value result = Value::adopt(ObjArray::create(last > first ? static_cast<size_t>(last - first) : 0));
+    double* data = result.asArray()->data;
+    parallelRange(first, last, [&](int64_t begin, int64_t end) {
+        Interpreter interpreter(shared);
+        FunctionEntry& function = interpreter.functions[funcDecl->name];
+        std::vector<Value> args(1);
+        for (int64_t i = begin; i < end; i++) {
+            args[0] = Value(static_cast<double>(i));
+            Value value = interpreter.callFunction(function, args);
+            if (!value.isNumber())
+                throw std::runtime_error("parallelFor expects a function returning numbers.");
+            data[i - first] = value.asNumber();
+        }
+    });
+    return result;
+}
@@ -2,50 +2,181 @@
 #define INTERPRETER_HPP
 
 #include "AST.hpp"
-#include <unordered_map>
-#include <string>
+#include "ASTVisitor.hpp"
+#include "Builtins.hpp"
+#include "Resolver.hpp"
+#include "Shape.hpp"
+#include "NativeTier.hpp"
+#include "Value.hpp"
 #include <vector>
 #include <memory>
 
-// The Value type supports numbers and strings.
-struct Value {
-    enum Type { NUMBER, STRING } type;
-    double numberValue;
-    std::string stringValue;
-
-    Value() : type(NUMBER), numberValue(0) {}
-    Value(double num) : type(NUMBER), numberValue(num) {}
-    Value(const std::string &str) : type(STRING), stringValue(str) {}
+// How a statement finished executing. Anything but NORMAL unwinds the
+// enclosing blocks until a loop or function call consumes it.
+enum class Completion {
+    NORMAL,
+    RETURN,    // The value is held in Interpreter::returnValue.
+    TAIL_CALL, // The call to run instead is held in Interpreter::pendingCall.
+    BREAK,
+    CONTINUE
 };
 
-class Interpreter {
+class Interpreter : private ASTVisitor<Interpreter, Value, Completion> {
 public:
-    Interpreter();
+    static constexpr const char* PASS_NAME = "interpreter";
+
+    // With tiered set, hot functions are compiled to native code by a
+    // NativeTier and called directly once ready.
+    explicit Interpreter(bool tiered = false);
+    // Waits for the tasks still running.
+    ~Interpreter();
     void interpret(Program* program);
 
-private:
-    // Environment: mapping variable names to Value.
-    std::vector<std::unordered_map<std::string, Value>> environments;
-    std::unordered_map<std::string, FunctionDeclaration*> functions;
+    // Streaming mode: runs top-level statements one at a time as they are
+    // parsed. Functions become callable once their declaration has been
+    // executed. Returns false once a top-level return ends the program.
+    void beginStream();
+    bool execute(Statement* stmt);
 
-    Value visit(Expression* expr);
-    void execute(Statement* stmt);
-    void executeBlock(BlockStatement* block);
+    // Hits and misses of the inline caches at member accesses so far.
+    InlineCacheStats inlineCacheStats() const;
 
-    Value lookupVariable(const std::string& name);
-    void assignVariable(const std::string& name, const Value& value);
-    void declareVariable(const std::string& name, const Value& value);
+    // Hits and misses of each memoized function so far.
+    std::vector<std::pair<Symbol, MemoStats>> memoStats() const;
 
-    Value callFunction(FunctionDeclaration* funcDecl, const std::vector<Value>& args);
+private:
+    // How a function runs now.
+    enum class Tier : uint8_t {
+        INTERPRETED, // Not hot yet.
+        COMPILING,   // Hot; still interpreted until its native code is ready.
+        NATIVE,
+        REJECTED     // Not compilable, or compilation failed.
+    };
 
-    // For built-in functions.
-    Value builtInFunction(const std::string& name, const std::vector<Value>& args);
+    // A function callable by name, with the state of its native tier.
+    struct FunctionEntry {
+        FunctionDeclaration* decl = nullptr;
+        NativeFunction native = nullptr;
+        unsigned heat = 0; // Calls plus loop back-edges.
+        Tier tier = Tier::INTERPRETED;
+        int job = -1;      // NativeTier job while COMPILING.
+        std::unique_ptr<MemoTable<Value>> memo; // Results, if the function is memoized.
+    };
+
+    // Flat frames addressed by the slots assigned by the Resolver. The global
+    // frame sits at the bottom of the stack; each call appends its own frame.
+    std::vector<Value> stack;
+    size_t frameBase = 0;
+    int callDepth = 0;
+    // Functions may run before a global's declaration has executed.
+    std::vector<bool> globalDefined;
+    std::vector<FunctionEntry> functions; // Indexed by name Symbol.
+    std::unique_ptr<NativeTier> nativeTier; // Null unless tiered.
+    FunctionEntry* running = nullptr;       // Innermost call, when tiered.
+    // Tasks share nothing mutable with their spawner: each runs on an
+    // interpreter of its own, which gets copies of the arguments and the
+    // program's functions and classes, and cannot reach the globals. The
+    // result moves to the spawner at join.
+    struct TaskContext {
+        std::vector<FunctionDeclaration*> functions; // Indexed by name Symbol.
+        std::vector<std::shared_ptr<Shape>> shapes;
+        uint32_t caches = 0;
+    };
+    struct Task;
+    std::shared_ptr<const TaskContext> context; // Built on the first spawn.
+    bool worker = false;  // Runs a task.
+    bool spawned = false; // Has spawned a task.
 
-    class ReturnException : public std::exception {
-    public:
-        Value value;
-        ReturnException(const Value& value) : value(value) {}
+    // A call in tail position, evaluated but not yet made.
+    struct TailCall {
+        FunctionDeclaration* decl = nullptr;
+        FunctionEntry* function = nullptr; // Null for methods.
+        ObjInstance* receiver = nullptr;
+        Value object; // Holds the receiver of obj.m(...).
+        std::vector<Value> args;
     };
+
+    Value returnValue;
+    TailCall pendingCall;
+    Resolver resolver; // Kept across the statements of a stream.
+
+    std::vector<std::shared_ptr<Shape>> shapes; // Indexed by class name Symbol.
+    std::vector<InlineCache> caches;            // Indexed by MemberAccessExpression::cache.
+    size_t cacheHits = 0;
+    size_t cacheMisses = 0;
+    ObjInstance* receiver = nullptr; // Object whose method or initializer is running.
+
+    friend class ASTVisitor<Interpreter, Value, Completion>;
+
+    explicit Interpreter(std::shared_ptr<const TaskContext> context);
+
+    // Statements.
+    Completion visitVariableDeclaration(VariableDeclaration* varDecl);
+    Completion visitPrintStatement(PrintStatement* printStmt);
+    Completion visitExpressionStatement(ExpressionStatement* exprStmt);
+    Completion visitBlockStatement(BlockStatement* block);
+    Completion visitIfStatement(IfStatement* ifStmt);
+    Completion visitWhileStatement(WhileStatement* whileStmt);
+    Completion visitReturnStatement(ReturnStatement* returnStmt);
+    Completion visitBreakStatement(BreakStatement* breakStmt);
+    Completion visitContinueStatement(ContinueStatement* continueStmt);
+    Completion visitFunctionDeclaration(FunctionDeclaration* funcDecl);
+    Completion visitClassDeclaration(ClassDeclaration* classDecl);
+
+    // Expressions.
+    Value visitNumericLiteral(NumericLiteral* num);
+    Value visitStringLiteral(StringLiteral* str);
+    Value visitIdentifier(Identifier* id);
+    Value visitAssignment(Assignment* assign);
+    Value visitBinaryExpression(BinaryExpression* bin);
+    Value visitUnaryExpression(UnaryExpression* unary);
+    Value visitCallExpression(CallExpression* callExpr);
+    Value visitMemberAccessExpression(MemberAccessExpression* memberAccess);
+    Value visitNewExpression(NewExpression* newExpr);
+    Value visitArrayLiteral(ArrayLiteral* arrayLit);
+    Value visitIndexExpression(IndexExpression* indexExpr);
+    Value visitIndexAssignment(IndexAssignment* indexAssign);
+    Value visitSpawnExpression(SpawnExpression* spawnExpr);
+    Value visitParallelFor(ParallelFor* loop);
+
+    Value& variable(const VariableAddress& address, Symbol name);
+
+    // object.method(...): the callee is found through the site's inline cache.
+    Value callMember(CallExpression* callExpr, MemberAccessExpression* memberAccess);
+    Completion tailCall(CallExpression* callExpr);
+    Value runTailCalls();
+    std::vector<Value> arguments(CallExpression* callExpr);
+    // The method obj.member(...) calls.
+    FunctionDeclaration* method(MemberAccessExpression* memberAccess, const Value& object);
+    // Runs the native code of function, unless an argument is not a number.
+    bool callNative(FunctionEntry& function, const std::vector<Value>& args, Value& result);
+    Value callFunction(FunctionEntry& function, const std::vector<Value>& args);
+    Value callMemoized(FunctionEntry& function, const std::vector<Value>& args);
+    Value runFunction(FunctionEntry& function, const std::vector<Value>& args);
+    Value callMethod(FunctionDeclaration* method, ObjInstance* object, const std::vector<Value>& args);
+    // Runs a function body in a new frame, with object as the receiver of
+    // field accesses and bare method calls (null outside methods).
+    Value invoke(FunctionDeclaration* funcDecl, ObjInstance* object, const std::vector<Value>& args);
+    // Counts a call or back-edge toward compiling the function natively, and
+    // checks on its compilation.
+    void warm(FunctionEntry& function);
+
+    // Builds the shape of a class; the shape of its base must exist.
+    void defineClass(ClassDeclaration* classDecl);
+    // What object.member refers to, through the site's inline cache.
+    InlineCache::Entry member(MemberAccessExpression* memberAccess, const Value& object, bool call);
+
+    // The functions and classes declared so far, for tasks.
+    std::shared_ptr<const TaskContext> taskContext();
+    // The function a task calls.
+    FunctionDeclaration* taskFunction(Symbol name);
+    Value joinTask(const std::vector<Value>& args);
+
+    // For built-in functions.
+    Value builtInFunction(Symbol name, const std::vector<Value>& args);
+    Value overridableBuiltIn(Symbol name, const std::vector<Value>& args);
+    // The element array[index] refers to.
+    double& element(const Value& array, const Value& index);
 };
 
 #endif // INTERPRETER_HPP
\ No newline at end of file
@@ -7,8 +7,10 @@ if [ ! -f compiled.cpp ]; then
     exit 1
 fi
 
-# Compile the generated C++ source along with Builtins.cpp into program.
-g++ -std=c++17 compiled.cpp Builtins.cpp -o program
+# Compile the generated C++ source along with Builtins.cpp into program. The
+# compiler driver reuses a cached program when compiled.cpp, the runtime and
+# the C++ compiler are unchanged; pass --no-cache to force a rebuild.
+./mini_compiler --link "$@"
 
 if [ $? -eq 0 ]; then
     echo "Program compiled successfully. Running program..."
@@ -1,170 +1,220 @@
 #include "Lexer.hpp"
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <limits>
 #include <stdexcept>
-#include <cstdlib>
 
-Lexer::Lexer(const std::string &input) : input(input), pos(0) {}
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool isIdentifierStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
 
-char Lexer::peek() const {
-    if (pos < input.size())
-        return input[pos];
-    return '\0';
+static inline bool isIdentifierChar(char c) {
+    return isIdentifierStart(c) || isDigit(c);
 }
 
-char Lexer::get() {
-    if (pos < input.size())
-        return input[pos++];
-    return '\0';
+static inline bool isWhitespace(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Keywords are recognized with a perfect hash on their first and last
+// characters: every keyword lands in its own slot of a 32-entry table, so a
+// lookup is one hash, one length check and at most one memcmp.
+namespace {
+struct Keyword {
+    const char* text = nullptr;
+    size_t length = 0;
+    TokenType type = TokenType::IDENTIFIER;
+    Symbol symbol = Symbols::NONE;
+};
+
+constexpr size_t KEYWORD_TABLE_SIZE = 32;
+
+inline size_t keywordHash(const char* text, size_t length) {
+    return (static_cast<unsigned char>(text[0]) * 4u + static_cast<unsigned char>(text[length - 1])) &
+           (KEYWORD_TABLE_SIZE - 1);
+}
+
+struct KeywordTable {
+    Keyword slots[KEYWORD_TABLE_SIZE];
+
+    KeywordTable() {
+        const Keyword keywords[] = {
+            {"let", 3, TokenType::LET, Symbols::LET},
+            {"print", 5, TokenType::PRINT, Symbols::PRINT},
+            {"function", 8, TokenType::FUNCTION, Symbols::FUNCTION},
+            {"if", 2, TokenType::IF, Symbols::IF},
+            {"else", 4, TokenType::ELSE, Symbols::ELSE},
+            {"while", 5, TokenType::WHILE, Symbols::WHILE},
+            {"return", 6, TokenType::RETURN, Symbols::RETURN},
+            {"break", 5, TokenType::BREAK, Symbols::BREAK},
+            {"continue", 8, TokenType::CONTINUE, Symbols::CONTINUE},
+            {"class", 5, TokenType::CLASS, Symbols::CLASS},
+            {"extends", 7, TokenType::EXTENDS, Symbols::EXTENDS},
+            {"new", 3, TokenType::NEW, Symbols::NEW},
+            {"this", 4, TokenType::THIS, Symbols::THIS},
+            {"spawn", 5, TokenType::SPAWN, Symbols::SPAWN},
+            {"import", 6, TokenType::IMPORT, Symbols::IMPORT}
+        };
+        for (const Keyword& keyword : keywords) {
+            Keyword& slot = slots[keywordHash(keyword.text, keyword.length)];
+            if (slot.text)
+                throw std::logic_error("Keyword hash collision.");
+            slot = keyword;
+        }
+    }
+
+    const Keyword* find(const char* text, size_t length) const {
+        const Keyword& slot = slots[keywordHash(text, length)];
+        if (slot.length == length && std::memcmp(slot.text, text, length) == 0)
+            return &slot;
+        return nullptr;
+    }
+};
+
+const KeywordTable keywordTable;
+} // namespace
+
+Lexer::Lexer(std::string_view input) : input(input), pos(0) {
+    if (input.size() >= std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error("Source file is too large.");
 }
 
 void Lexer::skipWhitespace() {
     while (pos < input.size()) {
         char current = input[pos];
-        if (std::isspace(current)) {
+        if (isWhitespace(current)) {
             pos++;
         } else if (current == '/' && pos + 1 < input.size() && input[pos + 1] == '/') {
-            pos += 2;
-            while (pos < input.size() && input[pos] != '\n')
-                pos++;
+            const void* newline = std::memchr(input.data() + pos, '\n', input.size() - pos);
+            pos = newline ? static_cast<const char*>(newline) - input.data() : input.size();
         } else {
             break;
         }
     }
 }
 
-Token Lexer::number() {
+void Lexer::number(Token& token) {
     size_t start = pos;
-    while (pos < input.size() && std::isdigit(input[pos]))
+    while (pos < input.size() && isDigit(input[pos]))
         pos++;
     if (pos < input.size() && input[pos] == '.') {
         pos++;
-        while (pos < input.size() && std::isdigit(input[pos]))
+        while (pos < input.size() && isDigit(input[pos]))
             pos++;
     }
-    std::string numStr = input.substr(start, pos - start);
-    Token token;
+    auto result = std::from_chars(input.data() + start, input.data() + pos, token.number);
+    if (result.ec == std::errc::result_out_of_range)
+        token.number = std::numeric_limits<double>::infinity();
+    else if (result.ec != std::errc())
+        throw std::runtime_error("Invalid number literal: " + std::string(input.substr(start, pos - start)));
     token.type = TokenType::NUMBER;
-    token.lexeme = numStr;
-    token.numberValue = std::stod(numStr);
-    return token;
 }
 
-Token Lexer::string() {
-    char quote = get(); // consume opening quote.
-    size_t start = pos;
-    while (pos < input.size() && input[pos] != quote)
-        pos++;
-    if (pos >= input.size())
+void Lexer::string(Token& token) {
+    char quote = input[pos++]; // consume opening quote.
+    const void* end = std::memchr(input.data() + pos, quote, input.size() - pos);
+    if (!end)
         throw std::runtime_error("Unterminated string literal.");
-    std::string strVal = input.substr(start, pos - start);
-    get(); // consume closing quote.
-    Token token;
+    // The token covers the characters between the quotes.
     token.type = TokenType::STRING;
-    token.lexeme = strVal;
-    return token;
+    token.offset = static_cast<uint32_t>(pos);
+    pos = static_cast<const char*>(end) - input.data();
+    token.length = static_cast<uint32_t>(pos - token.offset);
+    pos++; // consume closing quote.
 }
 
-Token Lexer::identifier() {
+void Lexer::identifier(Token& token) {
     size_t start = pos;
-    while (pos < input.size() && (std::isalnum(input[pos]) || input[pos] == '_'))
+    while (pos < input.size() && isIdentifierChar(input[pos]))
         pos++;
-    std::string idStr = input.substr(start, pos - start);
-    Token token;
-    if (idStr == "let")
-        token.type = TokenType::LET;
-    else if (idStr == "print")
-        token.type = TokenType::PRINT;
-    else if (idStr == "function")
-        token.type = TokenType::FUNCTION;
-    else if (idStr == "if")
-        token.type = TokenType::IF;
-    else if (idStr == "else")
-        token.type = TokenType::ELSE;
-    else if (idStr == "while")
-        token.type = TokenType::WHILE;
-    else if (idStr == "return")
-        token.type = TokenType::RETURN;
-    else if (idStr == "class")
-        token.type = TokenType::CLASS;
-    else if (idStr == "extends")
-        token.type = TokenType::EXTENDS;
-    else if (idStr == "new")
-        token.type = TokenType::NEW;
-    else if (idStr == "this")
-        token.type = TokenType::THIS;
-    else
-        token.type = TokenType::IDENTIFIER;
-    token.lexeme = idStr;
-    return token;
+    if (const Keyword* keyword = keywordTable.find(input.data() + start, pos - start)) {
+        token.type = keyword->type;
+        token.symbol = keyword->symbol;
+        return;
+    }
+    token.type = TokenType::IDENTIFIER;
+    token.symbol = intern(input.substr(start, pos - start));
 }
 
-std::vector<Token> Lexer::tokenize() {
-    std::vector<Token> tokens;
-    while (pos < input.size()) {
-        skipWhitespace();
-        char current = peek();
-        if (current == '\0')
-            break;
-        if (std::isdigit(current)) {
-            tokens.push_back(number());
-            continue;
-        }
-        if (current == '"') {
-            tokens.push_back(string());
-            continue;
-        }
-        if (std::isalpha(current) || current == '_') {
-            tokens.push_back(identifier());
-            continue;
-        }
-        Token token;
+Token Lexer::next() {
+    skipWhitespace();
+    Token token;
+    token.offset = static_cast<uint32_t>(pos);
+    if (pos >= input.size())
+        return token; // END_OF_FILE.
+    char current = input[pos];
+    if (isDigit(current)) {
+        number(token);
+    } else if (current == '"') {
+        string(token);
+        return token;
+    } else if (isIdentifierStart(current)) {
+        identifier(token);
+    } else {
+        pos++;
         switch (current) {
             case '<':
-                pos++;
-                if (peek() == '=') {
+                token.type = TokenType::LESS;
+                if (pos < input.size() && input[pos] == '=') {
                     pos++;
                     token.type = TokenType::LESS_EQUAL;
-                    token.lexeme = "<=";
-                } else {
-                    token.type = TokenType::LESS;
-                    token.lexeme = "<";
                 }
-                tokens.push_back(token);
-                continue;
+                break;
             case '>':
-                pos++;
-                if (peek() == '=') {
+                token.type = TokenType::GREATER;
+                if (pos < input.size() && input[pos] == '=') {
                     pos++;
                     token.type = TokenType::GREATER_EQUAL;
-                    token.lexeme = ">=";
-                } else {
-                    token.type = TokenType::GREATER;
-                    token.lexeme = ">";
                 }
-                tokens.push_back(token);
-                continue;
-            case '+': token.type = TokenType::PLUS; token.lexeme = "+"; break;
-            case '-': token.type = TokenType::MINUS; token.lexeme = "-"; break;
-            case '*': token.type = TokenType::MULTIPLY; token.lexeme = "*"; break;
-            case '/': token.type = TokenType::DIVIDE; token.lexeme = "/"; break;
-            case '=': token.type = TokenType::EQUALS; token.lexeme = "="; break;
-            case '.': token.type = TokenType::DOT; token.lexeme = "."; break;
-            case ';': token.type = TokenType::SEMICOLON; token.lexeme = ";"; break;
-            case '(': token.type = TokenType::LPAREN; token.lexeme = "("; break;
-            case ')': token.type = TokenType::RPAREN; token.lexeme = ")"; break;
-            case '{': token.type = TokenType::LBRACE; token.lexeme = "{"; break;
-            case '}': token.type = TokenType::RBRACE; token.lexeme = "}"; break;
-            case ',': token.type = TokenType::COMMA; token.lexeme = ","; break;
-            default:
-                token.type = TokenType::UNKNOWN;
-                token.lexeme = std::string(1, current);
                 break;
+            case '+': token.type = TokenType::PLUS; break;
+            case '-': token.type = TokenType::MINUS; break;
+            case '*': token.type = TokenType::MULTIPLY; break;
+            case '/': token.type = TokenType::DIVIDE; break;
+            case '=': token.type = TokenType::EQUALS; break;
+            case '.': token.type = TokenType::DOT; break;
+            case ';': token.type = TokenType::SEMICOLON; break;
+            case '(': token.type = TokenType::LPAREN; break;
+            case ')': token.type = TokenType::RPAREN; break;
+            case '{': token.type = TokenType::LBRACE; break;
+            case '}': token.type = TokenType::RBRACE; break;
+            case '[': token.type = TokenType::LBRACKET; break;
+            case ']': token.type = TokenType::RBRACKET; break;
+            case ',': token.type = TokenType::COMMA; break;
+            case '@': token.type = TokenType::AT; break;
+            default: token.type = TokenType::UNKNOWN; break;
         }
-        tokens.push_back(token);
-        pos++;
     }
-    Token eofToken;
-    eofToken.type = TokenType::END_OF_FILE;
-    eofToken.lexeme = "";
-    tokens.push_back(eofToken);
-    return tokens;
+    token.length = static_cast<uint32_t>(pos - token.offset);
+    return token;
+}
+
+TokenStream Lexer::tokenize() {
+    TokenStream tokens;
+    tokens.source = input;
+    // Typical MiniLang code averages a token every five to ten bytes.
+    size_t estimate = input.size() / 4 + 1;
+    tokens.types.reserve(estimate);
+    tokens.offsets.reserve(estimate);
+    tokens.lengths.reserve(estimate);
+    tokens.values.reserve(estimate);
+    while (true) {
+        Token token = next();
+        uint32_t value = token.symbol;
+        if (token.type == TokenType::NUMBER) {
+            value = static_cast<uint32_t>(tokens.numbers.size());
+            tokens.numbers.push_back(token.number);
+        }
+        tokens.types.push_back(token.type);
+        tokens.offsets.push_back(token.offset);
+        tokens.lengths.push_back(token.length);
+        tokens.values.push_back(value);
+        if (token.type == TokenType::END_OF_FILE)
+            return tokens;
+    }
 }
\ No newline at end of file
@@ -1,11 +1,12 @@
 #ifndef LEXER_HPP
 #define LEXER_HPP
 
-#include <string>
+#include "Symbol.hpp"
+#include <string_view>
 #include <vector>
-#include <cctype>
+#include <cstdint>
 
-enum class TokenType {
+enum class TokenType : uint8_t {
     NUMBER,
     STRING,
     IDENTIFIER,
@@ -16,10 +17,14 @@ enum class TokenType {
     ELSE,
     WHILE,
     RETURN,
+    BREAK,    // 'break' keyword.
+    CONTINUE, // 'continue' keyword.
     CLASS,    // 'class' keyword.
     EXTENDS,  // 'extends' keyword.
     NEW,      // 'new' operator.
     THIS,     // 'this' keyword.
+    SPAWN,    // 'spawn' keyword.
+    IMPORT,   // 'import' keyword.
     PLUS,
     MINUS,
     MULTIPLY,
@@ -31,7 +36,10 @@ enum class TokenType {
     RPAREN,   // ')'
     LBRACE,   // '{'
     RBRACE,   // '}'
+    LBRACKET, // '['
+    RBRACKET, // ']'
     COMMA,
+    AT,       // '@', before an annotation.
     LESS,
     LESS_EQUAL,
     GREATER,
@@ -40,24 +48,48 @@ enum class TokenType {
     UNKNOWN
 };
 
+// A single token, as produced by Lexer::next(). Like TokenStream entries,
+// it references the source by offset and length.
 struct Token {
-    TokenType type;
-    std::string lexeme;
-    double numberValue = 0;
+    TokenType type = TokenType::END_OF_FILE;
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    Symbol symbol = Symbols::NONE; // Identifiers and keywords.
+    double number = 0;             // NUMBER tokens.
 };
 
+// Token stream in struct-of-arrays layout. Tokens do not own any text: they
+// reference the source by offset and length, so the source must outlive the
+// stream. String tokens cover the characters between the quotes.
+struct TokenStream {
+    std::string_view source;
+    std::vector<TokenType> types;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    // Symbol of identifiers and keywords; index into numbers for NUMBER tokens.
+    std::vector<uint32_t> values;
+    std::vector<double> numbers;
+
+    size_t size() const { return types.size(); }
+    std::string_view text(size_t index) const { return source.substr(offsets[index], lengths[index]); }
+};
+
+// Tokenizes source text in place, without copying it. Tokens are pulled one
+// at a time with next(), or all at once with tokenize().
 class Lexer {
 public:
-    Lexer(const std::string &input);
-    std::vector<Token> tokenize();
+    explicit Lexer(std::string_view input);
+    // Returns the next token; END_OF_FILE is returned once input runs out.
+    Token next();
+    TokenStream tokenize();
+    std::string_view source() const { return input; }
+    std::string_view text(const Token& token) const { return input.substr(token.offset, token.length); }
 private:
-    char peek() const;
-    char get();
     void skipWhitespace();
-    Token number();
-    Token identifier();
-    Token string();
-    std::string input;
+    void number(Token& token);
+    void identifier(Token& token);
+    void string(Token& token);
+    std::string_view input;
     size_t pos;
 };
 
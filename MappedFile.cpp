@@ -0,0 +1,39 @@
+#include "MappedFile.hpp"
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path, Access access) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open file: " + path);
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* address = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            ::madvise(address, static_cast<size_t>(info.st_size),
+                      access == Access::SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM);
+            data = static_cast<const char*>(address);
+            size = static_cast<size_t>(info.st_size);
+            mapped = true;
+            ::close(fd);
+            return;
+        }
+    }
+    char buffer[65536];
+    ssize_t count;
+    while ((count = ::read(fd, buffer, sizeof(buffer))) > 0)
+        fallback.append(buffer, static_cast<size_t>(count));
+    ::close(fd);
+    if (count < 0)
+        throw std::runtime_error("Cannot read file: " + path);
+    data = fallback.data();
+    size = fallback.size();
+}
+
+MappedFile::~MappedFile() {
+    if (mapped)
+        ::munmap(const_cast<char*>(data), size);
+}
\ No newline at end of file
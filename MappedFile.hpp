@@ -0,0 +1,31 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only view of a whole file, memory-mapped so that its contents are
+// paged in on demand instead of being copied into a buffer. Files that
+// cannot be mapped (empty files, pipes) are read into memory instead.
+class MappedFile {
+public:
+    // How the contents will be read, as a hint to the kernel's read-ahead.
+    enum class Access { SEQUENTIAL, RANDOM };
+
+    // Throws std::runtime_error if the file cannot be opened.
+    explicit MappedFile(const std::string& path, Access access = Access::SEQUENTIAL);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view text() const { return std::string_view(data, size); }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::string fallback;
+};
+
+#endif // MAPPEDFILE_HPP
\ No newline at end of file
@@ -0,0 +1,240 @@
+#include "Modules.hpp"
+#include "CodeGenerator.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "Resolver.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Paths of the modules a source imports. An import keyword outside braces
+// can only start an import declaration, so the tokens tell without parsing;
+// the parser reports misplaced and malformed ones later. Most files import
+// nothing and are not even lexed.
+std::vector<std::string> scanImports(std::string_view source) {
+    std::vector<std::string> paths;
+    if (source.find("import") == std::string_view::npos)
+        return paths;
+    Lexer lexer(source);
+    int depth = 0;
+    for (Token token = lexer.next(); token.type != TokenType::END_OF_FILE; token = lexer.next()) {
+        if (token.type == TokenType::LBRACE)
+            depth++;
+        else if (token.type == TokenType::RBRACE)
+            depth--;
+        if (token.type != TokenType::IMPORT || depth != 0)
+            continue;
+        token = lexer.next();
+        if (token.type == TokenType::STRING)
+            paths.emplace_back(lexer.text(token));
+    }
+    return paths;
+}
+
+std::string typeName(StaticType type) {
+    switch (type.kind) {
+        case TypeKind::UNKNOWN: return "unknown";
+        case TypeKind::INTEGER: return "integer";
+        case TypeKind::NUMBER: return "number";
+        case TypeKind::STRING: return "string";
+        case TypeKind::ARRAY: return "array";
+        case TypeKind::OBJECT: return "object:" + std::string(symbolName(type.className));
+        case TypeKind::TASK: return "task:" + typeName({type.result});
+    }
+    return "unknown";
+}
+
+StaticType parseType(std::string_view text) {
+    StaticType type;
+    size_t colon = text.find(':');
+    std::string_view kind = text.substr(0, colon);
+    std::string_view detail = colon == std::string_view::npos ? std::string_view() : text.substr(colon + 1);
+    if (kind == "integer")
+        type.kind = TypeKind::INTEGER;
+    else if (kind == "number")
+        type.kind = TypeKind::NUMBER;
+    else if (kind == "string")
+        type.kind = TypeKind::STRING;
+    else if (kind == "array")
+        type.kind = TypeKind::ARRAY;
+    else if (kind == "object") {
+        type.kind = TypeKind::OBJECT;
+        type.className = intern(detail);
+    } else if (kind == "task") {
+        type.kind = TypeKind::TASK;
+        type.result = parseType(detail).kind;
+    }
+    return type;
+}
+
+} // namespace
+
+ModuleGraph::ModuleGraph(const std::string& path) {
+    std::vector<Loading> stack;
+    std::unordered_map<std::string, Module*> loaded;
+    load(path, stack, loaded);
+    // Modules come after everything they import, so the dependencies of
+    // each import are known by then.
+    std::unordered_map<const Module*, size_t> order;
+    for (const std::unique_ptr<Module>& module : modules) {
+        std::unordered_set<Module*> seen;
+        for (Module* imported : module->imports) {
+            for (Module* dependency : imported->dependencies)
+                seen.insert(dependency);
+            seen.insert(imported);
+        }
+        module->dependencies.assign(seen.begin(), seen.end());
+        std::sort(module->dependencies.begin(), module->dependencies.end(),
+                  [&order](const Module* a, const Module* b) { return order.at(a) < order.at(b); });
+        order.emplace(module.get(), order.size());
+    }
+}
+
+Module* ModuleGraph::load(const std::string& path, std::vector<Loading>& stack,
+                          std::unordered_map<std::string, Module*>& loaded) {
+    std::error_code error;
+    std::string identity = fs::weakly_canonical(path, error).string();
+    if (error)
+        identity = path;
+    auto found = loaded.find(identity);
+    if (found != loaded.end())
+        return found->second;
+    auto cycle = std::find_if(stack.begin(), stack.end(),
+                              [&identity](const Loading& loading) { return loading.identity == identity; });
+    if (cycle != stack.end()) {
+        std::string message = "Import cycle: ";
+        for (auto it = cycle; it != stack.end(); ++it)
+            message += it->path + " -> ";
+        throw std::runtime_error(message + path);
+    }
+
+    // The file is mapped before its imports are loaded, so that they come
+    // first in modules.
+    auto module = std::make_unique<Module>(path);
+    stack.push_back({identity, path});
+    std::vector<Module*> imports;
+    for (const std::string& name : scanImports(module->source.text())) {
+        fs::path imported = (fs::path(path).parent_path() / name).lexically_normal();
+        if (!imported.has_extension())
+            imported += EXTENSION;
+        if (!fs::is_regular_file(imported, error))
+            throw std::runtime_error(path + ": Cannot find module " + imported.string());
+        Module* dependency = load(imported.string(), stack, loaded);
+        if (std::find(imports.begin(), imports.end(), dependency) == imports.end())
+            imports.push_back(dependency);
+    }
+    stack.pop_back();
+    module->imports = std::move(imports);
+    Module* result = module.get();
+    loaded.emplace(identity, result);
+    modules.push_back(std::move(module));
+    return result;
+}
+
+std::unique_ptr<Program> ModuleGraph::parse(const Module& module) const {
+    Lexer lexer(module.source.text());
+    Parser parser(lexer);
+    if (&module == &program())
+        return parser.parse();
+    try {
+        std::unique_ptr<Program> parsed = parser.parse();
+        for (auto& stmt : parsed->statements) {
+            if (stmt->kind != NodeKind::FUNCTION_DECLARATION)
+                throw std::runtime_error("A module may only declare functions.");
+        }
+        // The Resolver rejects any variable that is not a local.
+        Resolver().resolve(parsed.get());
+        return parsed;
+    } catch (const std::exception& e) {
+        throw std::runtime_error(module.path + ": " + e.what());
+    }
+}
+
+std::unique_ptr<Program> ModuleGraph::parseAll() {
+    std::unique_ptr<Program> root = parse(program());
+    if (!hasImports())
+        return root;
+    std::vector<Statement*> statements;
+    std::unordered_map<Symbol, const Module*> definedIn;
+    for (const std::unique_ptr<Module>& module : modules) {
+        if (module.get() == &program())
+            break;
+        parsed.push_back(parse(*module));
+        Program& functions = *parsed.back();
+        for (auto& stmt : functions.statements) {
+            Symbol name = static_cast<FunctionDeclaration*>(stmt)->name;
+            auto [it, added] = definedIn.emplace(name, module.get());
+            if (!added)
+                throw std::runtime_error("Function " + std::string(symbolName(name)) + " is defined in both " +
+                                         it->second->path + " and " + module->path);
+            statements.push_back(stmt);
+        }
+        root->usesTasks |= functions.usesTasks;
+    }
+    for (auto& stmt : root->statements) {
+        auto funcDecl = nodeCast<FunctionDeclaration>(stmt);
+        auto defined = funcDecl ? definedIn.find(funcDecl->name) : definedIn.end();
+        if (defined != definedIn.end())
+            throw std::runtime_error("Function " + std::string(symbolName(funcDecl->name)) + " is defined in both " +
+                                     defined->second->path + " and " + program().path);
+        statements.push_back(stmt);
+    }
+    root->statements = root->arena.copyArray(statements);
+    return root;
+}
+
+std::string ModuleGraph::interface(const Program& module) {
+    std::ostringstream out;
+    for (auto& stmt : module.statements) {
+        auto funcDecl = static_cast<FunctionDeclaration*>(stmt);
+        out << symbolName(funcDecl->name) << " " << typeName(funcDecl->returnType) << " "
+            << (CodeGenerator::memoized(funcDecl) ? "memo" : "nomemo");
+        for (size_t i = 0; i < funcDecl->params.size(); i++)
+            out << " " << symbolName(funcDecl->params[i]) << ":" << typeName(funcDecl->paramTypes[i]);
+        out << "\n";
+    }
+    return out.str();
+}
+
+void ModuleGraph::declareImports(Program& program, const Module& module) {
+    std::unordered_map<Symbol, const Module*> definedIn;
+    for (auto& stmt : program.statements) {
+        if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt))
+            definedIn.emplace(funcDecl->name, &module);
+    }
+    std::vector<FunctionDeclaration*> externs;
+    for (const Module* dependency : module.dependencies) {
+        std::istringstream lines(dependency->interface);
+        std::string line;
+        while (std::getline(lines, line)) {
+            std::istringstream fields(line);
+            std::string name, result, memo, param;
+            fields >> name >> result >> memo;
+            auto funcDecl = program.arena.make<FunctionDeclaration>();
+            funcDecl->name = intern(name);
+            auto [it, added] = definedIn.emplace(funcDecl->name, dependency);
+            if (!added)
+                throw std::runtime_error("Function " + name + " is defined in both " + dependency->path + " and " +
+                                         it->second->path);
+            funcDecl->returnType = parseType(result);
+            funcDecl->memoize = memo == "memo";
+            std::vector<Symbol> params;
+            std::vector<StaticType> paramTypes;
+            while (fields >> param) {
+                size_t colon = param.find(':');
+                params.push_back(intern(std::string_view(param).substr(0, colon)));
+                paramTypes.push_back(parseType(std::string_view(param).substr(colon + 1)));
+            }
+            funcDecl->params = program.arena.copyArray(params);
+            funcDecl->paramTypes = program.arena.copyArray(paramTypes);
+            externs.push_back(funcDecl);
+        }
+    }
+    program.externs = program.arena.copyArray(externs);
+}
@@ -0,0 +1,81 @@
+#ifndef MODULES_HPP
+#define MODULES_HPP
+
+#include "AST.hpp"
+#include "MappedFile.hpp"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// A source file of the program: the program itself or a module it imports.
+struct Module {
+    explicit Module(const std::string& path) : path(path), source(path) {}
+
+    std::string path;                  // As opened, relative to the working directory.
+    MappedFile source;
+    std::vector<Module*> imports;      // Directly, in the order written.
+    std::vector<Module*> dependencies; // Imported directly or not, in dependency order.
+    // Functions the module provides, one per line, once the C++ backend has
+    // compiled it; see ModuleGraph::interface.
+    std::string interface;
+};
+
+// The program and every module it imports, directly or not. import "path";
+// names a file relative to the importing file's directory; the .minilang
+// extension may be left out. A module declares functions only, which may
+// not use the globals of the program: a module is compiled on its own, and
+// the functions of the modules it imports, directly or not, are all it sees.
+// Import cycles and a function defined in two files are errors.
+class ModuleGraph {
+public:
+    static constexpr const char* EXTENSION = ".minilang";
+
+    // Reads the program at path and finds its imports by scanning tokens,
+    // without parsing. Throws if a module is missing or imports form a cycle.
+    explicit ModuleGraph(const std::string& path);
+
+    Module& program() const { return *modules.back(); }
+    // Every file, each after the modules it imports, the program last.
+    const std::vector<std::unique_ptr<Module>>& files() const { return modules; }
+    bool hasImports() const { return modules.size() > 1; }
+
+    // Parses a file. A module is also checked to declare functions only,
+    // which use no globals. Errors name the file.
+    std::unique_ptr<Program> parse(const Module& module) const;
+
+    // For the backends that run a whole program at once: parses every file
+    // and puts the functions of the modules ahead of the program's
+    // statements. The functions live in the graph, which must outlive the
+    // result.
+    std::unique_ptr<Program> parseAll();
+
+    // The functions of a compiled module, for the programs importing it: one
+    // line per function with its name, result type, whether it is memoized,
+    // and its parameters with their types. Importers are compiled against
+    // it, so they are rebuilt when it changes, not when the module does.
+    static std::string interface(const Program& module);
+
+    // Declares the functions of the modules a file imports, directly or
+    // not, as the program's externs, from their interfaces. Throws if a
+    // function is defined twice.
+    static void declareImports(Program& program, const Module& module);
+
+private:
+    std::vector<std::unique_ptr<Module>> modules;
+    std::vector<std::unique_ptr<Program>> parsed; // By parseAll().
+
+    // A file being loaded: its canonical path, which identifies it, and its
+    // path as imported, for errors.
+    struct Loading {
+        std::string identity;
+        std::string path;
+    };
+
+    // Loads the file at path, after the modules it imports.
+    Module* load(const std::string& path, std::vector<Loading>& stack,
+                 std::unordered_map<std::string, Module*>& loaded);
+};
+
+#endif // MODULES_HPP
@@ -0,0 +1,227 @@
+#include "NativeTier.hpp"
+#include "ASTVisitor.hpp"
+#include "BuildCache.hpp"
+#include "Builtins.hpp"
+#include "CodeGenerator.hpp"
+#include <cstdlib>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unordered_set>
+
+extern char** environ;
+
+// Decides whether functions compile to native code that behaves exactly like
+// the interpreter: every value must be a number and every variable a local.
+// Collects the functions called, which are compiled along with the hot one,
+// and records the types the CodeGenerator needs: comparisons are whole
+// numbers, everything else is a double.
+class NativeTier::Checker : private ASTVisitor<NativeTier::Checker, bool, bool> {
+public:
+    static constexpr const char* PASS_NAME = "native tier";
+
+    explicit Checker(const std::function<FunctionDeclaration*(Symbol)>& lookup) : lookup(lookup) {}
+
+    // The function and its callees, hot function first; empty if any of them
+    // does not qualify.
+    std::vector<FunctionDeclaration*> check(FunctionDeclaration* funcDecl) {
+        add(funcDecl);
+        for (size_t i = 0; i < functions.size(); i++) {
+            if (functions[i]->params.size() > MAX_PARAMS || !visitBlockStatement(functions[i]->body))
+                return {};
+        }
+        return functions;
+    }
+
+private:
+    const std::function<FunctionDeclaration*(Symbol)>& lookup;
+    std::vector<FunctionDeclaration*> functions;
+    std::unordered_set<FunctionDeclaration*> seen;
+    // Name being declared. Its initializer sees the enclosing binding, where
+    // C++ would see the new variable.
+    Symbol declaring = Symbols::NONE;
+
+    friend class ASTVisitor<NativeTier::Checker, bool, bool>;
+
+    void add(FunctionDeclaration* funcDecl) {
+        if (seen.insert(funcDecl).second)
+            functions.push_back(funcDecl);
+    }
+
+    bool number(Expression* expr) {
+        expr->type = TypeKind::NUMBER;
+        return true;
+    }
+
+    // Statements.
+    bool visitVariableDeclaration(VariableDeclaration* varDecl) {
+        declaring = varDecl->identifier;
+        bool ok = visit(varDecl->expression);
+        declaring = Symbols::NONE;
+        return ok;
+    }
+    bool visitPrintStatement(PrintStatement* printStmt) { return visit(printStmt->expression); }
+    bool visitExpressionStatement(ExpressionStatement* exprStmt) { return visit(exprStmt->expression); }
+    bool visitBlockStatement(BlockStatement* block) {
+        for (auto& stmt : block->statements) {
+            if (!visit(stmt))
+                return false;
+        }
+        return true;
+    }
+    bool visitIfStatement(IfStatement* ifStmt) {
+        return visit(ifStmt->condition) && visitBlockStatement(ifStmt->thenBranch) &&
+               (!ifStmt->elseBranch || visitBlockStatement(ifStmt->elseBranch));
+    }
+    bool visitWhileStatement(WhileStatement* whileStmt) {
+        return visit(whileStmt->condition) && visitBlockStatement(whileStmt->body);
+    }
+    bool visitReturnStatement(ReturnStatement* returnStmt) {
+        return !returnStmt->expression || visit(returnStmt->expression);
+    }
+    bool visitBreakStatement(BreakStatement*) { return true; }
+    bool visitContinueStatement(ContinueStatement*) { return true; }
+    bool visitFunctionDeclaration(FunctionDeclaration*) { return false; }
+    bool visitClassDeclaration(ClassDeclaration*) { return false; }
+
+    // Expressions.
+    bool visitNumericLiteral(NumericLiteral* num) { return number(num); }
+    bool visitStringLiteral(StringLiteral*) { return false; }
+    bool visitIdentifier(Identifier* id) {
+        return id->address.depth == 0 && id->name != declaring && number(id);
+    }
+    bool visitAssignment(Assignment* assign) {
+        return assign->address.depth == 0 && assign->name != declaring && visit(assign->value) && number(assign);
+    }
+    bool visitBinaryExpression(BinaryExpression* bin) {
+        if (!visit(bin->left) || !visit(bin->right))
+            return false;
+        bool comparison = bin->op != BinaryOp::ADD && bin->op != BinaryOp::SUBTRACT &&
+                          bin->op != BinaryOp::MULTIPLY && bin->op != BinaryOp::DIVIDE;
+        bin->type = comparison ? TypeKind::INTEGER : TypeKind::NUMBER;
+        return true;
+    }
+    bool visitUnaryExpression(UnaryExpression* unary) { return visit(unary->argument) && number(unary); }
+    bool visitCallExpression(CallExpression* callExpr) {
+        auto calleeId = nodeCast<Identifier>(callExpr->callee);
+        if (!calleeId)
+            return false;
+        // Built-ins are not in the table: they work on strings.
+        FunctionDeclaration* callee = lookup(calleeId->name);
+        if (!callee || callExpr->arguments.size() > callee->params.size())
+            return false;
+        for (auto& arg : callExpr->arguments) {
+            if (!visit(arg))
+                return false;
+        }
+        add(callee);
+        return number(callExpr);
+    }
+    bool visitMemberAccessExpression(MemberAccessExpression*) { return false; }
+    bool visitNewExpression(NewExpression*) { return false; }
+    bool visitArrayLiteral(ArrayLiteral*) { return false; }
+    bool visitIndexExpression(IndexExpression*) { return false; }
+    bool visitIndexAssignment(IndexAssignment*) { return false; }
+    bool visitSpawnExpression(SpawnExpression*) { return false; }
+    bool visitParallelFor(ParallelFor*) { return false; }
+};
+
+NativeTier::~NativeTier() {
+    for (Job& job : jobs) {
+        if (job.compiler > 0) {
+            ::kill(job.compiler, SIGKILL);
+            ::waitpid(job.compiler, nullptr, 0);
+        }
+        if (job.handle)
+            ::dlclose(job.handle);
+    }
+    if (!directory.empty()) {
+        std::error_code error;
+        std::filesystem::remove_all(directory, error);
+    }
+}
+
+int NativeTier::compile(FunctionDeclaration* funcDecl, const std::function<FunctionDeclaration*(Symbol)>& lookup) {
+    std::vector<FunctionDeclaration*> functions = Checker(lookup).check(funcDecl);
+    if (functions.empty())
+        return -1;
+    if (directory.empty()) {
+        std::string pattern = std::filesystem::temp_directory_path().string() + "/minilang-native-XXXXXX";
+        if (!::mkdtemp(pattern.data()))
+            return -1;
+        directory = pattern;
+    }
+
+    int id = static_cast<int>(jobs.size());
+    Job& job = jobs.emplace_back();
+    std::string base = directory + "/" + std::to_string(id);
+    std::string source = base + ".cpp";
+    job.library = base + ".so";
+    std::string code = CodeGenerator().generateNative(functions);
+    std::string compiler = BuildCache::cxxCompiler();
+    std::vector<std::string> command = {compiler, "-std=c++17", "-O2", "-shared", "-fPIC", "-o", job.library, source};
+
+    static const std::string version = BuildCache::compilerVersion(compiler);
+    job.key = BuildCache::key({"native", "-std=c++17 -O2 -shared -fPIC", version, code});
+    if (BuildCache().fetch(job.key, job.library)) {
+        if (!load(job))
+            job.state = State::FAILED;
+        return id;
+    }
+
+    std::ofstream(source) << code;
+    // The compiler's diagnostics would interleave with program output.
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    std::vector<char*> argv;
+    for (std::string& arg : command)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+    if (::posix_spawnp(&job.compiler, compiler.c_str(), &actions, nullptr, argv.data(), environ) != 0) {
+        job.compiler = -1;
+        job.state = State::FAILED;
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    return id;
+}
+
+NativeTier::State NativeTier::poll(int id, NativeFunction& native) {
+    Job& job = jobs[id];
+    if (job.state == State::COMPILING) {
+        int status;
+        pid_t done = ::waitpid(job.compiler, &status, WNOHANG);
+        if (done == 0)
+            return job.state;
+        job.compiler = -1;
+        if (done > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            BuildCache().store(job.key, job.library);
+            if (!load(job))
+                job.state = State::FAILED;
+        } else {
+            job.state = State::FAILED;
+        }
+    }
+    native = job.native;
+    return job.state;
+}
+
+// Output from native code goes through the interpreter's buffer, so that it
+// stays in order with the rest.
+bool NativeTier::load(Job& job) {
+    job.handle = ::dlopen(job.library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!job.handle)
+        return false;
+    auto bind = reinterpret_cast<void (*)(void (*)(double))>(::dlsym(job.handle, "minilang_bind"));
+    job.native = reinterpret_cast<NativeFunction>(::dlsym(job.handle, "minilang_entry"));
+    if (!bind || !job.native)
+        return false;
+    bind(static_cast<void (*)(double)>(&print));
+    job.state = State::READY;
+    return true;
+}
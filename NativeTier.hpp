@@ -0,0 +1,66 @@
+#ifndef NATIVETIER_HPP
+#define NATIVETIER_HPP
+
+#include "AST.hpp"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// Native code for a function: takes its arguments, all numbers, and returns
+// its result.
+using NativeFunction = double (*)(const double* args);
+
+// Compiles hot interpreted functions to machine code. A function qualifies if
+// it and every function it calls work on numbers only and touch no globals;
+// those are the functions whose C++ translation behaves exactly like the
+// interpreter. The CodeGenerator emits them as a shared object, the local C++
+// compiler builds it in a child process while the interpreter keeps running,
+// and the result is loaded with dlopen. Shared objects are kept in the
+// BuildCache, so a function compiled once loads at once on later runs.
+class NativeTier {
+public:
+    // Calls plus loop back-edges after which a function is compiled.
+    static constexpr unsigned HOT_THRESHOLD = 1000;
+    static constexpr size_t MAX_PARAMS = 16;
+
+    enum class State {
+        COMPILING,
+        READY,
+        FAILED // The compiler or the loader failed; stay interpreted.
+    };
+
+    NativeTier() = default;
+    // Stops compilations still running and unloads the native code.
+    ~NativeTier();
+    NativeTier(const NativeTier&) = delete;
+    NativeTier& operator=(const NativeTier&) = delete;
+
+    // Starts compiling funcDecl together with the functions it calls, which
+    // lookup finds by name. Returns a job to poll, or -1 if the function
+    // does not qualify.
+    int compile(FunctionDeclaration* funcDecl, const std::function<FunctionDeclaration*(Symbol)>& lookup);
+
+    // Checks on a job without blocking; sets native once it is READY.
+    State poll(int job, NativeFunction& native);
+
+private:
+    class Checker;
+
+    struct Job {
+        State state = State::COMPILING;
+        pid_t compiler = -1; // Running compiler, or -1.
+        std::string key;     // BuildCache key of the shared object.
+        std::string library; // Path of the shared object.
+        void* handle = nullptr;
+        NativeFunction native = nullptr;
+    };
+
+    std::vector<Job> jobs;
+    std::string directory; // Scratch files, created on first use.
+
+    bool load(Job& job);
+};
+
+#endif // NATIVETIER_HPP
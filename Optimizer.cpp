@@ -0,0 +1,485 @@
+#include "Optimizer.hpp"
+#include <string>
+#include <vector>
+
+// First pass: binds every declaration to a Variable with the Resolver's
+// scoping rules and counts the writes to each variable.
+class Optimizer::Binder : private ASTVisitor<Optimizer::Binder, void> {
+public:
+    static constexpr const char* PASS_NAME = "optimizer";
+
+    explicit Binder(Optimizer& optimizer) : optimizer(optimizer) {}
+
+    void bind(Program* program) {
+        for (auto& stmt : program->statements) {
+            if (stmt->kind != NodeKind::FUNCTION_DECLARATION)
+                visit(stmt);
+        }
+        // As in the Resolver, functions see every global. So do methods,
+        // which are left as written but may assign globals; a field with the
+        // same name counts as one too, which only costs a propagation.
+        for (auto& stmt : program->statements) {
+            if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt)) {
+                bindFunction(funcDecl);
+            } else if (auto classDecl = nodeCast<ClassDeclaration>(stmt)) {
+                for (auto& member : classDecl->body->statements) {
+                    if (auto method = nodeCast<FunctionDeclaration>(member))
+                        bindFunction(method);
+                    else if (auto field = nodeCast<VariableDeclaration>(member))
+                        visit(field->expression);
+                }
+            }
+        }
+    }
+
+private:
+    Optimizer& optimizer;
+    Scopes scopes;
+
+    friend class ASTVisitor<Optimizer::Binder, void>;
+
+    void bindFunction(FunctionDeclaration* funcDecl) {
+        scopes.inFunction = true;
+        scopes.begin();
+        for (auto& param : funcDecl->params)
+            scopes.declare(param, &optimizer.parameter);
+        visitBlockStatement(funcDecl->body);
+        scopes.end();
+        scopes.inFunction = false;
+    }
+
+    // Redeclaring a name in the same scope rebinds the same variable, so it
+    // counts as another write.
+    void visitVariableDeclaration(VariableDeclaration* varDecl) {
+        visit(varDecl->expression);
+        Variable* variable = scopes.declared(varDecl->identifier);
+        if (!variable) {
+            optimizer.variables.emplace_back();
+            variable = &optimizer.variables.back();
+            scopes.declare(varDecl->identifier, variable);
+        }
+        variable->writes++;
+        optimizer.declarations[varDecl] = variable;
+    }
+
+    void visitPrintStatement(PrintStatement* printStmt) { visit(printStmt->expression); }
+
+    void visitExpressionStatement(ExpressionStatement* exprStmt) { visit(exprStmt->expression); }
+
+    void visitBlockStatement(BlockStatement* block) {
+        scopes.begin();
+        for (auto& stmt : block->statements)
+            visit(stmt);
+        scopes.end();
+    }
+
+    void visitIfStatement(IfStatement* ifStmt) {
+        visit(ifStmt->condition);
+        visitBlockStatement(ifStmt->thenBranch);
+        if (ifStmt->elseBranch)
+            visitBlockStatement(ifStmt->elseBranch);
+    }
+
+    void visitWhileStatement(WhileStatement* whileStmt) {
+        visit(whileStmt->condition);
+        visitBlockStatement(whileStmt->body);
+    }
+
+    void visitReturnStatement(ReturnStatement* returnStmt) {
+        if (returnStmt->expression)
+            visit(returnStmt->expression);
+    }
+
+    void visitBreakStatement(BreakStatement*) {}
+    void visitContinueStatement(ContinueStatement*) {}
+    void visitFunctionDeclaration(FunctionDeclaration*) {}
+    void visitClassDeclaration(ClassDeclaration*) {}
+
+    void visitNumericLiteral(NumericLiteral*) {}
+    void visitStringLiteral(StringLiteral*) {}
+    void visitIdentifier(Identifier*) {}
+
+    void visitAssignment(Assignment* assign) {
+        visit(assign->value);
+        bool global = false;
+        if (Variable* variable = scopes.lookup(assign->name, global))
+            variable->writes++;
+    }
+
+    void visitBinaryExpression(BinaryExpression* bin) {
+        visit(bin->left);
+        visit(bin->right);
+    }
+
+    void visitUnaryExpression(UnaryExpression* unary) { visit(unary->argument); }
+
+    void visitCallExpression(CallExpression* callExpr) {
+        if (callExpr->callee->kind != NodeKind::IDENTIFIER)
+            visit(callExpr->callee);
+        for (auto& arg : callExpr->arguments)
+            visit(arg);
+    }
+
+    void visitMemberAccessExpression(MemberAccessExpression* memberAccess) { visit(memberAccess->object); }
+
+    void visitNewExpression(NewExpression* newExpr) {
+        for (auto& arg : newExpr->arguments)
+            visit(arg);
+    }
+
+    void visitArrayLiteral(ArrayLiteral* arrayLit) {
+        for (auto& element : arrayLit->elements)
+            visit(element);
+    }
+
+    void visitIndexExpression(IndexExpression* indexExpr) {
+        visit(indexExpr->array);
+        visit(indexExpr->index);
+    }
+
+    // Writes an element, not the variable holding the array.
+    void visitIndexAssignment(IndexAssignment* indexAssign) {
+        visit(indexAssign->array);
+        visit(indexAssign->index);
+        visit(indexAssign->value);
+    }
+
+    void visitSpawnExpression(SpawnExpression* spawnExpr) { visitCallExpression(spawnExpr->call); }
+
+    void visitParallelFor(ParallelFor* loop) {
+        visit(loop->from);
+        visit(loop->to);
+    }
+};
+
+Optimizer::Variable* Optimizer::Scopes::declared(Symbol name) const {
+    if (starts.empty()) {
+        auto found = globals.find(name);
+        return found == globals.end() ? nullptr : found->second;
+    }
+    for (size_t i = starts.back(); i < locals.size(); i++) {
+        if (locals[i].first == name)
+            return locals[i].second;
+    }
+    return nullptr;
+}
+
+void Optimizer::Scopes::declare(Symbol name, Variable* variable) {
+    if (starts.empty())
+        globals[name] = variable;
+    else if (!declared(name))
+        locals.emplace_back(name, variable);
+}
+
+Optimizer::Variable* Optimizer::Scopes::lookup(Symbol name, bool& global) const {
+    for (auto it = locals.rbegin(); it != locals.rend(); ++it) {
+        if (it->first == name)
+            return it->second;
+    }
+    auto found = globals.find(name);
+    if (found == globals.end())
+        return nullptr;
+    global = true;
+    return found->second;
+}
+
+// Evaluates an operator the way the Interpreter and the VM do.
+static double applyOperator(BinaryOp op, double left, double right) {
+    switch (op) {
+        case BinaryOp::ADD: return left + right;
+        case BinaryOp::SUBTRACT: return left - right;
+        case BinaryOp::MULTIPLY: return left * right;
+        case BinaryOp::DIVIDE: return left / right;
+        case BinaryOp::LESS: return left < right ? 1.0 : 0.0;
+        case BinaryOp::LESS_EQUAL: return left <= right ? 1.0 : 0.0;
+        case BinaryOp::GREATER: return left > right ? 1.0 : 0.0;
+        case BinaryOp::GREATER_EQUAL: return left >= right ? 1.0 : 0.0;
+    }
+    return 0;
+}
+
+// Returns true if expr is a literal, setting truthy to its truth value.
+static bool constantCondition(Expression* expr, bool& truthy) {
+    if (auto num = nodeCast<NumericLiteral>(expr)) {
+        truthy = num->value != 0;
+        return true;
+    }
+    if (auto str = nodeCast<StringLiteral>(expr)) {
+        truthy = !str->value.empty();
+        return true;
+    }
+    return false;
+}
+
+// True if no path through stmt reaches the statement after it: each ends
+// in a return, break or continue, as both branches of an if may.
+static bool endsControlFlow(Statement* stmt) {
+    switch (stmt->kind) {
+        case NodeKind::RETURN_STATEMENT:
+        case NodeKind::BREAK_STATEMENT:
+        case NodeKind::CONTINUE_STATEMENT:
+            return true;
+        case NodeKind::BLOCK_STATEMENT:
+            for (auto& s : static_cast<BlockStatement*>(stmt)->statements) {
+                if (endsControlFlow(s))
+                    return true;
+            }
+            return false;
+        case NodeKind::IF_STATEMENT: {
+            auto ifStmt = static_cast<IfStatement*>(stmt);
+            return ifStmt->elseBranch && endsControlFlow(ifStmt->thenBranch) && endsControlFlow(ifStmt->elseBranch);
+        }
+        default:
+            return false;
+    }
+}
+
+void Optimizer::optimize(Program* program) {
+    arena = &program->arena;
+    variables.clear();
+    declarations.clear();
+    scopes = Scopes();
+    Binder(*this).bind(program);
+    // Declarations after a top-level return are kept: functions are hoisted,
+    // and their bodies may name globals declared there.
+    optimizeStatements(program->statements, true);
+}
+
+bool Optimizer::optimizeStatements(ArenaArray<Statement*>& statements, bool keepDeclarations) {
+    std::vector<Statement*> kept;
+    kept.reserve(statements.size());
+    bool changed = false;
+    bool reachable = true;
+    for (auto& stmt : statements) {
+        if (!reachable) {
+            bool declaration = stmt->kind == NodeKind::FUNCTION_DECLARATION ||
+                               stmt->kind == NodeKind::CLASS_DECLARATION ||
+                               stmt->kind == NodeKind::VARIABLE_DECLARATION;
+            if (keepDeclarations && declaration) {
+                kept.push_back(visit(stmt));
+            } else {
+                counts.removedStatements++;
+                changed = true;
+            }
+            continue;
+        }
+        Statement* result = visit(stmt);
+        if (result != stmt)
+            changed = true;
+        if (!result)
+            continue;
+        kept.push_back(result);
+        if (endsControlFlow(result))
+            reachable = false;
+    }
+    if (changed)
+        statements = arena->copyArray(kept);
+    return changed;
+}
+
+void Optimizer::optimizeArguments(ArenaArray<Expression*>& arguments) {
+    for (auto& arg : arguments)
+        arg = visit(arg);
+}
+
+NumericLiteral* Optimizer::numberLiteral(double value) {
+    auto num = arena->make<NumericLiteral>();
+    num->value = value;
+    return num;
+}
+
+// Only numbers are propagated: the Interpreter allocates a new string each
+// time it evaluates a string literal, while a variable read shares one.
+Statement* Optimizer::visitVariableDeclaration(VariableDeclaration* varDecl) {
+    varDecl->expression = visit(varDecl->expression);
+    Variable* variable = declarations[varDecl];
+    if (variable->writes == 1 && varDecl->expression->kind == NodeKind::NUMERIC_LITERAL)
+        variable->constant = varDecl->expression;
+    scopes.declare(varDecl->identifier, variable);
+    return varDecl;
+}
+
+Statement* Optimizer::visitPrintStatement(PrintStatement* printStmt) {
+    printStmt->expression = visit(printStmt->expression);
+    return printStmt;
+}
+
+Statement* Optimizer::visitExpressionStatement(ExpressionStatement* exprStmt) {
+    exprStmt->expression = visit(exprStmt->expression);
+    return exprStmt;
+}
+
+Statement* Optimizer::visitBlockStatement(BlockStatement* block) {
+    scopes.begin();
+    optimizeStatements(block->statements, false);
+    scopes.end();
+    return block;
+}
+
+// An if with a constant condition is replaced by the block it would run,
+// which keeps that block's scope.
+Statement* Optimizer::visitIfStatement(IfStatement* ifStmt) {
+    ifStmt->condition = visit(ifStmt->condition);
+    bool truthy;
+    if (constantCondition(ifStmt->condition, truthy)) {
+        counts.eliminatedBranches++;
+        BlockStatement* taken = truthy ? ifStmt->thenBranch : ifStmt->elseBranch;
+        if (!taken)
+            return nullptr;
+        visitBlockStatement(taken);
+        return taken->statements.empty() ? nullptr : taken;
+    }
+    visitBlockStatement(ifStmt->thenBranch);
+    if (ifStmt->elseBranch)
+        visitBlockStatement(ifStmt->elseBranch);
+    return ifStmt;
+}
+
+Statement* Optimizer::visitWhileStatement(WhileStatement* whileStmt) {
+    whileStmt->condition = visit(whileStmt->condition);
+    bool truthy;
+    if (constantCondition(whileStmt->condition, truthy) && !truthy) {
+        counts.eliminatedBranches++;
+        return nullptr;
+    }
+    visitBlockStatement(whileStmt->body);
+    return whileStmt;
+}
+
+Statement* Optimizer::visitReturnStatement(ReturnStatement* returnStmt) {
+    if (returnStmt->expression)
+        returnStmt->expression = visit(returnStmt->expression);
+    return returnStmt;
+}
+
+Statement* Optimizer::visitBreakStatement(BreakStatement* breakStmt) {
+    return breakStmt;
+}
+
+Statement* Optimizer::visitContinueStatement(ContinueStatement* continueStmt) {
+    return continueStmt;
+}
+
+// Nested functions are never callable and are left as written.
+Statement* Optimizer::visitFunctionDeclaration(FunctionDeclaration* funcDecl) {
+    if (scopes.inFunction || !scopes.starts.empty())
+        return funcDecl;
+    scopes.inFunction = true;
+    scopes.begin();
+    for (auto& param : funcDecl->params)
+        scopes.declare(param, &parameter);
+    visitBlockStatement(funcDecl->body);
+    scopes.end();
+    scopes.inFunction = false;
+    return funcDecl;
+}
+
+// Classes are only compiled by the CodeGenerator and are left as written.
+Statement* Optimizer::visitClassDeclaration(ClassDeclaration* classDecl) {
+    return classDecl;
+}
+
+Expression* Optimizer::visitNumericLiteral(NumericLiteral* num) {
+    return num;
+}
+
+Expression* Optimizer::visitStringLiteral(StringLiteral* str) {
+    return str;
+}
+
+// Literal nodes are immutable, so propagated reads share the declaration's
+// node. Reads of a global from a function are left alone: the function may run
+// before the global's declaration, which must still fail at runtime.
+Expression* Optimizer::visitIdentifier(Identifier* id) {
+    bool global = false;
+    Variable* variable = scopes.lookup(id->name, global);
+    if (!variable || !variable->constant || (global && scopes.inFunction))
+        return id;
+    counts.propagatedConstants++;
+    return variable->constant;
+}
+
+Expression* Optimizer::visitAssignment(Assignment* assign) {
+    assign->value = visit(assign->value);
+    return assign;
+}
+
+// Arithmetic on numbers and concatenation of two strings are folded. Mixed
+// operands are left alone: the generated C++ does not treat them like the
+// interpreters do.
+Expression* Optimizer::visitBinaryExpression(BinaryExpression* bin) {
+    bin->left = visit(bin->left);
+    bin->right = visit(bin->right);
+    auto leftNum = nodeCast<NumericLiteral>(bin->left);
+    auto rightNum = nodeCast<NumericLiteral>(bin->right);
+    if (leftNum && rightNum) {
+        counts.foldedExpressions++;
+        return numberLiteral(applyOperator(bin->op, leftNum->value, rightNum->value));
+    }
+    auto leftStr = nodeCast<StringLiteral>(bin->left);
+    auto rightStr = nodeCast<StringLiteral>(bin->right);
+    if (bin->op == BinaryOp::ADD && leftStr && rightStr) {
+        counts.foldedExpressions++;
+        auto str = arena->make<StringLiteral>();
+        str->value = arena->copyString(std::string(leftStr->value) + std::string(rightStr->value));
+        return str;
+    }
+    return bin;
+}
+
+Expression* Optimizer::visitUnaryExpression(UnaryExpression* unary) {
+    unary->argument = visit(unary->argument);
+    if (auto num = nodeCast<NumericLiteral>(unary->argument)) {
+        counts.foldedExpressions++;
+        return numberLiteral(-num->value);
+    }
+    return unary;
+}
+
+Expression* Optimizer::visitCallExpression(CallExpression* callExpr) {
+    // A callee named directly refers to a function, not a variable.
+    if (callExpr->callee->kind != NodeKind::IDENTIFIER)
+        callExpr->callee = visit(callExpr->callee);
+    optimizeArguments(callExpr->arguments);
+    return callExpr;
+}
+
+Expression* Optimizer::visitMemberAccessExpression(MemberAccessExpression* memberAccess) {
+    memberAccess->object = visit(memberAccess->object);
+    return memberAccess;
+}
+
+Expression* Optimizer::visitNewExpression(NewExpression* newExpr) {
+    optimizeArguments(newExpr->arguments);
+    return newExpr;
+}
+
+Expression* Optimizer::visitArrayLiteral(ArrayLiteral* arrayLit) {
+    optimizeArguments(arrayLit->elements);
+    return arrayLit;
+}
+
+Expression* Optimizer::visitIndexExpression(IndexExpression* indexExpr) {
+    indexExpr->array = visit(indexExpr->array);
+    indexExpr->index = visit(indexExpr->index);
+    return indexExpr;
+}
+
+Expression* Optimizer::visitIndexAssignment(IndexAssignment* indexAssign) {
+    indexAssign->array = visit(indexAssign->array);
+    indexAssign->index = visit(indexAssign->index);
+    indexAssign->value = visit(indexAssign->value);
+    return indexAssign;
+}
+
+// The call stays a call: spawn needs one.
+Expression* Optimizer::visitSpawnExpression(SpawnExpression* spawnExpr) {
+    optimizeArguments(spawnExpr->call->arguments);
+    return spawnExpr;
+}
+
+Expression* Optimizer::visitParallelFor(ParallelFor* loop) {
+    loop->from = visit(loop->from);
+    loop->to = visit(loop->to);
+    return loop;
+}
@@ -0,0 +1,108 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include "AST.hpp"
+#include "ASTVisitor.hpp"
+#include <cstddef>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Number of times each transformation fired.
+struct OptimizerStats {
+    size_t foldedExpressions = 0;   // Operators applied to literal operands.
+    size_t propagatedConstants = 0; // Variable reads replaced by their numeric value.
+    size_t eliminatedBranches = 0;  // if/while statements with a constant condition.
+    size_t removedStatements = 0;   // Unreachable statements after return/break/continue.
+};
+
+// AST-to-AST pass run between the Parser and the backends. It folds operators
+// on literals, propagates variables written once with a numeric literal, removes
+// if/while statements whose condition is constant and drops statements that
+// follow a return, break or continue. Folding follows the runtime semantics of
+// the Interpreter and the VM, so optimized programs print the same output.
+class Optimizer : private ASTVisitor<Optimizer, Expression*, Statement*> {
+public:
+    static constexpr const char* PASS_NAME = "optimizer";
+
+    // Rewrites the program in place. Replacement nodes are allocated in the
+    // program's arena.
+    void optimize(Program* program);
+
+    const OptimizerStats& stats() const { return counts; }
+
+private:
+    // A variable, as bound by the lexical scoping rules of the Resolver.
+    struct Variable {
+        int writes = 0;                 // Declarations plus assignments.
+        Expression* constant = nullptr; // Numeric literal, once the declaration is optimized.
+    };
+
+    // Variables in scope. Scopes are small, so locals live on one flat stack
+    // searched from the top; the global scope is a map.
+    struct Scopes {
+        std::vector<std::pair<Symbol, Variable*>> locals;
+        std::vector<size_t> starts; // Where each scope begins in locals.
+        std::unordered_map<Symbol, Variable*> globals;
+        bool inFunction = false;
+
+        void begin() { starts.push_back(locals.size()); }
+        void end() {
+            locals.resize(starts.back());
+            starts.pop_back();
+        }
+        // The variable a name is bound to in the innermost scope, if any.
+        Variable* declared(Symbol name) const;
+        void declare(Symbol name, Variable* variable);
+        // Returns nullptr for undefined names; the Resolver reports those.
+        Variable* lookup(Symbol name, bool& global) const;
+    };
+
+    class Binder;
+
+    Arena* arena = nullptr;
+    OptimizerStats counts;
+    std::deque<Variable> variables;
+    std::unordered_map<const VariableDeclaration*, Variable*> declarations;
+    Scopes scopes;
+    Variable parameter; // Stands for every parameter: never a constant.
+
+    friend class ASTVisitor<Optimizer, Expression*, Statement*>;
+
+    // Statements return their replacement, or nullptr if removed.
+    Statement* visitVariableDeclaration(VariableDeclaration* varDecl);
+    Statement* visitPrintStatement(PrintStatement* printStmt);
+    Statement* visitExpressionStatement(ExpressionStatement* exprStmt);
+    Statement* visitBlockStatement(BlockStatement* block);
+    Statement* visitIfStatement(IfStatement* ifStmt);
+    Statement* visitWhileStatement(WhileStatement* whileStmt);
+    Statement* visitReturnStatement(ReturnStatement* returnStmt);
+    Statement* visitBreakStatement(BreakStatement* breakStmt);
+    Statement* visitContinueStatement(ContinueStatement* continueStmt);
+    Statement* visitFunctionDeclaration(FunctionDeclaration* funcDecl);
+    Statement* visitClassDeclaration(ClassDeclaration* classDecl);
+
+    // Expressions return their replacement.
+    Expression* visitNumericLiteral(NumericLiteral* num);
+    Expression* visitStringLiteral(StringLiteral* str);
+    Expression* visitIdentifier(Identifier* id);
+    Expression* visitAssignment(Assignment* assign);
+    Expression* visitBinaryExpression(BinaryExpression* bin);
+    Expression* visitUnaryExpression(UnaryExpression* unary);
+    Expression* visitCallExpression(CallExpression* callExpr);
+    Expression* visitMemberAccessExpression(MemberAccessExpression* memberAccess);
+    Expression* visitNewExpression(NewExpression* newExpr);
+    Expression* visitArrayLiteral(ArrayLiteral* arrayLit);
+    Expression* visitIndexExpression(IndexExpression* indexExpr);
+    Expression* visitIndexAssignment(IndexAssignment* indexAssign);
+    Expression* visitSpawnExpression(SpawnExpression* spawnExpr);
+    Expression* visitParallelFor(ParallelFor* loop);
+
+    // Optimizes a statement list. Returns true if it changed.
+    bool optimizeStatements(ArenaArray<Statement*>& statements, bool keepDeclarations);
+    void optimizeArguments(ArenaArray<Expression*>& arguments);
+    NumericLiteral* numberLiteral(double value);
+};
+
+#endif // OPTIMIZER_HPP
@@ -2,209 +2,291 @@
 #include <stdexcept>
 #include <memory>
 
-Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), pos(0) {}
+Parser::Parser(Lexer& lexer) : lexer(lexer) {}
 
-Token Parser::currentToken() {
-    if (pos < tokens.size())
-        return tokens[pos];
-    Token t;
-    t.type = TokenType::END_OF_FILE;
-    return t;
+const Token& Parser::peek(size_t ahead) {
+    while (count <= ahead) {
+        ring[(head + count) & (LOOKAHEAD - 1)] = lexer.next();
+        count++;
+    }
+    return ring[(head + ahead) & (LOOKAHEAD - 1)];
 }
 
 void Parser::advance() {
-    if (pos < tokens.size())
-        pos++;
+    // The lexer keeps returning END_OF_FILE, so there is no need to stop there.
+    peek();
+    head = (head + 1) & (LOOKAHEAD - 1);
+    count--;
 }
 
 bool Parser::match(TokenType type) {
-    if (currentToken().type == type) {
+    if (current() == type) {
         advance();
         return true;
     }
     return false;
 }
 
+
+// Nodes are allocated before their children wherever the grammar allows it,
+// so the arena lays the tree out roughly in the order the passes walk it.
 std::unique_ptr<Program> Parser::parse() {
     auto program = std::make_unique<Program>();
-    while (currentToken().type != TokenType::END_OF_FILE) {
-        if (currentToken().type == TokenType::SEMICOLON) {
+    arena = &program->arena;
+    std::vector<Statement*> statements;
+    while (true) {
+        while (current() == TokenType::SEMICOLON)
             advance();
+        if (current() == TokenType::IMPORT) {
+            importDeclaration();
             continue;
         }
-        program->statements.push_back(declaration());
+        Statement* stmt = topLevel();
+        if (!stmt)
+            break;
+        statements.push_back(stmt);
     }
+    program->statements = arena->copyArray(statements);
+    program->imports = arena->copyArray(imports);
+    program->usesTasks = usesTasks;
+    arena = nullptr;
     return program;
 }
 
-std::unique_ptr<Statement> Parser::declaration() {
-    if (currentToken().type == TokenType::CLASS)
+Statement* Parser::nextStatement(Program& program) {
+    scratch.reset();
+    while (current() == TokenType::SEMICOLON)
+        advance();
+    // The modules would have to be loaded before the first statement runs.
+    if (current() == TokenType::IMPORT)
+        throw std::runtime_error("Programs that import modules cannot be streamed");
+    bool persistent = current() == TokenType::FUNCTION || current() == TokenType::CLASS ||
+                      current() == TokenType::AT;
+    arena = persistent ? &program.arena : &scratch;
+    Statement* stmt = topLevel();
+    program.usesTasks = usesTasks;
+    arena = nullptr;
+    return stmt;
+}
+
+// Parses one top-level declaration, skipping stray semicolons. Returns
+// nullptr at the end of the input.
+Statement* Parser::topLevel() {
+    while (current() == TokenType::SEMICOLON)
+        advance();
+    if (current() == TokenType::END_OF_FILE)
+        return nullptr;
+    return declaration();
+}
+
+// import "path"; names a module whose functions the program may call. The
+// module graph loads it; the program only records the path.
+void Parser::importDeclaration() {
+    advance(); // consume 'import'
+    if (current() != TokenType::STRING)
+        throw std::runtime_error("Expected a module path in quotes after 'import'.");
+    imports.push_back(arena->copyString(currentText()));
+    advance();
+    if (!match(TokenType::SEMICOLON))
+        throw std::runtime_error("Expected ';' after import.");
+}
+
+Statement* Parser::declaration() {
+    if (current() == TokenType::IMPORT)
+        throw std::runtime_error("'import' is only allowed at the top level of a file.");
+    if (current() == TokenType::CLASS)
         return classDeclaration();
-    if (currentToken().type == TokenType::FUNCTION)
+    if (current() == TokenType::FUNCTION || current() == TokenType::AT)
         return functionDeclaration();
-    if (currentToken().type == TokenType::LET)
+    if (current() == TokenType::LET)
         return expressionStatement();
     return statement();
 }
 
-std::unique_ptr<Statement> Parser::classDeclaration() {
+Statement* Parser::classDeclaration() {
     advance(); // consume 'class'
-    if (currentToken().type != TokenType::IDENTIFIER)
+    if (current() != TokenType::IDENTIFIER)
         throw std::runtime_error("Expected class name after 'class'");
-    auto classDecl = std::make_unique<ClassDeclaration>();
-    classDecl->name = currentToken().lexeme;
+    auto classDecl = arena->make<ClassDeclaration>();
+    classDecl->name = currentSymbol();
     advance();
     // Optional "extends" clause.
     if (match(TokenType::EXTENDS)) {
-        if (currentToken().type != TokenType::IDENTIFIER)
+        if (current() != TokenType::IDENTIFIER)
             throw std::runtime_error("Expected base class name after 'extends'");
-        classDecl->baseClass = currentToken().lexeme;
+        classDecl->baseClass = currentSymbol();
         advance();
     }
     classDecl->body = block();
     return classDecl;
 }
 
-std::unique_ptr<Statement> Parser::functionDeclaration() {
-    advance(); // consume "function"
-    if (currentToken().type != TokenType::IDENTIFIER)
+// Annotations come first. @nomemo keeps a pure function from being memoized,
+// for instance when it is called with few repeated arguments.
+Statement* Parser::functionDeclaration() {
+    auto funcDecl = arena->make<FunctionDeclaration>();
+    while (match(TokenType::AT)) {
+        if (current() != TokenType::IDENTIFIER || symbolName(currentSymbol()) != "nomemo")
+            throw std::runtime_error("Unknown annotation; expected '@nomemo'");
+        funcDecl->noMemo = true;
+        advance();
+    }
+    if (!match(TokenType::FUNCTION))
+        throw std::runtime_error("Expected 'function' after annotation");
+    if (current() != TokenType::IDENTIFIER)
         throw std::runtime_error("Expected function name after 'function'");
-    std::string fname = currentToken().lexeme;
+    funcDecl->name = currentSymbol();
     advance();
     if (!match(TokenType::LPAREN))
         throw std::runtime_error("Expected '(' after function name");
-    std::vector<std::string> params;
-    if (currentToken().type != TokenType::RPAREN) {
+    std::vector<Symbol> params;
+    if (current() != TokenType::RPAREN) {
         do {
-            if (currentToken().type != TokenType::IDENTIFIER)
+            if (current() != TokenType::IDENTIFIER)
                 throw std::runtime_error("Expected parameter name");
-            params.push_back(currentToken().lexeme);
+            params.push_back(currentSymbol());
             advance();
         } while (match(TokenType::COMMA));
     }
     if (!match(TokenType::RPAREN))
         throw std::runtime_error("Expected ')' after parameters");
-    auto body = block();
-    auto funcDecl = std::make_unique<FunctionDeclaration>();
-    funcDecl->name = fname;
-    funcDecl->params = params;
-    funcDecl->body = std::move(body);
+    funcDecl->params = arena->copyArray(params);
+    // A function body starts outside of any loop.
+    int savedLoopDepth = loopDepth;
+    loopDepth = 0;
+    funcDecl->body = block();
+    loopDepth = savedLoopDepth;
     return funcDecl;
 }
 
-std::unique_ptr<BlockStatement> Parser::block() {
+BlockStatement* Parser::block() {
     if (!match(TokenType::LBRACE))
         throw std::runtime_error("Expected '{' to start block");
-    auto blockStmt = std::make_unique<BlockStatement>();
-    while (currentToken().type != TokenType::RBRACE && currentToken().type != TokenType::END_OF_FILE) {
-        if (currentToken().type == TokenType::SEMICOLON) {
+    auto blockStmt = arena->make<BlockStatement>();
+    std::vector<Statement*> statements;
+    while (current() != TokenType::RBRACE && current() != TokenType::END_OF_FILE) {
+        if (current() == TokenType::SEMICOLON) {
             advance();
             continue;
         }
-        blockStmt->statements.push_back(declaration());
+        statements.push_back(declaration());
     }
     if (!match(TokenType::RBRACE))
         throw std::runtime_error("Expected '}' after block");
+    blockStmt->statements = arena->copyArray(statements);
     return blockStmt;
 }
 
-std::unique_ptr<Statement> Parser::ifStatement() {
+Statement* Parser::ifStatement() {
     advance(); // consume 'if'
     if (!match(TokenType::LPAREN))
         throw std::runtime_error("Expected '(' after 'if'");
-    auto condition = expression();
+    auto ifStmt = arena->make<IfStatement>();
+    ifStmt->condition = expression();
     if (!match(TokenType::RPAREN))
         throw std::runtime_error("Expected ')' after if condition");
-    auto thenBranch = block();
-    std::unique_ptr<BlockStatement> elseBranch = nullptr;
-    if (currentToken().type == TokenType::ELSE) {
+    ifStmt->thenBranch = block();
+    if (current() == TokenType::ELSE) {
         advance();
-        elseBranch = block();
+        ifStmt->elseBranch = block();
     }
-    auto ifStmt = std::make_unique<IfStatement>();
-    ifStmt->condition = std::move(condition);
-    ifStmt->thenBranch = std::move(thenBranch);
-    ifStmt->elseBranch = std::move(elseBranch);
     return ifStmt;
 }
 
-std::unique_ptr<Statement> Parser::whileStatement() {
+Statement* Parser::whileStatement() {
     advance(); // consume 'while'
     if (!match(TokenType::LPAREN))
         throw std::runtime_error("Expected '(' after 'while'");
-    auto condition = expression();
+    auto whileStmt = arena->make<WhileStatement>();
+    whileStmt->condition = expression();
     if (!match(TokenType::RPAREN))
         throw std::runtime_error("Expected ')' after while condition");
-    auto body = block();
-    auto whileStmt = std::make_unique<WhileStatement>();
-    whileStmt->condition = std::move(condition);
-    whileStmt->body = std::move(body);
+    loopDepth++;
+    whileStmt->body = block();
+    loopDepth--;
     return whileStmt;
 }
 
-std::unique_ptr<Statement> Parser::returnStatement() {
+Statement* Parser::returnStatement() {
     advance(); // consume 'return'
-    auto retStmt = std::make_unique<ReturnStatement>();
-    if (currentToken().type != TokenType::SEMICOLON)
+    auto retStmt = arena->make<ReturnStatement>();
+    if (current() != TokenType::SEMICOLON)
         retStmt->expression = expression();
     if (!match(TokenType::SEMICOLON))
         throw std::runtime_error("Expected ';' after return statement");
     return retStmt;
 }
 
-std::unique_ptr<Statement> Parser::expressionStatement() {
-    if (currentToken().type == TokenType::LET) {
+Statement* Parser::loopControlStatement() {
+    bool isBreak = current() == TokenType::BREAK;
+    const char* keyword = isBreak ? "break" : "continue";
+    if (loopDepth == 0)
+        throw std::runtime_error(std::string("'") + keyword + "' outside of a loop");
+    advance(); // consume 'break' or 'continue'
+    if (!match(TokenType::SEMICOLON))
+        throw std::runtime_error(std::string("Expected ';' after '") + keyword + "'");
+    if (isBreak)
+        return arena->make<BreakStatement>();
+    return arena->make<ContinueStatement>();
+}
+
+Statement* Parser::expressionStatement() {
+    if (current() == TokenType::LET) {
         advance();
-        if (currentToken().type != TokenType::IDENTIFIER)
+        if (current() != TokenType::IDENTIFIER)
             throw std::runtime_error("Expected identifier in variable declaration.");
-        std::string varName = currentToken().lexeme;
+        auto varDecl = arena->make<VariableDeclaration>();
+        varDecl->identifier = currentSymbol();
         advance();
         if (!match(TokenType::EQUALS))
             throw std::runtime_error("Expected '=' in variable declaration.");
-        auto expr = expression();
+        varDecl->expression = expression();
         if (!match(TokenType::SEMICOLON))
             throw std::runtime_error("Expected ';' after variable declaration.");
-        auto varDecl = std::make_unique<VariableDeclaration>();
-        varDecl->identifier = varName;
-        varDecl->expression = std::move(expr);
         return varDecl;
     }
-    if (currentToken().type == TokenType::PRINT) {
+    if (current() == TokenType::PRINT) {
         advance();
-        auto expr = expression();
+        auto printStmt = arena->make<PrintStatement>();
+        printStmt->expression = expression();
         if (!match(TokenType::SEMICOLON))
             throw std::runtime_error("Expected ';' after print statement.");
-        auto printStmt = std::make_unique<PrintStatement>();
-        printStmt->expression = std::move(expr);
         return printStmt;
     }
-    if (currentToken().type == TokenType::RETURN)
+    if (current() == TokenType::RETURN)
         return returnStatement();
-    if (currentToken().type == TokenType::IF)
+    if (current() == TokenType::BREAK || current() == TokenType::CONTINUE)
+        return loopControlStatement();
+    if (current() == TokenType::IF)
         return ifStatement();
-    if (currentToken().type == TokenType::WHILE)
+    if (current() == TokenType::WHILE)
         return whileStatement();
-    auto expr = expression();
+    auto exprStmt = arena->make<ExpressionStatement>();
+    exprStmt->expression = expression();
     if (!match(TokenType::SEMICOLON))
         throw std::runtime_error("Expected ';' after expression.");
-    auto exprStmt = std::make_unique<ExpressionStatement>();
-    exprStmt->expression = std::move(expr);
     return exprStmt;
 }
 
-std::unique_ptr<Statement> Parser::statement() {
+Statement* Parser::statement() {
     return expressionStatement();
 }
 
-std::unique_ptr<Expression> Parser::assignment() {
+Expression* Parser::assignment() {
     auto expr = equality();
-    if (currentToken().type == TokenType::EQUALS) {
+    if (current() == TokenType::EQUALS) {
         advance(); // consume '='
-        auto value = assignment();
-        if (auto ident = dynamic_cast<Identifier*>(expr.get())) {
-            auto assign = std::make_unique<Assignment>();
+        if (auto ident = nodeCast<Identifier>(expr)) {
+            auto assign = arena->make<Assignment>();
             assign->name = ident->name;
-            assign->value = std::move(value);
+            assign->value = assignment();
+            return assign;
+        }
+        if (auto indexExpr = nodeCast<IndexExpression>(expr)) {
+            auto assign = arena->make<IndexAssignment>();
+            assign->array = indexExpr->array;
+            assign->index = indexExpr->index;
+            assign->value = assignment();
             return assign;
         }
         throw std::runtime_error("Invalid assignment target.");
@@ -212,85 +294,96 @@ std::unique_ptr<Expression> Parser::assignment() {
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::equality() {
+Expression* Parser::equality() {
     return comparison();
 }
 
-std::unique_ptr<Expression> Parser::comparison() {
+static BinaryOp binaryOperator(TokenType type) {
+    switch (type) {
+        case TokenType::PLUS: return BinaryOp::ADD;
+        case TokenType::MINUS: return BinaryOp::SUBTRACT;
+        case TokenType::MULTIPLY: return BinaryOp::MULTIPLY;
+        case TokenType::DIVIDE: return BinaryOp::DIVIDE;
+        case TokenType::LESS: return BinaryOp::LESS;
+        case TokenType::LESS_EQUAL: return BinaryOp::LESS_EQUAL;
+        case TokenType::GREATER: return BinaryOp::GREATER;
+        case TokenType::GREATER_EQUAL: return BinaryOp::GREATER_EQUAL;
+        default: throw std::runtime_error("Expected a binary operator.");
+    }
+}
+
+// Builds a left-associative binary node. The node is allocated before its
+// right operand is parsed.
+template <typename Operand>
+Expression* Parser::binary(Expression* left, Operand operand) {
+    auto binExp = arena->make<BinaryExpression>();
+    binExp->op = binaryOperator(current());
+    advance();
+    binExp->left = left;
+    binExp->right = (this->*operand)();
+    return binExp;
+}
+
+Expression* Parser::comparison() {
     auto expr = addition();
-    while (currentToken().type == TokenType::LESS ||
-           currentToken().type == TokenType::LESS_EQUAL ||
-           currentToken().type == TokenType::GREATER ||
-           currentToken().type == TokenType::GREATER_EQUAL) {
-        std::string op = currentToken().lexeme;
-        advance();
-        auto right = addition();
-        auto binExp = std::make_unique<BinaryExpression>();
-        binExp->op = op;
-        binExp->left = std::move(expr);
-        binExp->right = std::move(right);
-        expr = std::move(binExp);
+    while (current() == TokenType::LESS ||
+           current() == TokenType::LESS_EQUAL ||
+           current() == TokenType::GREATER ||
+           current() == TokenType::GREATER_EQUAL) {
+        expr = binary(expr, &Parser::addition);
     }
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::addition() {
+Expression* Parser::addition() {
     auto expr = multiplication();
-    while (currentToken().type == TokenType::PLUS ||
-           currentToken().type == TokenType::MINUS) {
-        std::string op = currentToken().lexeme;
-        advance();
-        auto right = multiplication();
-        auto binExp = std::make_unique<BinaryExpression>();
-        binExp->op = op;
-        binExp->left = std::move(expr);
-        binExp->right = std::move(right);
-        expr = std::move(binExp);
+    while (current() == TokenType::PLUS ||
+           current() == TokenType::MINUS) {
+        expr = binary(expr, &Parser::multiplication);
     }
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::multiplication() {
+Expression* Parser::multiplication() {
     auto expr = call();
-    while (currentToken().type == TokenType::MULTIPLY ||
-           currentToken().type == TokenType::DIVIDE) {
-        std::string op = currentToken().lexeme;
-        advance();
-        auto right = call();
-        auto binExp = std::make_unique<BinaryExpression>();
-        binExp->op = op;
-        binExp->left = std::move(expr);
-        binExp->right = std::move(right);
-        expr = std::move(binExp);
+    while (current() == TokenType::MULTIPLY ||
+           current() == TokenType::DIVIDE) {
+        expr = binary(expr, &Parser::call);
     }
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::call() {
+Expression* Parser::call() {
     auto expr = primary();
     while (true) {
         if (match(TokenType::LPAREN)) {
-            std::vector<std::unique_ptr<Expression>> args;
-            if (currentToken().type != TokenType::RPAREN) {
+            auto callExpr = arena->make<CallExpression>();
+            callExpr->callee = expr;
+            std::vector<Expression*> args;
+            if (current() != TokenType::RPAREN) {
                 do {
                     args.push_back(expression());
                 } while (match(TokenType::COMMA));
             }
             if (!match(TokenType::RPAREN))
                 throw std::runtime_error("Expected ')' after arguments");
-            auto callExpr = std::make_unique<CallExpression>();
-            callExpr->callee = std::move(expr);
-            callExpr->arguments = std::move(args);
-            expr = std::move(callExpr);
+            callExpr->arguments = arena->copyArray(args);
+            expr = callExpr;
         } else if (match(TokenType::DOT)) {
-            if (currentToken().type != TokenType::IDENTIFIER)
+            if (current() != TokenType::IDENTIFIER)
                 throw std::runtime_error("Expected property name after '.'");
-            std::string memberName = currentToken().lexeme;
+            auto memberAccess = arena->make<MemberAccessExpression>();
+            memberAccess->object = expr;
+            memberAccess->member = currentSymbol();
             advance();
-            auto memberAccess = std::make_unique<MemberAccessExpression>();
-            memberAccess->object = std::move(expr);
-            memberAccess->member = memberName;
-            expr = std::move(memberAccess);
+            expr = memberAccess;
+        } else if (match(TokenType::LBRACKET)) {
+            auto indexExpr = arena->make<IndexExpression>();
+            indexExpr->array = expr;
+            indexExpr->index = expression();
+            if (!match(TokenType::RBRACKET))
+                throw std::runtime_error("Expected ']' after index");
+            expr = indexExpr;
         } else {
             break;
         }
@@ -298,57 +391,102 @@ std::unique_ptr<Expression> Parser::call() {
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::primary() {
-    Token token = currentToken();
-    if (token.type == TokenType::NUMBER) {
+Expression* Parser::primary() {
+    TokenType type = current();
+    if (type == TokenType::NUMBER) {
+        auto numLit = arena->make<NumericLiteral>();
+        numLit->value = peek().number;
         advance();
-        auto numLit = std::make_unique<NumericLiteral>();
-        numLit->value = token.numberValue;
         return numLit;
-    } else if (token.type == TokenType::STRING) {
+    } else if (type == TokenType::STRING) {
+        auto strLit = arena->make<StringLiteral>();
+        strLit->value = arena->copyString(currentText());
         advance();
-        auto strLit = std::make_unique<StringLiteral>();
-        strLit->value = token.lexeme;
         return strLit;
-    } else if (token.type == TokenType::IDENTIFIER) {
+    } else if (type == TokenType::IDENTIFIER) {
+        if (currentSymbol() == Symbols::PARALLEL_FOR && peek(1).type == TokenType::LPAREN)
+            return parallelFor();
+        auto id = arena->make<Identifier>();
+        id->name = currentSymbol();
         advance();
-        auto id = std::make_unique<Identifier>();
-        id->name = token.lexeme;
         return id;
-    } else if (token.type == TokenType::NEW) {
+    } else if (type == TokenType::NEW) {
         advance(); // consume 'new'
-        if (currentToken().type != TokenType::IDENTIFIER)
+        if (current() != TokenType::IDENTIFIER)
             throw std::runtime_error("Expected class name after 'new'");
-        auto newExpr = std::make_unique<NewExpression>();
-        newExpr->className = currentToken().lexeme;
+        auto newExpr = arena->make<NewExpression>();
+        newExpr->className = currentSymbol();
         advance();
         if (!match(TokenType::LPAREN))
             throw std::runtime_error("Expected '(' after class name in new expression");
-        while (currentToken().type != TokenType::RPAREN) {
-            newExpr->arguments.push_back(expression());
+        std::vector<Expression*> args;
+        while (current() != TokenType::RPAREN) {
+            args.push_back(expression());
             if (!match(TokenType::COMMA))
                 break;
         }
         if (!match(TokenType::RPAREN))
             throw std::runtime_error("Expected ')' after arguments in new expression");
+        newExpr->arguments = arena->copyArray(args);
         return newExpr;
-    } else if (token.type == TokenType::LPAREN) {
+    } else if (type == TokenType::SPAWN) {
+        advance(); // consume 'spawn'
+        auto spawnExpr = arena->make<SpawnExpression>();
+        spawnExpr->call = nodeCast<CallExpression>(call());
+        if (!spawnExpr->call || !nodeCast<Identifier>(spawnExpr->call->callee))
+            throw std::runtime_error("Expected a function call after 'spawn'");
+        usesTasks = true;
+        return spawnExpr;
+    } else if (type == TokenType::LBRACKET) {
+        advance(); // consume '['
+        auto arrayLit = arena->make<ArrayLiteral>();
+        std::vector<Expression*> elements;
+        if (current() != TokenType::RBRACKET) {
+            do {
+                elements.push_back(expression());
+            } while (match(TokenType::COMMA));
+        }
+        if (!match(TokenType::RBRACKET))
+            throw std::runtime_error("Expected ']' after array elements");
+        arrayLit->elements = arena->copyArray(elements);
+        return arrayLit;
+    } else if (type == TokenType::LPAREN) {
         advance();
         auto expr = expression();
         if (!match(TokenType::RPAREN))
             throw std::runtime_error("Expected ')'");
         return expr;
-    } else if (token.type == TokenType::MINUS) {
+    } else if (type == TokenType::MINUS) {
         advance();
-        auto arg = primary();
-        auto unary = std::make_unique<UnaryExpression>();
-        unary->op = "-";
-        unary->argument = std::move(arg);
+        auto unary = arena->make<UnaryExpression>();
+        unary->op = UnaryOp::NEGATE;
+        unary->argument = call();
         return unary;
     }
-    throw std::runtime_error("Unexpected token in expression: " + token.lexeme);
+    throw std::runtime_error("Unexpected token in expression: " + std::string(currentText()));
+}
+
+// The function is named, not called: functions are not values.
+Expression* Parser::parallelFor() {
+    advance(); // consume 'parallelFor'
+    advance(); // consume '('
+    auto loop = arena->make<ParallelFor>();
+    loop->from = expression();
+    if (!match(TokenType::COMMA))
+        throw std::runtime_error("Expected ',' after the first bound of parallelFor");
+    loop->to = expression();
+    if (!match(TokenType::COMMA))
+        throw std::runtime_error("Expected ',' after the second bound of parallelFor");
+    if (current() != TokenType::IDENTIFIER)
+        throw std::runtime_error("parallelFor expects a function name as its third argument");
+    loop->function = currentSymbol();
+    advance();
+    if (!match(TokenType::RPAREN))
+        throw std::runtime_error("Expected ')' after arguments");
+    usesTasks = true;
+    return loop;
 }
 
-std::unique_ptr<Expression> Parser::expression() {
+Expression* Parser::expression() {
     return assignment();
 }
\ No newline at end of file
@@ -6,37 +6,68 @@
 #include <vector>
 #include <memory>
 
+// Recursive-descent parser that pulls tokens from the Lexer on demand,
+// keeping only a small ring buffer of lookahead tokens.
 class Parser {
 public:
-    Parser(const std::vector<Token>& tokens);
+    explicit Parser(Lexer& lexer);
+
+    // Parses the whole program.
     std::unique_ptr<Program> parse();
+
+    // Streaming mode: parses the next top-level statement, or returns nullptr
+    // at the end of the input. Function and class declarations are allocated
+    // in program's arena and stay valid. Any other statement lives in a
+    // scratch arena and is only valid until the next call, so memory does not
+    // grow with the length of the script.
+    Statement* nextStatement(Program& program);
+
 private:
-    const std::vector<Token>& tokens;
-    size_t pos;
-    Token currentToken();
+    static constexpr size_t LOOKAHEAD = 4; // Ring buffer capacity; a power of two.
+
+    Lexer& lexer;
+    Token ring[LOOKAHEAD];
+    size_t head = 0;  // Index of the current token in ring.
+    size_t count = 0; // Tokens buffered, starting at head.
+    int loopDepth = 0; // Enclosing loops, for validating break/continue.
+    Arena* arena = nullptr; // Where nodes of the statement being parsed go.
+    Arena scratch;          // Top-level statements in streaming mode.
+    bool usesTasks = false; // A spawn or parallelFor has been parsed.
+    std::vector<std::string_view> imports;
+
+    const Token& peek(size_t ahead = 0);
+    TokenType current() { return peek().type; }
+    Symbol currentSymbol() { return peek().symbol; }
+    std::string_view currentText() { return lexer.text(peek()); }
     void advance();
     bool match(TokenType type);
 
     // Declarations and statements.
-    std::unique_ptr<Statement> declaration();
-    std::unique_ptr<Statement> functionDeclaration();
-    std::unique_ptr<Statement> classDeclaration();
-    std::unique_ptr<BlockStatement> block();
-    std::unique_ptr<Statement> ifStatement();
-    std::unique_ptr<Statement> whileStatement();
-    std::unique_ptr<Statement> returnStatement();
-    std::unique_ptr<Statement> expressionStatement();
-    std::unique_ptr<Statement> statement();
+    Statement* topLevel();
+    void importDeclaration();
+    Statement* declaration();
+    Statement* functionDeclaration();
+    Statement* classDeclaration();
+    BlockStatement* block();
+    Statement* ifStatement();
+    Statement* whileStatement();
+    Statement* returnStatement();
+    Statement* loopControlStatement();
+    Statement* expressionStatement();
+    Statement* statement();
 
     // Expressions.
-    std::unique_ptr<Expression> expression();
-    std::unique_ptr<Expression> assignment();
-    std::unique_ptr<Expression> equality();
-    std::unique_ptr<Expression> comparison();
-    std::unique_ptr<Expression> addition();
-    std::unique_ptr<Expression> multiplication();
-    std::unique_ptr<Expression> call();
-    std::unique_ptr<Expression> primary();
+    Expression* expression();
+    Expression* assignment();
+    Expression* equality();
+    Expression* comparison();
+    Expression* addition();
+    Expression* multiplication();
+    template <typename Operand>
+    Expression* binary(Expression* left, Operand operand);
+    Expression* call();
+    Expression* primary();
+    Expression* parallelFor();
 };
 
 #endif // PARSER_HPP
\ No newline at end of file
@@ -0,0 +1,248 @@
+#include "ProgramImage.hpp"
+#include "BuildCache.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// Every table and pool starts at a multiple of 8 bytes, so that the image can
+// be read in place. Numbers are stored as the host writes them; the byte
+// order mark rejects images from a host of the other byte order.
+
+struct ProgramImage::Text {
+    uint64_t offset;
+    uint64_t length;
+};
+
+struct ProgramImage::Header {
+    char magic[8];            // MAGIC.
+    uint32_t version;         // VERSION.
+    uint32_t byteOrder;       // BYTE_ORDER_MARK, as the writer stored it.
+    uint64_t size;            // Of the whole file, to detect truncation.
+    uint32_t functionCount;   // Not counting the script.
+    uint32_t globalCount;
+    uint64_t functionsOffset; // Function[functionCount + 1], script first.
+    uint64_t globalsOffset;   // Text[globalCount]: the names of the globals.
+    Text source;              // Name of the source file, in the image's directory.
+    uint64_t sourceSize;
+    int64_t sourceModified;   // Nanoseconds since the epoch.
+    char sourceHash[64];      // Hex SHA-256 of the source text.
+};
+
+struct ProgramImage::Function {
+    Text name;
+    uint64_t codeOffset;
+    uint64_t codeSize;
+    uint64_t constantsOffset; // double[constantCount]; 0 where a string goes.
+    uint64_t stringsOffset;   // StringConstant[stringCount].
+    uint32_t constantCount;
+    uint32_t stringCount;
+    uint32_t localCount;
+    uint16_t arity;
+    uint8_t defined;
+    uint8_t reserved;
+};
+
+struct ProgramImage::StringConstant {
+    uint64_t index; // In the constant pool.
+    Text text;
+};
+
+namespace {
+
+const char MAGIC[8] = {'M', 'L', 'I', 'M', 'A', 'G', 'E', '\0'};
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+// A Value holding a number is the number's bits, so numeric pools are read
+// in place as Values.
+static_assert(sizeof(Value) == sizeof(double), "Value must be NaN-boxed");
+
+std::string sourceHash(std::string_view sourceText) {
+    return BuildCache::key({sourceText});
+}
+
+// Modification time of the file at path in nanoseconds, or -1 if it has none.
+int64_t modificationTime(const std::string& path) {
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0)
+        return -1;
+    return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+// Appends objects to the image at 8-byte boundaries.
+class ImageBuilder {
+public:
+    explicit ImageBuilder(size_t reserved) : bytes(reserved, '\0') {}
+
+    uint64_t place(const void* data, size_t size) {
+        bytes.resize((bytes.size() + 7) & ~size_t(7), '\0');
+        uint64_t offset = bytes.size();
+        bytes.append(static_cast<const char*>(data), size);
+        return offset;
+    }
+    template <typename T>
+    uint64_t place(const std::vector<T>& items) {
+        static_assert(std::is_trivially_copyable<T>::value, "Image tables hold plain data");
+        return place(items.data(), items.size() * sizeof(T));
+    }
+
+    std::string bytes;
+};
+
+} // namespace
+
+std::string ProgramImage::pathFor(const std::string& sourcePath) {
+    return fs::path(sourcePath).replace_extension(EXTENSION).string();
+}
+
+void ProgramImage::write(const std::string& path, const CompiledProgram& program, const std::string& sourcePath,
+                         std::string_view sourceText) {
+    static_assert(std::is_trivially_copyable<Header>::value && std::is_trivially_copyable<Function>::value,
+                  "Image records are copied as bytes");
+    ImageBuilder image(sizeof(Header));
+    auto text = [&image](std::string_view value) { return Text{image.place(value.data(), value.size()), value.size()}; };
+
+    std::vector<Function> records;
+    auto add = [&](const FunctionProto& proto) {
+        Function record{};
+        record.name = text(proto.name);
+        record.codeOffset = image.place(proto.chunk.code.data(), proto.chunk.code.size());
+        record.codeSize = proto.chunk.code.size();
+        std::vector<double> numbers;
+        std::vector<StringConstant> strings;
+        for (const Value& constant : proto.chunk.constants) {
+            if (constant.isString()) {
+                strings.push_back({numbers.size(), text(constant.stringView())});
+                numbers.push_back(0);
+            } else {
+                numbers.push_back(constant.asNumber());
+            }
+        }
+        record.constantsOffset = image.place(numbers);
+        record.constantCount = static_cast<uint32_t>(numbers.size());
+        record.stringsOffset = image.place(strings);
+        record.stringCount = static_cast<uint32_t>(strings.size());
+        record.localCount = proto.localCount;
+        record.arity = proto.arity;
+        record.defined = proto.defined;
+        records.push_back(record);
+    };
+    add(program.script);
+    for (const FunctionProto& proto : program.functions)
+        add(proto);
+    std::vector<Text> globals;
+    for (const std::string& name : program.globals)
+        globals.push_back(text(name));
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.functionCount = static_cast<uint32_t>(program.functions.size());
+    header.globalCount = static_cast<uint32_t>(globals.size());
+    header.source = text(fs::path(sourcePath).filename().string());
+    header.sourceSize = sourceText.size();
+    header.sourceModified = modificationTime(sourcePath);
+    std::string hash = sourceHash(sourceText);
+    std::memcpy(header.sourceHash, hash.data(), sizeof(header.sourceHash));
+    header.functionsOffset = image.place(records);
+    header.globalsOffset = image.place(globals);
+    header.size = image.bytes.size();
+    std::memcpy(&image.bytes[0], &header, sizeof(header));
+
+    // A program running the old image has it mapped: replace the file rather
+    // than overwrite it.
+    std::string temporary = path + ".tmp" + std::to_string(::getpid());
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        out.write(image.bytes.data(), static_cast<std::streamsize>(image.bytes.size()));
+        if (!out)
+            throw std::runtime_error("Cannot write program image " + path);
+    }
+    std::error_code error;
+    fs::rename(temporary, path, error);
+    if (error) {
+        fs::remove(temporary, error);
+        throw std::runtime_error("Cannot write program image " + path);
+    }
+}
+
+ProgramImage::ProgramImage(const std::string& path) : file(path, MappedFile::Access::RANDOM) {
+    std::string_view data = file.text();
+    base = data.data();
+    auto within = [&data](uint64_t offset, uint64_t count, size_t itemSize) {
+        return offset % 8 == 0 && offset <= data.size() && count <= (data.size() - offset) / itemSize;
+    };
+    auto withinText = [&data](const Text& text) {
+        return text.offset <= data.size() && text.length <= data.size() - text.offset;
+    };
+    if (data.size() < sizeof(Header) || std::memcmp(base, MAGIC, sizeof(MAGIC)) != 0)
+        throw std::runtime_error(path + " is not a MiniLang program image");
+    header = reinterpret_cast<const Header*>(base);
+    if (header->version != VERSION || header->byteOrder != BYTE_ORDER_MARK)
+        throw std::runtime_error(path + " was built by another version of mini_compiler; rebuild it with --emit-image");
+    if (header->size != data.size() || !within(header->functionsOffset, header->functionCount + 1ull, sizeof(Function)) ||
+        !within(header->globalsOffset, header->globalCount, sizeof(Text)) || !withinText(header->source))
+        throw std::runtime_error(path + " is truncated or corrupt");
+    functions = reinterpret_cast<const Function*>(base + header->functionsOffset);
+    const Text* globals = reinterpret_cast<const Text*>(base + header->globalsOffset);
+    for (uint32_t i = 0; i < header->globalCount; i++) {
+        if (!withinText(globals[i]))
+            throw std::runtime_error(path + " is truncated or corrupt");
+    }
+
+    codes.reserve(header->functionCount + 1);
+    pools.resize(header->functionCount + 1);
+    for (uint32_t i = 0; i <= header->functionCount; i++) {
+        const Function& function = functions[i];
+        if (!withinText(function.name) || !withinText({function.codeOffset, function.codeSize}) ||
+            !within(function.constantsOffset, function.constantCount, sizeof(double)) ||
+            !within(function.stringsOffset, function.stringCount, sizeof(StringConstant)))
+            throw std::runtime_error(path + " is truncated or corrupt");
+        const Value* constants = reinterpret_cast<const Value*>(base + function.constantsOffset);
+        if (function.stringCount > 0) {
+            std::vector<Value>& pool = pools[i];
+            pool.assign(constants, constants + function.constantCount);
+            const StringConstant* strings = reinterpret_cast<const StringConstant*>(base + function.stringsOffset);
+            for (uint32_t s = 0; s < function.stringCount; s++) {
+                if (strings[s].index >= function.constantCount || !withinText(strings[s].text))
+                    throw std::runtime_error(path + " is truncated or corrupt");
+                pool[strings[s].index] = Value(text(strings[s].text));
+            }
+            constants = pool.data();
+        }
+        codes.push_back({reinterpret_cast<const uint8_t*>(base + function.codeOffset), function.codeSize, constants,
+                         function.arity, function.localCount, function.defined != 0});
+    }
+
+    // The source is looked for next to the image. Hashing it would cost
+    // more than the rest of loading, so it is hashed only if its size or
+    // modification time changed, as touching it leaves the image current.
+    std::string source = (fs::path(path).parent_path() / std::string(text(header->source))).string();
+    std::error_code error;
+    if (!fs::exists(source, error))
+        return;
+    if (fs::file_size(source, error) == header->sourceSize && !error &&
+        modificationTime(source) == header->sourceModified)
+        return;
+    MappedFile sourceFile(source);
+    if (sourceHash(sourceFile.text()) != std::string_view(header->sourceHash, sizeof(header->sourceHash)))
+        throw std::runtime_error(path + " is out of date: " + source + " has changed since; rebuild it with --emit-image");
+}
+
+std::string_view ProgramImage::functionName(uint32_t index) const {
+    return text(functions[index + 1].name);
+}
+
+std::string_view ProgramImage::globalName(uint32_t index) const {
+    return text(reinterpret_cast<const Text*>(base + header->globalsOffset)[index]);
+}
+
+std::string_view ProgramImage::text(const Text& text) const {
+    return std::string_view(base + text.offset, text.length);
+}
@@ -0,0 +1,70 @@
+#ifndef PROGRAMIMAGE_HPP
+#define PROGRAMIMAGE_HPP
+
+#include "Bytecode.hpp"
+#include "MappedFile.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compiled program saved to a file, so that a script runs on the VM without
+// being lexed, parsed or compiled again. The image holds the bytecode and
+// constant pool of the script and of every function, and the names of the
+// functions and globals, all addressed by their offset in the file.
+//
+// Loading maps the file and checks its header and tables; there is no
+// deserialization pass. The VM runs the bytecode and numeric constants where
+// they are mapped, so each page costs a page fault when first used and
+// nothing before. Only string constants are copied out, since strings are
+// heap objects.
+//
+// The header records the size, modification time and SHA-256 of the source.
+// An image whose source has changed since is refused, and one whose source is
+// gone still runs. The contents are trusted like an executable's: only the
+// layout is checked.
+class ProgramImage {
+public:
+    // Bumped whenever the layout or the instruction set changes.
+    static constexpr uint32_t VERSION = 1;
+    static constexpr const char* EXTENSION = ".mlimage";
+
+    // Where --emit-image puts the image of a source: next to it, named
+    // after it.
+    static std::string pathFor(const std::string& sourcePath);
+
+    // Writes the image of program, compiled from sourceText read from
+    // sourcePath, to path. Throws if it cannot be written.
+    static void write(const std::string& path, const CompiledProgram& program, const std::string& sourcePath,
+                      std::string_view sourceText);
+
+    // Maps the image at path. Throws std::runtime_error if the file is not
+    // an image of this version, or if its source has changed.
+    explicit ProgramImage(const std::string& path);
+
+    // The interface the VM runs programs through.
+    FunctionCode script() const { return codes[0]; }
+    FunctionCode function(uint32_t index) const { return codes[index + 1]; }
+    std::string_view functionName(uint32_t index) const;
+    std::string_view globalName(uint32_t index) const;
+
+private:
+    // Layout of the file, defined in ProgramImage.cpp.
+    struct Header;
+    struct Function;
+    struct Text;
+    struct StringConstant;
+
+    MappedFile file;
+    const char* base;
+    const Header* header;
+    const Function* functions; // The script, then the functions.
+    // Pointers into the image, by function, the script first. Functions
+    // with string constants use a copy of their pool, kept in pools.
+    std::vector<FunctionCode> codes;
+    std::vector<std::vector<Value>> pools;
+
+    std::string_view text(const Text& text) const;
+};
+
+#endif // PROGRAMIMAGE_HPP
@@ -0,0 +1,106 @@
+#include "Purity.hpp"
+#include <algorithm>
+
+size_t PurityAnalysis::analyze(Program* program) {
+    functions.clear();
+    callees.clear();
+    pure.clear();
+    for (auto& stmt : program->statements) {
+        if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt)) {
+            funcDecl->memoize = false;
+            functions[funcDecl->name] = funcDecl;
+        }
+    }
+    // Imported functions have no body here; those their module memoized are
+    // pure.
+    for (auto funcDecl : program->externs) {
+        functions.emplace(funcDecl->name, funcDecl);
+        if (funcDecl->memoize)
+            pure.insert(funcDecl);
+    }
+    for (auto& entry : functions) {
+        if (entry.second->body && checkFunction(entry.second))
+            pure.insert(entry.second);
+    }
+    // Start from every function that is pure on its own and drop those that
+    // call one that is not, until nothing changes.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = pure.begin(); it != pure.end();) {
+            const std::vector<FunctionDeclaration*>& called = callees[*it];
+            bool callsImpure = std::any_of(called.begin(), called.end(),
+                                           [this](FunctionDeclaration* callee) { return !pure.count(callee); });
+            if (callsImpure) {
+                it = pure.erase(it);
+                changed = true;
+            } else {
+                ++it;
+            }
+        }
+    }
+    size_t marked = 0;
+    for (FunctionDeclaration* funcDecl : pure) {
+        if (funcDecl->body && !funcDecl->noMemo && !funcDecl->params.empty() && funcDecl->params.size() <= MAX_PARAMS) {
+            funcDecl->memoize = true;
+            marked++;
+        }
+    }
+    return marked;
+}
+
+bool PurityAnalysis::checkFunction(FunctionDeclaration* funcDecl) {
+    current = funcDecl;
+    locals.assign(funcDecl->params.begin(), funcDecl->params.end());
+    scopeStarts.clear();
+    bool result = visitBlockStatement(funcDecl->body);
+    current = nullptr;
+    return result;
+}
+
+bool PurityAnalysis::isLocal(Symbol name) const {
+    return std::find(locals.begin(), locals.end(), name) != locals.end();
+}
+
+// The initializer sees the enclosing binding, so the name is declared after.
+bool PurityAnalysis::visitVariableDeclaration(VariableDeclaration* varDecl) {
+    if (!visit(varDecl->expression))
+        return false;
+    locals.push_back(varDecl->identifier);
+    return true;
+}
+
+bool PurityAnalysis::visitBlockStatement(BlockStatement* block) {
+    scopeStarts.push_back(locals.size());
+    bool result = std::all_of(block->statements.begin(), block->statements.end(),
+                              [this](Statement* stmt) { return visit(stmt); });
+    locals.resize(scopeStarts.back());
+    scopeStarts.pop_back();
+    return result;
+}
+
+bool PurityAnalysis::visitIfStatement(IfStatement* ifStmt) {
+    return visit(ifStmt->condition) && visitBlockStatement(ifStmt->thenBranch) &&
+           (!ifStmt->elseBranch || visitBlockStatement(ifStmt->elseBranch));
+}
+
+bool PurityAnalysis::visitWhileStatement(WhileStatement* whileStmt) {
+    return visit(whileStmt->condition) && visitBlockStatement(whileStmt->body);
+}
+
+bool PurityAnalysis::visitReturnStatement(ReturnStatement* returnStmt) {
+    return !returnStmt->expression || visit(returnStmt->expression);
+}
+
+// Built-ins are not in the table: they read files, write files or output.
+bool PurityAnalysis::visitCallExpression(CallExpression* callExpr) {
+    auto calleeId = nodeCast<Identifier>(callExpr->callee);
+    if (!calleeId)
+        return false;
+    auto callee = functions.find(calleeId->name);
+    if (callee == functions.end())
+        return false;
+    callees[current].push_back(callee->second);
+    return std::all_of(callExpr->arguments.begin(), callExpr->arguments.end(),
+                       [this](Expression* arg) { return visit(arg); });
+}
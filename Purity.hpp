@@ -0,0 +1,81 @@
+#ifndef PURITY_HPP
+#define PURITY_HPP
+
+#include "AST.hpp"
+#include "ASTVisitor.hpp"
+#include <cstddef>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Finds the top-level functions whose result depends on their arguments
+// only, and marks them for memoization. A function is pure if it prints
+// nothing, calls no file or output built-in, reads and writes its own locals
+// only, creates and touches no objects, arrays or tasks (it may read the
+// elements of an array parameter), and calls pure functions only; the
+// last condition is solved for all functions together, so recursive and
+// mutually recursive functions qualify. Functions annotated @nomemo, and
+// functions taking no argument or more than MAX_PARAMS, are not memoized.
+// Reading any global makes a function impure, even a global written once
+// with a number: the Optimizer replaces those by their value in top-level
+// code only, since a function may run before the global's declaration.
+class PurityAnalysis : private ASTVisitor<PurityAnalysis, bool, bool> {
+public:
+    static constexpr const char* PASS_NAME = "purity analysis";
+
+    // The arguments of a call are the key of its cached result.
+    static constexpr size_t MAX_PARAMS = 4;
+
+    // Sets FunctionDeclaration::memoize. Returns the number of functions
+    // marked.
+    size_t analyze(Program* program);
+
+private:
+    std::unordered_map<Symbol, FunctionDeclaration*> functions;
+    std::unordered_map<FunctionDeclaration*, std::vector<FunctionDeclaration*>> callees;
+    std::unordered_set<FunctionDeclaration*> pure;
+    FunctionDeclaration* current = nullptr;
+    std::vector<Symbol> locals;      // Innermost last.
+    std::vector<size_t> scopeStarts; // Where each scope begins in locals.
+
+    friend class ASTVisitor<PurityAnalysis, bool, bool>;
+
+    // Whether the body alone is pure, assuming every function it calls is.
+    bool checkFunction(FunctionDeclaration* funcDecl);
+    bool isLocal(Symbol name) const;
+
+    // Statements.
+    bool visitVariableDeclaration(VariableDeclaration* varDecl);
+    bool visitPrintStatement(PrintStatement*) { return false; }
+    bool visitExpressionStatement(ExpressionStatement* exprStmt) { return visit(exprStmt->expression); }
+    bool visitBlockStatement(BlockStatement* block);
+    bool visitIfStatement(IfStatement* ifStmt);
+    bool visitWhileStatement(WhileStatement* whileStmt);
+    bool visitReturnStatement(ReturnStatement* returnStmt);
+    bool visitBreakStatement(BreakStatement*) { return true; }
+    bool visitContinueStatement(ContinueStatement*) { return true; }
+    bool visitFunctionDeclaration(FunctionDeclaration*) { return false; }
+    bool visitClassDeclaration(ClassDeclaration*) { return false; }
+
+    // Expressions.
+    bool visitNumericLiteral(NumericLiteral*) { return true; }
+    bool visitStringLiteral(StringLiteral*) { return true; }
+    bool visitIdentifier(Identifier* id) { return isLocal(id->name); }
+    bool visitAssignment(Assignment* assign) { return isLocal(assign->name) && visit(assign->value); }
+    bool visitBinaryExpression(BinaryExpression* bin) { return visit(bin->left) && visit(bin->right); }
+    bool visitUnaryExpression(UnaryExpression* unary) { return visit(unary->argument); }
+    bool visitCallExpression(CallExpression* callExpr);
+    bool visitMemberAccessExpression(MemberAccessExpression*) { return false; }
+    bool visitNewExpression(NewExpression*) { return false; }
+    // A cached array would be shared by every call, so functions creating or
+    // writing arrays are impure. Reading a parameter's elements is fine:
+    // calls passing arrays are never cached.
+    bool visitArrayLiteral(ArrayLiteral*) { return false; }
+    bool visitIndexExpression(IndexExpression* indexExpr) { return visit(indexExpr->array) && visit(indexExpr->index); }
+    bool visitIndexAssignment(IndexAssignment*) { return false; }
+    // Tasks may print, and their results are arrays or handles.
+    bool visitSpawnExpression(SpawnExpression*) { return false; }
+    bool visitParallelFor(ParallelFor*) { return false; }
+};
+
+#endif // PURITY_HPP
@@ -0,0 +1,279 @@
+#include "Resolver.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+void Resolver::resolve(Program* program) {
+    beginStream();
+    // Classes may extend classes declared after them.
+    for (auto& stmt : program->statements) {
+        if (auto classDecl = nodeCast<ClassDeclaration>(stmt))
+            classes[classDecl->name] = ClassLayout(classDecl);
+    }
+    for (auto& stmt : program->statements) {
+        if (stmt->kind != NodeKind::FUNCTION_DECLARATION)
+            resolveStatement(stmt);
+    }
+    program->frameSize = globalSlots;
+
+    // Function bodies are resolved last so they can refer to any global,
+    // including ones declared after the function.
+    for (auto& stmt : program->statements) {
+        if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt))
+            resolveFunction(funcDecl);
+    }
+    for (auto& stmt : program->statements) {
+        if (auto classDecl = nodeCast<ClassDeclaration>(stmt))
+            resolveClass(classDecl);
+    }
+}
+
+void Resolver::beginStream() {
+    scopes.clear();
+    globals.clear();
+    inFunction = false;
+    globalSlots = 0;
+    topLevelSlots = 0;
+    classes.clear();
+    currentClass = nullptr;
+    nextCache = 0;
+    statementCaches = 0;
+}
+
+// Top-level code runs in the global frame, whose outermost scope is globals.
+void Resolver::resolveStatement(Statement* stmt) {
+    statementCaches = nextCache;
+    nextSlot = globalSlots;
+    frameSize = globalSlots;
+    visit(stmt);
+    globalSlots = frameSize;
+}
+
+void Resolver::resolveFunction(FunctionDeclaration* funcDecl) {
+    inFunction = true;
+    nextSlot = 0;
+    frameSize = 0;
+    beginScope();
+    for (auto& param : funcDecl->params)
+        declare(param);
+    visitBlockStatement(funcDecl->body);
+    endScope();
+    funcDecl->frameSize = frameSize;
+    inFunction = false;
+}
+
+void Resolver::resolveClass(ClassDeclaration* classDecl) {
+    ClassLayout& layout = classes[classDecl->name];
+    if (layout.decl != classDecl)
+        layout = ClassLayout(classDecl);
+    currentClass = &layOut(classDecl);
+    for (auto& stmt : classDecl->body->statements) {
+        if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt)) {
+            resolveFunction(funcDecl);
+        } else if (auto varDecl = nodeCast<VariableDeclaration>(stmt)) {
+            // Initializers run when an object is created, from any frame.
+            inFunction = true;
+            visit(varDecl->expression);
+            inFunction = false;
+        }
+    }
+    currentClass = nullptr;
+}
+
+// A field redeclared by a subclass keeps the slot of the inherited one.
+Resolver::ClassLayout& Resolver::layOut(ClassDeclaration* classDecl) {
+    ClassLayout& layout = classes[classDecl->name];
+    if (layout.laidOut)
+        return layout;
+    if (layout.layingOut)
+        throw std::runtime_error("Class " + std::string(symbolName(classDecl->name)) + " inherits from itself.");
+    layout.layingOut = true;
+    if (classDecl->baseClass != Symbols::NONE) {
+        auto base = classes.find(classDecl->baseClass);
+        if (base == classes.end())
+            throw std::runtime_error("Undefined base class: " + std::string(symbolName(classDecl->baseClass)));
+        layout.fields = layOut(base->second.decl).fields;
+    }
+    for (auto& stmt : classDecl->body->statements) {
+        if (auto varDecl = nodeCast<VariableDeclaration>(stmt)) {
+            int slot = static_cast<int>(layout.fields.size());
+            varDecl->address.depth = VariableAddress::FIELD;
+            varDecl->address.slot = layout.fields.emplace(varDecl->identifier, slot).first->second;
+        }
+    }
+    classDecl->fieldCount = static_cast<int>(layout.fields.size());
+    layout.layingOut = false;
+    layout.laidOut = true;
+    return layout;
+}
+
+void Resolver::visitVariableDeclaration(VariableDeclaration* varDecl) {
+    // The initializer is evaluated before the new binding exists.
+    visit(varDecl->expression);
+    varDecl->address.depth = 0;
+    varDecl->address.slot = declare(varDecl->identifier);
+}
+
+void Resolver::visitPrintStatement(PrintStatement* printStmt) {
+    visit(printStmt->expression);
+}
+
+void Resolver::visitExpressionStatement(ExpressionStatement* exprStmt) {
+    visit(exprStmt->expression);
+}
+
+void Resolver::visitBlockStatement(BlockStatement* block) {
+    beginScope();
+    for (auto& stmt : block->statements)
+        visit(stmt);
+    endScope();
+}
+
+void Resolver::visitIfStatement(IfStatement* ifStmt) {
+    visit(ifStmt->condition);
+    visitBlockStatement(ifStmt->thenBranch);
+    if (ifStmt->elseBranch)
+        visitBlockStatement(ifStmt->elseBranch);
+}
+
+void Resolver::visitWhileStatement(WhileStatement* whileStmt) {
+    visit(whileStmt->condition);
+    visitBlockStatement(whileStmt->body);
+}
+
+void Resolver::visitReturnStatement(ReturnStatement* returnStmt) {
+    if (returnStmt->expression)
+        visit(returnStmt->expression);
+    // A top-level return ends the program; there is no frame to reuse.
+    returnStmt->tailCall = inFunction && returnStmt->expression &&
+                           returnStmt->expression->kind == NodeKind::CALL_EXPRESSION;
+}
+
+void Resolver::visitBreakStatement(BreakStatement*) {}
+
+void Resolver::visitContinueStatement(ContinueStatement*) {}
+
+// Nested functions are never callable, and only top-level classes can be
+// instantiated, so there is nothing to resolve in them.
+void Resolver::visitFunctionDeclaration(FunctionDeclaration*) {}
+
+void Resolver::visitClassDeclaration(ClassDeclaration*) {}
+
+void Resolver::visitNumericLiteral(NumericLiteral*) {}
+
+void Resolver::visitStringLiteral(StringLiteral*) {}
+
+void Resolver::visitIdentifier(Identifier* id) {
+    id->address = lookup(id->name);
+}
+
+void Resolver::visitAssignment(Assignment* assign) {
+    visit(assign->value);
+    assign->address = lookup(assign->name);
+}
+
+void Resolver::visitBinaryExpression(BinaryExpression* bin) {
+    visit(bin->left);
+    visit(bin->right);
+}
+
+void Resolver::visitUnaryExpression(UnaryExpression* unary) {
+    visit(unary->argument);
+}
+
+void Resolver::visitCallExpression(CallExpression* callExpr) {
+    // A callee named directly refers to a function, not a variable.
+    if (callExpr->callee->kind != NodeKind::IDENTIFIER)
+        visit(callExpr->callee);
+    for (auto& arg : callExpr->arguments)
+        visit(arg);
+}
+
+void Resolver::visitMemberAccessExpression(MemberAccessExpression* memberAccess) {
+    visit(memberAccess->object);
+    memberAccess->cache = nextCache++;
+}
+
+void Resolver::visitNewExpression(NewExpression* newExpr) {
+    for (auto& arg : newExpr->arguments)
+        visit(arg);
+}
+
+void Resolver::visitArrayLiteral(ArrayLiteral* arrayLit) {
+    for (auto& element : arrayLit->elements)
+        visit(element);
+}
+
+void Resolver::visitIndexExpression(IndexExpression* indexExpr) {
+    visit(indexExpr->array);
+    visit(indexExpr->index);
+}
+
+void Resolver::visitIndexAssignment(IndexAssignment* indexAssign) {
+    visit(indexAssign->array);
+    visit(indexAssign->index);
+    visit(indexAssign->value);
+}
+
+void Resolver::visitSpawnExpression(SpawnExpression* spawnExpr) {
+    visitCallExpression(spawnExpr->call);
+}
+
+void Resolver::visitParallelFor(ParallelFor* loop) {
+    visit(loop->from);
+    visit(loop->to);
+}
+
+void Resolver::beginScope() {
+    scopes.push_back({{}, nextSlot});
+}
+
+void Resolver::endScope() {
+    // Top-level block locals keep their slots so that they never alias a
+    // global, which functions may read before its declaration has run. When
+    // streaming, endStatement frees them.
+    if (inFunction)
+        nextSlot = scopes.back().firstSlot;
+    scopes.pop_back();
+}
+
+int Resolver::declare(Symbol name) {
+    // Redeclaring a name in the same scope rebinds the existing slot.
+    auto& names = scopes.empty() ? globals : scopes.back().names;
+    auto it = names.find(name);
+    if (it != names.end())
+        return it->second;
+    int slot = nextSlot++;
+    if (nextSlot > frameSize)
+        frameSize = nextSlot;
+    if (scopes.empty())
+        topLevelSlots = std::max(topLevelSlots, nextSlot);
+    names.emplace(name, slot);
+    return slot;
+}
+
+VariableAddress Resolver::lookup(Symbol name) const {
+    VariableAddress address;
+    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+        auto found = it->names.find(name);
+        if (found != it->names.end()) {
+            address.depth = 0;
+            address.slot = found->second;
+            return address;
+        }
+    }
+    if (currentClass) {
+        auto field = currentClass->fields.find(name);
+        if (field != currentClass->fields.end()) {
+            address.depth = VariableAddress::FIELD;
+            address.slot = field->second;
+            return address;
+        }
+    }
+    auto found = globals.find(name);
+    if (found != globals.end()) {
+        address.depth = inFunction ? 1 : 0;
+        address.slot = found->second;
+        return address;
+    }
+    throw std::runtime_error("Undefined variable: " + std::string(symbolName(name)));
+}
\ No newline at end of file
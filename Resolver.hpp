@@ -0,0 +1,110 @@
+#ifndef RESOLVER_HPP
+#define RESOLVER_HPP
+
+#include "AST.hpp"
+#include "ASTVisitor.hpp"
+#include <unordered_map>
+#include <vector>
+
+// Static pass that assigns every variable declaration and reference a
+// (depth, slot) address, so backends can use flat, index-addressed frames.
+// Scoping is lexical: block scopes nest inside a function's frame, and
+// functions see their own locals plus top-level globals. Methods also see
+// the fields of their class, which are laid out with the fields of the base
+// class first, so a field has the same slot in every subclass.
+class Resolver : private ASTVisitor<Resolver, void> {
+public:
+    static constexpr const char* PASS_NAME = "resolver";
+
+    // Annotates the program in place. Throws on undefined variables.
+    void resolve(Program* program);
+
+    // Streaming mode: top-level statements and functions are resolved one at
+    // a time, in source order, so a function only sees the globals declared
+    // before it.
+    void beginStream();
+    void resolveStatement(Statement* stmt);
+    // Gives back the inline caches and block local slots of the last
+    // statement resolved, once it has run and its nodes are gone, for the
+    // next statement to reuse. Globals keep their slots.
+    void endStatement() {
+        nextCache = statementCaches;
+        globalSlots = topLevelSlots;
+    }
+    void resolveFunction(FunctionDeclaration* funcDecl);
+    // Lays out the fields of a top-level class and resolves its methods and
+    // field initializers. Its base class must have been declared.
+    void resolveClass(ClassDeclaration* classDecl);
+    // Slots the global frame needs for everything resolved so far.
+    int globalFrameSize() const { return globalSlots; }
+    // Inline caches for every member access resolved so far.
+    uint32_t inlineCacheCount() const { return nextCache; }
+
+private:
+    struct Scope {
+        std::unordered_map<Symbol, int> names;   // Name to slot.
+        int firstSlot;                              // Slots are reused once the scope ends.
+    };
+
+    // Fields of a class, by name, inherited ones included.
+    struct ClassLayout {
+        ClassLayout() = default;
+        explicit ClassLayout(ClassDeclaration* decl) : decl(decl) {}
+
+        ClassDeclaration* decl = nullptr;
+        std::unordered_map<Symbol, int> fields;
+        bool laidOut = false;
+        bool layingOut = false; // Detects a class that inherits from itself.
+    };
+
+    std::vector<Scope> scopes; // Innermost last; excludes the global scope.
+    std::unordered_map<Symbol, int> globals; // Outermost top-level scope.
+    bool inFunction = false;
+    int nextSlot = 0;
+    int frameSize = 0;
+    int globalSlots = 0;   // nextSlot of top-level code, which only endStatement shrinks.
+    int topLevelSlots = 0; // Slots up to the last global's.
+    std::unordered_map<Symbol, ClassLayout> classes;
+    const ClassLayout* currentClass = nullptr; // Class whose members are being resolved.
+    uint32_t nextCache = 0;
+    uint32_t statementCaches = 0; // First inline cache of the last statement resolved.
+
+    friend class ASTVisitor<Resolver, void>;
+
+    // Statements.
+    void visitVariableDeclaration(VariableDeclaration* varDecl);
+    void visitPrintStatement(PrintStatement* printStmt);
+    void visitExpressionStatement(ExpressionStatement* exprStmt);
+    void visitBlockStatement(BlockStatement* block);
+    void visitIfStatement(IfStatement* ifStmt);
+    void visitWhileStatement(WhileStatement* whileStmt);
+    void visitReturnStatement(ReturnStatement* returnStmt);
+    void visitBreakStatement(BreakStatement* breakStmt);
+    void visitContinueStatement(ContinueStatement* continueStmt);
+    void visitFunctionDeclaration(FunctionDeclaration* funcDecl);
+    void visitClassDeclaration(ClassDeclaration* classDecl);
+
+    // Expressions.
+    void visitNumericLiteral(NumericLiteral* num);
+    void visitStringLiteral(StringLiteral* str);
+    void visitIdentifier(Identifier* id);
+    void visitAssignment(Assignment* assign);
+    void visitBinaryExpression(BinaryExpression* bin);
+    void visitUnaryExpression(UnaryExpression* unary);
+    void visitCallExpression(CallExpression* callExpr);
+    void visitMemberAccessExpression(MemberAccessExpression* memberAccess);
+    void visitNewExpression(NewExpression* newExpr);
+    void visitArrayLiteral(ArrayLiteral* arrayLit);
+    void visitIndexExpression(IndexExpression* indexExpr);
+    void visitIndexAssignment(IndexAssignment* indexAssign);
+    void visitSpawnExpression(SpawnExpression* spawnExpr);
+    void visitParallelFor(ParallelFor* loop);
+
+    ClassLayout& layOut(ClassDeclaration* classDecl);
+    void beginScope();
+    void endScope();
+    int declare(Symbol name);
+    VariableAddress lookup(Symbol name) const;
+};
+
+#endif // RESOLVER_HPP
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef SHAPE_HPP
+#define SHAPE_HPP
+
+#include "AST.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Hidden class of the interpreter's objects: which slot holds each field and
+// which method each name calls. MiniLang objects cannot gain fields after
+// creation, so every class has exactly one shape. A subclass's shape keeps
+// the fields of its base class in the same slots, and its method table holds
+// the inherited methods with the subclass's overrides applied.
+struct Shape {
+    Symbol className = Symbols::NONE;
+    std::unordered_map<Symbol, uint32_t> fieldSlots;
+    std::vector<VariableDeclaration*> initializers; // By slot; run by new.
+    std::unordered_map<Symbol, FunctionDeclaration*> methods;
+};
+
+// Inline cache of one `object.member` site, called or not. It remembers what
+// the member resolved to for the last shapes seen there, so that a hit costs
+// a pointer comparison instead of two hash lookups. A site that has seen
+// more than WAYS shapes is megamorphic: further shapes are looked up each
+// time.
+struct InlineCache {
+    static constexpr int WAYS = 4;
+
+    struct Entry {
+        const Shape* shape = nullptr;
+        FunctionDeclaration* method = nullptr; // Null if the member is a field.
+        uint32_t slot = 0;                     // Field slot.
+    };
+
+    Entry entries[WAYS];
+    uint8_t size = 0;
+    bool megamorphic = false;
+};
+
+// Counters of all inline caches, reported by --ic-stats.
+struct InlineCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t monomorphicSites = 0; // Sites that saw one shape.
+    size_t polymorphicSites = 0; // Sites that saw 2 to WAYS shapes.
+    size_t megamorphicSites = 0; // Sites that saw more.
+};
+
+#endif // SHAPE_HPP
@@ -0,0 +1,90 @@
+#include "Symbol.hpp"
+#include <mutex>
+#include <stdexcept>
+
+SymbolTable& SymbolTable::global() {
+    static SymbolTable table;
+    return table;
+}
+
+SymbolTable::SymbolTable() : slots(256, Slot{0, EMPTY_SLOT}) {
+    // Must list the names in the order of the Symbols enum.
+    static const char* const predefined[] = {
+        "", "let", "print", "function", "if", "else", "while", "return", "break",
+        "continue", "class", "extends", "new", "this", "spawn", "import", "readFile", "writeFile",
+        "flush", "parallelFor", "array", "len", "sum", "dot", "scale", "add", "min", "max", "sort", "join",
+        "openLines", "hasLine", "nextLine", "openWriter", "write", "close"
+    };
+    static_assert(sizeof(predefined) / sizeof(predefined[0]) == Symbols::PREDEFINED_COUNT,
+                  "predefined names out of sync with Symbols");
+    for (const char* text : predefined)
+        intern(text);
+}
+
+// FNV-1a: cheap on the short names typical of identifiers.
+static uint32_t hashName(std::string_view text) {
+    uint32_t hash = 2166136261u;
+    for (char c : text) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// The symbol of text, or EMPTY_SLOT if it is not interned. Needs the lock,
+// shared or exclusive.
+Symbol SymbolTable::find(std::string_view text, uint32_t hash) const {
+    size_t mask = slots.size() - 1;
+    for (size_t index = hash & mask;; index = (index + 1) & mask) {
+        const Slot& slot = slots[index];
+        if (slot.symbol == EMPTY_SLOT || (slot.hash == hash && name(slot.symbol) == text))
+            return slot.symbol;
+    }
+}
+
+Symbol SymbolTable::intern(std::string_view text) {
+    uint32_t hash = hashName(text);
+    {
+        std::shared_lock<std::shared_mutex> reading(lock);
+        Symbol symbol = find(text, hash);
+        if (symbol != EMPTY_SLOT)
+            return symbol;
+    }
+    // Another thread may have added the name since the lookup.
+    std::unique_lock<std::shared_mutex> writing(lock);
+    Symbol symbol = find(text, hash);
+    if (symbol != EMPTY_SLOT)
+        return symbol;
+    size_t next = count.load(std::memory_order_relaxed);
+    size_t block = blockOf(static_cast<Symbol>(next));
+    if (next >= EMPTY_SLOT || block >= MAX_BLOCKS)
+        throw std::length_error("Too many distinct names.");
+    if (!blocks[block])
+        blocks[block] = std::make_unique<std::string_view[]>(FIRST_BLOCK << block);
+    symbol = static_cast<Symbol>(next);
+    blocks[block][next - blockStart(block)] = storage.copyString(text);
+    size_t mask = slots.size() - 1;
+    size_t index = hash & mask;
+    while (slots[index].symbol != EMPTY_SLOT)
+        index = (index + 1) & mask;
+    slots[index] = {hash, symbol};
+    count.store(next + 1, std::memory_order_release);
+    // Keep the load factor at or below one half.
+    if ((next + 1) * 2 > slots.size())
+        grow();
+    return symbol;
+}
+
+void SymbolTable::grow() {
+    std::vector<Slot> old(slots.size() * 2, Slot{0, EMPTY_SLOT});
+    old.swap(slots);
+    size_t mask = slots.size() - 1;
+    for (const Slot& entry : old) {
+        if (entry.symbol == EMPTY_SLOT)
+            continue;
+        size_t index = entry.hash & mask;
+        while (slots[index].symbol != EMPTY_SLOT)
+            index = (index + 1) & mask;
+        slots[index] = entry;
+    }
+}
\ No newline at end of file
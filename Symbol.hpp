@@ -0,0 +1,130 @@
+#ifndef SYMBOL_HPP
+#define SYMBOL_HPP
+
+#include "Arena.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+// Interned name. Equal names always get the same id, so comparing names is
+// an integer compare and ids can index dense tables.
+using Symbol = uint32_t;
+
+// Names interned when the table is created, at fixed ids. Keywords come
+// first so the lexer can recognize them with a single range check.
+namespace Symbols {
+enum : Symbol {
+    NONE,       // The empty name.
+    LET,
+    PRINT,
+    FUNCTION,
+    IF,
+    ELSE,
+    WHILE,
+    RETURN,
+    BREAK,
+    CONTINUE,
+    CLASS,
+    EXTENDS,
+    NEW,
+    THIS,
+    SPAWN,
+    IMPORT,
+    KEYWORD_END, // One past the last keyword.
+    READ_FILE = KEYWORD_END,
+    WRITE_FILE,
+    FLUSH,
+    PARALLEL_FOR,
+    ARRAY, // Built-ins a function may override, ARRAY to CLOSE.
+    LEN,
+    SUM,
+    DOT,
+    SCALE,
+    ADD,
+    MIN,
+    MAX,
+    SORT,
+    JOIN,
+    OPEN_LINES,
+    HAS_LINE,
+    NEXT_LINE,
+    OPEN_WRITER,
+    WRITE,
+    CLOSE,
+    PREDEFINED_COUNT
+};
+
+// The array, join and line stream built-ins have common names, so a
+// function of the program with the same name takes precedence over them.
+// The other built-ins take precedence over functions.
+inline bool isOverridableBuiltIn(Symbol name) {
+    return name >= ARRAY && name <= CLOSE;
+}
+
+inline bool isLineStreamBuiltIn(Symbol name) {
+    return name >= OPEN_LINES && name <= CLOSE;
+}
+} // namespace Symbols
+
+// Process-wide intern table. Interned text is copied once and lives until
+// the program exits. Threads may intern and look up names concurrently:
+// finding a name already interned takes a shared lock, only adding one takes
+// the table exclusively, and name() takes no lock at all, since names are
+// stored in blocks that never move.
+class SymbolTable {
+public:
+    static SymbolTable& global();
+
+    Symbol intern(std::string_view text);
+    std::string_view name(Symbol symbol) const {
+        size_t block = blockOf(symbol);
+        return blocks[block][symbol - blockStart(block)];
+    }
+    size_t size() const { return count.load(std::memory_order_acquire); }
+
+private:
+    SymbolTable();
+
+    // Open-addressing hash index over names; capacity is a power of two.
+    struct Slot {
+        uint32_t hash;
+        Symbol symbol; // EMPTY_SLOT if unused.
+    };
+    static constexpr Symbol EMPTY_SLOT = 0xffffffffu;
+
+    // Block b holds FIRST_BLOCK << b names; MAX_BLOCKS blocks hold nearly
+    // 2^32 of them.
+    static constexpr size_t FIRST_BLOCK = 256;
+    static constexpr size_t MAX_BLOCKS = 24;
+
+    static size_t blockOf(Symbol symbol) {
+        size_t index = symbol / FIRST_BLOCK + 1;
+        size_t block = 0;
+        while (index >>= 1)
+            block++;
+        return block;
+    }
+    static size_t blockStart(size_t block) { return FIRST_BLOCK * ((size_t(1) << block) - 1); }
+
+    mutable std::shared_mutex lock; // Guards storage and slots.
+    Arena storage;
+    std::vector<Slot> slots;
+    std::unique_ptr<std::string_view[]> blocks[MAX_BLOCKS];
+    std::atomic<size_t> count{0};
+
+    Symbol find(std::string_view text, uint32_t hash) const;
+    void grow();
+};
+
+inline Symbol intern(std::string_view text) {
+    return SymbolTable::global().intern(text);
+}
+
+inline std::string_view symbolName(Symbol symbol) {
+    return SymbolTable::global().name(symbol);
+}
+
+#endif // SYMBOL_HPP
\ No newline at end of file
@@ -0,0 +1,588 @@
+#include "TypeInference.hpp"
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+static StaticType ofKind(TypeKind kind) {
+    StaticType type;
+    type.kind = kind;
+    return type;
+}
+
+// Records the kind of an expression's type on the node and returns the type.
+static StaticType typed(Expression* expr, StaticType type) {
+    expr->type = type.kind;
+    return type;
+}
+
+// Whole numbers up to 2^53 are exact both as a double and as an int64_t.
+// Negative zero prints differently from 0 and stays a double.
+static bool whole(double value) {
+    return value == std::trunc(value) && std::fabs(value) <= 9007199254740992.0 && !(value == 0 && std::signbit(value));
+}
+
+static std::string describe(StaticType type) {
+    switch (type.kind) {
+        case TypeKind::UNKNOWN: return "an unknown value";
+        case TypeKind::INTEGER:
+        case TypeKind::NUMBER: return "a number";
+        case TypeKind::STRING: return "a string";
+        case TypeKind::ARRAY: return "an array";
+        case TypeKind::OBJECT: return "an object of class " + std::string(symbolName(type.className));
+        case TypeKind::TASK: return "a task returning " + describe(ofKind(type.result));
+    }
+    return "?";
+}
+
+void TypeInference::infer(Program* program) {
+    functions.clear();
+    classes.clear();
+    writes.clear();
+    uncounted.clear();
+    for (auto funcDecl : program->externs)
+        functions[funcDecl->name] = funcDecl;
+    std::vector<FunctionDeclaration*> callables; // Functions and methods.
+    for (auto& stmt : program->statements) {
+        if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt)) {
+            functions[funcDecl->name] = funcDecl;
+            callables.push_back(funcDecl);
+        } else if (auto classDecl = nodeCast<ClassDeclaration>(stmt)) {
+            classes[classDecl->name] = classDecl;
+            for (auto& member : classDecl->body->statements) {
+                if (auto methodDecl = nodeCast<FunctionDeclaration>(member))
+                    callables.push_back(methodDecl);
+            }
+        }
+    }
+    for (auto funcDecl : callables)
+        funcDecl->paramTypes = program->arena.copyArray(std::vector<StaticType>(funcDecl->params.size()));
+
+    do {
+        changed = false;
+        inferPass(program);
+    } while (changed);
+
+    // Parameters that no call site constrains are numbers; propagate that.
+    // A module cannot see the calls of the programs importing it, which may
+    // pass any number.
+    for (auto funcDecl : callables) {
+        for (auto& paramType : funcDecl->paramTypes) {
+            if (paramType.kind == TypeKind::UNKNOWN || (program->isModule && paramType.kind == TypeKind::INTEGER)) {
+                paramType.kind = TypeKind::NUMBER;
+                changed = true;
+            }
+        }
+    }
+    while (changed) {
+        changed = false;
+        inferPass(program);
+    }
+}
+
+// One walk over the whole program, in the order the Resolver uses: top-level
+// code first, so that functions see every global.
+void TypeInference::inferPass(Program* program) {
+    locals.clear();
+    scopeStarts.clear();
+    globals.clear();
+    for (auto& stmt : program->statements) {
+        if (stmt->kind != NodeKind::FUNCTION_DECLARATION && stmt->kind != NodeKind::CLASS_DECLARATION)
+            visit(stmt);
+    }
+    for (auto& stmt : program->statements) {
+        if (auto classDecl = nodeCast<ClassDeclaration>(stmt)) {
+            currentClass = classDecl;
+            for (auto& member : classDecl->body->statements) {
+                if (auto fieldDecl = nodeCast<VariableDeclaration>(member))
+                    join(fieldDecl->type, visit(fieldDecl->expression), fieldDecl->identifier);
+                else if (auto methodDecl = nodeCast<FunctionDeclaration>(member))
+                    inferFunction(methodDecl);
+            }
+            currentClass = nullptr;
+        } else if (auto funcDecl = nodeCast<FunctionDeclaration>(stmt)) {
+            inferFunction(funcDecl);
+        }
+    }
+}
+
+void TypeInference::inferFunction(FunctionDeclaration* funcDecl) {
+    currentFunction = funcDecl;
+    beginScope();
+    for (size_t i = 0; i < funcDecl->params.size(); i++)
+        locals.push_back({funcDecl->params[i], &funcDecl->paramTypes[i]});
+    visitBlockStatement(funcDecl->body);
+    endScope();
+    // Falling off the end of a function returns 0.
+    if (!alwaysReturns(funcDecl->body))
+        join(funcDecl->returnType, ofKind(TypeKind::INTEGER), funcDecl->name);
+    currentFunction = nullptr;
+}
+
+bool TypeInference::alwaysReturns(Statement* stmt) {
+    switch (stmt->kind) {
+        case NodeKind::RETURN_STATEMENT:
+            return true;
+        case NodeKind::BLOCK_STATEMENT:
+            for (auto& s : static_cast<BlockStatement*>(stmt)->statements) {
+                if (alwaysReturns(s))
+                    return true;
+            }
+            return false;
+        case NodeKind::IF_STATEMENT: {
+            auto ifStmt = static_cast<IfStatement*>(stmt);
+            return ifStmt->elseBranch && alwaysReturns(ifStmt->thenBranch) && alwaysReturns(ifStmt->elseBranch);
+        }
+        default:
+            return false;
+    }
+}
+
+// Widens target to hold value as well. Whole numbers widen to doubles,
+// objects to the nearest class both derive from, and a task whose result
+// is not known yet to any task; any other mix of kinds cannot be expressed
+// with one C++ type.
+void TypeInference::join(StaticType& target, StaticType value, Symbol name) {
+    if (value.kind == TypeKind::UNKNOWN || (value.kind == target.kind && value.className == target.className &&
+                                            (value.result == target.result || value.result == TypeKind::UNKNOWN)))
+        return;
+    if (target.kind == TypeKind::NUMBER && value.kind == TypeKind::INTEGER)
+        return;
+    if (target.kind == TypeKind::OBJECT && value.kind == TypeKind::OBJECT) {
+        Symbol base = commonBase(target.className, value.className);
+        if (base == target.className)
+            return;
+        if (base != Symbols::NONE) {
+            target.className = base;
+            changed = true;
+            return;
+        }
+    }
+    bool bothTasks = target.kind == TypeKind::TASK && value.kind == TypeKind::TASK;
+    if (target.kind == TypeKind::UNKNOWN || (target.kind == TypeKind::INTEGER && value.kind == TypeKind::NUMBER) ||
+        (bothTasks && target.result == TypeKind::UNKNOWN)) {
+        target = value;
+        changed = true;
+        return;
+    }
+    throw std::runtime_error("Cannot infer a type for '" + std::string(symbolName(name)) + "': it holds both " +
+                             describe(target) + " and " + describe(value) + ".");
+}
+
+// The nearest class that both classes are or derive from; NONE if unrelated.
+Symbol TypeInference::commonBase(Symbol a, Symbol b) const {
+    for (Symbol ancestor = a; ancestor != Symbols::NONE;) {
+        for (Symbol other = b; other != Symbols::NONE;) {
+            if (other == ancestor)
+                return ancestor;
+            auto found = classes.find(other);
+            other = found == classes.end() ? Symbols::NONE : found->second->baseClass;
+        }
+        auto found = classes.find(ancestor);
+        ancestor = found == classes.end() ? Symbols::NONE : found->second->baseClass;
+    }
+    return Symbols::NONE;
+}
+
+FunctionDeclaration* TypeInference::method(ClassDeclaration* classDecl, Symbol name) const {
+    while (classDecl) {
+        for (auto& member : classDecl->body->statements) {
+            auto methodDecl = nodeCast<FunctionDeclaration>(member);
+            if (methodDecl && methodDecl->name == name)
+                return methodDecl;
+        }
+        auto base = classes.find(classDecl->baseClass);
+        classDecl = base == classes.end() ? nullptr : base->second;
+    }
+    return nullptr;
+}
+
+VariableDeclaration* TypeInference::field(ClassDeclaration* classDecl, Symbol name) const {
+    while (classDecl) {
+        for (auto& member : classDecl->body->statements) {
+            auto fieldDecl = nodeCast<VariableDeclaration>(member);
+            if (fieldDecl && fieldDecl->identifier == name)
+                return fieldDecl;
+        }
+        auto base = classes.find(classDecl->baseClass);
+        classDecl = base == classes.end() ? nullptr : base->second;
+    }
+    return nullptr;
+}
+
+// Locals first, then fields of the enclosing class, then globals. Returns a
+// binding with a null type for names that are not variables.
+TypeInference::Binding TypeInference::lookup(Symbol name) const {
+    for (auto it = locals.rbegin(); it != locals.rend(); ++it) {
+        if (it->name == name)
+            return *it;
+    }
+    if (currentClass) {
+        if (VariableDeclaration* fieldDecl = field(currentClass, name))
+            return {name, &fieldDecl->type};
+    }
+    auto found = globals.find(name);
+    return {name, found == globals.end() ? nullptr : found->second};
+}
+
+// Passes an argument to a parameter. Imported functions were compiled apart,
+// so their parameters keep their type: the argument must fit it, and a
+// variable of still unknown type takes it.
+void TypeInference::pass(FunctionDeclaration* callee, size_t index, Expression* arg, StaticType type) {
+    if (index >= callee->params.size())
+        return;
+    StaticType& param = callee->paramTypes[index];
+    if (callee->body) {
+        join(param, type, callee->params[index]);
+        return;
+    }
+    if (type.kind == TypeKind::UNKNOWN) {
+        auto id = nodeCast<Identifier>(arg);
+        Binding binding = id ? lookup(id->name) : Binding();
+        if (binding.type)
+            join(*binding.type, param, id->name);
+        return;
+    }
+    bool fits = (type.kind == param.kind && type.className == param.className &&
+                 (type.result == param.result || type.result == TypeKind::UNKNOWN)) ||
+                (param.kind == TypeKind::NUMBER && type.kind == TypeKind::INTEGER);
+    if (!fits)
+        throw std::runtime_error("Cannot pass " + describe(type) + " as '" +
+                                 std::string(symbolName(callee->params[index])) + "' to imported function " +
+                                 std::string(symbolName(callee->name)) + ", which takes " + describe(param) +
+                                 " (modules are compiled on their own: a parameter nothing in its module constrains"
+                                 " is a number).");
+}
+
+// Checks that an expression has the type an array or task operation needs. A
+// variable of still unknown type, such as a parameter, takes that type.
+void TypeInference::expect(Expression* expr, StaticType type, TypeKind expected, const std::string& what) {
+    if (type.kind == TypeKind::UNKNOWN) {
+        auto id = nodeCast<Identifier>(expr);
+        Binding binding = id ? lookup(id->name) : Binding();
+        if (binding.type)
+            join(*binding.type, ofKind(expected), id->name);
+        return;
+    }
+    bool number = type.kind == TypeKind::INTEGER || type.kind == TypeKind::NUMBER;
+    if (expected == TypeKind::NUMBER ? !number : type.kind != expected)
+        throw std::runtime_error(what + ", not " + describe(type) + ".");
+}
+
+void TypeInference::visitVariableDeclaration(VariableDeclaration* varDecl) {
+    join(varDecl->type, visit(varDecl->expression), varDecl->identifier);
+    writes[varDecl->identifier]++;
+    if (scopeStarts.empty())
+        globals[varDecl->identifier] = &varDecl->type;
+    else
+        locals.push_back({varDecl->identifier, &varDecl->type});
+}
+
+void TypeInference::visitPrintStatement(PrintStatement* printStmt) {
+    visit(printStmt->expression);
+}
+
+void TypeInference::visitExpressionStatement(ExpressionStatement* exprStmt) {
+    visit(exprStmt->expression);
+}
+
+void TypeInference::visitBlockStatement(BlockStatement* block) {
+    beginScope();
+    for (auto& stmt : block->statements)
+        visit(stmt);
+    endScope();
+}
+
+void TypeInference::visitIfStatement(IfStatement* ifStmt) {
+    visit(ifStmt->condition);
+    visitBlockStatement(ifStmt->thenBranch);
+    if (ifStmt->elseBranch)
+        visitBlockStatement(ifStmt->elseBranch);
+}
+
+// The step of a counted loop: the loop compares a variable with a whole bound
+// and its body ends by stepping the variable toward the bound by a whole
+// constant. Null for other loops.
+static BinaryExpression* counterStep(WhileStatement* whileStmt) {
+    auto compare = nodeCast<BinaryExpression>(whileStmt->condition);
+    auto counter = compare ? nodeCast<Identifier>(compare->left) : nullptr;
+    if (!counter || compare->right->type != TypeKind::INTEGER || whileStmt->body->statements.empty())
+        return nullptr;
+    bool up = compare->op == BinaryOp::LESS || compare->op == BinaryOp::LESS_EQUAL;
+    bool down = compare->op == BinaryOp::GREATER || compare->op == BinaryOp::GREATER_EQUAL;
+    auto last = nodeCast<ExpressionStatement>(whileStmt->body->statements[whileStmt->body->statements.size() - 1]);
+    auto assign = last ? nodeCast<Assignment>(last->expression) : nullptr;
+    auto step = assign ? nodeCast<BinaryExpression>(assign->value) : nullptr;
+    if (!step || assign->name != counter->name)
+        return nullptr;
+    auto self = nodeCast<Identifier>(step->left);
+    auto amount = nodeCast<NumericLiteral>(step->right);
+    if (!self || self->name != counter->name || !amount || !whole(amount->value) || amount->value <= 0)
+        return nullptr;
+    return (up && step->op == BinaryOp::ADD) || (down && step->op == BinaryOp::SUBTRACT) ? step : nullptr;
+}
+
+// The step of a counted loop runs only after the condition held, so it
+// leaves the counter within one step of a whole bound, unless something else
+// in the loop writes the counter too. That is known once the body is walked;
+// the step is whole until then, and a loop found to write its counter
+// elsewhere is walked as uncounted from then on.
+void TypeInference::visitWhileStatement(WhileStatement* whileStmt) {
+    visit(whileStmt->condition);
+    BinaryExpression* step = uncounted.count(whileStmt) ? nullptr : counterStep(whileStmt);
+    if (!step) {
+        visitBlockStatement(whileStmt->body);
+        return;
+    }
+    Symbol counter = static_cast<Identifier*>(step->left)->name;
+    int before = writes[counter];
+    countedSteps.insert(step);
+    visitBlockStatement(whileStmt->body);
+    countedSteps.erase(step);
+    if (writes[counter] - before != 1) {
+        uncounted.insert(whileStmt);
+        changed = true;
+    }
+}
+
+void TypeInference::visitReturnStatement(ReturnStatement* returnStmt) {
+    // A bare return returns 0.
+    StaticType value = returnStmt->expression ? visit(returnStmt->expression) : ofKind(TypeKind::INTEGER);
+    if (currentFunction)
+        join(currentFunction->returnType, value, currentFunction->name);
+}
+
+void TypeInference::visitBreakStatement(BreakStatement*) {}
+
+void TypeInference::visitContinueStatement(ContinueStatement*) {}
+
+// Nested declarations are not compiled by the CodeGenerator.
+void TypeInference::visitFunctionDeclaration(FunctionDeclaration*) {}
+
+void TypeInference::visitClassDeclaration(ClassDeclaration*) {}
+
+StaticType TypeInference::visitNumericLiteral(NumericLiteral* num) {
+    return typed(num, ofKind(whole(num->value) ? TypeKind::INTEGER : TypeKind::NUMBER));
+}
+
+StaticType TypeInference::visitStringLiteral(StringLiteral* str) {
+    return typed(str, ofKind(TypeKind::STRING));
+}
+
+StaticType TypeInference::visitIdentifier(Identifier* id) {
+    Binding binding = lookup(id->name);
+    return typed(id, binding.type ? *binding.type : StaticType());
+}
+
+StaticType TypeInference::visitAssignment(Assignment* assign) {
+    StaticType value = visit(assign->value);
+    writes[assign->name]++;
+    Binding binding = lookup(assign->name);
+    if (!binding.type)
+        return typed(assign, value);
+    join(*binding.type, value, assign->name);
+    return typed(assign, *binding.type);
+}
+
+// Sums and differences of whole numbers are doubles, as at runtime, but for
+// the steps of counted loops, whose range the loop bounds. Products are
+// doubles too, and so is a negation, since -0 must stay distinct from 0.
+StaticType TypeInference::visitBinaryExpression(BinaryExpression* bin) {
+    TypeKind left = visit(bin->left).kind;
+    TypeKind right = visit(bin->right).kind;
+    TypeKind result = TypeKind::NUMBER;
+    switch (bin->op) {
+        case BinaryOp::ADD:
+            // Arrays concatenate as their text, as in the interpreter.
+            if (left == TypeKind::STRING || right == TypeKind::STRING || left == TypeKind::ARRAY ||
+                right == TypeKind::ARRAY) {
+                result = TypeKind::STRING;
+                break;
+            }
+            // Fall through.
+        case BinaryOp::SUBTRACT:
+            if (left == TypeKind::UNKNOWN || right == TypeKind::UNKNOWN)
+                result = TypeKind::UNKNOWN;
+            else if (left == TypeKind::INTEGER && right == TypeKind::INTEGER && countedSteps.count(bin))
+                result = TypeKind::INTEGER;
+            break;
+        case BinaryOp::MULTIPLY:
+        case BinaryOp::DIVIDE:
+            break;
+        case BinaryOp::LESS:
+        case BinaryOp::LESS_EQUAL:
+        case BinaryOp::GREATER:
+        case BinaryOp::GREATER_EQUAL:
+            result = TypeKind::INTEGER;
+            break;
+    }
+    return typed(bin, ofKind(result));
+}
+
+StaticType TypeInference::visitUnaryExpression(UnaryExpression* unary) {
+    visit(unary->argument);
+    return typed(unary, ofKind(TypeKind::NUMBER));
+}
+
+// Arguments widen the parameters of the function or method they are passed to.
+StaticType TypeInference::visitCallExpression(CallExpression* callExpr) {
+    FunctionDeclaration* callee = nullptr;
+    StaticType result;
+    if (auto calleeId = nodeCast<Identifier>(callExpr->callee)) {
+        if (calleeId->name == Symbols::READ_FILE) {
+            result = ofKind(TypeKind::STRING);
+        } else if (calleeId->name != Symbols::WRITE_FILE && calleeId->name != Symbols::FLUSH) {
+            // Inside a class, a bare name may call a method of the object.
+            callee = currentClass ? method(currentClass, calleeId->name) : nullptr;
+            if (!callee) {
+                auto found = functions.find(calleeId->name);
+                callee = found == functions.end() ? nullptr : found->second;
+            }
+            // Functions and methods shadow the array built-ins and join.
+            callExpr->builtIn = !callee && Symbols::isOverridableBuiltIn(calleeId->name);
+            if (callExpr->builtIn)
+                return typed(callExpr, overridableBuiltIn(callExpr, calleeId->name));
+        }
+    } else if (auto memberAccess = nodeCast<MemberAccessExpression>(callExpr->callee)) {
+        StaticType object = visit(memberAccess->object);
+        auto classDecl = classes.find(object.className);
+        if (object.kind == TypeKind::OBJECT && classDecl != classes.end())
+            callee = method(classDecl->second, memberAccess->member);
+    } else {
+        visit(callExpr->callee);
+    }
+    for (size_t i = 0; i < callExpr->arguments.size(); i++) {
+        StaticType argument = visit(callExpr->arguments[i]);
+        if (callee)
+            pass(callee, i, callExpr->arguments[i], argument);
+    }
+    if (callee)
+        result = callee->returnType;
+    return typed(callExpr, result);
+}
+
+StaticType TypeInference::visitMemberAccessExpression(MemberAccessExpression* memberAccess) {
+    StaticType object = visit(memberAccess->object);
+    auto classDecl = classes.find(object.className);
+    if (object.kind != TypeKind::OBJECT || classDecl == classes.end())
+        return typed(memberAccess, StaticType());
+    VariableDeclaration* fieldDecl = field(classDecl->second, memberAccess->member);
+    return typed(memberAccess, fieldDecl ? fieldDecl->type : StaticType());
+}
+
+StaticType TypeInference::visitNewExpression(NewExpression* newExpr) {
+    for (auto& arg : newExpr->arguments)
+        visit(arg);
+    StaticType type = ofKind(TypeKind::OBJECT);
+    type.className = newExpr->className;
+    return typed(newExpr, type);
+}
+
+// array(n) takes a length; scale(a, k) an array and a factor; dot and add two
+// arrays; join a task; openLines and openWriter a filename; write(w, text) a
+// handle and a string or number; the line stream built-ins a handle; the
+// others one array. The C++ functions take exactly these arguments, where
+// the interpreter would ignore extra ones.
+StaticType TypeInference::overridableBuiltIn(CallExpression* callExpr, Symbol name) {
+    std::string text(symbolName(name));
+    bool binary = name == Symbols::DOT || name == Symbols::ADD || name == Symbols::SCALE || name == Symbols::WRITE;
+    size_t arity = binary ? 2 : 1;
+    if (callExpr->arguments.size() != arity)
+        throw std::runtime_error(text + " expects " + std::to_string(arity) + " argument" + (binary ? "s." : "."));
+    if (Symbols::isLineStreamBuiltIn(name)) {
+        Expression* arg = callExpr->arguments[0];
+        if (name == Symbols::OPEN_LINES || name == Symbols::OPEN_WRITER) {
+            expect(arg, visit(arg), TypeKind::STRING, text + " expects a string filename");
+            return ofKind(TypeKind::NUMBER);
+        }
+        expect(arg, visit(arg), TypeKind::NUMBER, text + " expects a handle");
+        if (name == Symbols::WRITE) {
+            StaticType line = visit(callExpr->arguments[1]);
+            bool number = line.kind == TypeKind::INTEGER || line.kind == TypeKind::NUMBER;
+            if (!number && line.kind != TypeKind::STRING && line.kind != TypeKind::UNKNOWN)
+                throw std::runtime_error("write expects a string or a number, not " + describe(line) + ".");
+        }
+        if (name == Symbols::HAS_LINE)
+            return ofKind(TypeKind::INTEGER);
+        return ofKind(name == Symbols::NEXT_LINE ? TypeKind::STRING : TypeKind::NUMBER);
+    }
+    if (name == Symbols::JOIN) {
+        Expression* arg = callExpr->arguments[0];
+        StaticType task = visit(arg);
+        expect(arg, task, TypeKind::TASK, "join expects a task");
+        return ofKind(task.kind == TypeKind::TASK ? task.result : TypeKind::UNKNOWN);
+    }
+    for (size_t i = 0; i < arity; i++) {
+        Expression* arg = callExpr->arguments[i];
+        StaticType type = visit(arg);
+        bool number = name == Symbols::ARRAY || (name == Symbols::SCALE && i == 1);
+        expect(arg, type, number ? TypeKind::NUMBER : TypeKind::ARRAY,
+               text + " expects " + (number ? "a number" : "an array"));
+    }
+    if (name == Symbols::ARRAY || name == Symbols::SCALE || name == Symbols::ADD || name == Symbols::SORT)
+        return ofKind(TypeKind::ARRAY);
+    return ofKind(name == Symbols::LEN ? TypeKind::INTEGER : TypeKind::NUMBER);
+}
+
+StaticType TypeInference::visitArrayLiteral(ArrayLiteral* arrayLit) {
+    for (auto& element : arrayLit->elements)
+        expect(element, visit(element), TypeKind::NUMBER, "Array elements must be numbers");
+    return typed(arrayLit, ofKind(TypeKind::ARRAY));
+}
+
+StaticType TypeInference::visitIndexExpression(IndexExpression* indexExpr) {
+    expect(indexExpr->array, visit(indexExpr->array), TypeKind::ARRAY, "Only arrays can be indexed");
+    expect(indexExpr->index, visit(indexExpr->index), TypeKind::NUMBER, "Array index must be a number");
+    return typed(indexExpr, ofKind(TypeKind::NUMBER));
+}
+
+StaticType TypeInference::visitIndexAssignment(IndexAssignment* indexAssign) {
+    expect(indexAssign->array, visit(indexAssign->array), TypeKind::ARRAY, "Only arrays can be indexed");
+    expect(indexAssign->index, visit(indexAssign->index), TypeKind::NUMBER, "Array index must be a number");
+    expect(indexAssign->value, visit(indexAssign->value), TypeKind::NUMBER, "Array elements must be numbers");
+    return typed(indexAssign, ofKind(TypeKind::NUMBER));
+}
+
+// Tasks run functions, not methods or built-ins. The arguments widen the
+// parameters like those of a call; they and the result must be numbers,
+// strings or arrays, which a task can copy.
+StaticType TypeInference::visitSpawnExpression(SpawnExpression* spawnExpr) {
+    CallExpression* callExpr = spawnExpr->call;
+    Symbol name = static_cast<Identifier*>(callExpr->callee)->name;
+    auto found = functions.find(name);
+    if (found == functions.end())
+        throw std::runtime_error("Undefined function: " + std::string(symbolName(name)));
+    FunctionDeclaration* callee = found->second;
+    for (size_t i = 0; i < callExpr->arguments.size(); i++) {
+        StaticType argument = visit(callExpr->arguments[i]);
+        if (argument.kind == TypeKind::OBJECT || argument.kind == TypeKind::TASK)
+            throw std::runtime_error("spawn arguments must be numbers, strings or arrays, not " + describe(argument) +
+                                     ".");
+        pass(callee, i, callExpr->arguments[i], argument);
+    }
+    StaticType task = ofKind(TypeKind::TASK);
+    task.result = callee->returnType.kind == TypeKind::INTEGER ? TypeKind::NUMBER : callee->returnType.kind;
+    if (task.result == TypeKind::OBJECT || task.result == TypeKind::TASK)
+        throw std::runtime_error("Tasks must return numbers, strings or arrays, not " +
+                                 describe(callee->returnType) + ".");
+    spawnExpr->result = task.result;
+    return typed(spawnExpr, task);
+}
+
+// f is called with the index as its first argument, the others missing.
+StaticType TypeInference::visitParallelFor(ParallelFor* loop) {
+    expect(loop->from, visit(loop->from), TypeKind::NUMBER, "parallelFor expects numbers as bounds");
+    expect(loop->to, visit(loop->to), TypeKind::NUMBER, "parallelFor expects numbers as bounds");
+    auto found = functions.find(loop->function);
+    if (found == functions.end())
+        throw std::runtime_error("Undefined function: " + std::string(symbolName(loop->function)));
+    FunctionDeclaration* funcDecl = found->second;
+    if (funcDecl->params.empty())
+        throw std::runtime_error("parallelFor expects a function taking the index: " +
+                                 std::string(symbolName(loop->function)) + ".");
+    pass(funcDecl, 0, nullptr, ofKind(TypeKind::INTEGER));
+    TypeKind result = funcDecl->returnType.kind;
+    if (result != TypeKind::UNKNOWN && result != TypeKind::INTEGER && result != TypeKind::NUMBER)
+        throw std::runtime_error("parallelFor expects a function returning numbers, not " +
+                                 describe(funcDecl->returnType) + ".");
+    return typed(loop, ofKind(TypeKind::ARRAY));
+}
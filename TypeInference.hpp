@@ -0,0 +1,104 @@
+#ifndef TYPEINFERENCE_HPP
+#define TYPEINFERENCE_HPP
+
+#include "AST.hpp"
+#include "ASTVisitor.hpp"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Infers static types for the C++ backend. Every variable, parameter, field
+// and function result gets one type: the join of everything written to it,
+// including the arguments at every call site. The program is walked until no
+// type changes. Numbers that are provably whole and bounded (literals,
+// comparisons and the counters of counted loops) are INTEGER; other sums,
+// products and quotients are NUMBER, as they are doubles at runtime. A
+// variable indexed or passed to an array built-in is an ARRAY. Objects of
+// related classes join to their nearest common class. A task's type records
+// what joining it returns; numbers are doubles there, so that one variable
+// can hold tasks of functions returning whole and other numbers. Parameters
+// that no call site constrains default to NUMBER. Functions imported from
+// modules compiled apart (Program::externs) have fixed types, which
+// arguments are checked against.
+class TypeInference : private ASTVisitor<TypeInference, StaticType, void> {
+public:
+    static constexpr const char* PASS_NAME = "type inference";
+
+    // Annotates the program in place. Throws if a variable would have to hold
+    // values of two incompatible types.
+    void infer(Program* program);
+
+    // True if control cannot reach the end of the statement.
+    static bool alwaysReturns(Statement* stmt);
+
+private:
+    // A variable in scope: where its type is stored, and its name for errors.
+    struct Binding {
+        Symbol name;
+        StaticType* type;
+    };
+
+    std::unordered_map<Symbol, FunctionDeclaration*> functions;
+    std::unordered_map<Symbol, ClassDeclaration*> classes;
+    std::vector<Binding> locals;     // Innermost last.
+    std::vector<size_t> scopeStarts; // Where each scope begins in locals.
+    std::unordered_map<Symbol, StaticType*> globals;
+    ClassDeclaration* currentClass = nullptr;
+    FunctionDeclaration* currentFunction = nullptr;
+    bool changed = false;
+    std::unordered_map<Symbol, int> writes;             // Assignments and declarations walked, by name.
+    std::unordered_set<BinaryExpression*> countedSteps; // Steps of the counted loops being walked.
+    std::unordered_set<WhileStatement*> uncounted;      // Loops that write their counter elsewhere too.
+
+    friend class ASTVisitor<TypeInference, StaticType, void>;
+
+    void inferPass(Program* program);
+    void inferFunction(FunctionDeclaration* funcDecl);
+    void join(StaticType& target, StaticType value, Symbol name);
+    Symbol commonBase(Symbol a, Symbol b) const;
+    FunctionDeclaration* method(ClassDeclaration* classDecl, Symbol name) const;
+    VariableDeclaration* field(ClassDeclaration* classDecl, Symbol name) const;
+    Binding lookup(Symbol name) const;
+    void pass(FunctionDeclaration* callee, size_t index, Expression* arg, StaticType type);
+    void expect(Expression* expr, StaticType type, TypeKind expected, const std::string& what);
+    StaticType overridableBuiltIn(CallExpression* callExpr, Symbol name);
+
+    void beginScope() { scopeStarts.push_back(locals.size()); }
+    void endScope() {
+        locals.resize(scopeStarts.back());
+        scopeStarts.pop_back();
+    }
+
+    // Statements.
+    void visitVariableDeclaration(VariableDeclaration* varDecl);
+    void visitPrintStatement(PrintStatement* printStmt);
+    void visitExpressionStatement(ExpressionStatement* exprStmt);
+    void visitBlockStatement(BlockStatement* block);
+    void visitIfStatement(IfStatement* ifStmt);
+    void visitWhileStatement(WhileStatement* whileStmt);
+    void visitReturnStatement(ReturnStatement* returnStmt);
+    void visitBreakStatement(BreakStatement* breakStmt);
+    void visitContinueStatement(ContinueStatement* continueStmt);
+    void visitFunctionDeclaration(FunctionDeclaration* funcDecl);
+    void visitClassDeclaration(ClassDeclaration* classDecl);
+
+    // Expressions return their type and record its kind on the node.
+    StaticType visitNumericLiteral(NumericLiteral* num);
+    StaticType visitStringLiteral(StringLiteral* str);
+    StaticType visitIdentifier(Identifier* id);
+    StaticType visitAssignment(Assignment* assign);
+    StaticType visitBinaryExpression(BinaryExpression* bin);
+    StaticType visitUnaryExpression(UnaryExpression* unary);
+    StaticType visitCallExpression(CallExpression* callExpr);
+    StaticType visitMemberAccessExpression(MemberAccessExpression* memberAccess);
+    StaticType visitNewExpression(NewExpression* newExpr);
+    StaticType visitArrayLiteral(ArrayLiteral* arrayLit);
+    StaticType visitIndexExpression(IndexExpression* indexExpr);
+    StaticType visitIndexAssignment(IndexAssignment* indexAssign);
+    StaticType visitSpawnExpression(SpawnExpression* spawnExpr);
+    StaticType visitParallelFor(ParallelFor* loop);
+};
+
+#endif // TYPEINFERENCE_HPP
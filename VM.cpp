@@ -0,0 +1,283 @@
+#include "VM.hpp"
+#include "Builtins.hpp"
+#include "ProgramImage.hpp"
+#include <cstring>
+#include <stdexcept>
+
+static inline uint16_t readU16(const uint8_t*& ip) {
+    uint16_t value = static_cast<uint16_t>(ip[0] | (ip[1] << 8));
+    ip += 2;
+    return value;
+}
+
+static inline uint32_t readU32(const uint8_t*& ip) {
+    uint32_t value = static_cast<uint32_t>(ip[0]) |
+                     (static_cast<uint32_t>(ip[1]) << 8) |
+                     (static_cast<uint32_t>(ip[2]) << 16) |
+                     (static_cast<uint32_t>(ip[3]) << 24);
+    ip += 4;
+    return value;
+}
+
+namespace {
+
+// A CompiledProgram, as the VM reads it.
+struct CompiledFunctions {
+    const CompiledProgram& program;
+
+    static FunctionCode code(const FunctionProto& proto) {
+        return {proto.chunk.code.data(), proto.chunk.code.size(), proto.chunk.constants.data(),
+                proto.arity, proto.localCount, proto.defined};
+    }
+    FunctionCode script() const { return code(program.script); }
+    FunctionCode function(uint32_t index) const { return code(program.functions[index]); }
+    std::string_view functionName(uint32_t index) const { return program.functions[index].name; }
+    std::string_view globalName(uint32_t index) const { return program.globals[index]; }
+};
+
+} // namespace
+
+void VM::run(const CompiledProgram& program) {
+    stack.clear();
+    frames.clear();
+    globalDefined.clear();
+    execute(program);
+}
+
+void VM::run(const ProgramImage& image) {
+    stack.clear();
+    frames.clear();
+    globalDefined.clear();
+    executeProgram(image);
+}
+
+bool VM::execute(const CompiledProgram& program) {
+    return executeProgram(CompiledFunctions{program});
+}
+
+template <typename Program>
+bool VM::executeProgram(const Program& program) {
+    FunctionCode script = program.script();
+    // Slots of earlier scripts keep their values, but for the block locals
+    // of the last one, which the next may reuse.
+    stack.resize(script.localCount);
+    globalDefined.resize(script.localCount, false);
+    frames.push_back({script.code, script.constants, 0});
+    const uint8_t* scriptEnd = script.code + script.codeSize;
+
+    CallFrame* frame = &frames.back();
+    const uint8_t* ip = frame->ip;
+    const Value* constants = frame->constants;
+    Value* slots = stack.data() + frame->base;
+
+    // Reloads the cached frame state after the stack or frame list changed.
+    auto reload = [&]() {
+        frame = &frames.back();
+        ip = frame->ip;
+        constants = frame->constants;
+        slots = stack.data() + frame->base;
+    };
+
+    while (true) {
+        OpCode op = static_cast<OpCode>(*ip++);
+        switch (op) {
+            case OpCode::CONSTANT:
+                stack.push_back(constants[readU32(ip)]);
+                slots = stack.data() + frame->base;
+                break;
+            case OpCode::POP:
+                stack.pop_back();
+                break;
+            case OpCode::GET_LOCAL:
+                stack.push_back(slots[readU16(ip)]);
+                slots = stack.data() + frame->base;
+                break;
+            case OpCode::SET_LOCAL:
+                slots[readU16(ip)] = stack.back();
+                break;
+            case OpCode::GET_GLOBAL: {
+                uint32_t index = readU32(ip);
+                if (!globalDefined[index])
+                    throw std::runtime_error("Undefined variable: " + std::string(program.globalName(index)));
+                stack.push_back(stack[index]);
+                slots = stack.data() + frame->base;
+                break;
+            }
+            case OpCode::SET_GLOBAL: {
+                uint32_t index = readU32(ip);
+                if (!globalDefined[index])
+                    throw std::runtime_error("Undefined variable: " + std::string(program.globalName(index)));
+                stack[index] = stack.back();
+                break;
+            }
+            case OpCode::DEFINE_GLOBAL: {
+                uint32_t index = readU32(ip);
+                stack[index] = std::move(stack.back());
+                globalDefined[index] = true;
+                stack.pop_back();
+                break;
+            }
+            case OpCode::ADD: {
+                Value right = std::move(stack.back());
+                stack.pop_back();
+                Value& left = stack.back();
+                left = addValues(left, right);
+                break;
+            }
+            case OpCode::SUBTRACT: {
+                double right = stack.back().toNumber();
+                stack.pop_back();
+                stack.back() = Value(stack.back().toNumber() - right);
+                break;
+            }
+            case OpCode::MULTIPLY: {
+                double right = stack.back().toNumber();
+                stack.pop_back();
+                stack.back() = Value(stack.back().toNumber() * right);
+                break;
+            }
+            case OpCode::DIVIDE: {
+                double right = stack.back().toNumber();
+                stack.pop_back();
+                stack.back() = Value(stack.back().toNumber() / right);
+                break;
+            }
+            case OpCode::LESS: {
+                double right = stack.back().toNumber();
+                stack.pop_back();
+                stack.back() = Value(stack.back().toNumber() < right ? 1.0 : 0.0);
+                break;
+            }
+            case OpCode::LESS_EQUAL: {
+                double right = stack.back().toNumber();
+                stack.pop_back();
+                stack.back() = Value(stack.back().toNumber() <= right ? 1.0 : 0.0);
+                break;
+            }
+            case OpCode::GREATER: {
+                double right = stack.back().toNumber();
+                stack.pop_back();
+                stack.back() = Value(stack.back().toNumber() > right ? 1.0 : 0.0);
+                break;
+            }
+            case OpCode::GREATER_EQUAL: {
+                double right = stack.back().toNumber();
+                stack.pop_back();
+                stack.back() = Value(stack.back().toNumber() >= right ? 1.0 : 0.0);
+                break;
+            }
+            case OpCode::NEGATE:
+                stack.back() = Value(-stack.back().toNumber());
+                break;
+            case OpCode::PRINT: {
+                const Value& value = stack.back();
+                if (value.isNumber())
+                    print(value.asNumber());
+                else
+                    print(value.stringView());
+                stack.pop_back();
+                break;
+            }
+            case OpCode::JUMP: {
+                int32_t offset = static_cast<int32_t>(readU32(ip));
+                ip += offset;
+                break;
+            }
+            case OpCode::JUMP_IF_FALSE: {
+                int32_t offset = static_cast<int32_t>(readU32(ip));
+                if (!stack.back().isTruthy())
+                    ip += offset;
+                stack.pop_back();
+                break;
+            }
+            case OpCode::CALL: {
+                uint32_t index = readU32(ip);
+                FunctionCode callee = program.function(index);
+                uint8_t argc = *ip++;
+                if (!callee.defined)
+                    throw std::runtime_error("Undefined function: " + std::string(program.functionName(index)));
+                // Missing arguments default to 0; extra arguments are dropped.
+                for (uint8_t i = callee.arity; i < argc; i++)
+                    stack.pop_back();
+                size_t base = stack.size() - (argc < callee.arity ? argc : callee.arity);
+                stack.resize(base + callee.localCount);
+                frame->ip = ip;
+                frames.push_back({callee.code, callee.constants, base});
+                reload();
+                break;
+            }
+            case OpCode::CALL_BUILTIN: {
+                BuiltinId id = static_cast<BuiltinId>(*ip++);
+                uint8_t argc = *ip++;
+                Value result = callBuiltin(id, stack.data() + stack.size() - argc, argc);
+                stack.resize(stack.size() - argc);
+                stack.push_back(std::move(result));
+                slots = stack.data() + frame->base;
+                break;
+            }
+            case OpCode::RETURN: {
+                Value result = std::move(stack.back());
+                size_t base = frame->base;
+                frames.pop_back();
+                if (frames.empty()) {
+                    // The implicit return at the end of the script is its
+                    // last instruction; any other one is an explicit return.
+                    stack.resize(script.localCount);
+                    return ip == scriptEnd;
+                }
+                stack.resize(base);
+                stack.push_back(std::move(result));
+                reload();
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown opcode in VM.");
+        }
+    }
+}
+
+Value VM::callBuiltin(BuiltinId id, const Value* args, uint8_t argc) {
+    switch (id) {
+        case BuiltinId::READ_FILE:
+            if (argc < 1 || !args[0].isString())
+                throw std::runtime_error("readFile expects a string filename.");
+            return Value::adopt(ObjString::fromFile(std::string(args[0].stringView())));
+        case BuiltinId::WRITE_FILE:
+            if (argc < 2 || !args[0].isString() || !args[1].isString())
+                throw std::runtime_error("writeFile expects two string arguments: filename and content.");
+            writeFile(std::string(args[0].stringView()), args[1].stringView());
+            return Value(0);
+        case BuiltinId::FLUSH:
+            flush();
+            return Value(0);
+        case BuiltinId::OPEN_LINES:
+        case BuiltinId::OPEN_WRITER: {
+            bool lines = id == BuiltinId::OPEN_LINES;
+            if (argc < 1 || !args[0].isString())
+                throw std::runtime_error(std::string(lines ? "openLines" : "openWriter") + " expects a string filename.");
+            std::string filename(args[0].stringView());
+            return Value(lines ? fileOpenLines(filename) : fileOpenWriter(filename));
+        }
+        default:
+            break;
+    }
+    // Line streams: handles are numbers; anything else is refused like a
+    // closed handle.
+    double handle = argc >= 1 && args[0].isNumber() ? args[0].asNumber() : 0;
+    switch (id) {
+        case BuiltinId::HAS_LINE:
+            return Value(static_cast<double>(fileHasLine(handle)));
+        case BuiltinId::NEXT_LINE:
+            return Value(fileNextLine(handle));
+        case BuiltinId::WRITE:
+            if (argc < 2 || !(args[1].isString() || args[1].isNumber()))
+                throw std::runtime_error("write expects a handle and a string or number.");
+            return Value(args[1].isString() ? fileWrite(handle, args[1].stringView())
+                                            : fileWrite(handle, args[1].asNumber()));
+        case BuiltinId::CLOSE:
+            return Value(fileClose(handle));
+        default:
+            break;
+    }
+    throw std::runtime_error("Undefined built-in function.");
+}
\ No newline at end of file
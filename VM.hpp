@@ -0,0 +1,41 @@
+#ifndef VM_HPP
+#define VM_HPP
+
+#include "Bytecode.hpp"
+#include <vector>
+
+class ProgramImage;
+
+// Stack-based virtual machine executing bytecode produced by BytecodeCompiler,
+// either in memory or from a program image.
+class VM {
+public:
+    void run(const CompiledProgram& program);
+    void run(const ProgramImage& image);
+
+    // Runs program.script on top of the globals left by earlier scripts, for
+    // compiling and running a program one top-level statement at a time.
+    // Returns false if the script ended the program with a top-level return.
+    bool execute(const CompiledProgram& program);
+
+private:
+    struct CallFrame {
+        const uint8_t* ip;
+        const Value* constants;
+        size_t base; // Index of the frame's first local slot in the stack.
+    };
+
+    // The script frame at the bottom of the stack doubles as the global frame.
+    std::vector<Value> stack;
+    std::vector<CallFrame> frames;
+    std::vector<bool> globalDefined;
+
+    // Program is a CompiledProgram or a ProgramImage, seen through the same
+    // interface: script(), function(index), functionName(index) and
+    // globalName(index).
+    template <typename Program>
+    bool executeProgram(const Program& program);
+    Value callBuiltin(BuiltinId id, const Value* args, uint8_t argc);
+};
+
+#endif // VM_HPP
\ No newline at end of file
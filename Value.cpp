@@ -0,0 +1,134 @@
+#include "Value.hpp"
+#include "Builtins.hpp"
+#include "Shape.hpp"
+#include <new>
+
+ObjString* ObjString::create(std::string_view text) {
+    return concat(text, std::string_view());
+}
+
+ObjString* ObjString::concat(std::string_view left, std::string_view right) {
+    size_t length = left.size() + right.size();
+    void* memory = ::operator new(sizeof(ObjString) + length + 1);
+    ObjString* str = static_cast<ObjString*>(memory);
+    str->refCount = 1;
+    str->kind = ObjKind::STRING;
+    str->mapped = false;
+    str->length = length;
+    char* chars = reinterpret_cast<char*>(str + 1);
+    str->chars = chars;
+    if (!left.empty())
+        std::memcpy(chars, left.data(), left.size());
+    if (!right.empty())
+        std::memcpy(chars + left.size(), right.data(), right.size());
+    chars[length] = '\0';
+    return str;
+}
+
+ObjString* ObjString::fromFile(const std::string& filename) {
+    size_t length = 0;
+    const char* data = mapFile(filename, length);
+    if (!data)
+        return create(readFile(filename));
+    ObjString* str = static_cast<ObjString*>(::operator new(sizeof(ObjString)));
+    str->refCount = 1;
+    str->kind = ObjKind::STRING;
+    str->mapped = true;
+    str->length = length;
+    str->chars = data;
+    return str;
+}
+
+ObjInstance* ObjInstance::create(const Shape* shape, uint32_t fieldCount) {
+    void* memory = ::operator new(sizeof(ObjInstance) + fieldCount * sizeof(Value));
+    ObjInstance* object = static_cast<ObjInstance*>(memory);
+    object->refCount = 1;
+    object->kind = ObjKind::INSTANCE;
+    object->shape = shape;
+    object->fieldCount = fieldCount;
+    Value* fields = object->fields();
+    for (uint32_t i = 0; i < fieldCount; i++)
+        new (&fields[i]) Value();
+    return object;
+}
+
+ObjTask* ObjTask::create(std::shared_ptr<TaskState> state) {
+    ObjTask* task = new ObjTask();
+    task->refCount = 1;
+    task->kind = ObjKind::TASK;
+    task->state = std::move(state);
+    return task;
+}
+
+ObjArray* ObjArray::create(size_t length) {
+    ObjArray* array = static_cast<ObjArray*>(::operator new(sizeof(ObjArray)));
+    array->refCount = 1;
+    array->kind = ObjKind::ARRAY;
+    array->length = length;
+    array->data = allocateArray(length);
+    return array;
+}
+
+// Objects referring to each other in a cycle are never freed.
+void freeObject(Obj* obj) {
+    switch (obj->kind) {
+        case ObjKind::STRING: {
+            ObjString* str = static_cast<ObjString*>(obj);
+            if (str->mapped)
+                unmapFile(str->chars, str->length);
+            ::operator delete(obj);
+            return;
+        }
+        case ObjKind::INSTANCE: {
+            ObjInstance* object = static_cast<ObjInstance*>(obj);
+            Value* fields = object->fields();
+            for (uint32_t i = 0; i < object->fieldCount; i++)
+                fields[i].~Value();
+            ::operator delete(obj);
+            return;
+        }
+        case ObjKind::ARRAY:
+            freeArray(static_cast<ObjArray*>(obj)->data);
+            ::operator delete(obj);
+            return;
+        case ObjKind::TASK:
+            delete static_cast<ObjTask*>(obj);
+            return;
+    }
+}
+
+std::string_view objectText(const Value& value, std::string& buffer) {
+    if (value.isString())
+        return value.stringView();
+    if (value.isArray()) {
+        buffer = arrayText(value.asArray()->data, value.asArray()->length);
+        return buffer;
+    }
+    if (value.isTask()) {
+        buffer = "<task>";
+        return buffer;
+    }
+    buffer = "<" + std::string(symbolName(value.asInstance()->shape->className)) + " object>";
+    return buffer;
+}
+
+Value addValues(const Value& left, const Value& right) {
+    if (left.isNumber() && right.isNumber())
+        return Value(left.asNumber() + right.asNumber());
+    // Numbers are formatted with std::to_string when concatenated.
+    std::string leftText, rightText;
+    std::string_view leftView, rightView;
+    if (left.isNumber()) {
+        leftText = std::to_string(left.asNumber());
+        leftView = leftText;
+    } else {
+        leftView = objectText(left, leftText);
+    }
+    if (right.isNumber()) {
+        rightText = std::to_string(right.asNumber());
+        rightView = rightText;
+    } else {
+        rightView = objectText(right, rightText);
+    }
+    return Value::adopt(ObjString::concat(leftView, rightView));
+}
\ No newline at end of file
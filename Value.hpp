@@ -0,0 +1,194 @@
+#ifndef VALUE_HPP
+#define VALUE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Kinds of reference-counted heap objects a Value can point to.
+enum class ObjKind : uint8_t {
+    STRING,
+    INSTANCE,
+    ARRAY,
+    TASK
+};
+
+// Header shared by all heap objects.
+struct Obj {
+    uint32_t refCount;
+    ObjKind kind;
+};
+
+// Immutable string. The characters are allocated inline after the header,
+// or, for a large file read by readFile, are a read-only mapping of it that
+// is only copied by operations making new strings.
+struct ObjString : Obj {
+    bool mapped;
+    size_t length;
+    const char* chars;
+
+    const char* data() const { return chars; }
+    std::string_view view() const { return std::string_view(chars, length); }
+
+    // Allocates a string with refCount 1 holding a copy of the given text.
+    static ObjString* create(std::string_view text);
+    // Allocates the concatenation of two pieces of text.
+    static ObjString* concat(std::string_view left, std::string_view right);
+    // The contents of a file, mapped if it is large (see mapFile).
+    static ObjString* fromFile(const std::string& filename);
+};
+
+struct Shape;
+class Value;
+
+// Object of a MiniLang class. Its fields are allocated inline after the
+// header, in the slots its shape assigns.
+struct ObjInstance : Obj {
+    const Shape* shape;
+    uint32_t fieldCount;
+
+    inline Value* fields();
+
+    // Allocates an object with refCount 1 whose fields are all 0.
+    static ObjInstance* create(const Shape* shape, uint32_t fieldCount);
+};
+
+// Fixed-length array of numbers. The elements are 64-byte aligned, for the
+// SIMD built-ins.
+struct ObjArray : Obj {
+    size_t length;
+    double* data;
+
+    // Allocates an array with refCount 1 whose elements are all 0.
+    static ObjArray* create(size_t length);
+};
+
+struct ObjTask;
+struct TaskState;
+
+// Releases an object whose reference count dropped to zero.
+void freeObject(Obj* obj);
+
+// The Value type supports numbers, strings, objects, arrays and tasks in 8 bytes using NaN-boxing:
+// any bit pattern that is not a tagged quiet NaN is a double, and tagged
+// patterns carry a 48-bit pointer to a reference-counted heap object.
+// Shared by the tree-walking Interpreter and the bytecode VM.
+class Value {
+public:
+    enum Type { NUMBER, STRING, INSTANCE, ARRAY, TASK };
+
+    Value() : bits(0) {}
+    Value(double num) {
+        // Collapse NaN payloads to one canonical pattern (keeping the sign, which
+        // is visible when printed) so that no NaN collides with the object tag.
+        std::memcpy(&bits, &num, sizeof(bits));
+        if (num != num)
+            bits = (bits & SIGN_BIT) | CANONICAL_NAN;
+    }
+    Value(std::string_view str) : bits(tagObject(ObjString::create(str))) {}
+    Value(const std::string& str) : Value(std::string_view(str)) {}
+
+    // Wraps a freshly created object, taking over the caller's reference.
+    static Value adopt(Obj* obj) {
+        Value value;
+        value.bits = tagObject(obj);
+        return value;
+    }
+
+    Value(const Value& other) : bits(other.bits) { retain(); }
+    Value(Value&& other) noexcept : bits(other.bits) { other.bits = 0; }
+    Value& operator=(const Value& other) {
+        if (bits != other.bits) {
+            other.retain();
+            release();
+            bits = other.bits;
+        }
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            release();
+            bits = other.bits;
+            other.bits = 0;
+        }
+        return *this;
+    }
+    ~Value() { release(); }
+
+    Type type() const {
+        return isNumber() ? NUMBER : isString() ? STRING : isInstance() ? INSTANCE : isArray() ? ARRAY : TASK;
+    }
+    bool isNumber() const { return (bits & OBJ_TAG) != OBJ_TAG; }
+    bool isString() const { return isObject() && asObject()->kind == ObjKind::STRING; }
+    bool isInstance() const { return isObject() && asObject()->kind == ObjKind::INSTANCE; }
+    bool isArray() const { return isObject() && asObject()->kind == ObjKind::ARRAY; }
+    bool isTask() const { return isObject() && asObject()->kind == ObjKind::TASK; }
+
+    double asNumber() const {
+        double num;
+        std::memcpy(&num, &bits, sizeof(num));
+        return num;
+    }
+    // Numeric view used by the arithmetic operators; strings count as 0.
+    double toNumber() const { return isNumber() ? asNumber() : 0; }
+    const ObjString* asString() const { return static_cast<const ObjString*>(asObject()); }
+    std::string_view stringView() const { return asString()->view(); }
+    ObjInstance* asInstance() const { return static_cast<ObjInstance*>(asObject()); }
+    ObjArray* asArray() const { return static_cast<ObjArray*>(asObject()); }
+    inline ObjTask* asTask() const;
+
+    // Objects are always true.
+    bool isTruthy() const {
+        if (isNumber())
+            return asNumber() != 0;
+        return !isString() || asString()->length != 0;
+    }
+
+private:
+    static constexpr uint64_t SIGN_BIT = 0x8000000000000000ull;
+    static constexpr uint64_t QUIET_NAN = 0x7ffc000000000000ull;
+    static constexpr uint64_t OBJ_TAG = SIGN_BIT | QUIET_NAN;
+    static constexpr uint64_t CANONICAL_NAN = 0x7ff8000000000000ull;
+
+    uint64_t bits;
+
+    static uint64_t tagObject(Obj* obj) { return OBJ_TAG | reinterpret_cast<uint64_t>(obj); }
+    bool isObject() const { return (bits & OBJ_TAG) == OBJ_TAG; }
+    Obj* asObject() const { return reinterpret_cast<Obj*>(bits & ~OBJ_TAG); }
+    void retain() const {
+        if (isObject())
+            asObject()->refCount++;
+    }
+    void release() {
+        if (isObject() && --asObject()->refCount == 0)
+            freeObject(asObject());
+    }
+};
+
+static_assert(sizeof(Value) == 8, "Value must stay NaN-boxed into 8 bytes");
+
+Value* ObjInstance::fields() { return reinterpret_cast<Value*>(this + 1); }
+
+// Handle of a task spawned by the interpreter. The state is shared with the
+// thread running the task until the first join moves the result here.
+struct ObjTask : Obj {
+    std::shared_ptr<TaskState> state;
+    Value result;
+
+    // Allocates a handle with refCount 1.
+    static ObjTask* create(std::shared_ptr<TaskState> state);
+};
+
+ObjTask* Value::asTask() const { return static_cast<ObjTask*>(asObject()); }
+
+// Implements '+': numeric addition, or concatenation if either side is a string.
+Value addValues(const Value& left, const Value& right);
+
+// Text of a string, "<ClassName object>" for an object, "[1, 2.5]" for an
+// array or "<task>" for a task, as print and concatenation show it. The text
+// of anything but a string is built in buffer.
+std::string_view objectText(const Value& value, std::string& buffer);
+
+#endif // VALUE_HPP
\ No newline at end of file
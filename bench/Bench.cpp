@@ -0,0 +1,687 @@
+// Bench.cpp: Benchmark suite for spotting performance regressions between
+// versions of the compiler. It times
+//   - the front-end phases (lexing, parsing, optimizing, type inference and
+//     C++ generation) on a large synthetic program, and
+//   - end-to-end workloads (recursion, loops, string concatenation, method
+//     calls and file I/O) under the interpreter, the VM and generated C++,
+//     and regression checks: small programs on which a backend once went
+//     wrong, run once each.
+// Each benchmark runs once untimed, to warm up and to check that every
+// backend prints the same, then --reps times. The report goes to stdout as
+// JSON, one benchmark per line, with every sample, the median, mean,
+// variance and range; a summary table goes to stderr. --compare with an
+// earlier report shows how each median changed, and fails if one grew by
+// more than --threshold percent.
+//
+// Build and run from the repository root:
+//   bench/Build.sh && ./minilang_bench > before.json
+//   ./minilang_bench --compare before.json > after.json
+//
+// The interpreter and the VM run in this process, from parsing on, as
+// --interpret and --vm do once the file is read. Generated C++ is compiled
+// with $CXX (else g++) -O2, which is not timed, and its runs include
+// starting the process.
+#include "Builtins.hpp"
+#include "BuildCache.hpp"
+#include "BytecodeCompiler.hpp"
+#include "CodeGenerator.hpp"
+#include "Interpreter.hpp"
+#include "Lexer.hpp"
+#include "Optimizer.hpp"
+#include "Parser.hpp"
+#include "Purity.hpp"
+#include "TypeInference.hpp"
+#include "VM.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct Options {
+    int reps = 7;
+    int scale = 1; // Size of the synthetic program, in units of 2000 blocks.
+    std::string filter;
+    std::string compare;
+    double threshold = 10;
+    bool cpp = true;
+};
+
+struct Result {
+    std::string name;
+    std::vector<double> samples; // Milliseconds.
+    std::string fields;          // More JSON fields, each with a leading ", ".
+    std::string error;           // Empty unless the benchmark failed.
+};
+
+double median(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    size_t middle = samples.size() / 2;
+    return samples.size() % 2 ? samples[middle] : (samples[middle - 1] + samples[middle]) / 2;
+}
+
+double mean(const std::vector<double>& samples) {
+    double total = 0;
+    for (double sample : samples)
+        total += sample;
+    return total / samples.size();
+}
+
+// Of a sample: divided by n - 1.
+double variance(const std::vector<double>& samples) {
+    if (samples.size() < 2)
+        return 0;
+    double average = mean(samples);
+    double squares = 0;
+    for (double sample : samples)
+        squares += (sample - average) * (sample - average);
+    return squares / (samples.size() - 1);
+}
+
+std::string number(double value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.6g", value);
+    return text;
+}
+
+std::string quoted(const std::string& text) {
+    std::string json = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            json += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20)
+            json += c;
+    }
+    return json + "\"";
+}
+
+std::string json(const Result& result) {
+    std::string line = "{\"name\": " + quoted(result.name);
+    if (!result.error.empty())
+        return line + ", \"error\": " + quoted(result.error) + result.fields + "}";
+    line += ", \"reps\": " + std::to_string(result.samples.size());
+    line += ", \"median_ms\": " + number(median(result.samples));
+    line += ", \"mean_ms\": " + number(mean(result.samples));
+    line += ", \"variance_ms2\": " + number(variance(result.samples));
+    line += ", \"stddev_ms\": " + number(std::sqrt(variance(result.samples)));
+    line += ", \"min_ms\": " + number(*std::min_element(result.samples.begin(), result.samples.end()));
+    line += ", \"max_ms\": " + number(*std::max_element(result.samples.begin(), result.samples.end()));
+    line += result.fields + ", \"samples_ms\": [";
+    for (size_t i = 0; i < result.samples.size(); i++)
+        line += (i ? ", " : "") + number(result.samples[i]);
+    return line + "]}";
+}
+
+void summarize(const Result& result) {
+    if (!result.error.empty()) {
+        std::fprintf(stderr, "%-28s failed: %s\n", result.name.c_str(), result.error.c_str());
+        return;
+    }
+    std::fprintf(stderr, "%-28s median %10.3f ms  stddev %8.3f ms  min %10.3f ms\n", result.name.c_str(),
+                 median(result.samples), std::sqrt(variance(result.samples)),
+                 *std::min_element(result.samples.begin(), result.samples.end()));
+}
+
+// Runs a timed function once untimed and then reps times. run returns the
+// milliseconds of the part it times, so that it can set up untimed.
+template <typename Run>
+Result measure(const std::string& name, const Options& options, Run run) {
+    Result result;
+    result.name = name;
+    try {
+        run();
+        for (int i = 0; i < options.reps; i++)
+            result.samples.push_back(run());
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+    return result;
+}
+
+std::string readText(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+// Sends what this process prints to a file, until destroyed.
+class Redirect {
+public:
+    explicit Redirect(const std::string& path) {
+        flush();
+        saved = ::dup(STDOUT_FILENO);
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        ::dup2(fd, STDOUT_FILENO);
+        ::close(fd);
+    }
+    ~Redirect() {
+        flush();
+        ::dup2(saved, STDOUT_FILENO);
+        ::close(saved);
+    }
+    Redirect(const Redirect&) = delete;
+    Redirect& operator=(const Redirect&) = delete;
+
+private:
+    int saved;
+};
+
+// Runs an executable with its output in outputPath. Throws unless it exits
+// with status 0.
+void runProgram(const std::string& path, const std::string& outputPath) {
+    pid_t pid = ::fork();
+    if (pid == 0) {
+        int fd = ::open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        ::dup2(fd, STDOUT_FILENO);
+        ::execl(path.c_str(), path.c_str(), static_cast<char*>(nullptr));
+        ::_exit(127);
+    }
+    int status = 0;
+    if (pid < 0 || ::waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        throw std::runtime_error(path + " failed");
+}
+
+// Parses a source as the backends get it: optimized, pure functions marked
+// for memoization.
+std::unique_ptr<Program> frontEnd(const std::string& source) {
+    Lexer lexer(source);
+    std::unique_ptr<Program> program = Parser(lexer).parse();
+    Optimizer().optimize(program.get());
+    PurityAnalysis().analyze(program.get());
+    return program;
+}
+
+// blocks copies of a block using functions, loops, branches, strings,
+// classes and arrays, all of which the C++ backend supports.
+std::string syntheticProgram(int blocks) {
+    std::string source;
+    for (int i = 0; i < blocks; i++) {
+        std::string n = std::to_string(i);
+        source += "function step" + n + "(a, b) {\n"
+                  "    let x = a * " + n + " + b;\n"
+                  "    let total = 0;\n"
+                  "    while (x > 0) {\n"
+                  "        if (x < 3) {\n"
+                  "            break;\n"
+                  "        }\n"
+                  "        total = total + x / 2;\n"
+                  "        x = x - 1;\n"
+                  "    }\n"
+                  "    return total;\n"
+                  "}\n"
+                  "class Shape" + n + " {\n"
+                  "    let size = " + n + ";\n"
+                  "    function grow(by) {\n"
+                  "        size = size + by;\n"
+                  "        return size;\n"
+                  "    }\n"
+                  "}\n"
+                  "let shape" + n + " = new Shape" + n + "();\n"
+                  "let label" + n + " = \"block " + n + ": \" + shape" + n + ".grow(step" + n + "(" + n + ", 2));\n"
+                  "let values" + n + " = [1, 2.5, " + n + "];\n"
+                  "print label" + n + ";\n";
+    }
+    return source;
+}
+
+void benchPhases(const Options& options, std::vector<Result>& results) {
+    std::string source = syntheticProgram(2000 * options.scale);
+    std::string size = ", \"bytes\": " + std::to_string(source.size());
+    auto add = [&](Result result) {
+        result.fields += size;
+        summarize(result);
+        results.push_back(std::move(result));
+    };
+    if (std::string("phase/lex").find(options.filter) != std::string::npos) {
+        size_t tokens = 0;
+        Result result = measure("phase/lex", options, [&] {
+            auto start = Clock::now();
+            tokens = Lexer(source).tokenize().size();
+            return millisecondsSince(start);
+        });
+        result.fields = ", \"tokens\": " + std::to_string(tokens);
+        add(std::move(result));
+    }
+    // The parser pulls its tokens from the lexer: lexing is part of parsing.
+    if (std::string("phase/parse").find(options.filter) != std::string::npos) {
+        add(measure("phase/parse", options, [&] {
+            auto start = Clock::now();
+            Lexer lexer(source);
+            std::unique_ptr<Program> program = Parser(lexer).parse();
+            return millisecondsSince(start);
+        }));
+    }
+    if (std::string("phase/optimize").find(options.filter) != std::string::npos) {
+        add(measure("phase/optimize", options, [&] {
+            Lexer lexer(source);
+            std::unique_ptr<Program> program = Parser(lexer).parse();
+            auto start = Clock::now();
+            Optimizer().optimize(program.get());
+            PurityAnalysis().analyze(program.get());
+            return millisecondsSince(start);
+        }));
+    }
+    if (std::string("phase/infer").find(options.filter) != std::string::npos) {
+        add(measure("phase/infer", options, [&] {
+            std::unique_ptr<Program> program = frontEnd(source);
+            auto start = Clock::now();
+            TypeInference().infer(program.get());
+            return millisecondsSince(start);
+        }));
+    }
+    // Generation infers types first, as the C++ backend does.
+    if (std::string("phase/codegen").find(options.filter) != std::string::npos) {
+        add(measure("phase/codegen", options, [&] {
+            std::unique_ptr<Program> program = frontEnd(source);
+            auto start = Clock::now();
+            std::string code = CodeGenerator().generate(program.get());
+            return millisecondsSince(start);
+        }));
+    }
+}
+
+struct Workload {
+    const char* name;
+    bool vm; // The VM runs neither classes nor arrays yet.
+    const char* source;
+};
+
+const Workload WORKLOADS[] = {
+    {"recursion", true, R"(
+@nomemo
+function fib(n) {
+    if (n < 2) {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+print fib(27);
+)"},
+    {"loops", true, R"(
+let total = 0;
+let i = 0;
+while (i < 3000) {
+    let j = 0;
+    while (j < 1000) {
+        total = total + i * 0.5 - j;
+        j = j + 1;
+    }
+    i = i + 1;
+}
+print total;
+)"},
+    {"strings", true, R"(
+let text = "";
+let i = 0;
+while (i < 20000) {
+    text = text + "ab";
+    i = i + 1;
+}
+print text;
+)"},
+    {"oop", false, R"(
+class Counter {
+    let count = 0;
+    function add(n) {
+        count = count + n;
+        return count;
+    }
+}
+let counter = new Counter();
+let i = 0;
+while (i < 1000000) {
+    counter.add(i);
+    i = i + 1;
+}
+print counter.count;
+)"},
+    {"fileio", true, R"(
+writeFile("bench_lines.txt", "");
+let out = openWriter("bench_lines.txt");
+let i = 0;
+while (i < 300000) {
+    write(out, "line " + i);
+    i = i + 1;
+}
+close(out);
+let lines = openLines("bench_lines.txt");
+let n = 0;
+while (hasLine(lines)) {
+    let line = nextLine(lines);
+    n = n + 1;
+}
+close(lines);
+writeFile("bench_copy.txt", readFile("bench_lines.txt"));
+print n;
+)"},
+};
+
+// Programs on which a backend once printed something else than the
+// interpreter. They run once, untimed but for the record, under each
+// backend, which must print what the interpreter does.
+const Workload CHECKS[] = {
+    // Strength reduction of a product of the counter past 2^63.
+    {"loop-product-overflow", true, R"(
+let t = 0;
+let i = 0;
+while (i < 10000) {
+    t = i * 4000000000000000;
+    i = i + 1;
+}
+print t;
+)"},
+    // A sum of whole numbers past 2^63.
+    {"integer-sum-overflow", true, R"(
+let x = 1;
+let n = 0;
+while (n < 70) {
+    x = x + x;
+    n = n + 1;
+}
+print x;
+)"},
+    // Dead code after an if whose branches both return, which C++ cannot
+    // type.
+    {"dead-after-if-else", true, R"(
+function sign(x) {
+    if (x < 0) {
+        return 0 - 1;
+    } else {
+        return 1;
+    }
+    return "unreachable";
+}
+print sign(0 - 5);
+print sign(5);
+)"},
+    // A declaration whose initializer reads the variable it shadows.
+    {"shadowing-initializer", true, R"(
+function f(x) {
+    if (x > 0) {
+        let x = x + 1;
+        return x;
+    }
+    return 0;
+}
+print f(5);
+)"},
+    // Objects of a class and of its subclasses in one variable.
+    {"subclass-join", false, R"(
+class Animal {
+    function speak() {
+        return "...";
+    }
+}
+class Dog extends Animal {
+    function speak() {
+        return "woof";
+    }
+}
+class Cat extends Animal {
+}
+function describe(animal) {
+    return animal.speak();
+}
+let x = new Animal();
+print describe(x);
+x = new Dog();
+print describe(x);
+x = new Cat();
+print x.speak();
+)"},
+};
+
+// Compiles Builtins.cpp once for the generated programs. Returns the object,
+// or "" if the compiler failed.
+std::string builtinsObject(const std::string& root) {
+    std::string command = BuildCache::cxxCompiler() + " -std=c++17 -O2 -pthread -c " + root +
+                          "/Builtins.cpp -o Builtins.o 2> Builtins.log";
+    return std::system(command.c_str()) == 0 ? "Builtins.o" : "";
+}
+
+// Runs each workload under each backend, as group/workload/backend.
+template <size_t N>
+void runWorkloads(const Options& options, const std::string& root, const std::string& builtins,
+                  const std::string& group, const Workload (&workloads)[N], std::vector<Result>& results) {
+    for (const Workload& workload : workloads) {
+        std::string source = workload.source;
+        std::string prefix = group + "/" + workload.name + "/";
+        std::string expected; // What the interpreter printed.
+        auto add = [&](Result result, const std::string& outputPath) {
+            if (result.error.empty()) {
+                std::string output = readText(outputPath);
+                if (expected.empty())
+                    expected = output;
+                else if (output != expected)
+                    result.error = "printed something else than the interpreter";
+            }
+            summarize(result);
+            results.push_back(std::move(result));
+        };
+        auto wanted = [&](const char* backend) { return (prefix + backend).find(options.filter) != std::string::npos; };
+
+        // The interpreter's output is the reference, even when it is not
+        // timed.
+        std::string interpreterOutput = std::string(workload.name) + ".interpreter.txt";
+        bool checked = false;
+        auto interpret = [&] {
+            Redirect redirect(checked ? "/dev/null" : interpreterOutput);
+            checked = true;
+            auto start = Clock::now();
+            std::unique_ptr<Program> program = frontEnd(source);
+            Interpreter().interpret(program.get());
+            flush();
+            return millisecondsSince(start);
+        };
+        if (wanted("interpreter")) {
+            add(measure(prefix + "interpreter", options, interpret), interpreterOutput);
+        } else {
+            try {
+                interpret();
+                expected = readText(interpreterOutput);
+            } catch (const std::exception&) {
+                // The other backends are compared with each other instead.
+            }
+        }
+        if (workload.vm && wanted("vm")) {
+            std::string outputPath = std::string(workload.name) + ".vm.txt";
+            checked = false;
+            add(measure(prefix + "vm", options, [&] {
+                Redirect redirect(checked ? "/dev/null" : outputPath);
+                checked = true;
+                auto start = Clock::now();
+                std::unique_ptr<Program> program = frontEnd(source);
+                CompiledProgram compiled = BytecodeCompiler().compile(program.get());
+                VM().run(compiled);
+                flush();
+                return millisecondsSince(start);
+            }), outputPath);
+        }
+        if (!builtins.empty() && wanted("cpp")) {
+            std::string name = workload.name;
+            std::string outputPath = name + ".cpp.txt";
+            Result result;
+            result.name = prefix + "cpp";
+            try {
+                std::unique_ptr<Program> program = frontEnd(source);
+                std::ofstream(name + ".cpp") << CodeGenerator().generate(program.get());
+                std::string command = BuildCache::cxxCompiler() + " -std=c++17 -O2 -pthread -I" + root + " " + name +
+                                      ".cpp " + builtins + " -o " + name + " 2> " + name + ".log";
+                auto start = Clock::now();
+                if (std::system(command.c_str()) != 0)
+                    throw std::runtime_error("cannot compile " + name + ".cpp: see " + name + ".log");
+                double buildMs = millisecondsSince(start);
+                checked = false;
+                result = measure(prefix + "cpp", options, [&] {
+                    auto runStart = Clock::now();
+                    runProgram("./" + name, checked ? "/dev/null" : outputPath);
+                    checked = true;
+                    return millisecondsSince(runStart);
+                });
+                result.fields = ", \"build_ms\": " + number(buildMs);
+            } catch (const std::exception& e) {
+                result.error = e.what();
+            }
+            add(std::move(result), outputPath);
+        }
+    }
+}
+
+void benchWorkloads(const Options& options, const std::string& root, std::vector<Result>& results) {
+    auto cppWanted = [&options](const std::string& group, const Workload& workload) {
+        return (group + "/" + workload.name + "/cpp").find(options.filter) != std::string::npos;
+    };
+    std::string builtins;
+    if (options.cpp &&
+        (std::any_of(std::begin(WORKLOADS), std::end(WORKLOADS),
+                     [&](const Workload& workload) { return cppWanted("e2e", workload); }) ||
+         std::any_of(std::begin(CHECKS), std::end(CHECKS),
+                     [&](const Workload& workload) { return cppWanted("check", workload); }))) {
+        auto start = Clock::now();
+        builtins = builtinsObject(root);
+        std::fprintf(stderr, "%-28s %s in %.0f ms\n", "Builtins.o", builtins.empty() ? "failed" : "compiled",
+                     millisecondsSince(start));
+    }
+    runWorkloads(options, root, builtins, "e2e", WORKLOADS, results);
+    Options once = options;
+    once.reps = 1;
+    runWorkloads(once, root, builtins, "check", CHECKS, results);
+}
+
+// Medians of an earlier report by benchmark name. Reports have one
+// benchmark per line, as this program writes them.
+std::map<std::string, double> readMedians(const std::string& path) {
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("Cannot open " + path);
+    std::map<std::string, double> medians;
+    const std::string nameKey = "{\"name\": \"";
+    const std::string medianKey = "\"median_ms\": ";
+    for (std::string line; std::getline(in, line);) {
+        size_t name = line.find(nameKey);
+        size_t median = line.find(medianKey);
+        if (name == std::string::npos || median == std::string::npos)
+            continue;
+        name += nameKey.size();
+        medians[line.substr(name, line.find('"', name) - name)] =
+            std::strtod(line.c_str() + median + medianKey.size(), nullptr);
+    }
+    return medians;
+}
+
+// Returns the number of benchmarks whose median grew past the threshold.
+int compare(const std::vector<Result>& results, const Options& options) {
+    std::map<std::string, double> before = readMedians(options.compare);
+    std::fprintf(stderr, "\nChange of each median against %s:\n", options.compare.c_str());
+    int regressions = 0;
+    for (const Result& result : results) {
+        auto found = before.find(result.name);
+        if (found == before.end() || !result.error.empty())
+            continue;
+        double now = median(result.samples);
+        double change = found->second > 0 ? (now / found->second - 1) * 100 : 0;
+        bool regressed = change > options.threshold;
+        regressions += regressed;
+        std::fprintf(stderr, "%-28s %10.3f -> %10.3f ms  %+7.1f%%%s\n", result.name.c_str(), found->second, now,
+                     change, regressed ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+void usage() {
+    std::fprintf(stderr,
+                 "Usage: minilang_bench [--reps N] [--scale N] [--filter TEXT] [--no-cpp]\n"
+                 "                      [--compare REPORT.json] [--threshold PERCENT]\n"
+                 "  --reps N        timed runs of each benchmark (default 7)\n"
+                 "  --scale N       size of the synthetic program of the phases, in 2000 blocks (default 1)\n"
+                 "  --filter TEXT   only the benchmarks whose name contains TEXT\n"
+                 "  --no-cpp        skip generated C++, for machines without a C++ compiler\n"
+                 "  --compare FILE  report the change of each median against an earlier report\n"
+                 "  --threshold P   with --compare, fail if a median grew by more than P percent (default 10)\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--reps" && hasValue)
+            options.reps = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--scale" && hasValue)
+            options.scale = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--filter" && hasValue)
+            options.filter = argv[++i];
+        else if (arg == "--compare" && hasValue)
+            options.compare = fs::absolute(argv[++i]).string();
+        else if (arg == "--threshold" && hasValue)
+            options.threshold = std::atof(argv[++i]);
+        else if (arg == "--no-cpp")
+            options.cpp = false;
+        else {
+            usage();
+            return 1;
+        }
+    }
+    std::string root = fs::current_path().string();
+    if (!fs::exists(root + "/Builtins.hpp")) {
+        std::fprintf(stderr, "Error: run minilang_bench from the repository root\n");
+        return 1;
+    }
+    // The workloads write files, and the generated programs are built, in a
+    // directory of their own.
+    char work[] = "/tmp/minilang_bench.XXXXXX";
+    if (!::mkdtemp(work) || ::chdir(work) != 0) {
+        std::fprintf(stderr, "Error: cannot create a working directory\n");
+        return 1;
+    }
+
+    std::vector<Result> results;
+    benchPhases(options, results);
+    benchWorkloads(options, root, results);
+
+    std::printf("{\"suite\": \"minilang\", \"reps\": %d, \"scale\": %d, \"simd\": \"%s\", \"cxx\": %s,\n",
+                options.reps, options.scale, simd::level(), quoted(BuildCache::cxxCompiler()).c_str());
+    std::printf(" \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+        std::printf("  %s%s\n", json(results[i]).c_str(), i + 1 < results.size() ? "," : "");
+    std::printf("]}\n");
+    std::fflush(stdout);
+
+    int status = std::any_of(results.begin(), results.end(), [](const Result& r) { return !r.error.empty(); });
+    if (!options.compare.empty()) {
+        try {
+            if (compare(results, options) > 0)
+                status = 1;
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "Error: %s\n", e.what());
+            status = 1;
+        }
+    }
+    std::error_code error;
+    fs::remove_all(work, error);
+    return status;
+}
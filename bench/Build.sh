@@ -0,0 +1,14 @@
+#!/bin/bash
+# bench/Build.sh: Build the benchmarks into the repository root.
+cd "$(dirname "$0")/.." || exit 1
+
+# The suite links every source of the compiler but main.cpp.
+g++ -std=c++17 -O2 -pthread -I. bench/Bench.cpp Arena.cpp Symbol.cpp MappedFile.cpp Lexer.cpp Parser.cpp CodeGenerator.cpp Interpreter.cpp Resolver.cpp Optimizer.cpp Purity.cpp TypeInference.cpp BytecodeCompiler.cpp VM.cpp Value.cpp Builtins.cpp BuildCache.cpp NativeTier.cpp ProgramImage.cpp Modules.cpp -ldl -o minilang_bench &&
+g++ -std=c++17 -O2 -I. bench/DispatchBench.cpp Arena.cpp -o dispatch_bench
+
+if [ $? -eq 0 ]; then
+    echo "minilang_bench and dispatch_bench built successfully."
+else
+    echo "Error building the benchmarks."
+    exit 1
+fi
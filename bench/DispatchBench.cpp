@@ -0,0 +1,87 @@
+// DispatchBench.cpp: Measures the cost of dispatching on an AST node type.
+// Compares the old chain of dynamic_casts (as Interpreter::visit used to do)
+// with the NodeKind switch in ASTVisitor.
+//
+// Build and run from the repository root (bench/Build.sh builds it too):
+//   g++ -std=c++17 -O2 -I. bench/DispatchBench.cpp Arena.cpp -o dispatch_bench && ./dispatch_bench
+#include "AST.hpp"
+#include "ASTVisitor.hpp"
+#include <chrono>
+#include <cstdio>
+
+// Visitor returning a distinct number per node type.
+struct KindVisitor : ASTVisitor<KindVisitor, int> {
+    static constexpr const char* PASS_NAME = "dispatch benchmark";
+    int visitNumericLiteral(NumericLiteral*) { return 1; }
+    int visitStringLiteral(StringLiteral*) { return 2; }
+    int visitIdentifier(Identifier*) { return 3; }
+    int visitAssignment(Assignment*) { return 4; }
+    int visitBinaryExpression(BinaryExpression*) { return 5; }
+    int visitUnaryExpression(UnaryExpression*) { return 6; }
+    int visitCallExpression(CallExpression*) { return 7; }
+    int visitMemberAccessExpression(MemberAccessExpression*) { return 8; }
+    int visitNewExpression(NewExpression*) { return 9; }
+};
+
+// The node hierarchy as it was before the AST moved into an arena: each type
+// is polymorphic so that it can be identified with dynamic_cast.
+namespace legacy {
+struct Node { virtual ~Node() = default; };
+struct NumericLiteral : Node {};
+struct StringLiteral : Node {};
+struct Identifier : Node {};
+struct Assignment : Node {};
+struct BinaryExpression : Node {};
+struct UnaryExpression : Node {};
+struct CallExpression : Node {};
+} // namespace legacy
+
+// The dispatch order previously used by Interpreter::visit.
+__attribute__((noinline)) static int dispatchByCast(legacy::Node* node) {
+    if (dynamic_cast<legacy::NumericLiteral*>(node))
+        return 1;
+    else if (dynamic_cast<legacy::StringLiteral*>(node))
+        return 2;
+    else if (dynamic_cast<legacy::Identifier*>(node))
+        return 3;
+    else if (dynamic_cast<legacy::Assignment*>(node))
+        return 4;
+    else if (dynamic_cast<legacy::BinaryExpression*>(node))
+        return 5;
+    else if (dynamic_cast<legacy::UnaryExpression*>(node))
+        return 6;
+    else if (dynamic_cast<legacy::CallExpression*>(node))
+        return 7;
+    return 0;
+}
+
+__attribute__((noinline)) static int dispatchByKind(KindVisitor& visitor, Expression* expr) {
+    return visitor.visit(expr);
+}
+
+int main() {
+    // Volatile so that the compiler cannot hoist the dispatch out of the loop.
+    Arena arena;
+    Expression* volatile nodes[] = {arena.make<NumericLiteral>(), arena.make<BinaryExpression>(),
+                                    arena.make<CallExpression>()};
+    legacy::Node* volatile legacyNodes[] = {new legacy::NumericLiteral(), new legacy::BinaryExpression(),
+                                            new legacy::CallExpression()};
+    const char* names[] = {"NumericLiteral", "BinaryExpression", "CallExpression"};
+    const int iterations = 20000000;
+    KindVisitor visitor;
+    for (int k = 0; k < 3; k++) {
+        long checksum = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+            checksum += dispatchByCast(legacyNodes[k]);
+        auto t1 = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+            checksum += dispatchByKind(visitor, nodes[k]);
+        auto t2 = std::chrono::steady_clock::now();
+        double castNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+        double kindNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / iterations;
+        std::printf("%-18s dynamic_cast chain %7.2f ns   kind switch %5.2f ns   (checksum %ld)\n",
+                    names[k], castNs, kindNs, checksum);
+    }
+    return 0;
+}
@@ -1,48 +1,747 @@
 #include "Lexer.hpp"
 #include "Parser.hpp"
 #include "CodeGenerator.hpp"
+#include "Interpreter.hpp"
+#include "BytecodeCompiler.hpp"
+#include "VM.hpp"
+#include "Optimizer.hpp"
+#include "Purity.hpp"
 #include "AST.hpp"
+#include "MappedFile.hpp"
+#include "Builtins.hpp"
+#include "BuildCache.hpp"
+#include "ProgramImage.hpp"
+#include "Modules.hpp"
+#include <chrono>
+#include <cstdarg>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include <memory>
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: mini_compiler <source.minilang>" << std::endl;
+// Execution backends selectable from the command line.
+enum class Mode {
+    COMPILE,   // Generate C++ source (default).
+    INTERPRET, // Tree-walking interpreter.
+    VM,        // Bytecode compiler + virtual machine.
+    IMAGE,     // Bytecode compiler, saved as a program image.
+    LINK       // Compile compiled.cpp into program with the C++ compiler.
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static void printUsage() {
+    std::cerr << "Usage: mini_compiler [--interpret [--tier] [--ic-stats] | --vm] [--stream] [--no-optimize] [--opt-stats] [--memo-stats] [--line-buffered] [--no-cache] [--timings] <source.minilang>" << std::endl;
+    std::cerr << "       mini_compiler [--no-optimize] [--opt-stats] [--memo-stats] [--line-buffered] [--no-cache] [--timings] --out-dir <dir> <source.minilang>..." << std::endl;
+    std::cerr << "       mini_compiler --emit-image [--no-optimize] [--timings] <source.minilang>" << std::endl;
+    std::cerr << "       mini_compiler --vm [--timings] <program.mlimage>" << std::endl;
+    std::cerr << "       mini_compiler --link [--no-cache]" << std::endl;
+    std::cerr << "       mini_compiler --cache-stats | --cache-clear" << std::endl;
+    std::cerr << "  (no flag)        generate C++ source to compiled.cpp" << std::endl;
+    std::cerr << "  --interpret      run the program with the tree-walking interpreter" << std::endl;
+    std::cerr << "  --out-dir <dir>  generate C++ source for each file to <dir>/<name>.cpp, in parallel" << std::endl;
+    std::cerr << "  --vm             run the program on the bytecode virtual machine" << std::endl;
+    std::cerr << "  --emit-image     compile the program to bytecode and save it next to the source as .mlimage," << std::endl;
+    std::cerr << "                   for --vm to run without parsing" << std::endl;
+    std::cerr << "  --tier           with --interpret, compile hot functions to native code" << std::endl;
+    std::cerr << "  --ic-stats       with --interpret, report inline cache hit rates on stderr" << std::endl;
+    std::cerr << "  --stream         run each top-level statement as soon as it is parsed (unoptimized)" << std::endl;
+    std::cerr << "  --no-optimize    skip constant folding, propagation, dead-code elimination and loop optimization" << std::endl;
+    std::cerr << "  --opt-stats      report what the optimizer changed on stderr" << std::endl;
+    std::cerr << "  --memo-stats     report the hit rate of each memoized function on stderr at exit" << std::endl;
+    std::cerr << "  --line-buffered  write out each printed line at once (interactive use)" << std::endl;
+    std::cerr << "  --timings        report the time spent in each phase on stderr" << std::endl;
+    std::cerr << "  --link           compile compiled.cpp, the modules it imports and Builtins.cpp into program" << std::endl;
+    std::cerr << "  --no-cache       always rebuild, bypassing the build cache" << std::endl;
+    std::cerr << "  --cache-stats    show the size and hit rate of the build cache" << std::endl;
+    std::cerr << "  --cache-clear    remove every entry from the build cache" << std::endl;
+}
+
+// The command --link runs.
+static std::string linkCommand() {
+    return BuildCache::cxxCompiler() + " -std=c++17 -O2 -pthread compiled.cpp Builtins.cpp -o program";
+}
+
+// Hash of this executable: generated C++ depends on every part of the
+// compiler, so any rebuild of it must miss the cache. It is hashed once, as
+// a program importing modules makes a key for each.
+static const std::string& compilerIdentity() {
+    static const std::string identity = [] {
+        try {
+            return BuildCache::key({MappedFile("/proc/self/exe").text()});
+        } catch (const std::exception&) {
+            return std::string(__DATE__ " " __TIME__);
+        }
+    }();
+    return identity;
+}
+
+// First line of the C++ generated for a program that imports modules,
+// followed by the paths of their C++, relative to the program's.
+static const char MODULES_LINE[] = "// modules:";
+
+// Where the C++ of the modules a program imports goes: next to the
+// program's, in a directory named after it.
+static std::string modulesDirectory(const std::string& outputPath) {
+    std::filesystem::path path(outputPath);
+    return (path.parent_path() / path.stem()).string() + "_modules";
+}
+
+// Compiles each file of a program that imports modules to an object of its
+// own and links the objects. An object comes from the cache unless its
+// source, the runtime header or the compiler changed, so after a module is
+// edited only its object is compiled again, plus the objects of the files
+// importing it if its interface changed.
+static int linkModules(const std::vector<std::string>& units, bool useCache, bool timings) {
+    auto start = Clock::now();
+    std::string compiler = BuildCache::cxxCompiler();
+    std::string version = BuildCache::compilerVersion(compiler);
+    const std::string compileFlags = " -std=c++17 -O2 -pthread -I. -c ";
+    MappedFile runtimeHeader("Builtins.hpp");
+    std::string objectsDirectory = modulesDirectory("compiled.cpp");
+    std::string objects;
+    std::string objectKeys;
+    size_t compiled = 0;
+    for (const std::string& unit : units) {
+        std::string object = objectsDirectory + "/" + std::filesystem::path(unit).stem().string() + ".o";
+        std::string command = compiler + compileFlags + unit + " -o " + object;
+        MappedFile source(unit);
+        std::string key = BuildCache::key({"object", compileFlags, version, source.text(), runtimeHeader.text()});
+        objects += " " + object;
+        objectKeys += key;
+        if (useCache && BuildCache().fetch(key, object))
+            continue;
+        if (std::system(command.c_str()) != 0) {
+            std::cerr << "Error: Cannot compile " << unit << std::endl;
+            return 1;
+        }
+        compiled++;
+        if (useCache)
+            BuildCache().store(key, object);
+    }
+    if (timings)
+        std::fprintf(stderr, "compile:  %8.2f ms  %zu of %zu objects compiled\n", millisecondsSince(start), compiled,
+                     units.size());
+
+    auto linkStart = Clock::now();
+    std::string command = compiler + " -pthread" + objects + " -o program";
+    std::string key = BuildCache::key({"program", command, version, objectKeys});
+    if (useCache && BuildCache().fetch(key, "program")) {
+        if (timings)
+            std::fprintf(stderr, "link:     %8.2f ms  (cached)\n", millisecondsSince(linkStart));
+        return 0;
+    }
+    if (std::system(command.c_str()) != 0) {
+        std::cerr << "Error: Cannot link program" << std::endl;
         return 1;
     }
-    std::ifstream file(argv[1]);
-    if (!file) {
-        std::cerr << "Error: Cannot open file: " << argv[1] << std::endl;
+    if (useCache)
+        BuildCache().store(key, "program");
+    if (timings)
+        std::fprintf(stderr, "link:     %8.2f ms\n", millisecondsSince(linkStart));
+    return 0;
+}
+
+// Builds program from compiled.cpp and the runtime, or copies it from the
+// cache when the sources, the runtime, the command and the compiler version
+// are all unchanged.
+static int link(bool useCache, bool timings) {
+    {
+        // A program importing modules names them on its first line.
+        std::ifstream program("compiled.cpp");
+        std::string line;
+        if (std::getline(program, line) && line.compare(0, sizeof(MODULES_LINE) - 1, MODULES_LINE) == 0) {
+            std::vector<std::string> units = {"compiled.cpp"};
+            std::istringstream paths(line.substr(sizeof(MODULES_LINE) - 1));
+            for (std::string path; paths >> path;)
+                units.push_back(path);
+            units.push_back("Builtins.cpp");
+            return linkModules(units, useCache, timings);
+        }
+    }
+    auto start = Clock::now();
+    std::string command = linkCommand();
+    std::string key;
+    if (useCache) {
+        MappedFile program("compiled.cpp");
+        MappedFile runtimeSource("Builtins.cpp");
+        MappedFile runtimeHeader("Builtins.hpp");
+        key = BuildCache::key({"program", command, BuildCache::compilerVersion(BuildCache::cxxCompiler()), program.text(),
+                               runtimeSource.text(), runtimeHeader.text()});
+        if (BuildCache().fetch(key, "program")) {
+            if (timings)
+                std::fprintf(stderr, "link:     %8.2f ms  (cached)\n", millisecondsSince(start));
+            return 0;
+        }
+    }
+    if (std::system(command.c_str()) != 0) {
+        std::cerr << "Error: Cannot compile compiled.cpp" << std::endl;
         return 1;
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string source = buffer.str();
+    if (useCache)
+        BuildCache().store(key, "program");
+    if (timings)
+        std::fprintf(stderr, "link:     %8.2f ms\n", millisecondsSince(start));
+    return 0;
+}
 
-    // Lexing.
-    Lexer lexer(source);
-    std::vector<Token> tokens = lexer.tokenize();
+static void printInlineCacheStats(const InlineCacheStats& stats) {
+    size_t lookups = stats.hits + stats.misses;
+    std::fprintf(stderr, "inline caches: %zu hits, %zu misses (%.1f%% hit rate); "
+                 "%zu monomorphic, %zu polymorphic, %zu megamorphic sites\n",
+                 stats.hits, stats.misses, lookups ? 100.0 * stats.hits / lookups : 0.0,
+                 stats.monomorphicSites, stats.polymorphicSites, stats.megamorphicSites);
+}
 
-    // Parsing.
-    Parser parser(tokens);
-    std::unique_ptr<Program> program = parser.parse();
+static void printGenerated(size_t modules) {
+    if (modules == 0) {
+        std::cout << "C++ source code generated to compiled.cpp" << std::endl;
+        std::cout << "Now compile it with your C++ compiler (e.g., g++ -std=c++17 -pthread compiled.cpp Builtins.cpp -o program)" << std::endl;
+        return;
+    }
+    std::string directory = modulesDirectory("compiled.cpp");
+    std::cout << "C++ source code generated to compiled.cpp, and for " << modules << " imported module"
+              << (modules == 1 ? "" : "s") << " to " << directory << std::endl;
+    std::cout << "Now build it with --link, or with your C++ compiler (e.g., g++ -std=c++17 -pthread -I. compiled.cpp "
+              << directory << "/*.cpp Builtins.cpp -o program)" << std::endl;
+}
 
-    // Code Generation.
-    CodeGenerator generator;
-    std::string cppCode = generator.generate(program.get());
+static void printCacheStats() {
+    BuildCache cache;
+    CacheStats stats = cache.stats();
+    uint64_t lookups = stats.hits + stats.misses;
+    std::printf("cache:     %s\n", cache.path().c_str());
+    std::printf("size:      %.1f MB of %.1f MB\n", cache.size() / (1024.0 * 1024.0),
+                cache.maxSize() / (1024.0 * 1024.0));
+    std::printf("hits:      %llu (%.1f%%)\n", static_cast<unsigned long long>(stats.hits),
+                lookups ? 100.0 * stats.hits / lookups : 0.0);
+    std::printf("misses:    %llu\n", static_cast<unsigned long long>(stats.misses));
+    std::printf("stores:    %llu\n", static_cast<unsigned long long>(stats.stores));
+    std::printf("evictions: %llu\n", static_cast<unsigned long long>(stats.evictions));
+}
 
-    std::ofstream out("compiled.cpp");
-    if (!out) {
-        std::cerr << "Error: Cannot write output file compiled.cpp" << std::endl;
-        return 1;
+// Settings of the front end and the C++ backend.
+struct CompileOptions {
+    bool optimize = true;
+    bool optStats = false;
+    bool lineBuffered = false;
+    bool memoStats = false;
+    bool useCache = true;
+    bool timings = false;
+};
+
+// Appends a line to the report of --timings and --opt-stats. Reports are
+// collected rather than printed, so that files compiled in parallel can
+// report in order.
+__attribute__((format(printf, 2, 3)))
+static void report(std::string& log, const char* format, ...) {
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    std::vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    log += line;
+}
+
+// The parser pulls tokens from the lexer as it goes, so lexing has no phase
+// of its own. To report lexer throughput, --timings lexes the whole source
+// once up front.
+static void timeLexer(std::string_view source, std::string& log) {
+    auto lexStart = Clock::now();
+    TokenStream tokens = Lexer(source).tokenize();
+    double ms = millisecondsSince(lexStart);
+    double megabytes = source.size() / (1024.0 * 1024.0);
+    report(log, "lex:      %8.2f ms  %zu tokens, %.2f MB (%.1f MB/s)\n",
+           ms, tokens.size(), megabytes, ms > 0 ? megabytes / (ms / 1000.0) : 0.0);
+}
+
+// Unless disabled, optimizes a parsed program.
+static void optimize(Program* program, const CompileOptions& options, std::string& log) {
+    // Streaming skips optimization: it needs the whole program to know which
+    // variables are written only once.
+    if (options.optimize) {
+        auto optimizeStart = Clock::now();
+        Optimizer optimizer;
+        optimizer.optimize(program);
+        size_t memoized = PurityAnalysis().analyze(program);
+        if (options.timings)
+            report(log, "optimize: %8.2f ms\n", millisecondsSince(optimizeStart));
+        if (options.optStats) {
+            const OptimizerStats& stats = optimizer.stats();
+            report(log, "optimizer: %zu expressions folded, %zu constants propagated, "
+                   "%zu branches eliminated, %zu unreachable statements removed\n",
+                   stats.foldedExpressions, stats.propagatedConstants,
+                   stats.eliminatedBranches, stats.removedStatements);
+            report(log, "purity:    %zu functions memoized\n", memoized);
+        }
+    }
+}
+
+// Parses a file of the program and, unless disabled, optimizes it. The
+// program itself is parsed with the modules it imports unless it is
+// compiled apart from them (separately).
+static std::unique_ptr<Program> frontEnd(ModuleGraph& graph, const Module& file, bool separately,
+                                         const CompileOptions& options, std::string& log) {
+    bool isProgram = &file == &graph.program();
+    if (options.timings && isProgram)
+        timeLexer(file.source.text(), log);
+    auto parseStart = Clock::now();
+    std::unique_ptr<Program> program = isProgram && !separately ? graph.parseAll() : graph.parse(file);
+    if (separately) {
+        ModuleGraph::declareImports(*program, file);
+        program->isModule = !isProgram;
+    }
+    if (options.timings && isProgram)
+        report(log, "parse:    %8.2f ms\n", millisecondsSince(parseStart));
+    optimize(program.get(), options, log);
+    return program;
+}
+
+// The report of a file, for the report of another: each line prefixed.
+static std::string prefixLines(const std::string& prefix, const std::string& log) {
+    std::string lines;
+    size_t start = 0;
+    while (start < log.size()) {
+        size_t end = log.find('\n', start);
+        if (end == std::string::npos)
+            end = log.size();
+        lines += prefix + log.substr(start, end - start) + "\n";
+        start = end + 1;
     }
-    out << cppCode;
+    return lines;
+}
+
+// Writes generated C++ to path, and stores it in the cache under cacheKey
+// unless that is empty.
+static void writeGenerated(const std::string& path, const std::string& code, const std::string& cacheKey) {
+    std::ofstream out(path);
+    if (!out)
+        throw std::runtime_error("Cannot write output file " + path);
+    out << code;
     out.close();
+    if (!cacheKey.empty())
+        BuildCache().store(cacheKey, path);
+}
+
+// Generates C++ source for each module the program imports into directory,
+// named after the module, and returns the paths. The C++ of a module opens
+// with its interface, as comments. It depends on the module's source and on
+// the interfaces of the modules it imports, so editing a module generates it
+// again, and the modules importing it only if its interface changed; the
+// others come from the cache, interface included.
+static std::vector<std::string> generateModules(ModuleGraph& graph, const std::string& directory,
+                                                const CompileOptions& options, std::string& log) {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+        throw std::runtime_error("Cannot create output directory " + directory);
+    std::vector<std::string> outputs;
+    // The objects of the program and of the runtime go in the directory as
+    // well, under these names.
+    std::unordered_map<std::string, int> stems = {{"compiled", 1}, {"Builtins", 1}};
+    for (const std::unique_ptr<Module>& module : graph.files()) {
+        if (module.get() == &graph.program())
+            break;
+        auto start = Clock::now();
+        std::string stem = std::filesystem::path(module->path).stem().string();
+        int uses = stems[stem]++;
+        std::string output = directory + "/" + stem + (uses > 0 ? "_" + std::to_string(uses + 1) : "") + ".cpp";
+        outputs.push_back(output);
+
+        std::string cacheKey;
+        if (options.useCache && !options.optStats) {
+            std::string imported;
+            for (const Module* dependency : module->dependencies)
+                imported += dependency->path + "\n" + dependency->interface;
+            cacheKey = BuildCache::key({"module", compilerIdentity(), options.optimize ? "optimize" : "",
+                                        module->source.text(), imported});
+            if (BuildCache().fetch(cacheKey, output)) {
+                std::ifstream in(output);
+                std::string line;
+                std::getline(in, line); // The module's path.
+                while (std::getline(in, line) && line.compare(0, 3, "// ") == 0)
+                    module->interface += line.substr(3) + "\n";
+                if (options.timings)
+                    report(log, "%s: codegen:  %8.2f ms  (cached)\n", module->path.c_str(), millisecondsSince(start));
+                continue;
+            }
+        }
+        // Parse errors name the module already.
+        std::string moduleLog;
+        std::unique_ptr<Program> program = frontEnd(graph, *module, true, options, moduleLog);
+        std::string code;
+        try {
+            CodeGenOptions codegenOptions;
+            codegenOptions.optimizeLoops = options.optimize;
+            code = CodeGenerator(codegenOptions).generate(program.get());
+        } catch (const std::exception& e) {
+            throw std::runtime_error(module->path + ": " + e.what());
+        }
+        module->interface = ModuleGraph::interface(*program);
+        std::string header = "// MiniLang module " + module->path + "\n";
+        std::istringstream lines(module->interface);
+        for (std::string line; std::getline(lines, line);)
+            header += "// " + line + "\n";
+        writeGenerated(output, header + "\n" + code, cacheKey);
+        if (options.timings)
+            report(moduleLog, "codegen:  %8.2f ms\n", millisecondsSince(start));
+        log += prefixLines(module->path + ": ", moduleLog);
+    }
+    return outputs;
+}
+
+// Generates C++ source for the program at sourcePath into outputPath, and
+// for the modules it imports into modulesDirectory(outputPath). Returns the
+// number of modules. The program's C++ depends only on its source, the
+// interfaces of its modules, the compiler and the flags that affect code
+// generation, so an unchanged script is not compiled again; --opt-stats
+// needs the optimizer to run. Throws on errors in the source. Safe to call
+// from several threads for different outputs.
+static size_t generateFile(const std::string& sourcePath, const std::string& outputPath,
+                           const CompileOptions& options, std::string& log) {
+    // Sources are mapped, not copied; tokens refer into them.
+    ModuleGraph graph(sourcePath);
+    std::string directory = modulesDirectory(outputPath);
+    std::vector<std::string> modules;
+    std::string imported;
+    if (graph.hasImports()) {
+        modules = generateModules(graph, directory, options, log);
+        imported = MODULES_LINE;
+        std::string relative = std::filesystem::path(directory).filename().string();
+        for (const std::string& module : modules)
+            imported += " " + relative + "/" + std::filesystem::path(module).filename().string();
+        imported += "\n";
+    }
+    std::string interfaces;
+    for (const Module* dependency : graph.program().dependencies)
+        interfaces += dependency->path + "\n" + dependency->interface;
+
+    std::string cacheKey;
+    if (options.useCache && !options.optStats) {
+        auto cacheStart = Clock::now();
+        cacheKey = BuildCache::key({"compiled.cpp", compilerIdentity(), options.optimize ? "optimize" : "",
+                                    options.lineBuffered ? "line-buffered" : "",
+                                    options.memoStats ? "memo-stats" : "", graph.program().source.text(), imported,
+                                    interfaces});
+        if (BuildCache().fetch(cacheKey, outputPath)) {
+            if (options.timings)
+                report(log, "codegen:  %8.2f ms  (cached)\n", millisecondsSince(cacheStart));
+            return modules.size();
+        }
+    }
+
+    std::unique_ptr<Program> program = frontEnd(graph, graph.program(), graph.hasImports(), options, log);
+    auto codegenStart = Clock::now();
+    CodeGenOptions codegenOptions;
+    codegenOptions.lineBuffered = options.lineBuffered;
+    codegenOptions.memoStats = options.memoStats;
+    codegenOptions.optimizeLoops = options.optimize;
+    std::string cppCode = CodeGenerator(codegenOptions).generate(program.get());
+    if (options.timings)
+        report(log, "codegen:  %8.2f ms\n", millisecondsSince(codegenStart));
+    writeGenerated(outputPath, imported + cppCode, cacheKey);
+    return modules.size();
+}
+
+// Prints a file's report with each line prefixed by the file's name.
+static void printReport(const std::string& sourcePath, const std::string& log) {
+    std::fputs(prefixLines(sourcePath + ": ", log).c_str(), stderr);
+}
 
-    std::cout << "C++ source code generated to compiled.cpp" << std::endl;
-    std::cout << "Now compile it with your C++ compiler (e.g., g++ -std=c++17 compiled.cpp Builtins.cpp -o program)" << std::endl;
+// Generates C++ source for each program into outDir, named after the source
+// with a .cpp extension. Files are compiled in parallel on the task pool,
+// one task per file. Reports and errors come out in the order of the sources
+// whatever order the files finish in: each file's are printed once it and
+// every file before it are done. A file with errors does not stop the
+// others.
+static int compileAll(const std::vector<std::string>& sources, const std::string& outDir,
+                      const CompileOptions& options) {
+    auto start = Clock::now();
+    std::vector<std::string> outputs;
+    std::unordered_map<std::string, const std::string*> sourceOf; // By output.
+    for (const std::string& source : sources) {
+        std::string output = (std::filesystem::path(outDir) / std::filesystem::path(source).stem()).string() + ".cpp";
+        auto [it, added] = sourceOf.emplace(output, &source);
+        if (!added) {
+            std::cerr << "Error: " << *it->second << " and " << source << " would both be compiled to " << output
+                      << std::endl;
+            return 1;
+        }
+        outputs.push_back(std::move(output));
+    }
+    std::error_code error;
+    std::filesystem::create_directories(outDir, error);
+    if (error) {
+        std::cerr << "Error: Cannot create output directory " << outDir << std::endl;
+        return 1;
+    }
+
+    struct Job : TaskState {
+        Job(const std::string& source, const std::string& output, const CompileOptions& options)
+            : source(source), output(output), options(options) {}
+        void run() override {
+            auto jobStart = Clock::now();
+            modules = generateFile(source, output, options, log);
+            if (options.timings)
+                report(log, "total:    %8.2f ms\n", millisecondsSince(jobStart));
+        }
+
+        const std::string& source;
+        const std::string& output;
+        const CompileOptions& options;
+        std::string log;
+        size_t modules = 0;
+    };
+    std::vector<std::shared_ptr<Job>> jobs;
+    for (size_t i = 0; i < sources.size(); i++) {
+        jobs.push_back(std::make_shared<Job>(sources[i], outputs[i], options));
+        submitTask(jobs.back());
+    }
+    size_t failed = 0;
+    size_t modules = 0;
+    for (const std::shared_ptr<Job>& job : jobs) {
+        try {
+            waitTask(*job);
+            printReport(job->source, job->log);
+            modules += job->modules;
+        } catch (const std::exception& e) {
+            printReport(job->source, job->log);
+            std::cerr << "Error: " << job->source << ": " << e.what() << std::endl;
+            failed++;
+        }
+    }
+    if (options.timings)
+        std::fprintf(stderr, "total:    %8.2f ms  %zu files on %u threads\n", millisecondsSince(start),
+                     sources.size(), taskThreads());
+    if (failed > 0) {
+        std::cerr << "Error: " << failed << " of " << sources.size() << " files failed to compile" << std::endl;
+        return 1;
+    }
+    std::cout << "C++ source code generated for " << sources.size() << " files to " << outDir << std::endl;
+    if (modules > 0)
+        std::cout << "The modules a file imports went to " << outDir << "/<name>_modules; compile them along with it"
+                  << std::endl;
+    std::cout << "Now compile each with your C++ compiler (e.g., g++ -std=c++17 -pthread " << outputs.front()
+              << " Builtins.cpp -o program)" << std::endl;
     return 0;
-}
\ No newline at end of file
+}
+
+int main(int argc, char* argv[]) {
+    Mode mode = Mode::COMPILE;
+    CompileOptions options;
+    bool stream = false;
+    bool tiered = false;
+    bool icStats = false;
+    const char* outDir = nullptr;
+    std::vector<std::string> sourcePaths;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--interpret") == 0) {
+            mode = Mode::INTERPRET;
+        } else if (std::strcmp(argv[i], "--vm") == 0) {
+            mode = Mode::VM;
+        } else if (std::strcmp(argv[i], "--emit-image") == 0) {
+            mode = Mode::IMAGE;
+        } else if (std::strcmp(argv[i], "--timings") == 0) {
+            options.timings = true;
+        } else if (std::strcmp(argv[i], "--stream") == 0) {
+            stream = true;
+        } else if (std::strcmp(argv[i], "--no-optimize") == 0) {
+            options.optimize = false;
+        } else if (std::strcmp(argv[i], "--opt-stats") == 0) {
+            options.optStats = true;
+        } else if (std::strcmp(argv[i], "--line-buffered") == 0) {
+            options.lineBuffered = true;
+        } else if (std::strcmp(argv[i], "--tier") == 0) {
+            tiered = true;
+        } else if (std::strcmp(argv[i], "--ic-stats") == 0) {
+            icStats = true;
+        } else if (std::strcmp(argv[i], "--memo-stats") == 0) {
+            options.memoStats = true;
+        } else if (std::strcmp(argv[i], "--link") == 0) {
+            mode = Mode::LINK;
+        } else if (std::strcmp(argv[i], "--no-cache") == 0) {
+            options.useCache = false;
+        } else if (std::strcmp(argv[i], "--out-dir") == 0) {
+            if (++i == argc) {
+                std::cerr << "Error: --out-dir expects a directory" << std::endl;
+                return 1;
+            }
+            outDir = argv[i];
+        } else if (std::strcmp(argv[i], "--cache-stats") == 0) {
+            printCacheStats();
+            return 0;
+        } else if (std::strcmp(argv[i], "--cache-clear") == 0) {
+            BuildCache cache;
+            cache.clear();
+            std::cout << "Cleared build cache " << cache.path() << std::endl;
+            return 0;
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            std::cerr << "Error: Unknown option: " << argv[i] << std::endl;
+            printUsage();
+            return 1;
+        } else {
+            sourcePaths.push_back(argv[i]);
+        }
+    }
+    if (mode == Mode::LINK) {
+        try {
+            return link(options.useCache, options.timings);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    if (sourcePaths.empty()) {
+        printUsage();
+        return 1;
+    }
+    if (outDir || sourcePaths.size() > 1) {
+        if (mode != Mode::COMPILE || stream) {
+            std::cerr << "Error: Several sources and --out-dir only work when generating C++" << std::endl;
+            return 1;
+        }
+        if (!outDir) {
+            std::cerr << "Error: Several sources require --out-dir" << std::endl;
+            return 1;
+        }
+        return compileAll(sourcePaths, outDir, options);
+    }
+    const std::string& sourcePath = sourcePaths.front();
+    if (stream && (mode == Mode::COMPILE || mode == Mode::IMAGE)) {
+        std::cerr << "Error: --stream requires --interpret or --vm" << std::endl;
+        return 1;
+    }
+    bool image = std::filesystem::path(sourcePath).extension() == ProgramImage::EXTENSION;
+    if (image && (mode != Mode::VM || stream)) {
+        std::cerr << "Error: Program images run with --vm, without --stream" << std::endl;
+        return 1;
+    }
+    // Native code is compiled from the whole program's functions, which a
+    // stream may still redefine.
+    if (tiered && (mode != Mode::INTERPRET || stream)) {
+        std::cerr << "Error: --tier requires --interpret without --stream" << std::endl;
+        return 1;
+    }
+
+    // Program output is buffered; it is written out at exit unless stdout is
+    // a terminal or --line-buffered asks for every line at once.
+    if (options.lineBuffered)
+        setLineBuffered(true);
+
+    std::string log;
+    try {
+        if (mode == Mode::COMPILE) {
+            size_t modules = generateFile(sourcePath, "compiled.cpp", options, log);
+            std::fputs(log.c_str(), stderr);
+            printGenerated(modules);
+            return 0;
+        }
+
+        if (image) {
+            // The image is mapped and run in place.
+            auto loadStart = Clock::now();
+            ProgramImage program(sourcePath);
+            if (options.timings)
+                std::fprintf(stderr, "load:     %8.2f ms\n", millisecondsSince(loadStart));
+            auto executeStart = Clock::now();
+            VM vm;
+            vm.run(program);
+            if (options.timings)
+                std::fprintf(stderr, "execute:  %8.2f ms\n", millisecondsSince(executeStart));
+            return 0;
+        }
+
+        if (stream) {
+            // The source is mapped, not copied; tokens refer into it.
+            MappedFile source(sourcePath);
+            if (options.timings) {
+                timeLexer(source.text(), log);
+                std::fputs(log.c_str(), stderr);
+                log.clear();
+            }
+            // Each top-level statement runs as soon as it has been parsed.
+            Lexer lexer(source.text());
+            Parser parser(lexer);
+            auto streamStart = Clock::now();
+            Program program;
+            if (mode == Mode::INTERPRET) {
+                Interpreter interpreter;
+                interpreter.beginStream();
+                while (Statement* stmt = parser.nextStatement(program)) {
+                    if (!interpreter.execute(stmt))
+                        break;
+                }
+            } else {
+                BytecodeCompiler compiler;
+                compiler.beginStream();
+                VM vm;
+                while (Statement* stmt = parser.nextStatement(program)) {
+                    compiler.compileStatement(stmt);
+                    if (stmt->kind != NodeKind::FUNCTION_DECLARATION && !vm.execute(compiler.compiled()))
+                        break;
+                }
+            }
+            if (options.timings)
+                std::fprintf(stderr, "parse+execute: %8.2f ms\n", millisecondsSince(streamStart));
+            return 0;
+        }
+
+        // The functions of the modules are run along with the program.
+        ModuleGraph graph(sourcePath);
+        if (mode == Mode::IMAGE && graph.hasImports()) {
+            std::cerr << "Error: --emit-image does not support programs that import modules" << std::endl;
+            return 1;
+        }
+        std::unique_ptr<Program> program = frontEnd(graph, graph.program(), false, options, log);
+        std::fputs(log.c_str(), stderr);
+        log.clear();
+
+        auto backendStart = Clock::now();
+        if (mode == Mode::INTERPRET) {
+            Interpreter interpreter(tiered);
+            interpreter.interpret(program.get());
+            if (options.timings)
+                std::fprintf(stderr, "execute:  %8.2f ms\n", millisecondsSince(backendStart));
+            if (icStats)
+                printInlineCacheStats(interpreter.inlineCacheStats());
+            if (options.memoStats) {
+                for (const auto& [name, stats] : interpreter.memoStats())
+                    printMemoStats(symbolName(name), stats);
+            }
+            return 0;
+        }
+        BytecodeCompiler compiler;
+        CompiledProgram compiled = compiler.compile(program.get());
+        if (mode == Mode::IMAGE) {
+            std::string imagePath = ProgramImage::pathFor(sourcePath);
+            ProgramImage::write(imagePath, compiled, sourcePath, graph.program().source.text());
+            if (options.timings)
+                std::fprintf(stderr, "compile:  %8.2f ms\n", millisecondsSince(backendStart));
+            std::cout << "Program image written to " << imagePath << std::endl;
+            return 0;
+        }
+        VM vm;
+        vm.run(compiled);
+        if (options.timings)
+            std::fprintf(stderr, "execute:  %8.2f ms\n", millisecondsSince(backendStart));
+        return 0;
+    } catch (const std::exception& e) {
+        // Show what the program printed before the error, in order.
+        flush();
+        std::fputs(log.c_str(), stderr);
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}